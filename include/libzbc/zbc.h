@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 /***** Macro definitions *****/
 
@@ -39,6 +40,40 @@
  */
 #define ZBC_FORCE_ATA_RW       	0x40000000
 
+/**
+ * zbc_open flag to access the data of an emulated device through
+ * a shared memory mapping of the emulation file instead of read and
+ * write system calls. Reads and writes become memory copies, and
+ * zbc_pread_borrow can be used to access written data without any copy.
+ * This flag is ignored if the target device is not an emulated device.
+ *
+ * This is defined as bit 29 of the standard fcntl flags.
+ */
+#define ZBC_FAKE_MMAP           0x20000000
+
+/**
+ * zbc_open flag to allocate the pool of command buffers of a SCSI
+ * or ATA device in huge pages (if huge pages are available) instead
+ * of regular pages. This flag is ignored for other device types.
+ *
+ * This is defined as bit 28 of the standard fcntl flags.
+ */
+#define ZBC_SG_HUGE_PAGES       0x10000000
+
+/**
+ * zbc_open flag to transfer data without copies through the SG node
+ * of a SCSI or ATA device: reads and writes of buffers aligned on the
+ * logical block size use sg direct I/O, and zbc_pread_borrow reads into
+ * the sg driver reserved buffer mapped in memory. zbc_open fails with
+ * -ENOTSUP if the device is not accessed through an SG node, if the sg
+ * driver does not allow direct I/O (allow_dio module parameter) or if its
+ * reserved buffer cannot be mapped. This flag is ignored for other device
+ * types.
+ *
+ * This is defined as bit 27 of the standard fcntl flags.
+ */
+#define ZBC_SG_DIRECT_IO        0x08000000
+
 /**
  * Device info flags.
  *
@@ -49,6 +84,13 @@
  */
 #define ZBC_UNRESTRICTED_READ   0x00000001
 
+/**
+ * Maximum number of asynchronous I/O operations that can be
+ * outstanding (submitted and not yet collected with
+ * zbc_aio_getevents) on a device handle.
+ */
+#define ZBC_AIO_MAX_QD          128
+
 /**
  * Device type: BLOCK, SCSI, ATA or fake (emulation).
  * Each type correspond to a different internal backend driver.
@@ -127,11 +169,21 @@ enum zbc_reporting_options {
     ZBC_RO_PARTIAL              = 0x80,
 };
 
+/**
+ * Asynchronous I/O operations.
+ */
+enum zbc_aio_op {
+    ZBC_AIO_READ                = 0x01,
+    ZBC_AIO_WRITE               = 0x02,
+};
+
 /**
  * Sense key.
  */
 enum zbc_sk {
+    ZBC_E_NOT_READY               = 0x2,
     ZBC_E_ILLEGAL_REQUEST         = 0x5,
+    ZBC_E_UNIT_ATTENTION          = 0x6,
     ZBC_E_DATA_PROTECT            = 0x7,
     ZBC_E_ABORTED_COMMAND         = 0xB,
 };
@@ -147,6 +199,7 @@ enum zbc_asc_ascq {
     ZBC_E_ATTEMPT_TO_READ_INVALID_DATA          = 0x2106,
     ZBC_E_READ_BOUNDARY_VIOLATION               = 0x2107,
     ZBC_E_ZONE_IS_READ_ONLY                     = 0x2708,
+    ZBC_E_ZONE_IS_OFFLINE                       = 0x2C0E,
     ZBC_E_INSUFFICIENT_ZONE_RESOURCES           = 0x550E,
 };
 
@@ -157,6 +210,11 @@ enum zbc_asc_ascq {
  */
 struct zbc_device;
 
+/**
+ * Zone iterator: structure is private to the library.
+ */
+struct zbc_zone_iter;
+
 /**
  * Zone descriptor.
  */
@@ -188,6 +246,68 @@ struct zbc_errno {
 };
 typedef struct zbc_errno zbc_errno_t;
 
+/**
+ * Asynchronous I/O descriptor.
+ * The descriptor, the zone and the data buffer it references
+ * must remain valid until the descriptor is returned by
+ * zbc_aio_getevents(). On completion, zba_ret is set to the
+ * number of logical blocks transferred or to a negative error code.
+ */
+struct zbc_aio {
+
+    enum zbc_aio_op             zba_op;
+    struct zbc_zone             *zba_zone;
+    void                        *zba_buf;
+    uint32_t                    zba_lba_count;
+    uint64_t                    zba_lba_ofst;
+
+    int32_t                     zba_ret;
+
+    void                        *zba_private;
+
+};
+typedef struct zbc_aio zbc_aio_t;
+
+/**
+ * Command classes: each class has its own timeout and retry policy.
+ */
+enum zbc_cmd_class {
+    ZBC_CMD_CLASS_IO            = 0x00, /* Reads and writes */
+    ZBC_CMD_CLASS_ZONE          = 0x01, /* Zone open, close, finish and reset */
+    ZBC_CMD_CLASS_REPORT        = 0x02, /* Zone reports */
+    ZBC_CMD_CLASS_FLUSH         = 0x03, /* Cache flushes */
+    ZBC_CMD_CLASS_MGMT          = 0x04, /* Other commands */
+    ZBC_CMD_CLASS_NUM,
+};
+
+/**
+ * Command timeout and retry policy. A command failing with a transient
+ * error (UNIT ATTENTION, NOT READY becoming ready, ABORTED COMMAND, busy
+ * device or transport error) is retried at most zcp_max_retries times,
+ * waiting zcp_backoff microseconds before the first retry and doubling
+ * the wait for each following retry. Timed out commands are not retried.
+ */
+struct zbc_cmd_policy {
+
+    unsigned int                zcp_timeout;            /* ms */
+    unsigned int                zcp_max_retries;
+    unsigned int                zcp_backoff;            /* us */
+
+};
+typedef struct zbc_cmd_policy zbc_cmd_policy_t;
+
+/**
+ * Command execution counters.
+ */
+struct zbc_cmd_stats {
+
+    unsigned long long          zcs_retries;            /* Command retries */
+    unsigned long long          zcs_timeouts;           /* Commands timed out */
+    unsigned long long          zcs_errors;             /* Commands failed after retries */
+
+};
+typedef struct zbc_cmd_stats zbc_cmd_stats_t;
+
 /**
  * Some handy accessor macros.
  */
@@ -225,6 +345,7 @@ typedef struct zbc_errno zbc_errno_t;
         if ( zbc_zone_sequential(z) ) {                         \
             (z)->zbz_write_pointer = zbc_zone_start_lba(z); 	\
             (z)->zbz_condition = ZBC_ZC_EMPTY;                  \
+            (z)->zbz_flags = 0;                                 \
         }                                                       \
     } while( 0 )
 
@@ -317,7 +438,10 @@ static inline int __attribute__((deprecated))
  * Opens the file pointed to by @filename, and returns a handle to it
  * in @dev if it the file is a device special file for a ZBC-capable
  * device.  If the device does not support ZBC this calls returns -EINVAL.
- * Any other error code returned from open(2) can be returned as well.
+ * -ENOTSUP is returned if the device cannot be accessed as requested by
+ * @flags (ZBC_SG_DIRECT_IO). Any other error code returned from open(2)
+ * can be returned as well. A @filename of the form "mem:size=<size>[,zone=<size>][,conv=<size>]"
+ * creates an emulated device in memory, private to the returned handle.
  */
 extern int
 zbc_open(const char *filename,
@@ -329,7 +453,9 @@ zbc_open(const char *filename,
  * @dev:                (IN) ZBC device handle to close
  *
  * Performs the equivalent to close(2) for a ZBC handle.  Can return any
- * error that close could return.
+ * error that close could return. Data staged by zbc_zone_append() with
+ * write-combining enabled is written first and the first write error of
+ * staged data not yet reported is returned.
  */
 extern int
 zbc_close(struct zbc_device *dev);
@@ -393,6 +519,8 @@ zbc_report_nr_zones(struct zbc_device *dev,
  * parameter is used to return an array of zones which is allocated using
  * malloc(3) internally and needs to be freed using free(3).  The number
  * of zones in @zones is returned in @nr_zones.
+ * The zones are reported in a single pass over the device. Use the
+ * zbc_zone_iter_open() interface to process zones with bounded memory.
  *
  * Returns -EIO if an error happened when communicating with the device.
  * Returns -ENOMEM if memory could not be allocated for @zones.
@@ -404,6 +532,108 @@ zbc_list_zones(struct zbc_device *dev,
                struct zbc_zone **zones,
                unsigned int *nr_zones);
 
+/**
+ * zbc_zone_iter_open - start iterating over the zones of a ZBC device
+ * @dev:                (IN) ZBC device handle to report on
+ * @start_lba:          (IN) Start LBA for the first zone to be reported
+ * @ro:                 (IN) Reporting options
+ * @iter:               (OUT) Address where to return the iterator
+ *
+ * Allocate an iterator reporting the zones of @dev matching @ro, starting
+ * from the zone containing @start_lba, in batches of at most as many zones
+ * as a single REPORT ZONES command can return (bounded by the device maximum
+ * transfer size). The iterator must be freed using zbc_zone_iter_close().
+ *
+ * Returns -ENOMEM if memory could not be allocated for the iterator.
+ */
+extern int
+zbc_zone_iter_open(struct zbc_device *dev,
+                   uint64_t start_lba,
+                   enum zbc_reporting_options ro,
+                   struct zbc_zone_iter **iter);
+
+/**
+ * zbc_zone_iter_next - get the next batch of zones of an iterator
+ * @iter:               (IN) Zone iterator
+ * @zones:              (OUT) Address where to return the zone batch
+ * @nr_zones:           (OUT) Address where to return the number of zones in the batch
+ *
+ * The returned zone array belongs to the iterator and is overwritten by the next
+ * call to zbc_zone_iter_next(). When all zones were reported, @nr_zones is set to 0.
+ *
+ * Returns -EIO if an error happened when communicating with the device.
+ */
+extern int
+zbc_zone_iter_next(struct zbc_zone_iter *iter,
+                   struct zbc_zone **zones,
+                   unsigned int *nr_zones);
+
+/**
+ * zbc_zone_iter_close - free a zone iterator
+ * @iter:               (IN) Zone iterator
+ */
+extern void
+zbc_zone_iter_close(struct zbc_zone_iter *iter);
+
+/**
+ * zbc_zone_cache_enable - Enable caching of a device zone information
+ * @dev:                (IN) ZBC device handle
+ *
+ * Allocate a cache of the information of all zones of @dev, initialized
+ * using REPORT ZONES. The cache is then updated by the library from the
+ * completion of write, zone open, close, finish and reset write pointer
+ * operations executed through @dev, so that zbc_zone_lookup() can be used
+ * instead of zbc_report_zones(). The cache is only accurate if the device
+ * is not accessed through other handles or processes; zbc_zone_cache_resync()
+ * can be used to reload it. If the cache is already enabled, it is resynchronized.
+ * The cache is freed when @dev is closed.
+ *
+ * Returns -ENOMEM if memory could not be allocated for the cache.
+ * Returns -EIO if an error happened when communicating with the device.
+ */
+extern int
+zbc_zone_cache_enable(struct zbc_device *dev);
+
+/**
+ * zbc_zone_cache_disable - Disable caching of a device zone information
+ * @dev:                (IN) ZBC device handle
+ *
+ * Free the zone cache of @dev, if enabled.
+ */
+extern void
+zbc_zone_cache_disable(struct zbc_device *dev);
+
+/**
+ * zbc_zone_cache_resync - Resynchronize a device zone cache
+ * @dev:                (IN) ZBC device handle
+ *
+ * Reload the zone cache of @dev from the device using REPORT ZONES.
+ *
+ * Returns -ENXIO if the zone cache of @dev is not enabled.
+ * Returns -EIO if an error happened when communicating with the device.
+ */
+extern int
+zbc_zone_cache_resync(struct zbc_device *dev);
+
+/**
+ * zbc_zone_lookup - Get the cached information of a zone
+ * @dev:                (IN) ZBC device handle
+ * @lba:                (IN) Any LBA within the zone to look for
+ * @zone:               (OUT) Address where to copy the zone information
+ *
+ * Copy to @zone the cached information of the zone containing @lba,
+ * without issuing any command to the device. The lookup is done in
+ * constant time if all zones of the device have the same size and in
+ * logarithmic time otherwise.
+ *
+ * Returns -ENXIO if the zone cache of @dev is not enabled.
+ * Returns -EINVAL if @lba is not within the device capacity.
+ */
+extern int
+zbc_zone_lookup(struct zbc_device *dev,
+                uint64_t lba,
+                struct zbc_zone *zone);
+
 /**
  * zbc_open_zone - open the zone for a ZBC zone
  * @dev:                (IN) ZBC device handle to reset on
@@ -483,6 +713,47 @@ extern int
 zbc_reset_write_pointer(struct zbc_device *dev,
                         uint64_t start_lba);
 
+/**
+ * zbc_reset_zones - reset the write pointer of a list of zones
+ * @dev:                (IN) ZBC device handle
+ * @start_lbas:         (IN) Array of zone start LBAs (in any order)
+ * @nr_zones:           (IN) Number of zones in @start_lbas
+ *
+ * Resets the write pointer of all zones of @start_lbas, which is equivalent
+ * to calling zbc_reset_write_pointer() for each zone, but faster: for devices
+ * accessed through their SG node, the reset commands are queued for concurrent
+ * execution by the device; with the emulation backend, all zones are reset in
+ * a single pass; and with the block backend, contiguous zones are reset with a
+ * single discard. All zones are processed even if resetting some of them fails.
+ *
+ * Returns -EIO if an error happened when communicating with the device
+ * (the error of the first failed zone reset is returned).
+ */
+extern int
+zbc_reset_zones(struct zbc_device *dev,
+                const uint64_t *start_lbas,
+                unsigned int nr_zones);
+
+/**
+ * zbc_reset_zone_range - reset the write pointer of a range of zones
+ * @dev:                (IN) ZBC device handle
+ * @start_lba:          (IN) Start LBA of the first zone of the range
+ * @nr_zones:           (IN) Number of zones in the range
+ *
+ * Resets the write pointer of the @nr_zones zones starting with the zone
+ * at @start_lba, as zbc_reset_zones() does. Conventional and empty zones
+ * of the range are ignored. The zones of the range are obtained from the
+ * zone cache if enabled (see zbc_zone_cache_enable()) and with a single
+ * REPORT ZONES command otherwise.
+ *
+ * Returns -EINVAL if @start_lba is not a zone start LBA.
+ * Returns -EIO if an error happened when communicating with the device.
+ */
+extern int
+zbc_reset_zone_range(struct zbc_device *dev,
+                     uint64_t start_lba,
+                     unsigned int nr_zones);
+
 /**
  * zbc_read - read from a ZBC device
  * @dev:                (IN) ZBC device handle to read from
@@ -493,6 +764,9 @@ zbc_reset_write_pointer(struct zbc_device *dev,
  *
  * This an the equivalent to pread(2) that operates on a ZBC device handle,
  * and uses LBA addressing for the buffer length and I/O offset.
+ * Reads larger than the device maximum command size (zbd_max_rw_logical_blocks)
+ * are split into several commands, which are executed concurrently for devices
+ * accessed through their SG node.
  *
  * All errors returned by pread(2) can be returned. On success, the number of
  * logical blocks read is returned.
@@ -517,6 +791,11 @@ zbc_pread(struct zbc_device *dev,
  * zone (@zone) at the offset (@lba_ofst).
  * The disk write pointer may be updated in case of a succesful call, but this function
  * does not updates the write pointer value of @zone.
+ * Writes larger than the device maximum command size (zbd_max_rw_logical_blocks)
+ * are split into several commands. To preserve write ordering, these commands are
+ * executed one at a time for sequential zones and concurrently for conventional
+ * zones of devices accessed through their SG node. If a command fails, the number
+ * of logical blocks written before the failed command is returned.
  *
  * All errors returned by write(2) can be returned. On success, the number of
  * logical blocks written is returned.
@@ -528,6 +807,94 @@ zbc_pwrite(struct zbc_device *dev,
            uint32_t lba_count,
            uint64_t lba_ofst);
 
+/**
+ * zbc_preadv - vectored read from a ZBC device
+ * @dev:                (IN) ZBC device handle to read from
+ * @zone:               (IN) The zone to read in
+ * @iov:                (IN) Array of caller supplied buffers to read into
+ * @iovcnt:             (IN) Number of buffers in @iov
+ * @lba_ofst:           (IN) LBA offset where to start reading in @zone
+ *
+ * This an the equivalent to preadv(2) that operates on a ZBC device handle.
+ * The total size of the buffers of @iov must be a multiple of the device
+ * logical block size. Data is scattered to the buffers in a single command,
+ * unless the read is larger than the device maximum command size: as with
+ * zbc_pread(), it is then split into several commands, executed one at a
+ * time. A short read is returned if one of these commands fails.
+ *
+ * Returns -ENOTSUP for a device accessed through a bsg node if @iovcnt is
+ * larger than 1, as bsg does not accept vectors of buffers.
+ *
+ * All errors returned by preadv(2) can be returned. On success, the number of
+ * logical blocks read is returned.
+ */
+extern int32_t
+zbc_preadv(struct zbc_device *dev,
+           struct zbc_zone *zone,
+           const struct iovec *iov,
+           int iovcnt,
+           uint64_t lba_ofst);
+
+/**
+ * zbc_pwritev - vectored write to a ZBC device
+ * @dev:                (IN) ZBC device handle to write to
+ * @zone:               (IN) The zone to write to
+ * @iov:                (IN) Array of caller supplied buffers to write from
+ * @iovcnt:             (IN) Number of buffers in @iov
+ * @lba_ofst:           (IN) LBA Offset where to start writing in @zone
+ *
+ * This an the equivalent to pwritev(2) that operates on a ZBC device handle.
+ * The total size of the buffers of @iov must be a multiple of the device
+ * logical block size. Data is gathered from the buffers in a single command,
+ * unless the write is larger than the device maximum command size: as with
+ * zbc_pwrite(), it is then split into several commands, executed one at a
+ * time. A short write is returned if one of these commands fails.
+ * As with zbc_pwrite(), the write pointer value of @zone is not updated.
+ *
+ * Returns -ENOTSUP for a device accessed through a bsg node if @iovcnt is
+ * larger than 1, as bsg does not accept vectors of buffers.
+ *
+ * All errors returned by pwritev(2) can be returned. On success, the number of
+ * logical blocks written is returned.
+ */
+extern int32_t
+zbc_pwritev(struct zbc_device *dev,
+            struct zbc_zone *zone,
+            const struct iovec *iov,
+            int iovcnt,
+            uint64_t lba_ofst);
+
+/**
+ * zbc_pread_borrow - access data of a ZBC device without copying it
+ * @dev:                (IN) ZBC device handle to read from
+ * @zone:               (IN) The zone to read in
+ * @buf:                (OUT) Address of the data
+ * @lba_count:          (IN) Number of LBAs to read
+ * @lba_ofst:           (IN) LBA offset where to start reading in @zone
+ *
+ * Performs the same checks as zbc_pread(), but instead of copying the data
+ * into a caller supplied buffer, returns in @buf a pointer to the data in
+ * the device mapping. This is supported only by emulated devices opened
+ * with the ZBC_FAKE_MMAP flag and by SG nodes of SCSI and ATA devices opened
+ * with the ZBC_SG_DIRECT_IO flag (-ENOTSUP is returned otherwise). The data must
+ * not be modified. For emulated devices, it remains accessible until the device
+ * is closed, but its content changes if the zone is reset and written again.
+ * For SG nodes, @lba_count is limited to the size of the sg driver reserved
+ * buffer (-EINVAL is returned otherwise). The sg driver also uses its reserved
+ * buffer to bounce the data of commands that do not use direct I/O (zone
+ * reports, reads and writes of unaligned buffers, ...), so the data is valid
+ * only until the next function accessing the device is called, from any
+ * thread, including the write-combining flusher thread (zbc_write_combining_enable).
+ *
+ * On success, @lba_count is returned.
+ */
+extern int32_t
+zbc_pread_borrow(struct zbc_device *dev,
+                 struct zbc_zone *zone,
+                 const void **buf,
+                 uint32_t lba_count,
+                 uint64_t lba_ofst);
+
 /**
  * zbc_write - write to a ZBC device
  * @dev:                (IN) ZBC device handle to write to
@@ -551,15 +918,196 @@ zbc_write(struct zbc_device *dev,
           const void *buf,
           uint32_t lba_count);
 
+/**
+ * zbc_zone_append - append data to a zone
+ * @dev:                (IN) ZBC device handle to write to
+ * @zone_lba:           (IN) Start LBA of the sequential zone to write to
+ * @buf:                (IN) Caller supplied buffer to write from
+ * @lba_count:          (IN) Number of LBAs to write
+ * @lba:                (OUT) Address where to return the LBA where the data was written (may be NULL)
+ *
+ * Write @buf at the write pointer of the zone starting at @zone_lba. Unlike
+ * zbc_write(), this function can be called concurrently by multiple threads
+ * for the same zone: appends to a zone are serialized in submission order
+ * by the library and appends queued while a write is in progress are merged
+ * into a single write command (up to the device maximum command size).
+ * The zone write pointer is tracked using the device zone cache, which is
+ * enabled on the first call (see zbc_zone_cache_enable()).
+ * With write-combining enabled (see zbc_write_combining_enable()), success
+ * only means that the data was staged: it is durable only once a following
+ * zbc_flush() succeeds.
+ *
+ * All errors returned by write(2) can be returned. Returns -EINVAL if
+ * @zone_lba is not the start LBA of a sequential zone and -ENOSPC if the
+ * space left in the zone is smaller than @lba_count. On success, @lba_count
+ * is returned.
+ */
+extern int32_t
+zbc_zone_append(struct zbc_device *dev,
+                uint64_t zone_lba,
+                const void *buf,
+                uint32_t lba_count,
+                uint64_t *lba);
+
+/**
+ * zbc_write_combining_enable - Enable write-combining of zone appends
+ * @dev:                (IN) ZBC device handle
+ * @timeout:            (IN) Maximum time in milliseconds data stays staged (0 for no limit)
+ *
+ * Once enabled, appends done with zbc_zone_append() that are not larger than
+ * the device maximum command size (zbd_max_rw_logical_blocks) are copied to
+ * a per-zone staging buffer of that size instead of being written immediately.
+ * zbc_zone_append() returns as soon as the data is staged. A zone staging
+ * buffer is written to the device with a single command when it is full,
+ * when its oldest data was staged more than @timeout milliseconds ago,
+ * and by zbc_flush(). Staged data of a zone is also written before any read,
+ * write, close or finish operation on the zone, and is discarded if the zone
+ * write pointer is reset.
+ * Appended data is therefore durable only once a following zbc_flush()
+ * succeeds. If staged data cannot be written, it is lost and the error
+ * is latched: zbc_zone_append() fails with -EIO for the zone until the
+ * error is reported by zbc_flush(), zbc_write_combining_disable() or
+ * zbc_close(). If write-combining is already enabled, only @timeout is
+ * changed.
+ *
+ * Returns -ENOMEM if memory could not be allocated.
+ */
+extern int
+zbc_write_combining_enable(struct zbc_device *dev,
+                           unsigned int timeout);
+
+/**
+ * zbc_write_combining_disable - Disable write-combining of zone appends
+ * @dev:                (IN) ZBC device handle
+ *
+ * Write all staged data and disable write-combining.
+ *
+ * Returns the first write error of staged data not yet reported.
+ */
+extern int
+zbc_write_combining_disable(struct zbc_device *dev);
+
 /**
  * zbc_flush - flush to a ZBC device cache
  * @dev:                (IN) ZBC device handle to flush
  *
  * This an the equivalent to fsync/fdatasunc but operates at the device cache level.
+ * Data staged by zbc_zone_append() with write-combining enabled is written first
+ * and the first write error of staged data not yet reported is returned.
  */
 extern int
 zbc_flush(struct zbc_device *dev);
 
+/**
+ * zbc_aio_submit - submit asynchronous read and write operations
+ * @dev:                (IN) ZBC device handle
+ * @aios:               (IN) Array of asynchronous I/O descriptors to submit
+ * @nr_aios:            (IN) Number of descriptors in @aios
+ *
+ * Queue the read and write operations described by @aios for execution.
+ * For devices accessed through their SG node (SCSI and ATA backends), the
+ * operations are queued in the sg driver and executed concurrently by the
+ * device. For zoned block devices, the operations are executed using io_uring
+ * if the kernel supports it, and writes to the same sequential zone are issued
+ * one at a time in submission order. Other backends execute the operations
+ * synchronously at submission time. In all cases, completions must be collected
+ * using zbc_aio_getevents(). Otherwise, no write ordering is guaranteed between
+ * operations in flight. zbc_aio_submit() and zbc_aio_getevents() can be called
+ * by several threads: they are serialized by a mutex of the device handle.
+ *
+ * Returns the number of descriptors submitted, which may be less than @nr_aios
+ * if ZBC_AIO_MAX_QD (or the device queue depth) operations are outstanding.
+ * If no descriptor could be submitted, a negative error code is returned
+ * (-EAGAIN if the queue is full). -ENOTSUP is returned for devices accessed
+ * through a bsg node, which has no asynchronous interface.
+ */
+extern int
+zbc_aio_submit(struct zbc_device *dev,
+               struct zbc_aio **aios,
+               unsigned int nr_aios);
+
+/**
+ * zbc_aio_getevents - collect completed asynchronous operations
+ * @dev:                (IN) ZBC device handle
+ * @min_nr:             (IN) Minimum number of completions to wait for
+ * @max_nr:             (IN) Maximum number of completions to return
+ * @aios:               (OUT) Array of at least @max_nr entries where to return completed descriptors
+ * @timeout:            (IN) Maximum time to wait for @min_nr completions in milliseconds (-1 waits forever)
+ *
+ * Returns the number of completed descriptors stored in @aios, which may be
+ * less than @min_nr if the timeout expired or if less than @min_nr operations
+ * are outstanding. The status of each operation is returned in its zba_ret
+ * field. A negative error code is returned if waiting for completions failed.
+ * Completions are returned to the first caller, whichever thread submitted the
+ * operations, and submissions by other threads wait until this function returns.
+ */
+extern int
+zbc_aio_getevents(struct zbc_device *dev,
+                  unsigned int min_nr,
+                  unsigned int max_nr,
+                  struct zbc_aio **aios,
+                  int timeout);
+
+/**
+ * zbc_register_buffers - register asynchronous I/O data buffers
+ * @dev:                (IN) ZBC device handle
+ * @iov:                (IN) Array of buffers
+ * @nr_iov:             (IN) Number of buffers in @iov (0 unregisters all buffers)
+ *
+ * Pin the memory of the buffers described by @iov so that asynchronous
+ * operations using a data buffer contained in one of them avoid mapping the
+ * buffer on each operation. Registered buffers replace any previously
+ * registered set. This is supported only by the zoned block device backend
+ * with io_uring support (-ENXIO is returned otherwise), and cannot be done
+ * while asynchronous operations are in flight (-EBUSY).
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+extern int
+zbc_register_buffers(struct zbc_device *dev,
+                     const struct iovec *iov,
+                     unsigned int nr_iov);
+
+/**
+ * zbc_set_cmd_policy - set the timeout and retry policy of a command class
+ * @dev:                (IN) ZBC device handle
+ * @cls:                (IN) Command class
+ * @policy:             (IN) Policy of the class (the timeout cannot be 0)
+ *
+ * The policy applies to the commands initialized after this call. Only
+ * SCSI and ATA devices accessed through SG or bsg nodes use the policies.
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+extern int
+zbc_set_cmd_policy(struct zbc_device *dev,
+                   enum zbc_cmd_class cls,
+                   const struct zbc_cmd_policy *policy);
+
+/**
+ * zbc_get_cmd_policy - get the timeout and retry policy of a command class
+ * @dev:                (IN) ZBC device handle
+ * @cls:                (IN) Command class
+ * @policy:             (OUT) Address where to return the policy
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+extern int
+zbc_get_cmd_policy(struct zbc_device *dev,
+                   enum zbc_cmd_class cls,
+                   struct zbc_cmd_policy *policy);
+
+/**
+ * zbc_get_cmd_stats - get the command execution counters of a device
+ * @dev:                (IN) ZBC device handle
+ * @stats:              (OUT) Address where to return the counters
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+extern int
+zbc_get_cmd_stats(struct zbc_device *dev,
+                  struct zbc_cmd_stats *stats);
+
 /**
  * zbc_disk_type_str - returns a disk type name
  * @type: (IN) ZBC_DT_SCSI, ZBC_DT_ATA, or ZBC_DT_FAKE
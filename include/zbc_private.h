@@ -28,6 +28,22 @@ zbc_set_zones(struct zbc_device *dev,
               uint64_t conv_sz,
               uint64_t zone_sz);
 
+/**
+ * zbc_set_zone_geometry - Configure zones of a "hacked" ZBC device from a zone geometry file
+ * @dev:        (IN) ZBC device handle of the device to configure
+ * @path:       (IN) Path of the zone geometry file
+ *
+ * Each line of the geometry file describes a run of zones as "<number of zones> <type> <zone size> [<condition>]",
+ * with zone sizes in logical sectors, types "conv", "seq" (sequential write required) or "pref"
+ * (sequential write preferred), and conditions "empty" (default), "rdonly" or "offline".
+ * Runs are laid out in file order starting at LBA 0. See README for details.
+ *
+ * This function only affects devices operating with the emulation (fake) backend driver.
+ */
+extern int
+zbc_set_zone_geometry(struct zbc_device *dev,
+                      const char *path);
+
 /**
  * zbc_set_write_pointer - Change the value of a zone write pointer
  * @dev:        (IN) ZBC device handle of the device to configure
@@ -42,4 +58,37 @@ zbc_set_write_pointer(struct zbc_device *dev,
                       uint64_t start_lba,
                       uint64_t wp_lba);
 
+/**
+ * zbc_set_perf_model - Time the commands of an emulated device
+ * @dev:        (IN) ZBC device handle of the device to configure
+ * @profile:    (IN) Path of the drive performance profile file, or NULL to stop timing commands
+ *
+ * Commands executed through @dev are then delayed according to the
+ * drive model described in @profile (seek, rotation, transfer rate,
+ * zone operations and cache flush costs). See README for the profile format.
+ *
+ * This function only affects devices operating with the emulation (fake) backend driver.
+ */
+extern int
+zbc_set_perf_model(struct zbc_device *dev,
+                   const char *profile);
+
+/**
+ * zbc_ata_rw_cdb - Build the ATA PASSTHROUGH (16) CDB of a read or write command
+ * @cdb:        (OUT) CDB buffer (16 B)
+ * @write:      (IN) 0 for a read, 1 for a write
+ * @ncq:        (IN) Use READ/WRITE FPDMA QUEUED if not 0, READ/WRITE DMA EXT otherwise
+ * @lba_count:  (IN) Number of logical blocks to transfer (65536 at most)
+ * @lba:        (IN) First logical block
+ *
+ * This is the CDB used by the ATA backend driver for reads and writes.
+ * The NCQ tag field is left to 0: the tag is assigned by the SAT layer.
+ */
+extern void
+zbc_ata_rw_cdb(uint8_t *cdb,
+               int write,
+               int ncq,
+               uint32_t lba_count,
+               uint64_t lba);
+
 #endif /* _LIBZBC_PRIVATE_H_ */
@@ -19,6 +19,7 @@
 
 #include <string.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <linux/fs.h>
 
@@ -40,6 +41,28 @@ static struct zbc_ops *zbc_ops[] = {
     NULL
 };
 
+/**
+ * Default command timeout and retry policies.
+ */
+zbc_cmd_policy_t zbc_cmd_policy_default[ZBC_CMD_CLASS_NUM] = {
+
+    /* ZBC_CMD_CLASS_IO */
+    { 20000, 3, 1000 },
+
+    /* ZBC_CMD_CLASS_ZONE */
+    { 20000, 3, 1000 },
+
+    /* ZBC_CMD_CLASS_REPORT */
+    { 20000, 3, 1000 },
+
+    /* ZBC_CMD_CLASS_FLUSH */
+    { 60000, 3, 1000 },
+
+    /* ZBC_CMD_CLASS_MGMT */
+    { 20000, 3, 1000 },
+
+};
+
 /**
  * Sense key, ASC/ASCQ
  */
@@ -63,6 +86,18 @@ static struct zbc_sg_sk_s
         "Data-protect"
     },
 
+    /* NOT_READY */
+    {
+        ZBC_E_NOT_READY,
+        "Not-ready"
+    },
+
+    /* UNIT_ATTENTION */
+    {
+        ZBC_E_UNIT_ATTENTION,
+        "Unit-attention"
+    },
+
     /* ABORTED_COMMAND */
     {
         ZBC_E_ABORTED_COMMAND,
@@ -127,6 +162,12 @@ static struct zbc_sg_asc_ascq_s
         "Zone-is-read-only"
     },
 
+    /* ZBC_E_ZONE_IS_OFFLINE */
+    {
+        ZBC_E_ZONE_IS_OFFLINE,
+        "Zone-is-offline"
+    },
+
     /* ZBC_E_INSUFFICIENT_ZONE_RESOURCES */
     {
         ZBC_E_INSUFFICIENT_ZONE_RESOURCES,
@@ -157,300 +198,968 @@ zbc_do_report_zones(zbc_device_t *dev,
 
 }
 
-/***** Definition of public functions *****/
+/**
+ * Test if a device can execute asynchronous I/Os.
+ */
+#define zbc_aio_native(dev)	((dev)->zbd_ops->zbd_aio_submit && (dev)->zbd_aio_qd)
 
 /**
- * Set library log level.
+ * Maximum number of chunks of a large read or write kept in flight.
  */
-void
-zbc_set_log_level(char *log_level)
-{
+#define ZBC_IO_MAX_CHUNKS	8
 
-    if ( log_level ) {
-        if ( strcmp(log_level, "none") == 0 ) {
-            zbc_log_level = ZBC_LOG_NONE;
-        } else if ( strcmp(log_level, "error") == 0 ) {
-            zbc_log_level = ZBC_LOG_ERROR;
-        } else if ( strcmp(log_level, "info") == 0 ) {
-            zbc_log_level = ZBC_LOG_INFO;
-        } else if ( strcmp(log_level, "debug") == 0 ) {
-            zbc_log_level = ZBC_LOG_DEBUG;
-        } else if ( strcmp(log_level, "vdebug") == 0 ) {
-            zbc_log_level = ZBC_LOG_VDEBUG;
-        } else {
-            fprintf(stderr, "Unknown log level \"%s\"\n",
-                    log_level);
-        }
-    }
+/**
+ * Chunks of a large read or write, and chunks completed
+ * not yet collected by the thread executing it.
+ */
+struct zbc_rw_pipe {
 
-    return;
+    zbc_aio_t           chunks[ZBC_IO_MAX_CHUNKS];
+    zbc_aio_t           *done[ZBC_IO_MAX_CHUNKS];
+    unsigned int        nr_done;
 
-}
+    struct zbc_rw_pipe  *next;
+
+};
 
 /**
- * zbc_disk_type_str - returns a disk type name
- * @type: (IN) ZBC_DT_SCSI, ZBC_DT_ATA, or ZBC_DT_FAKE
- *
- * Returns a string describing the interface type of a disk.
+ * Queue a completed asynchronous I/O until collected by zbc_aio_getevents().
  */
-const char *
-zbc_disk_type_str(int type)
+static inline void
+zbc_aio_done(zbc_device_t *dev,
+             zbc_aio_t *aio)
 {
 
-    switch( type ) {
-    case ZBC_DT_SCSI:
-        return( "SCSI ZBC" );
-    case ZBC_DT_ATA:
-        return( "ATA ZAC" );
-    case ZBC_DT_FAKE:
-        return( "Emulated zoned device" );
-    case ZBC_DT_BLOCK:
-        return( "Zoned block device" );
-    }
+    dev->zbd_aio_done[(dev->zbd_aio_done_head + dev->zbd_aio_nr_done) % ZBC_AIO_MAX_QD] = aio;
+    dev->zbd_aio_nr_done++;
 
-    return( "Unknown-disk-type" );
+    return;
 
 }
 
 /**
- * zbc_disk_model_str - returns a disk model name
- * @model: (IN) ZBC_DM_DRIVE_MANAGED, ZBC_DM_HOST_AWARE, or ZBC_DM_HOST_MANAGED
- *
- * Returns a string describing a model type.
+ * Get the oldest completed asynchronous I/O not yet collected.
  */
-const char *
-zbc_disk_model_str(int model)
+static inline zbc_aio_t *
+zbc_aio_next_done(zbc_device_t *dev)
 {
+    zbc_aio_t *aio = dev->zbd_aio_done[dev->zbd_aio_done_head];
 
-    switch( model ) {
-    case ZBC_DM_DRIVE_MANAGED:
-        return( "Standard/Drive-managed" );
-    case ZBC_DM_HOST_AWARE:
-        return( "Host-aware" );
-    case ZBC_DM_HOST_MANAGED:
-        return( "Host-managed" );
-    }
+    dev->zbd_aio_done_head = (dev->zbd_aio_done_head + 1) % ZBC_AIO_MAX_QD;
+    dev->zbd_aio_nr_done--;
 
-    return( "Unknown-model" );
+    return( aio );
 
 }
 
 /**
- * zbc_zone_type_str - returns a string describing a zone type.
- * @type: (IN)  ZBC_ZT_CONVENTIONAL, ZBC_ZT_SEQUENTIAL_REQ or ZBC_ZT_SEQUENTIAL_PREF
- *
- * Returns a string describing a zone type.
+ * Get an asynchronous I/O completion from the backend driver.
  */
-const char *
-zbc_zone_type_str(enum zbc_zone_type type)
+static int
+zbc_aio_reap(zbc_device_t *dev,
+             int timeout,
+             zbc_aio_t **paio)
 {
+    zbc_aio_t *aio;
+    int ret;
 
-    switch( type ) {
-    case ZBC_ZT_CONVENTIONAL:
-        return( "Conventional" );
-    case ZBC_ZT_SEQUENTIAL_REQ:
-        return( "Sequential-write-required" );
-    case ZBC_ZT_SEQUENTIAL_PREF:
-        return( "Sequential-write-preferred" );
+    ret = (dev->zbd_ops->zbd_aio_reap)(dev, timeout, &aio);
+    if ( ret != 0 ) {
+        return( ret );
     }
 
-    return( "Unknown-type" );
+    dev->zbd_aio_inflight--;
+
+    if ( aio->zba_op == ZBC_AIO_WRITE ) {
+        zbc_zone_cache_write(dev, zbc_zone_start_lba(aio->zba_zone),
+                             aio->zba_lba_ofst, aio->zba_lba_count, aio->zba_ret);
+    }
+
+    if ( aio->zba_ret <= 0 ) {
+	zbc_error("%s %u blocks at block %llu + %llu failed %d (%s)\n",
+		  (aio->zba_op == ZBC_AIO_READ) ? "Read" : "Write",
+		  aio->zba_lba_count,
+		  (unsigned long long) zbc_zone_start_lba(aio->zba_zone),
+		  (unsigned long long) aio->zba_lba_ofst,
+		  aio->zba_ret,
+		  strerror(-aio->zba_ret));
+    }
+
+    *paio = aio;
+
+    return( 0 );
 
 }
 
 /**
- * zbc_zone_cond_str - returns a string describing a zone condition.
- * @zone: (IN)  ZBC_ZC_NOT_WP, ZBC_ZC_EMPTY, ZBC_ZC_IMP_OPEN, ZBC_ZC_EXP_OPEN,
- *              ZBC_ZC_CLOSED, ZBC_ZC_RDONLY, ZBC_ZC_FULL or ZBC_ZC_OFFLINE
- *
- * Returns a string describing a zone condition.
+ * Get the number of milliseconds left until a deadline.
  */
-const char *
-zbc_zone_condition_str(enum zbc_zone_condition cond)
+static int
+zbc_aio_timeout(struct timespec *deadline)
 {
-    switch( cond ) {
-    case ZBC_ZC_NOT_WP:
-        return( "Not-write-pointer" );
-    case ZBC_ZC_EMPTY:
-        return( "Empty" );
-    case ZBC_ZC_IMP_OPEN:
-        return( "Implicit-open" );
-    case ZBC_ZC_EXP_OPEN:
-        return( "Explicit-open" );
-    case ZBC_ZC_CLOSED:
-        return( "Closed" );
-    case ZBC_ZC_RDONLY:
-        return( "Read-only" );
-    case ZBC_ZC_FULL:
-        return( "Full" );
-    case ZBC_ZC_OFFLINE:
-        return( "Offline" );
-    }
+    struct timespec now;
+    long long ms;
 
-    return( "Unknown-cond" );
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (long long)(deadline->tv_sec - now.tv_sec) * 1000
+        + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+    return( (ms > 0) ? (int) ms : 0 );
 
 }
 
 /**
- * zbc_errno - returns detailed error report (sense key, sense code and
- *             sense code qualifier) of the last executed command.
- * @dev: (IN) ZBC device handle
- * @err: (OUT) Address where to return the error report
+ * Get the time @timeout milliseconds from now.
  */
-void
-zbc_errno(zbc_device_t *dev,
-          zbc_errno_t *err)
+static void
+zbc_aio_deadline(struct timespec *deadline,
+                 int timeout)
 {
 
-    if ( dev && err ) {
-        memcpy(err, &dev->zbd_errno, sizeof(zbc_errno_t));
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (long)(timeout % 1000) * 1000000;
+    if ( deadline->tv_nsec >= 1000000000 ) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
     }
 
     return;
+
 }
 
 /**
- * zbc_sk_str - returns a string describing a sense key.
- * @sk:    (IN)  Sense key
+ * Queue a completion for the thread waiting for it: the thread executing
+ * a large read or write for its chunks, zbc_aio_getevents() otherwise.
  */
-const char *
-zbc_sk_str(enum zbc_sk sk) {
-
-    int i = 0;
+static void
+zbc_aio_dispatch(zbc_device_t *dev,
+                 zbc_aio_t *aio)
+{
+    zbc_rw_pipe_t *pipe;
 
-    while ( zbc_sg_sk_list[i].sk != 0 ) {
-        if ( sk == zbc_sg_sk_list[i].sk ) {
-            return( zbc_sg_sk_list[i].sk_name );
+    for(pipe = dev->zbd_aio_pipes; pipe; pipe = pipe->next) {
+        if ( (aio >= &pipe->chunks[0]) && (aio < &pipe->chunks[ZBC_IO_MAX_CHUNKS]) ) {
+            pipe->done[pipe->nr_done++] = aio;
+            dev->zbd_aio_nr_chunks--;
+            return;
         }
-        i++;
     }
 
-    return( "Unknown-sense-key" );
+    zbc_aio_done(dev, aio);
+
+    return;
 
 }
 
 /**
- * zbc_asc_ascq_str - returns a string describing a sense code and sense code qualifier.
- * @asc_ascq:    (IN)  Sense code and sense code qualifier
+ * Wait at most @timeout milliseconds (-1 waits forever) for an asynchronous
+ * I/O completion, with the aio mutex held. A single thread at a time waits
+ * in the backend driver, which releases the mutex while blocked, and queues
+ * the completion it gets for the thread waiting for it. The other threads
+ * wait until it is done. Returns 0 if a completion was queued or if the
+ * thread waiting in the backend driver is done, -EAGAIN if @timeout
+ * expired and a negative error code if waiting failed.
  */
-const char *
-zbc_asc_ascq_str(enum zbc_asc_ascq asc_ascq) {
+static int
+zbc_aio_wait(zbc_device_t *dev,
+             int timeout)
+{
+    struct timespec deadline;
+    zbc_aio_t *aio;
+    int ret;
 
-    int i = 0;
+    if ( dev->zbd_aio_reaping ) {
 
-    while( zbc_sg_asc_ascq_list[i].asc_ascq  != 0 ) {
-        if ( asc_ascq == zbc_sg_asc_ascq_list[i].asc_ascq ) {
-            return( zbc_sg_asc_ascq_list[i].ascq_name );
+        /* Another thread is waiting in the backend driver */
+        if ( ! timeout ) {
+            return( -EAGAIN );
         }
-        i++;
+
+        if ( timeout < 0 ) {
+            pthread_cond_wait(&dev->zbd_aio_cond, &dev->zbd_aio_mutex);
+            return( 0 );
+        }
+
+        zbc_aio_deadline(&deadline, timeout);
+        ret = pthread_cond_timedwait(&dev->zbd_aio_cond, &dev->zbd_aio_mutex, &deadline);
+        if ( ret == ETIMEDOUT ) {
+            return( -EAGAIN );
+        }
+
+        return( 0 );
+
     }
 
-    return( "Unknown-additional-sense-code-qualifier" );
+    dev->zbd_aio_reaping = 1;
+
+    ret = zbc_aio_reap(dev, timeout, &aio);
+    if ( ret == 0 ) {
+        zbc_aio_dispatch(dev, aio);
+    }
+
+    dev->zbd_aio_reaping = 0;
+    pthread_cond_broadcast(&dev->zbd_aio_cond);
+
+    return( ret );
 
 }
 
 /**
- * zbc_device_is_zoned - test if a physical device is zoned.
- * @filename:        (IN) path to the device file
- * @info:            (IN) Address where to store the device information
- *
- * Test if a physical device supports the ZBC/ZAC command set.
- * This excludes libzbc emulation mode showing a regular block device
- * or regular file as a ZBC host-managed block device. If @info is not
- * NULL and the device is identified as a zoned device, the device
- * information is returned at the address specified by @info.
- *
- * Returns a negative error code if the device test failed. 1 is returned
- * if the device is identified as zoned. Otherwise, 0 is returned.
- * In this case, the application can use stat/fstat to get more
- * details about the device.
+ * Get the total size in logical blocks of a vector of buffers.
  */
-int
-zbc_device_is_zoned(const char *filename,
-		    zbc_device_info_t *info)
+static int64_t
+zbc_iov_lba_count(zbc_device_t *dev,
+                  const struct iovec *iov,
+                  int iovcnt)
 {
-    zbc_device_t *dev = NULL;
-    int ret = -ENODEV, i;
-
-    if ( ! filename ) {
-	return( -EFAULT );
-    }
+    size_t sz = 0;
+    int i;
 
-    /* Test all backends until one accepts the drive. */
-    for(i = 0; zbc_ops[i]; i++) {
-        ret = zbc_ops[i]->zbd_open(filename, O_RDONLY, &dev);
-	if ( ret == 0 ) {
-	    /* This backend accepted the drive */
-            dev->zbd_ops = zbc_ops[i];
-	    break;
-	}
+    for(i = 0; i < iovcnt; i++) {
+        if ( (! iov[i].iov_base) && iov[i].iov_len ) {
+            return( -EFAULT );
+        }
+        sz += iov[i].iov_len;
     }
 
-    if ( dev && dev->zbd_ops ) {
-	if ( dev->zbd_ops != &zbc_fake_ops ) {
-	    ret = 1;
-	    if ( info ) {
-		memcpy(info, &dev->zbd_info, sizeof(zbc_device_info_t));
-	    }
-	} else {
-	    ret = 0;
-	}
-	dev->zbd_ops->zbd_close(dev);
-    } else {
-	if ( (ret != -EPERM) && (ret != -EACCES) ) {
-	    ret = 0;
-	}
+    if ( sz % dev->zbd_info.zbd_logical_block_size ) {
+        return( -EINVAL );
     }
 
-    return( ret );
+    return( sz / dev->zbd_info.zbd_logical_block_size );
 
 }
 
 /**
- * zbc_open - open a (device)file for ZBC access.
- * @filename:   path to the file to be opened
- * @flags:      open mode: O_RDONLY, O_WRONLY or O_RDWR
- * @dev:        opaque ZBC handle
- *
- * Opens the file pointed to by @filename, and returns a handle to it
- * in @dev if it the file is a device special file for a ZBC-capable
- * device.  If the device does not support ZBC this calls returns -EINVAL.
- * Any other error code returned from open(2) can be returned as well.
+ * Execute a read or write of at most zbd_max_rw_logical_blocks.
  */
-int
-zbc_open(const char *filename,
-         int flags,
-         zbc_device_t **pdev)
+static inline int32_t
+zbc_do_rw(zbc_device_t *dev,
+          enum zbc_aio_op op,
+          zbc_zone_t *zone,
+          uint8_t *buf,
+          uint32_t lba_count,
+          uint64_t lba_ofst)
 {
-    zbc_device_t *dev = NULL;
-    int ret = -ENODEV, i;
 
-    /* Test all backends until one accepts the drive */
-    for(i = 0; zbc_ops[i] != NULL; i++) {
-        ret = zbc_ops[i]->zbd_open(filename, flags, &dev);
-	if ( ret == 0 ) {
-	    /* This backend accepted the drive */
-            dev->zbd_ops = zbc_ops[i];
-	    *pdev = dev;
-	    break;
-	}
+    if ( op == ZBC_AIO_READ ) {
+        return( (dev->zbd_ops->zbd_pread)(dev, zone, buf, lba_count, lba_ofst) );
     }
 
-    return( ret );
+    return( (dev->zbd_ops->zbd_pwrite)(dev, zone, buf, lba_count, lba_ofst) );
 
 }
 
 /**
- * zbc_close - close a ZBC file handle.
- * @dev:                ZBC device handle to close
- *
- * Performs the equivalent to close(2) for a ZBC handle.  Can return any
- * error that close could return.
+ * Execute a large read or write as a sequence of commands
+ * of at most zbd_max_rw_logical_blocks, one at a time.
+ */
+static int32_t
+zbc_do_rw_serial(zbc_device_t *dev,
+                 enum zbc_aio_op op,
+                 zbc_zone_t *zone,
+                 uint8_t *buf,
+                 uint32_t lba_count,
+                 uint64_t lba_ofst)
+{
+    size_t lba_size = dev->zbd_info.zbd_logical_block_size;
+    uint32_t count, done = 0;
+    int32_t ret;
+
+    while( done < lba_count ) {
+
+        count = lba_count - done;
+        if ( count > dev->zbd_info.zbd_max_rw_logical_blocks ) {
+            count = dev->zbd_info.zbd_max_rw_logical_blocks;
+        }
+
+        ret = zbc_do_rw(dev, op, zone, buf + (size_t)done * lba_size, count, lba_ofst + done);
+        if ( ret <= 0 ) {
+            return( done ? (int32_t)done : ret );
+        }
+
+        done += ret;
+        if ( (uint32_t)ret < count ) {
+            break;
+        }
+
+    }
+
+    return( done );
+
+}
+
+/**
+ * Execute a large read or write as a sequence of commands of at most
+ * zbd_max_rw_logical_blocks, keeping up to @nr_chunks commands in flight.
+ * Called with the aio mutex held, which is released while waiting for
+ * the chunks completions: these can be reaped by another thread waiting
+ * for completions and are then queued in the pipe of the read or write.
+ */
+static int32_t
+zbc_do_rw_pipelined(zbc_device_t *dev,
+                    enum zbc_aio_op op,
+                    zbc_zone_t *zone,
+                    uint8_t *buf,
+                    uint32_t lba_count,
+                    uint64_t lba_ofst,
+                    unsigned int nr_chunks)
+{
+    size_t lba_size = dev->zbd_info.zbd_logical_block_size;
+    zbc_aio_t *free_chunks[ZBC_IO_MAX_CHUNKS], *aio;
+    unsigned int nr_free = nr_chunks, inflight = 0, i;
+    uint64_t end_ofst = lba_ofst + lba_count, err_ofst = end_ofst;
+    uint64_t ofst = lba_ofst;
+    zbc_rw_pipe_t pipe, **prev;
+    int32_t err = 0;
+    int ret;
+
+    for(i = 0; i < nr_chunks; i++) {
+        free_chunks[i] = &pipe.chunks[i];
+    }
+    pipe.nr_done = 0;
+    pipe.next = dev->zbd_aio_pipes;
+    dev->zbd_aio_pipes = &pipe;
+
+    while( 1 ) {
+
+        /* Fill the pipeline */
+        while( nr_free && (ofst < err_ofst) && (ofst < end_ofst) ) {
+
+            aio = free_chunks[--nr_free];
+            aio->zba_op = op;
+            aio->zba_zone = zone;
+            aio->zba_lba_ofst = ofst;
+            aio->zba_buf = buf + (size_t)(ofst - lba_ofst) * lba_size;
+            aio->zba_lba_count = end_ofst - ofst;
+            if ( aio->zba_lba_count > dev->zbd_info.zbd_max_rw_logical_blocks ) {
+                aio->zba_lba_count = dev->zbd_info.zbd_max_rw_logical_blocks;
+            }
+
+            ret = (dev->zbd_ops->zbd_aio_submit)(dev, aio);
+            if ( ret != 0 ) {
+                /* Execute this chunk synchronously */
+                pthread_mutex_unlock(&dev->zbd_aio_mutex);
+                aio->zba_ret = zbc_do_rw(dev, op, zone, aio->zba_buf,
+                                         aio->zba_lba_count, aio->zba_lba_ofst);
+                pthread_mutex_lock(&dev->zbd_aio_mutex);
+                free_chunks[nr_free++] = aio;
+                if ( aio->zba_ret != (int32_t)aio->zba_lba_count ) {
+                    if ( aio->zba_ret > 0 ) {
+                        err_ofst = aio->zba_lba_ofst + aio->zba_ret;
+                    } else {
+                        err_ofst = aio->zba_lba_ofst;
+                        err = aio->zba_ret;
+                    }
+                }
+                ofst += aio->zba_lba_count;
+                continue;
+            }
+
+            dev->zbd_aio_inflight++;
+            dev->zbd_aio_nr_chunks++;
+            inflight++;
+            ofst += aio->zba_lba_count;
+
+        }
+
+        if ( ! inflight ) {
+            break;
+        }
+
+        /* Wait for a chunk completion */
+        if ( ! pipe.nr_done ) {
+            ret = zbc_aio_wait(dev, -1);
+            if ( (ret != 0) && (ret != -EAGAIN) ) {
+                /* Cannot wait: give up */
+                err = ret;
+                err_ofst = lba_ofst;
+                break;
+            }
+            continue;
+        }
+
+        aio = pipe.done[--pipe.nr_done];
+        inflight--;
+        free_chunks[nr_free++] = aio;
+
+        /* Remember the first failed or short chunk */
+        if ( aio->zba_ret != (int32_t)aio->zba_lba_count ) {
+            if ( aio->zba_ret > 0 ) {
+                if ( (aio->zba_lba_ofst + aio->zba_ret) < err_ofst ) {
+                    err_ofst = aio->zba_lba_ofst + aio->zba_ret;
+                    err = 0;
+                }
+            } else if ( aio->zba_lba_ofst < err_ofst ) {
+                err_ofst = aio->zba_lba_ofst;
+                err = aio->zba_ret;
+            }
+        }
+
+    }
+
+    for(prev = &dev->zbd_aio_pipes; *prev != &pipe; prev = &(*prev)->next) {
+        ;
+    }
+    *prev = pipe.next;
+
+    if ( (err_ofst == lba_ofst) && err ) {
+        return( err );
+    }
+
+    return( err_ofst - lba_ofst );
+
+}
+
+/**
+ * Execute a read or write of any size. Reads and writes to conventional
+ * zones larger than zbd_max_rw_logical_blocks are split into several
+ * commands executed concurrently if the device can queue commands.
+ * Writes to sequential zones are always executed one command at a time
+ * so that they reach the device in order.
+ */
+static int32_t
+zbc_rw(zbc_device_t *dev,
+       enum zbc_aio_op op,
+       zbc_zone_t *zone,
+       uint8_t *buf,
+       uint32_t lba_count,
+       uint64_t lba_ofst)
+{
+    unsigned int nr_chunks = 0;
+    int32_t ret;
+
+    if ( lba_count <= dev->zbd_info.zbd_max_rw_logical_blocks ) {
+        return( zbc_do_rw(dev, op, zone, buf, lba_count, lba_ofst) );
+    }
+
+    if ( zbc_aio_native(dev)
+         && ((op == ZBC_AIO_READ) || zbc_zone_conventional(zone)) ) {
+
+        pthread_mutex_lock(&dev->zbd_aio_mutex);
+
+        if ( ! dev->zbd_aio_excl ) {
+            nr_chunks = dev->zbd_aio_qd - dev->zbd_aio_inflight - dev->zbd_aio_nr_done;
+            if ( nr_chunks > ZBC_IO_MAX_CHUNKS ) {
+                nr_chunks = ZBC_IO_MAX_CHUNKS;
+            }
+        }
+
+        if ( nr_chunks > 1 ) {
+            ret = zbc_do_rw_pipelined(dev, op, zone, buf, lba_count, lba_ofst, nr_chunks);
+            pthread_mutex_unlock(&dev->zbd_aio_mutex);
+            return( ret );
+        }
+
+        pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+    }
+
+    return( zbc_do_rw_serial(dev, op, zone, buf, lba_count, lba_ofst) );
+
+}
+
+/**
+ * Execute a vectored read or write of any size. Reads and writes larger
+ * than zbd_max_rw_logical_blocks are split into several commands executed
+ * one at a time, splitting the buffers of @iov crossing a command boundary.
+ */
+static int32_t
+zbc_rwv(zbc_device_t *dev,
+        enum zbc_aio_op op,
+        zbc_zone_t *zone,
+        const struct iovec *iov,
+        int iovcnt,
+        uint32_t lba_count,
+        uint64_t lba_ofst)
+{
+    size_t lba_size = dev->zbd_info.zbd_logical_block_size;
+    size_t iov_ofst = 0, sz, len;
+    struct iovec *chunk_iov;
+    uint32_t count, done = 0;
+    int32_t ret = 0;
+    int i = 0, n;
+
+    if ( lba_count <= dev->zbd_info.zbd_max_rw_logical_blocks ) {
+        if ( op == ZBC_AIO_READ ) {
+            return( (dev->zbd_ops->zbd_preadv)(dev, zone, iov, iovcnt, lba_count, lba_ofst) );
+        }
+        return( (dev->zbd_ops->zbd_pwritev)(dev, zone, iov, iovcnt, lba_count, lba_ofst) );
+    }
+
+    /* A chunk never uses more buffers than the whole vector */
+    chunk_iov = malloc(sizeof(struct iovec) * iovcnt);
+    if ( ! chunk_iov ) {
+        return( -ENOMEM );
+    }
+
+    while( done < lba_count ) {
+
+        count = lba_count - done;
+        if ( count > dev->zbd_info.zbd_max_rw_logical_blocks ) {
+            count = dev->zbd_info.zbd_max_rw_logical_blocks;
+        }
+
+        /* Gather the buffer segments of this chunk */
+        sz = (size_t)count * lba_size;
+        n = 0;
+        while( sz ) {
+            len = iov[i].iov_len - iov_ofst;
+            if ( len > sz ) {
+                len = sz;
+            }
+            if ( len ) {
+                chunk_iov[n].iov_base = (uint8_t *)iov[i].iov_base + iov_ofst;
+                chunk_iov[n].iov_len = len;
+                n++;
+            }
+            sz -= len;
+            iov_ofst += len;
+            if ( iov_ofst == iov[i].iov_len ) {
+                iov_ofst = 0;
+                i++;
+            }
+        }
+
+        if ( op == ZBC_AIO_READ ) {
+            ret = (dev->zbd_ops->zbd_preadv)(dev, zone, chunk_iov, n, count, lba_ofst + done);
+        } else {
+            ret = (dev->zbd_ops->zbd_pwritev)(dev, zone, chunk_iov, n, count, lba_ofst + done);
+        }
+        if ( ret <= 0 ) {
+            break;
+        }
+
+        done += ret;
+        if ( (uint32_t)ret < count ) {
+            break;
+        }
+
+    }
+
+    free(chunk_iov);
+
+    if ( done ) {
+        return( done );
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Compare zone start LBAs.
+ */
+static int
+zbc_lba_cmp(const void *a,
+            const void *b)
+{
+    uint64_t lba_a = *((const uint64_t *)a);
+    uint64_t lba_b = *((const uint64_t *)b);
+
+    if ( lba_a < lba_b ) {
+        return( -1 );
+    }
+
+    return( lba_a > lba_b );
+
+}
+
+/**
+ * Reset the write pointer of a list of zones sorted by increasing start LBA.
+ */
+static int
+zbc_do_reset_zones(zbc_device_t *dev,
+                   const uint64_t *start_lbas,
+                   unsigned int nr_zones)
+{
+    unsigned int i;
+    int ret = 0;
+
+    if ( ! nr_zones ) {
+        return( 0 );
+    }
+
+    /* Staged data would be erased */
+    for(i = 0; i < nr_zones; i++) {
+        zbc_append_wc_sync(dev, start_lbas[i], 1);
+    }
+
+    if ( dev->zbd_ops->zbd_reset_zones ) {
+        ret = (dev->zbd_ops->zbd_reset_zones)(dev, start_lbas, nr_zones);
+    } else {
+        for(i = 0; i < nr_zones; i++) {
+            int r = (dev->zbd_ops->zbd_reset_wp)(dev, start_lbas[i]);
+            if ( r && (! ret) ) {
+                ret = r;
+            }
+        }
+    }
+
+    if ( ret != 0 ) {
+        zbc_error("RESET WRITE POINTER of %u zones failed %d (%s)\n",
+                  nr_zones,
+                  ret,
+                  strerror(-ret));
+        /* Some zones may have been reset */
+        if ( dev->zbd_zone_cache ) {
+            zbc_zone_cache_resync(dev);
+        }
+    } else {
+        for(i = 0; i < nr_zones; i++) {
+            zbc_zone_cache_op(dev, ZBC_OP_RESET_ZONE, start_lbas[i]);
+        }
+    }
+
+    return( ret );
+
+}
+
+/***** Definition of public functions *****/
+
+/**
+ * Set library log level.
+ */
+void
+zbc_set_log_level(char *log_level)
+{
+
+    if ( log_level ) {
+        if ( strcmp(log_level, "none") == 0 ) {
+            zbc_log_level = ZBC_LOG_NONE;
+        } else if ( strcmp(log_level, "error") == 0 ) {
+            zbc_log_level = ZBC_LOG_ERROR;
+        } else if ( strcmp(log_level, "info") == 0 ) {
+            zbc_log_level = ZBC_LOG_INFO;
+        } else if ( strcmp(log_level, "debug") == 0 ) {
+            zbc_log_level = ZBC_LOG_DEBUG;
+        } else if ( strcmp(log_level, "vdebug") == 0 ) {
+            zbc_log_level = ZBC_LOG_VDEBUG;
+        } else {
+            fprintf(stderr, "Unknown log level \"%s\"\n",
+                    log_level);
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * zbc_disk_type_str - returns a disk type name
+ * @type: (IN) ZBC_DT_SCSI, ZBC_DT_ATA, or ZBC_DT_FAKE
+ *
+ * Returns a string describing the interface type of a disk.
+ */
+const char *
+zbc_disk_type_str(int type)
+{
+
+    switch( type ) {
+    case ZBC_DT_SCSI:
+        return( "SCSI ZBC" );
+    case ZBC_DT_ATA:
+        return( "ATA ZAC" );
+    case ZBC_DT_FAKE:
+        return( "Emulated zoned device" );
+    case ZBC_DT_BLOCK:
+        return( "Zoned block device" );
+    }
+
+    return( "Unknown-disk-type" );
+
+}
+
+/**
+ * zbc_disk_model_str - returns a disk model name
+ * @model: (IN) ZBC_DM_DRIVE_MANAGED, ZBC_DM_HOST_AWARE, or ZBC_DM_HOST_MANAGED
+ *
+ * Returns a string describing a model type.
+ */
+const char *
+zbc_disk_model_str(int model)
+{
+
+    switch( model ) {
+    case ZBC_DM_DRIVE_MANAGED:
+        return( "Standard/Drive-managed" );
+    case ZBC_DM_HOST_AWARE:
+        return( "Host-aware" );
+    case ZBC_DM_HOST_MANAGED:
+        return( "Host-managed" );
+    }
+
+    return( "Unknown-model" );
+
+}
+
+/**
+ * zbc_zone_type_str - returns a string describing a zone type.
+ * @type: (IN)  ZBC_ZT_CONVENTIONAL, ZBC_ZT_SEQUENTIAL_REQ or ZBC_ZT_SEQUENTIAL_PREF
+ *
+ * Returns a string describing a zone type.
+ */
+const char *
+zbc_zone_type_str(enum zbc_zone_type type)
+{
+
+    switch( type ) {
+    case ZBC_ZT_CONVENTIONAL:
+        return( "Conventional" );
+    case ZBC_ZT_SEQUENTIAL_REQ:
+        return( "Sequential-write-required" );
+    case ZBC_ZT_SEQUENTIAL_PREF:
+        return( "Sequential-write-preferred" );
+    }
+
+    return( "Unknown-type" );
+
+}
+
+/**
+ * zbc_zone_cond_str - returns a string describing a zone condition.
+ * @zone: (IN)  ZBC_ZC_NOT_WP, ZBC_ZC_EMPTY, ZBC_ZC_IMP_OPEN, ZBC_ZC_EXP_OPEN,
+ *              ZBC_ZC_CLOSED, ZBC_ZC_RDONLY, ZBC_ZC_FULL or ZBC_ZC_OFFLINE
+ *
+ * Returns a string describing a zone condition.
+ */
+const char *
+zbc_zone_condition_str(enum zbc_zone_condition cond)
+{
+    switch( cond ) {
+    case ZBC_ZC_NOT_WP:
+        return( "Not-write-pointer" );
+    case ZBC_ZC_EMPTY:
+        return( "Empty" );
+    case ZBC_ZC_IMP_OPEN:
+        return( "Implicit-open" );
+    case ZBC_ZC_EXP_OPEN:
+        return( "Explicit-open" );
+    case ZBC_ZC_CLOSED:
+        return( "Closed" );
+    case ZBC_ZC_RDONLY:
+        return( "Read-only" );
+    case ZBC_ZC_FULL:
+        return( "Full" );
+    case ZBC_ZC_OFFLINE:
+        return( "Offline" );
+    }
+
+    return( "Unknown-cond" );
+
+}
+
+/**
+ * zbc_errno - returns detailed error report (sense key, sense code and
+ *             sense code qualifier) of the last executed command.
+ * @dev: (IN) ZBC device handle
+ * @err: (OUT) Address where to return the error report
+ */
+void
+zbc_errno(zbc_device_t *dev,
+          zbc_errno_t *err)
+{
+
+    if ( dev && err ) {
+        memcpy(err, &dev->zbd_errno, sizeof(zbc_errno_t));
+    }
+
+    return;
+}
+
+/**
+ * zbc_sk_str - returns a string describing a sense key.
+ * @sk:    (IN)  Sense key
+ */
+const char *
+zbc_sk_str(enum zbc_sk sk) {
+
+    int i = 0;
+
+    while ( zbc_sg_sk_list[i].sk != 0 ) {
+        if ( sk == zbc_sg_sk_list[i].sk ) {
+            return( zbc_sg_sk_list[i].sk_name );
+        }
+        i++;
+    }
+
+    return( "Unknown-sense-key" );
+
+}
+
+/**
+ * zbc_asc_ascq_str - returns a string describing a sense code and sense code qualifier.
+ * @asc_ascq:    (IN)  Sense code and sense code qualifier
+ */
+const char *
+zbc_asc_ascq_str(enum zbc_asc_ascq asc_ascq) {
+
+    int i = 0;
+
+    while( zbc_sg_asc_ascq_list[i].asc_ascq  != 0 ) {
+        if ( asc_ascq == zbc_sg_asc_ascq_list[i].asc_ascq ) {
+            return( zbc_sg_asc_ascq_list[i].ascq_name );
+        }
+        i++;
+    }
+
+    return( "Unknown-additional-sense-code-qualifier" );
+
+}
+
+/**
+ * zbc_device_is_zoned - test if a physical device is zoned.
+ * @filename:        (IN) path to the device file
+ * @info:            (IN) Address where to store the device information
+ *
+ * Test if a physical device supports the ZBC/ZAC command set.
+ * This excludes libzbc emulation mode showing a regular block device
+ * or regular file as a ZBC host-managed block device. If @info is not
+ * NULL and the device is identified as a zoned device, the device
+ * information is returned at the address specified by @info.
+ *
+ * Returns a negative error code if the device test failed. 1 is returned
+ * if the device is identified as zoned. Otherwise, 0 is returned.
+ * In this case, the application can use stat/fstat to get more
+ * details about the device.
+ */
+int
+zbc_device_is_zoned(const char *filename,
+		    zbc_device_info_t *info)
+{
+    zbc_device_t *dev = NULL;
+    int ret = -ENODEV, i;
+
+    if ( ! filename ) {
+	return( -EFAULT );
+    }
+
+    /* Memory devices are always emulated */
+    if ( zbc_fake_mem_dev(filename) ) {
+	return( 0 );
+    }
+
+    /* Test all backends until one accepts the drive. */
+    for(i = 0; zbc_ops[i]; i++) {
+        ret = zbc_ops[i]->zbd_open(filename, O_RDONLY, &dev);
+	if ( ret == 0 ) {
+	    /* This backend accepted the drive */
+            dev->zbd_ops = zbc_ops[i];
+	    break;
+	}
+    }
+
+    if ( dev && dev->zbd_ops ) {
+	if ( dev->zbd_ops != &zbc_fake_ops ) {
+	    ret = 1;
+	    if ( info ) {
+		memcpy(info, &dev->zbd_info, sizeof(zbc_device_info_t));
+	    }
+	} else {
+	    ret = 0;
+	}
+	dev->zbd_ops->zbd_close(dev);
+    } else {
+	if ( (ret != -EPERM) && (ret != -EACCES) ) {
+	    ret = 0;
+	}
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_open - open a (device)file for ZBC access.
+ * @filename:   path to the file to be opened
+ * @flags:      open mode: O_RDONLY, O_WRONLY or O_RDWR
+ * @dev:        opaque ZBC handle
+ *
+ * Opens the file pointed to by @filename, and returns a handle to it
+ * in @dev if it the file is a device special file for a ZBC-capable
+ * device.  If the device does not support ZBC this calls returns -EINVAL.
+ * -ENOTSUP is returned if the device cannot be accessed as requested by
+ * @flags (ZBC_SG_DIRECT_IO). Any other error code returned from open(2)
+ * can be returned as well.
+ */
+int
+zbc_open(const char *filename,
+         int flags,
+         zbc_device_t **pdev)
+{
+    zbc_device_t *dev = NULL;
+    pthread_condattr_t cattr;
+    int ret = -ENODEV, err = 0, i;
+
+    if ( ! filename ) {
+	return( -EFAULT );
+    }
+
+    /* Test all backends until one accepts the drive */
+    for(i = 0; zbc_ops[i] != NULL; i++) {
+        if ( zbc_fake_mem_dev(filename) && (zbc_ops[i] != &zbc_fake_ops) ) {
+            /* Memory devices are always emulated */
+            continue;
+        }
+        ret = zbc_ops[i]->zbd_open(filename, flags, &dev);
+	if ( ret == 0 ) {
+	    /* This backend accepted the drive */
+            dev->zbd_ops = zbc_ops[i];
+            pthread_mutex_init(&dev->zbd_aio_mutex, NULL);
+            pthread_condattr_init(&cattr);
+            pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+            pthread_cond_init(&dev->zbd_aio_cond, &cattr);
+            pthread_condattr_destroy(&cattr);
+	    *pdev = dev;
+	    break;
+	}
+        if ( ret == -ENOTSUP ) {
+            /* The drive was recognized but the flags cannot be honored */
+            err = ret;
+        }
+    }
+
+    if ( (ret != 0) && err ) {
+        ret = err;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_close - close a ZBC file handle.
+ * @dev:                ZBC device handle to close
+ *
+ * Performs the equivalent to close(2) for a ZBC handle.  Can return any
+ * error that close could return. Data staged by zbc_zone_append() with
+ * write-combining enabled is written first and the first write error of
+ * staged data not yet reported is returned.
  */
 int
 zbc_close(zbc_device_t *dev)
 {
-    return( dev->zbd_ops->zbd_close(dev) );
+    int ret, wc_ret;
+
+    /* Wait for asynchronous I/Os in flight */
+    pthread_mutex_lock(&dev->zbd_aio_mutex);
+    while( dev->zbd_aio_inflight ) {
+        ret = zbc_aio_wait(dev, -1);
+        if ( (ret != 0) && (ret != -EAGAIN) ) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+    wc_ret = zbc_append_free(dev);
+    zbc_zone_cache_disable(dev);
+    pthread_cond_destroy(&dev->zbd_aio_cond);
+    pthread_mutex_destroy(&dev->zbd_aio_mutex);
+
+    ret = dev->zbd_ops->zbd_close(dev);
+
+    return( wc_ret ? wc_ret : ret );
 }
 
 /**
@@ -542,85 +1251,236 @@ zbc_report_zones(struct zbc_device *dev,
                 break;
             }
 
-            if ( n == 0 ) {
-                break;
-            }
+            if ( n == 0 ) {
+                break;
+            }
+
+            nz += n;
+            z += n;
+            start_lba = zones[z - 1].zbz_start + zones[z - 1].zbz_length;
+            if ( start_lba >= dev->zbd_info.zbd_logical_blocks ) {
+                break;
+            }
+
+        }
+
+        if ( ret == 0 ) {
+            *nr_zones = nz;
+            zbc_zone_cache_update(dev, zones, nz);
+        }
+
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_list_zones - report zones for a ZBC device
+ * @dev:                (IN) ZBC device handle to report on
+ * @start_lba:          (IN) start LBA for the first zone to reported
+ * @ro:                 (IN) Reporting options
+ * @zones:              (OUT) pointer for reported zones
+ * @nr_zones:           (OUT) number of returned zones
+ *
+ * Reports the number and details of available zones.  The @zones
+ * parameter is used to return an array of zones which is allocated using
+ * malloc(3) internally and needs to be freed using free(3).  The number
+ * of zones in @zones is returned in @nr_zones.
+ *
+ * Returns -EIO if an error happened when communicating with the device.
+ * Returns -ENOMEM if memory could not be allocated for @zones.
+ */
+int
+zbc_list_zones(struct zbc_device *dev,
+               uint64_t start_lba,
+               enum zbc_reporting_options ro,
+               struct zbc_zone **pzones,
+               unsigned int *pnr_zones)
+{
+    struct zbc_zone_iter *iter;
+    zbc_zone_t *zones = NULL, *z, *batch;
+    unsigned int nr_zones = 0, max_zones = 0, n;
+    int ret;
+
+    if ( (! pzones) || (! pnr_zones) ) {
+        return( -EFAULT );
+    }
+
+    ret = zbc_zone_iter_open(dev, start_lba, ro & (~ZBC_RO_PARTIAL), &iter);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    /* Get zones info in a single pass, growing the array as needed */
+    while( 1 ) {
+
+        ret = zbc_zone_iter_next(iter, &batch, &n);
+        if ( ret != 0 ) {
+            zbc_error("zbc_zone_iter_next failed %d\n", ret);
+            break;
+        }
+
+        if ( ! n ) {
+            break;
+        }
+
+        if ( (nr_zones + n) > max_zones ) {
+            max_zones = (max_zones ? max_zones * 2 : n);
+            if ( max_zones < (nr_zones + n) ) {
+                max_zones = nr_zones + n;
+            }
+            z = (zbc_zone_t *) realloc(zones, sizeof(zbc_zone_t) * max_zones);
+            if ( ! z ) {
+                zbc_error("No memory\n");
+                ret = -ENOMEM;
+                break;
+            }
+            zones = z;
+        }
+
+        memcpy(&zones[nr_zones], batch, sizeof(zbc_zone_t) * n);
+        nr_zones += n;
+
+    }
+
+    zbc_zone_iter_close(iter);
+
+    if ( ret != 0 ) {
+        free(zones);
+        return( ret );
+    }
+
+    zbc_debug("Device %s: %u zones\n",
+              dev->zbd_filename,
+              nr_zones);
+
+    *pzones = zones;
+    *pnr_zones = nr_zones;
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_zone_iter_open - start iterating over the zones of a ZBC device
+ * @dev:                (IN) ZBC device handle to report on
+ * @start_lba:          (IN) Start LBA for the first zone to be reported
+ * @ro:                 (IN) Reporting options
+ * @iter:               (OUT) Address where to return the iterator
+ *
+ * Returns -ENOMEM if memory could not be allocated for the iterator.
+ */
+int
+zbc_zone_iter_open(struct zbc_device *dev,
+                   uint64_t start_lba,
+                   enum zbc_reporting_options ro,
+                   struct zbc_zone_iter **piter)
+{
+    struct zbc_zone_iter *iter;
+    uint64_t bufsz;
+
+    if ( (! dev) || (! piter) ) {
+        return( -EFAULT );
+    }
 
-            nz += n;
-            z += n;
-            start_lba = zones[z - 1].zbz_start + zones[z - 1].zbz_length;
-            if ( start_lba >= dev->zbd_info.zbd_logical_blocks ) {
-                break;
-            }
+    iter = calloc(1, sizeof(struct zbc_zone_iter));
+    if ( ! iter ) {
+        return( -ENOMEM );
+    }
 
-        }
+    iter->zzi_dev = dev;
+    iter->zzi_ro = ro & (~ZBC_RO_PARTIAL);
+    iter->zzi_lba = start_lba;
 
-        if ( ret == 0 ) {
-            *nr_zones = nz;
-        }
+    /* As many zones as a maximum size REPORT ZONES reply
+     * can hold (64 B header and 64 B per zone descriptor) */
+    bufsz = (uint64_t)dev->zbd_info.zbd_max_rw_logical_blocks * dev->zbd_info.zbd_logical_block_size;
+    iter->zzi_max_zones = (bufsz > 128) ? (bufsz - 64) / 64 : 1;
 
+    iter->zzi_zones = malloc(sizeof(zbc_zone_t) * iter->zzi_max_zones);
+    if ( ! iter->zzi_zones ) {
+        free(iter);
+        return( -ENOMEM );
     }
 
-    return( ret );
+    *piter = iter;
+
+    return( 0 );
 
 }
 
 /**
- * zbc_list_zones - report zones for a ZBC device
- * @dev:                (IN) ZBC device handle to report on
- * @start_lba:          (IN) start LBA for the first zone to reported
- * @ro:                 (IN) Reporting options
- * @zones:              (OUT) pointer for reported zones
- * @nr_zones:           (OUT) number of returned zones
- *
- * Reports the number and details of available zones.  The @zones
- * parameter is used to return an array of zones which is allocated using
- * malloc(3) internally and needs to be freed using free(3).  The number
- * of zones in @zones is returned in @nr_zones.
+ * zbc_zone_iter_next - get the next batch of zones of an iterator
+ * @iter:               (IN) Zone iterator
+ * @zones:              (OUT) Address where to return the zone batch
+ * @nr_zones:           (OUT) Address where to return the number of zones in the batch
  *
  * Returns -EIO if an error happened when communicating with the device.
- * Returns -ENOMEM if memory could not be allocated for @zones.
  */
 int
-zbc_list_zones(struct zbc_device *dev,
-               uint64_t start_lba,
-               enum zbc_reporting_options ro,
-               struct zbc_zone **pzones,
-               unsigned int *pnr_zones)
+zbc_zone_iter_next(struct zbc_zone_iter *iter,
+                   struct zbc_zone **zones,
+                   unsigned int *nr_zones)
 {
-    zbc_zone_t *zones = NULL;
-    unsigned int nr_zones;
+    zbc_device_t *dev;
+    zbc_zone_t *last;
+    unsigned int n;
     int ret;
 
-    /* Get total number of zones */
-    ret = zbc_report_nr_zones(dev, start_lba, ro & (~ZBC_RO_PARTIAL), &nr_zones);
-    if ( ret < 0 ) {
-        return( ret );
+    if ( (! iter) || (! zones) || (! nr_zones) ) {
+        return( -EFAULT );
     }
 
-    zbc_debug("Device %s: %d zones\n",
-              dev->zbd_filename,
-              nr_zones);
+    dev = iter->zzi_dev;
+    *zones = iter->zzi_zones;
+    *nr_zones = 0;
 
-    /* Allocate zone array */
-    zones = (zbc_zone_t *) malloc(sizeof(zbc_zone_t) * nr_zones);
-    if ( ! zones ) {
-        zbc_error("No memory\n");
-        return( -ENOMEM );
+    if ( iter->zzi_done || (iter->zzi_lba >= dev->zbd_info.zbd_logical_blocks) ) {
+        iter->zzi_done = 1;
+        return( 0 );
     }
-    memset(zones, 0, sizeof(zbc_zone_t) * nr_zones);
 
-    /* Get zones info */
-    ret = zbc_report_zones(dev, start_lba, ro & (~ZBC_RO_PARTIAL), zones, &nr_zones);
+    n = iter->zzi_max_zones;
+    ret = zbc_do_report_zones(dev, iter->zzi_lba, iter->zzi_ro | ZBC_RO_PARTIAL,
+                              NULL, iter->zzi_zones, &n);
     if ( ret != 0 ) {
-        zbc_error("zbc_report_zones failed %d\n", ret);
-        free(zones);
-    } else {
-        *pzones = zones;
-        *pnr_zones = nr_zones;
+        zbc_error("Get zones from LBA %llu failed %d (%s)\n",
+                  (unsigned long long) iter->zzi_lba,
+                  ret,
+                  strerror(-ret));
+        return( ret );
     }
 
-    return( ret );
+    if ( ! n ) {
+        iter->zzi_done = 1;
+        return( 0 );
+    }
+
+    zbc_zone_cache_update(dev, iter->zzi_zones, n);
+
+    last = &iter->zzi_zones[n - 1];
+    iter->zzi_lba = zbc_zone_next_lba(last);
+    *nr_zones = n;
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_zone_iter_close - free a zone iterator
+ * @iter:               (IN) Zone iterator
+ */
+void
+zbc_zone_iter_close(struct zbc_zone_iter *iter)
+{
+
+    if ( iter ) {
+        free(iter->zzi_zones);
+        free(iter);
+    }
+
+    return;
 
 }
 
@@ -650,6 +1510,8 @@ zbc_open_zone(zbc_device_t *dev,
     ret = (dev->zbd_ops->zbd_open_zone)(dev, start_lba);
     if ( ret != 0 ) {
         zbc_error("OPEN ZONE command failed\n");
+    } else {
+        zbc_zone_cache_op(dev, ZBC_OP_OPEN_ZONE, start_lba);
     }
 
     return( ret );
@@ -679,10 +1541,15 @@ zbc_close_zone(zbc_device_t *dev,
 {
     int ret;
 
+    /* Write staged data */
+    zbc_append_wc_sync(dev, start_lba, 0);
+
     /* Close zone */
     ret = (dev->zbd_ops->zbd_close_zone)(dev, start_lba);
     if ( ret != 0 ) {
         zbc_error("CLOSE ZONE command failed\n");
+    } else {
+        zbc_zone_cache_op(dev, ZBC_OP_CLOSE_ZONE, start_lba);
     }
 
     return( ret );
@@ -711,10 +1578,15 @@ zbc_finish_zone(zbc_device_t *dev,
 {
     int ret;
 
+    /* Write staged data */
+    zbc_append_wc_sync(dev, start_lba, 0);
+
     /* Finish zone */
     ret = (dev->zbd_ops->zbd_finish_zone)(dev, start_lba);
     if ( ret != 0 ) {
         zbc_error("FINISH ZONE command failed\n");
+    } else {
+        zbc_zone_cache_op(dev, ZBC_OP_FINISH_ZONE, start_lba);
     }
 
     return( ret );
@@ -734,18 +1606,317 @@ zbc_finish_zone(zbc_device_t *dev,
  * and be in the ZBC_ZC_OPEN or ZBC_ZC_FULL state, otherwise -EINVAL
  * will be returned.
  *
- * Returns -EIO if an error happened when communicating with the device.
+ * Returns -EIO if an error happened when communicating with the device.
+ */
+int
+zbc_reset_write_pointer(zbc_device_t *dev,
+                        uint64_t start_lba)
+{
+    int ret;
+
+    /* Staged data would be erased */
+    zbc_append_wc_sync(dev, start_lba, 1);
+
+    /* Reset write pointer */
+    ret = (dev->zbd_ops->zbd_reset_wp)(dev, start_lba);
+    if ( ret != 0 ) {
+        zbc_error("RESET WRITE POINTER command failed\n");
+    } else {
+        zbc_zone_cache_op(dev, ZBC_OP_RESET_ZONE, start_lba);
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_reset_zones - reset the write pointer of a list of zones
+ * @dev:                (IN) ZBC device handle
+ * @start_lbas:         (IN) Array of zone start LBAs
+ * @nr_zones:           (IN) Number of zones in @start_lbas
+ *
+ * Resets the write pointer of all zones of @start_lbas. All zones are
+ * processed even if resetting some of them fails. For devices accessed
+ * through their SG node, the commands are queued for concurrent execution.
+ *
+ * Returns the error of the first failed zone reset.
+ */
+int
+zbc_reset_zones(zbc_device_t *dev,
+                const uint64_t *start_lbas,
+                unsigned int nr_zones)
+{
+    uint64_t *lbas;
+    unsigned int i, n = 0;
+    int ret;
+
+    if ( (! dev) || ((! start_lbas) && nr_zones) ) {
+        return( -EFAULT );
+    }
+
+    if ( ! nr_zones ) {
+        return( 0 );
+    }
+
+    /* Sort the zones and remove duplicates */
+    lbas = (uint64_t *) malloc(sizeof(uint64_t) * nr_zones);
+    if ( ! lbas ) {
+        zbc_error("No memory\n");
+        return( -ENOMEM );
+    }
+    memcpy(lbas, start_lbas, sizeof(uint64_t) * nr_zones);
+    qsort(lbas, nr_zones, sizeof(uint64_t), zbc_lba_cmp);
+
+    for(i = 0; i < nr_zones; i++) {
+        if ( (! n) || (lbas[i] != lbas[n - 1]) ) {
+            lbas[n++] = lbas[i];
+        }
+    }
+
+    ret = zbc_do_reset_zones(dev, lbas, n);
+
+    free(lbas);
+
+    return( ret );
+
+}
+
+/**
+ * zbc_reset_zone_range - reset the write pointer of a range of zones
+ * @dev:                (IN) ZBC device handle
+ * @start_lba:          (IN) Start LBA of the first zone of the range
+ * @nr_zones:           (IN) Number of zones in the range
+ *
+ * Resets the write pointer of the @nr_zones zones starting with the zone
+ * at @start_lba. Conventional and empty zones of the range are ignored.
+ *
+ * Returns -EINVAL if @start_lba is not a zone start LBA.
+ */
+int
+zbc_reset_zone_range(zbc_device_t *dev,
+                     uint64_t start_lba,
+                     unsigned int nr_zones)
+{
+    zbc_zone_t *zones;
+    uint64_t *lbas;
+    unsigned int i, n = 0;
+    int ret = 0;
+
+    if ( ! dev ) {
+        return( -EFAULT );
+    }
+
+    if ( ! nr_zones ) {
+        return( 0 );
+    }
+
+    zones = (zbc_zone_t *) malloc((sizeof(zbc_zone_t) + sizeof(uint64_t)) * nr_zones);
+    if ( ! zones ) {
+        zbc_error("No memory\n");
+        return( -ENOMEM );
+    }
+    lbas = (uint64_t *) &zones[nr_zones];
+
+    /* Get the zones of the range */
+    if ( dev->zbd_zone_cache ) {
+        uint64_t lba = start_lba;
+        for(i = 0; i < nr_zones; i++) {
+            if ( zbc_zone_lookup(dev, lba, &zones[i]) != 0 ) {
+                break;
+            }
+            lba = zbc_zone_next_lba(&zones[i]);
+        }
+        nr_zones = i;
+    } else {
+        ret = zbc_report_zones(dev, start_lba, ZBC_RO_ALL, zones, &nr_zones);
+        if ( ret != 0 ) {
+            goto out;
+        }
+    }
+
+    if ( (! nr_zones) || (zbc_zone_start_lba(&zones[0]) != start_lba) ) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    for(i = 0; i < nr_zones; i++) {
+        if ( zbc_zone_sequential(&zones[i]) && (! zbc_zone_empty(&zones[i])) ) {
+            lbas[n++] = zbc_zone_start_lba(&zones[i]);
+        }
+    }
+
+    ret = zbc_do_reset_zones(dev, lbas, n);
+
+out:
+
+    free(zones);
+
+    return( ret );
+
+}
+
+/**
+ * zbc_pread - read from a ZBC device
+ * @dev:                (IN) ZBC device handle to read from
+ * @zone:               (IN) The zone to read in
+ * @buf:                (IN) Caller supplied buffer to read into
+ * @lba_count:          (IN) Number of LBAs to read
+ * @lba_ofst:           (IN) LBA offset where to start reading in @zone
+ *
+ * This an the equivalent to pread(2) that operates on a ZBC device handle,
+ * and uses LBA addressing for the buffer length and I/O offset.
+ * It attempts to read in the a number of bytes (@lba_count * logical_block_size)
+ * in the zone (@zone) at the offset (@lba_ofst). Reads larger than the device
+ * maximum command size are split into several commands, executed concurrently
+ * if the device allows it.
+ *
+ * All errors returned by pread(2) can be returned. On success, the number of
+ * logical blocks read is returned.
+ */
+int32_t
+zbc_pread(zbc_device_t *dev,
+          zbc_zone_t *zone,
+          void *buf,
+          uint32_t lba_count,
+          uint64_t lba_ofst)
+{
+    ssize_t ret;
+
+    if ( !dev || !zone || !buf )
+	return( -EFAULT );
+
+    if ( !lba_count )
+	return( 0 );
+
+    if ( lba_count > INT32_MAX )
+	return( -EINVAL );
+
+    /* Write data staged for the zone */
+    zbc_append_wc_sync(dev, zbc_zone_start_lba(zone), 0);
+
+    ret = zbc_rw(dev, ZBC_AIO_READ, zone, buf, lba_count, lba_ofst);
+    if ( ret <= 0 ) {
+	zbc_error("Read %u blocks at block %llu + %llu failed %zd (%s)\n",
+		  lba_count,
+		  (unsigned long long) zbc_zone_start_lba(zone),
+		  (unsigned long long) lba_ofst,
+		  -ret,
+		  strerror(-ret));
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_pwrite - write to a ZBC device
+ * @dev:                (IN) ZBC device handle to write to
+ * @zone:               (IN) The zone to write to
+ * @buf:                (IN) Caller supplied buffer to write from
+ * @lba_count:          (IN) Number of LBAs to write
+ * @lba_ofst:           (IN) LBA Offset where to start writing in @zone
+ *
+ * This an the equivalent to pwrite(2) that operates on a ZBC device handle,
+ * and uses LBA addressing for the buffer length. It attempts to writes in the
+ * zone (@zone) at the offset (@lba_ofst).
+ * The disk write pointer may be updated in case of a succesful call, but this function
+ * does not updates the write pointer value of @zone. Writes larger than the device
+ * maximum command size are split into several commands.
+ *
+ * All errors returned by write(2) can be returned. On success, the number of
+ * logical blocks written is returned.
+ */
+int32_t
+zbc_pwrite(zbc_device_t *dev,
+           zbc_zone_t *zone,
+           const void *buf,
+           uint32_t lba_count,
+           uint64_t lba_ofst)
+{
+    ssize_t ret;
+
+    if ( !dev || !zone || !buf )
+	return( -EFAULT );
+
+    if ( !lba_count )
+	return( 0 );
+
+    if ( lba_count > INT32_MAX )
+	return( -EINVAL );
+
+    /* Write data staged for the zone */
+    zbc_append_wc_sync(dev, zbc_zone_start_lba(zone), 0);
+
+    /* Execute write */
+    ret = zbc_rw(dev, ZBC_AIO_WRITE, zone, (uint8_t *)buf, lba_count, lba_ofst);
+    zbc_zone_cache_write(dev, zbc_zone_start_lba(zone), lba_ofst, lba_count, ret);
+    if ( ret <= 0 ) {
+	zbc_error("Write %u blocks at block %llu + %llu failed %zd (%s)\n",
+		  lba_count,
+		  (unsigned long long) zbc_zone_start_lba(zone),
+		  (unsigned long long) lba_ofst,
+		  ret,
+		  strerror(-ret));
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_preadv - vectored read from a ZBC device
+ * @dev:                (IN) ZBC device handle to read from
+ * @zone:               (IN) The zone to read in
+ * @iov:                (IN) Array of caller supplied buffers to read into
+ * @iovcnt:             (IN) Number of buffers in @iov
+ * @lba_ofst:           (IN) LBA offset where to start reading in @zone
+ *
+ * This an the equivalent to preadv(2) that operates on a ZBC device handle.
+ * The total size of the buffers of @iov must be a multiple of the device
+ * logical block size. Reads larger than the device maximum command size
+ * are split into several commands, executed one at a time.
+ *
+ * Returns -ENOTSUP for a device accessed through a bsg node if @iovcnt is
+ * larger than 1, as bsg does not accept vectors of buffers.
+ *
+ * All errors returned by preadv(2) can be returned. On success, the number of
+ * logical blocks read is returned.
  */
-int
-zbc_reset_write_pointer(zbc_device_t *dev,
-                        uint64_t start_lba)
+int32_t
+zbc_preadv(zbc_device_t *dev,
+           zbc_zone_t *zone,
+           const struct iovec *iov,
+           int iovcnt,
+           uint64_t lba_ofst)
 {
-    int ret;
+    int64_t lba_count;
+    ssize_t ret;
 
-    /* Reset write pointer */
-    ret = (dev->zbd_ops->zbd_reset_wp)(dev, start_lba);
-    if ( ret != 0 ) {
-        zbc_error("RESET WRITE POINTER command failed\n");
+    if ( !dev || !zone || !iov )
+	return( -EFAULT );
+
+    if ( (iovcnt <= 0) || (iovcnt > sysconf(_SC_IOV_MAX)) )
+	return( -EINVAL );
+
+    lba_count = zbc_iov_lba_count(dev, iov, iovcnt);
+    if ( lba_count <= 0 )
+	return( lba_count );
+
+    if ( lba_count > INT32_MAX )
+	return( -EINVAL );
+
+    /* Write data staged for the zone */
+    zbc_append_wc_sync(dev, zbc_zone_start_lba(zone), 0);
+
+    ret = zbc_rwv(dev, ZBC_AIO_READ, zone, iov, iovcnt, lba_count, lba_ofst);
+    if ( ret <= 0 ) {
+	zbc_error("Read %lld blocks (%d buffers) at block %llu + %llu failed %zd (%s)\n",
+		  (long long) lba_count,
+		  iovcnt,
+		  (unsigned long long) zbc_zone_start_lba(zone),
+		  (unsigned long long) lba_ofst,
+		  -ret,
+		  strerror(-ret));
     }
 
     return( ret );
@@ -753,29 +1924,23 @@ zbc_reset_write_pointer(zbc_device_t *dev,
 }
 
 /**
- * zbc_pread - read from a ZBC device
+ * zbc_pread_borrow - access data of a ZBC device without copying it
  * @dev:                (IN) ZBC device handle to read from
  * @zone:               (IN) The zone to read in
- * @buf:                (IN) Caller supplied buffer to read into
+ * @buf:                (OUT) Address of the data
  * @lba_count:          (IN) Number of LBAs to read
  * @lba_ofst:           (IN) LBA offset where to start reading in @zone
  *
- * This an the equivalent to pread(2) that operates on a ZBC device handle,
- * and uses LBA addressing for the buffer length and I/O offset.
- * It attempts to read in the a number of bytes (@lba_count * logical_block_size)
- * in the zone (@zone) at the offset (@lba_ofst).
- *
- * All errors returned by pread(2) can be returned. On success, the number of
- * logical blocks read is returned.
+ * On success, @lba_count is returned.
  */
 int32_t
-zbc_pread(zbc_device_t *dev,
-          zbc_zone_t *zone,
-          void *buf,
-          uint32_t lba_count,
-          uint64_t lba_ofst)
+zbc_pread_borrow(zbc_device_t *dev,
+                 zbc_zone_t *zone,
+                 const void **buf,
+                 uint32_t lba_count,
+                 uint64_t lba_ofst)
 {
-    ssize_t ret;
+    int32_t ret;
 
     if ( !dev || !zone || !buf )
 	return( -EFAULT );
@@ -783,12 +1948,18 @@ zbc_pread(zbc_device_t *dev,
     if ( !lba_count )
 	return( 0 );
 
-    if ( lba_count > dev->zbd_info.zbd_max_rw_logical_blocks )
+    if ( lba_count > INT32_MAX )
 	return( -EINVAL );
 
-    ret = (dev->zbd_ops->zbd_pread)(dev, zone, buf, lba_count, lba_ofst);
+    if ( ! dev->zbd_ops->zbd_pread_borrow )
+	return( -ENOTSUP );
+
+    /* Write data staged for the zone */
+    zbc_append_wc_sync(dev, zbc_zone_start_lba(zone), 0);
+
+    ret = (dev->zbd_ops->zbd_pread_borrow)(dev, zone, buf, lba_count, lba_ofst);
     if ( ret <= 0 ) {
-	zbc_error("Read %u blocks at block %llu + %llu failed %zd (%s)\n",
+	zbc_error("Borrow %u blocks at block %llu + %llu failed %d (%s)\n",
 		  lba_count,
 		  (unsigned long long) zbc_zone_start_lba(zone),
 		  (unsigned long long) lba_ofst,
@@ -801,48 +1972,61 @@ zbc_pread(zbc_device_t *dev,
 }
 
 /**
- * zbc_pwrite - write to a ZBC device
+ * zbc_pwritev - vectored write to a ZBC device
  * @dev:                (IN) ZBC device handle to write to
  * @zone:               (IN) The zone to write to
- * @buf:                (IN) Caller supplied buffer to write from
- * @lba_count:          (IN) Number of LBAs to write
+ * @iov:                (IN) Array of caller supplied buffers to write from
+ * @iovcnt:             (IN) Number of buffers in @iov
  * @lba_ofst:           (IN) LBA Offset where to start writing in @zone
  *
- * This an the equivalent to pwrite(2) that operates on a ZBC device handle,
- * and uses LBA addressing for the buffer length. It attempts to writes in the
- * zone (@zone) at the offset (@lba_ofst).
- * The disk write pointer may be updated in case of a succesful call, but this function
- * does not updates the write pointer value of @zone.
+ * This an the equivalent to pwritev(2) that operates on a ZBC device handle.
+ * The total size of the buffers of @iov must be a multiple of the device
+ * logical block size. This function does not update the write pointer
+ * value of @zone. Writes larger than the device maximum command size are
+ * split into several commands, executed one at a time.
  *
- * All errors returned by write(2) can be returned. On success, the number of
+ * Returns -ENOTSUP for a device accessed through a bsg node if @iovcnt is
+ * larger than 1, as bsg does not accept vectors of buffers.
+ *
+ * All errors returned by pwritev(2) can be returned. On success, the number of
  * logical blocks written is returned.
  */
 int32_t
-zbc_pwrite(zbc_device_t *dev,
-           zbc_zone_t *zone,
-           const void *buf,
-           uint32_t lba_count,
-           uint64_t lba_ofst)
+zbc_pwritev(zbc_device_t *dev,
+            zbc_zone_t *zone,
+            const struct iovec *iov,
+            int iovcnt,
+            uint64_t lba_ofst)
 {
+    int64_t lba_count;
     ssize_t ret;
 
-    if ( !dev || !zone || !buf )
+    if ( !dev || !zone || !iov )
 	return( -EFAULT );
 
-    if ( !lba_count )
-	return( 0 );
+    if ( (iovcnt <= 0) || (iovcnt > sysconf(_SC_IOV_MAX)) )
+	return( -EINVAL );
 
-    if ( lba_count > dev->zbd_info.zbd_max_rw_logical_blocks )
+    lba_count = zbc_iov_lba_count(dev, iov, iovcnt);
+    if ( lba_count <= 0 )
+	return( lba_count );
+
+    if ( lba_count > INT32_MAX )
 	return( -EINVAL );
 
+    /* Write data staged for the zone */
+    zbc_append_wc_sync(dev, zbc_zone_start_lba(zone), 0);
+
     /* Execute write */
-    ret = (dev->zbd_ops->zbd_pwrite)(dev, zone, buf, lba_count, lba_ofst);
+    ret = zbc_rwv(dev, ZBC_AIO_WRITE, zone, iov, iovcnt, lba_count, lba_ofst);
+    zbc_zone_cache_write(dev, zbc_zone_start_lba(zone), lba_ofst, lba_count, ret);
     if ( ret <= 0 ) {
-	zbc_error("Write %u blocks at block %llu + %llu failed %zd (%s)\n",
-		  lba_count,
+	zbc_error("Write %lld blocks (%d buffers) at block %llu + %llu failed %zd (%s)\n",
+		  (long long) lba_count,
+		  iovcnt,
 		  (unsigned long long) zbc_zone_start_lba(zone),
 		  (unsigned long long) lba_ofst,
-		  ret,
+		  -ret,
 		  strerror(-ret));
     }
 
@@ -898,12 +2082,20 @@ zbc_write(struct zbc_device *dev,
  * @dev:                (IN) ZBC device handle to flush
  *
  * This an the equivalent to fsync/fdatasunc but operates at the device cache level.
+ * Data staged by zbc_zone_append() with write-combining enabled is written first
+ * and the first write error of staged data not yet reported is returned.
  */
 int
 zbc_flush(zbc_device_t *dev)
 {
+    int ret, wc_ret;
 
-    return( (dev->zbd_ops->zbd_flush)(dev, 0, 0, 0) );
+    /* Write staged data first */
+    wc_ret = zbc_append_wc_sync(dev, (uint64_t)-1, 0);
+
+    ret = (dev->zbd_ops->zbd_flush)(dev, 0, 0, 0);
+
+    return( wc_ret ? wc_ret : ret );
 
 }
 
@@ -925,6 +2117,41 @@ zbc_set_zones(zbc_device_t *dev,
     /* Do this only if supported */
     if ( dev->zbd_ops->zbd_set_zones ) {
         ret = (dev->zbd_ops->zbd_set_zones)(dev, conv_sz, zone_sz);
+        if ( (ret == 0) && dev->zbd_zone_cache ) {
+            ret = zbc_zone_cache_resync(dev);
+        }
+    } else {
+        ret = -ENXIO;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_set_zone_geometry - Configure zones of a "hacked" ZBC device from a zone geometry file
+ * @dev:        (IN) ZBC device handle of the device to configure
+ * @path:       (IN) Path of the zone geometry file
+ *
+ * Each line of the geometry file describes a run of zones as "<number of zones> <type> <zone size> [<condition>]",
+ * with zone sizes in logical sectors, types "conv", "seq" (sequential write required) or "pref"
+ * (sequential write preferred), and conditions "empty" (default), "rdonly" or "offline".
+ * Runs are laid out in file order starting at LBA 0. See README for details.
+ *
+ * This function only affects devices operating with the emulation (fake) backend driver.
+ */
+int
+zbc_set_zone_geometry(struct zbc_device *dev,
+                      const char *path)
+{
+    int ret;
+
+    /* Do this only if supported */
+    if ( dev->zbd_ops->zbd_set_geometry ) {
+        ret = (dev->zbd_ops->zbd_set_geometry)(dev, path);
+        if ( (ret == 0) && dev->zbd_zone_cache ) {
+            ret = zbc_zone_cache_resync(dev);
+        }
     } else {
         ret = -ENXIO;
     }
@@ -952,6 +2179,33 @@ zbc_set_write_pointer(struct zbc_device *dev,
     /* Do this only if supported */
     if ( dev->zbd_ops->zbd_set_wp ) {
         ret = (dev->zbd_ops->zbd_set_wp)(dev, start_lba, wp_lba);
+        if ( ret == 0 ) {
+            zbc_zone_cache_refresh(dev, start_lba);
+        }
+    } else {
+        ret = -ENXIO;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_set_perf_model - Time the commands of an emulated device
+ * @dev:        (IN) ZBC device handle of the device to configure
+ * @profile:    (IN) Path of the drive performance profile file, or NULL to stop timing commands
+ *
+ * This function only affects devices operating with the emulation (fake) backend driver.
+ */
+int
+zbc_set_perf_model(struct zbc_device *dev,
+                   const char *profile)
+{
+    int ret;
+
+    /* Do this only if supported */
+    if ( dev->zbd_ops->zbd_set_perf_model ) {
+        ret = (dev->zbd_ops->zbd_set_perf_model)(dev, profile);
     } else {
         ret = -ENXIO;
     }
@@ -960,4 +2214,305 @@ zbc_set_write_pointer(struct zbc_device *dev,
 
 }
 
+/**
+ * zbc_aio_submit - submit asynchronous read and write operations
+ * @dev:                (IN) ZBC device handle
+ * @aios:               (IN) Array of asynchronous I/O descriptors to submit
+ * @nr_aios:            (IN) Number of descriptors in @aios
+ *
+ * Queue the read and write operations described by @aios for execution.
+ * Backends that cannot queue commands execute the operations synchronously,
+ * except bsg nodes, for which asynchronous I/Os are not supported.
+ *
+ * Returns the number of descriptors submitted (0 if @nr_aios is 0) or a
+ * negative error code if no descriptor could be submitted (-ENOTSUP for
+ * bsg nodes).
+ */
+int
+zbc_aio_submit(zbc_device_t *dev,
+               zbc_aio_t **aios,
+               unsigned int nr_aios)
+{
+    unsigned int qd, i;
+    zbc_aio_t *aio;
+    int ret = 0;
+
+    if ( (! dev) || (! aios) ) {
+        return( -EFAULT );
+    }
+
+    if ( dev->zbd_flags & ZBC_NO_AIO ) {
+        return( -ENOTSUP );
+    }
+
+    if ( ! nr_aios ) {
+        return( 0 );
+    }
+
+    qd = zbc_aio_native(dev) ? dev->zbd_aio_qd : ZBC_AIO_MAX_QD;
+
+    pthread_mutex_lock(&dev->zbd_aio_mutex);
+
+    /* Wait for the commands queued by zbc_sg_cmd_exec_pipelined() */
+    while( dev->zbd_aio_excl ) {
+        pthread_cond_wait(&dev->zbd_aio_cond, &dev->zbd_aio_mutex);
+    }
+
+    for(i = 0; i < nr_aios; i++) {
+
+        aio = aios[i];
+        if ( (! aio) || (! aio->zba_zone) || (! aio->zba_buf) ) {
+            ret = -EFAULT;
+            break;
+        }
+
+        if ( ((aio->zba_op != ZBC_AIO_READ) && (aio->zba_op != ZBC_AIO_WRITE))
+             || (! aio->zba_lba_count)
+             || (aio->zba_lba_count > dev->zbd_info.zbd_max_rw_logical_blocks) ) {
+            ret = -EINVAL;
+            break;
+        }
+
+        if ( (dev->zbd_aio_inflight + dev->zbd_aio_nr_done) >= qd ) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        if ( zbc_aio_native(dev) ) {
+
+            zbc_append_wc_sync(dev, zbc_zone_start_lba(aio->zba_zone), 0);
+
+            ret = (dev->zbd_ops->zbd_aio_submit)(dev, aio);
+            if ( ret != 0 ) {
+                break;
+            }
+            dev->zbd_aio_inflight++;
+
+        } else {
+
+            /* Execute synchronously */
+            if ( aio->zba_op == ZBC_AIO_READ ) {
+                aio->zba_ret = zbc_pread(dev, aio->zba_zone, aio->zba_buf,
+                                         aio->zba_lba_count, aio->zba_lba_ofst);
+            } else {
+                aio->zba_ret = zbc_pwrite(dev, aio->zba_zone, aio->zba_buf,
+                                          aio->zba_lba_count, aio->zba_lba_ofst);
+            }
+            zbc_aio_done(dev, aio);
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+    if ( i ) {
+        return( i );
+    }
+
+    if ( ret != -EAGAIN ) {
+        zbc_error("Submit asynchronous I/O failed %d (%s)\n",
+                  ret,
+                  strerror(-ret));
+    }
+
+    return( ret );
+
+}
+
+/**
+ * zbc_aio_getevents - collect completed asynchronous operations
+ * @dev:                (IN) ZBC device handle
+ * @min_nr:             (IN) Minimum number of completions to wait for
+ * @max_nr:             (IN) Maximum number of completions to return
+ * @aios:               (OUT) Array where to return completed descriptors
+ * @timeout:            (IN) Maximum time to wait in milliseconds (-1 waits forever)
+ *
+ * Returns the number of completed descriptors stored in @aios, or a negative
+ * error code if waiting for completions failed.
+ */
+int
+zbc_aio_getevents(zbc_device_t *dev,
+                  unsigned int min_nr,
+                  unsigned int max_nr,
+                  zbc_aio_t **aios,
+                  int timeout)
+{
+    struct timespec deadline;
+    unsigned int n = 0;
+    int tmo, ret;
+
+    if ( (! dev) || (! aios) ) {
+        return( -EFAULT );
+    }
+
+    if ( min_nr > max_nr ) {
+        return( -EINVAL );
+    }
+
+    if ( timeout > 0 ) {
+        zbc_aio_deadline(&deadline, timeout);
+    }
+
+    pthread_mutex_lock(&dev->zbd_aio_mutex);
+
+    while( n < max_nr ) {
+
+        /* Completions already collected first */
+        if ( dev->zbd_aio_nr_done ) {
+            aios[n++] = zbc_aio_next_done(dev);
+            continue;
+        }
+
+        /* Chunks of large reads and writes are not collected here */
+        if ( dev->zbd_aio_inflight == dev->zbd_aio_nr_chunks ) {
+            break;
+        }
+
+        /* Wait only until min_nr completions are collected */
+        if ( n >= min_nr ) {
+            tmo = 0;
+        } else if ( timeout > 0 ) {
+            tmo = zbc_aio_timeout(&deadline);
+        } else {
+            tmo = timeout;
+        }
+
+        ret = zbc_aio_wait(dev, tmo);
+        if ( ret == -EAGAIN ) {
+            break;
+        }
+
+        if ( ret != 0 ) {
+            if ( n ) {
+                break;
+            }
+            pthread_mutex_unlock(&dev->zbd_aio_mutex);
+            return( ret );
+        }
+
+    }
+
+    pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+    return( n );
+
+}
+
+/**
+ * zbc_register_buffers - register asynchronous I/O data buffers
+ * @dev:                (IN) ZBC device handle
+ * @iov:                (IN) Array of buffers
+ * @nr_iov:             (IN) Number of buffers in @iov (0 unregisters all buffers)
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+int
+zbc_register_buffers(zbc_device_t *dev,
+                     const struct iovec *iov,
+                     unsigned int nr_iov)
+{
+    int ret;
+
+    if ( (! dev) || (nr_iov && (! iov)) ) {
+        return( -EFAULT );
+    }
+
+    if ( ! dev->zbd_ops->zbd_register_buffers ) {
+        return( -ENXIO );
+    }
+
+    pthread_mutex_lock(&dev->zbd_aio_mutex);
+
+    if ( dev->zbd_aio_inflight ) {
+        ret = -EBUSY;
+    } else {
+        ret = (dev->zbd_ops->zbd_register_buffers)(dev, iov, nr_iov);
+    }
+
+    pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+    return( ret );
+
+}
+
+/**
+ * zbc_set_cmd_policy - set the timeout and retry policy of a command class
+ * @dev:                (IN) ZBC device handle
+ * @cls:                (IN) Command class
+ * @policy:             (IN) Policy of the class (the timeout cannot be 0)
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+int
+zbc_set_cmd_policy(zbc_device_t *dev,
+                   enum zbc_cmd_class cls,
+                   const zbc_cmd_policy_t *policy)
+{
+
+    if ( (! dev) || (! policy) ) {
+        return( -EFAULT );
+    }
+
+    if ( (cls < 0) || (cls >= ZBC_CMD_CLASS_NUM)
+         || (! policy->zcp_timeout) ) {
+        return( -EINVAL );
+    }
+
+    memcpy(&dev->zbd_cmd_policy[cls], policy, sizeof(zbc_cmd_policy_t));
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_get_cmd_policy - get the timeout and retry policy of a command class
+ * @dev:                (IN) ZBC device handle
+ * @cls:                (IN) Command class
+ * @policy:             (OUT) Address where to return the policy
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+int
+zbc_get_cmd_policy(zbc_device_t *dev,
+                   enum zbc_cmd_class cls,
+                   zbc_cmd_policy_t *policy)
+{
+
+    if ( (! dev) || (! policy) ) {
+        return( -EFAULT );
+    }
+
+    if ( (cls < 0) || (cls >= ZBC_CMD_CLASS_NUM) ) {
+        return( -EINVAL );
+    }
+
+    memcpy(policy, zbc_cmd_policy(dev, cls), sizeof(zbc_cmd_policy_t));
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_get_cmd_stats - get the command execution counters of a device
+ * @dev:                (IN) ZBC device handle
+ * @stats:              (OUT) Address where to return the counters
+ *
+ * Returns 0 on success and a negative error code otherwise.
+ */
+int
+zbc_get_cmd_stats(zbc_device_t *dev,
+                  zbc_cmd_stats_t *stats)
+{
+
+    if ( (! dev) || (! stats) ) {
+        return( -EFAULT );
+    }
+
+    stats->zcs_retries = __atomic_load_n(&dev->zbd_cmd_stats.zcs_retries, __ATOMIC_RELAXED);
+    stats->zcs_timeouts = __atomic_load_n(&dev->zbd_cmd_stats.zcs_timeouts, __ATOMIC_RELAXED);
+    stats->zcs_errors = __atomic_load_n(&dev->zbd_cmd_stats.zcs_errors, __ATOMIC_RELAXED);
 
+    return( 0 );
+
+}
@@ -22,12 +22,79 @@
 #include "zbc_log.h"
 
 #include <stdlib.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <scsi/scsi.h>
 #include <scsi/sg.h>
 
 /***** Type definitions *****/
 
+/**
+ * Zone operations.
+ */
+enum zbc_zone_op {
+    ZBC_OP_OPEN_ZONE            = 0x01,
+    ZBC_OP_CLOSE_ZONE           = 0x02,
+    ZBC_OP_FINISH_ZONE          = 0x03,
+    ZBC_OP_RESET_ZONE           = 0x04,
+};
+
+/**
+ * Zone cache.
+ */
+typedef struct zbc_zone_cache {
+
+    /**
+     * Cache lock.
+     */
+    pthread_mutex_t     zzc_mutex;
+
+    /**
+     * All zones of the device, sorted by start LBA.
+     */
+    zbc_zone_t          *zzc_zones;
+    unsigned int        zzc_nr_zones;
+
+    /**
+     * Zone size if all zones (except possibly the
+     * last one) have the same size, 0 otherwise.
+     */
+    uint64_t            zzc_zone_length;
+
+} zbc_zone_cache_t;
+
+/**
+ * Zone iterator.
+ */
+struct zbc_zone_iter {
+
+    struct zbc_device           *zzi_dev;
+
+    /**
+     * Reporting options and start LBA of the next report.
+     */
+    enum zbc_reporting_options  zzi_ro;
+    uint64_t                    zzi_lba;
+    int                         zzi_done;
+
+    /**
+     * Zone batch buffer.
+     */
+    zbc_zone_t                  *zzi_zones;
+    unsigned int                zzi_max_zones;
+
+};
+
+/**
+ * Zone append state (see zbc_append.c).
+ */
+typedef struct zbc_append zbc_append_t;
+
+/**
+ * Large read or write executed as several queued commands (see zbc.c).
+ */
+typedef struct zbc_rw_pipe zbc_rw_pipe_t;
+
 /**
  * Device operations.
  */
@@ -62,6 +129,38 @@ typedef struct zbc_ops {
                               uint32_t,
                               uint64_t);
 
+    /**
+     * Vectored read from a ZBC device: the
+     * total size of the vector is also specified
+     * in number of logical blocks.
+     */
+    int32_t     (*zbd_preadv)(struct zbc_device *,
+                              zbc_zone_t *,
+                              const struct iovec *,
+                              int,
+                              uint32_t,
+                              uint64_t);
+
+    /**
+     * Vectored write to a ZBC device.
+     */
+    int32_t     (*zbd_pwritev)(struct zbc_device *,
+                               zbc_zone_t *,
+                               const struct iovec *,
+                               int,
+                               uint32_t,
+                               uint64_t);
+
+    /**
+     * Get a pointer to the data of a zone without
+     * copying it (optional).
+     */
+    int32_t     (*zbd_pread_borrow)(struct zbc_device *,
+                                    zbc_zone_t *,
+                                    const void **,
+                                    uint32_t,
+                                    uint64_t);
+
     /**
      * Flush to a ZBC device cache.
      */
@@ -109,6 +208,14 @@ typedef struct zbc_ops {
     int         (*zbd_reset_wp)(struct zbc_device *,
                                 uint64_t);
 
+    /**
+     * Reset the write pointer of a list of zones
+     * sorted by increasing start LBA (optional).
+     */
+    int         (*zbd_reset_zones)(struct zbc_device *,
+                                   const uint64_t *,
+                                   unsigned int);
+
     /**
      * Change a device zone configuration.
      * For emulated drives only (optional).
@@ -117,6 +224,13 @@ typedef struct zbc_ops {
                                  uint64_t,
                                  uint64_t);
 
+    /**
+     * Change a device zone configuration using a zone geometry file.
+     * For emulated drives only (optional).
+     */
+    int         (*zbd_set_geometry)(struct zbc_device *,
+                                    const char *);
+
     /**
      * Change a zone write pointer.
      * For emulated drives only (optional).
@@ -125,6 +239,36 @@ typedef struct zbc_ops {
                               uint64_t,
                               uint64_t);
 
+    /**
+     * Set a drive performance model profile.
+     * For emulated drives only (optional).
+     */
+    int         (*zbd_set_perf_model)(struct zbc_device *,
+                                      const char *);
+
+    /**
+     * Submit an asynchronous I/O (optional).
+     */
+    int         (*zbd_aio_submit)(struct zbc_device *,
+                                  zbc_aio_t *);
+
+    /**
+     * Get a completed asynchronous I/O, waiting at most the
+     * specified number of milliseconds (-1 waits forever).
+     * Returns -EAGAIN if no I/O completed (optional).
+     */
+    int         (*zbd_aio_reap)(struct zbc_device *,
+                                int,
+                                zbc_aio_t **);
+
+    /**
+     * Register (or unregister if the number of buffers is 0)
+     * buffers used for asynchronous I/Os (optional).
+     */
+    int         (*zbd_register_buffers)(struct zbc_device *,
+                                        const struct iovec *,
+                                        unsigned int);
+
 } zbc_ops_t;
 
 /**
@@ -162,6 +306,75 @@ typedef struct zbc_device {
      */
     zbc_errno_t         zbd_errno;
 
+    /**
+     * Asynchronous I/O queue depth supported by the backend driver.
+     * 0 if the device cannot execute asynchronous I/Os, in which case
+     * asynchronous I/Os are executed synchronously when submitted.
+     */
+    unsigned int        zbd_aio_qd;
+
+    /**
+     * Number of asynchronous I/Os in flight in the backend driver.
+     */
+    unsigned int        zbd_aio_inflight;
+
+    /**
+     * Completed asynchronous I/Os not yet collected.
+     */
+    zbc_aio_t           *zbd_aio_done[ZBC_AIO_MAX_QD];
+    unsigned int        zbd_aio_done_head;
+    unsigned int        zbd_aio_nr_done;
+
+    /**
+     * Large reads and writes with chunks in flight, and number
+     * of these chunks (included in zbd_aio_inflight).
+     */
+    zbc_rw_pipe_t       *zbd_aio_pipes;
+    unsigned int        zbd_aio_nr_chunks;
+
+    /**
+     * A single thread at a time waits for completions in the backend
+     * driver (zbd_aio_reaping set) and queues the completions for the
+     * threads waiting for them on zbd_aio_cond. zbd_aio_excl is set while
+     * zbc_sg_cmd_exec_pipelined() has commands queued: no asynchronous
+     * I/O can be submitted until it completes.
+     */
+    int                 zbd_aio_reaping;
+    int                 zbd_aio_excl;
+    pthread_cond_t      zbd_aio_cond;
+
+    /**
+     * Protects the fields above and the completion queues of the
+     * backend driver. The thread waiting for completions releases
+     * it while blocked, so that the other threads can submit
+     * asynchronous I/Os and execute commands in the meantime.
+     */
+    pthread_mutex_t     zbd_aio_mutex;
+
+    /**
+     * Zone cache (NULL if not enabled).
+     */
+    zbc_zone_cache_t    *zbd_zone_cache;
+
+    /**
+     * Zone append state (NULL if zbc_zone_append was never called).
+     */
+    zbc_append_t        *zbd_append;
+
+    /**
+     * Command descriptors and buffers of SG devices (NULL otherwise).
+     */
+    struct zbc_sg_pool  *zbd_sg_pool;
+
+    /**
+     * Command timeout and retry policies set with zbc_set_cmd_policy()
+     * (a zero timeout selects the default policy of the class) and
+     * command execution counters (updated with zbc_cmd_stats_inc(), as
+     * commands may complete in several threads).
+     */
+    zbc_cmd_policy_t    zbd_cmd_policy[ZBC_CMD_CLASS_NUM];
+    zbc_cmd_stats_t     zbd_cmd_stats;
+
 } zbc_device_t;
 
 /***** Internal device functions *****/
@@ -186,10 +399,51 @@ extern zbc_ops_t zbc_scsi_ops;
  */
 extern struct zbc_ops zbc_fake_ops;
 
+/**
+ * Emulated devices in memory are named "mem:<options>".
+ */
+#define ZBC_FAKE_MEM_PREFIX         "mem:"
+#define zbc_fake_mem_dev(f)         (strncmp((f), ZBC_FAKE_MEM_PREFIX, strlen(ZBC_FAKE_MEM_PREFIX)) == 0)
+
 #define container_of(ptr, type, member) \
     ((type *)((char *)(ptr)-(unsigned long)(&((type *)0)->member)))
 
-#define zbc_open_flags(f)           ((f) & ~ZBC_FORCE_ATA_RW)
+#define zbc_open_flags(f)           ((f) & ~(ZBC_FORCE_ATA_RW | ZBC_FAKE_MMAP \
+                                             | ZBC_SG_HUGE_PAGES | ZBC_SG_DIRECT_IO))
+
+/**
+ * Device flag (zbd_flags) set by backend drivers if asynchronous I/Os
+ * cannot be executed, not even synchronously: zbc_aio_submit() then
+ * fails with -ENOTSUP.
+ */
+#define ZBC_NO_AIO                  0x00020000
+
+/**
+ * Default command timeout and retry policies.
+ */
+extern zbc_cmd_policy_t zbc_cmd_policy_default[ZBC_CMD_CLASS_NUM];
+
+/**
+ * Get the timeout and retry policy of a command class.
+ */
+static inline const zbc_cmd_policy_t *
+zbc_cmd_policy(zbc_device_t *dev,
+               enum zbc_cmd_class cls)
+{
+
+    if ( dev->zbd_cmd_policy[cls].zcp_timeout ) {
+        return( &dev->zbd_cmd_policy[cls] );
+    }
+
+    return( &zbc_cmd_policy_default[cls] );
+
+}
+
+/**
+ * Increment a command execution counter of a device.
+ */
+#define zbc_cmd_stats_inc(dev,field)                                    \
+    __atomic_fetch_add(&(dev)->zbd_cmd_stats.field, 1, __ATOMIC_RELAXED)
 
 
 /**
@@ -219,6 +473,44 @@ extern int
 zbc_scsi_finish_zone(zbc_device_t *dev,
                      uint64_t start_lba);
 
+/**
+ * Zone cache update.
+ */
+extern void
+zbc_zone_cache_op(zbc_device_t *dev,
+                  enum zbc_zone_op op,
+                  uint64_t start_lba);
+
+extern void
+zbc_zone_cache_write(zbc_device_t *dev,
+                     uint64_t start_lba,
+                     uint64_t lba_ofst,
+                     uint32_t lba_count,
+                     int32_t ret);
+
+extern void
+zbc_zone_cache_update(zbc_device_t *dev,
+                      zbc_zone_t *zones,
+                      unsigned int nr_zones);
+
+extern void
+zbc_zone_cache_refresh(zbc_device_t *dev,
+                       uint64_t lba);
+
+/**
+ * Write or discard zone append write-combining buffers.
+ */
+extern int
+zbc_append_wc_sync(zbc_device_t *dev,
+                   uint64_t start_lba,
+                   int discard);
+
+/**
+ * Free a device zone append state.
+ */
+extern int
+zbc_append_free(zbc_device_t *dev);
+
 #endif
 
 /* __LIBZBC_INTERNAL_H__ */
@@ -0,0 +1,946 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christoph Hellwig (hch@infradead.org)
+ */
+
+/***** Including files *****/
+
+#include "zbc.h"
+
+#include <string.h>
+#include <time.h>
+
+/***** Macro definitions *****/
+
+/**
+ * Hash of zones being appended to (zone start LBAs are
+ * usually multiples of a large power of 2).
+ */
+#define ZBC_APPEND_HASH_BITS	6
+#define ZBC_APPEND_HASH_SIZE	(1 << ZBC_APPEND_HASH_BITS)
+#define zbc_append_hash(lba)	\
+    ((unsigned int)(((lba) * 0x9e3779b97f4a7c15ULL) >> (64 - ZBC_APPEND_HASH_BITS)))
+
+/**
+ * Maximum number of appends merged into a single write command.
+ */
+#define ZBC_APPEND_MAX_BATCH	64
+
+/**
+ * Write-combining buffer synchronization modes.
+ */
+enum zbc_wc_sync {
+    ZBC_WC_FLUSH                = 0x01,   /* Write and report errors */
+    ZBC_WC_WRITEBACK            = 0x02,   /* Write only */
+    ZBC_WC_FLUSH_EXPIRED        = 0x03,   /* Write if staged for too long */
+    ZBC_WC_DISCARD              = 0x04,   /* Drop staged data */
+};
+
+/***** Type definitions *****/
+
+/**
+ * Append request.
+ */
+typedef struct zbc_append_req {
+
+    const void                  *zar_buf;
+    uint32_t                    zar_lba_count;
+    uint64_t                    zar_lba;
+    int32_t                     zar_ret;
+    int                         zar_done;
+
+    struct zbc_append_req       *zar_next;
+
+} zbc_append_req_t;
+
+/**
+ * Append state of a zone: appends are queued in
+ * submission order and written by a single thread
+ * (the leader) at a time.
+ */
+typedef struct zbc_append_zone {
+
+    uint64_t                    zaz_start;
+    uint64_t                    zaz_end;
+
+    pthread_mutex_t             zaz_mutex;
+    pthread_cond_t              zaz_cond;
+    int                         zaz_busy;
+
+    zbc_append_req_t            *zaz_head;
+    zbc_append_req_t            **zaz_tail;
+
+    /**
+     * Write-combining buffer: @zaz_wc_count blocks staged
+     * for writing at @zaz_wc_lba since @zaz_wc_time.
+     */
+    uint8_t                     *zaz_wc_buf;
+    uint64_t                    zaz_wc_lba;
+    uint32_t                    zaz_wc_count;
+    struct timespec             zaz_wc_time;
+    int                         zaz_wc_error;
+
+    struct zbc_append_zone      *zaz_next;
+
+} zbc_append_zone_t;
+
+/**
+ * Append state of a device.
+ */
+struct zbc_append {
+
+    pthread_mutex_t             za_mutex;
+    zbc_append_zone_t           *za_zones[ZBC_APPEND_HASH_SIZE];
+    unsigned int                za_nr_zones;
+
+    /**
+     * Write-combining: buffers are flushed when full, by zbc_flush()
+     * and, if @za_wc_timeout is not 0, by a flusher thread when
+     * data was staged for more than @za_wc_timeout milliseconds.
+     */
+    int                         za_wc_enabled;
+    uint32_t                    za_wc_max_count;
+    unsigned int                za_wc_timeout;
+    int                         za_wc_thread_started;
+    int                         za_wc_stop;
+    pthread_t                   za_wc_thread;
+    pthread_cond_t              za_wc_cond;
+
+};
+
+/***** Definition of private data *****/
+
+/**
+ * Protects the allocation of devices append state.
+ */
+static pthread_mutex_t zbc_append_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/***** Definition of private functions *****/
+
+/**
+ * Get the append state of a device, allocating it and
+ * enabling the device zone cache on first use.
+ */
+static int
+zbc_append_get(zbc_device_t *dev,
+               zbc_append_t **pza)
+{
+    zbc_append_t *za;
+    int ret = 0;
+
+    pthread_mutex_lock(&zbc_append_mutex);
+
+    za = dev->zbd_append;
+    if ( ! za ) {
+
+        if ( ! dev->zbd_zone_cache ) {
+            ret = zbc_zone_cache_enable(dev);
+            if ( ret != 0 ) {
+                goto out;
+            }
+        }
+
+        za = (zbc_append_t *) calloc(1, sizeof(zbc_append_t));
+        if ( ! za ) {
+            zbc_error("No memory\n");
+            ret = -ENOMEM;
+            goto out;
+        }
+        pthread_mutex_init(&za->za_mutex, NULL);
+        pthread_cond_init(&za->za_wc_cond, NULL);
+
+        dev->zbd_append = za;
+
+    }
+
+    *pza = za;
+
+out:
+
+    pthread_mutex_unlock(&zbc_append_mutex);
+
+    return( ret );
+
+}
+
+/**
+ * Get the append state of the zone starting at @start_lba.
+ */
+static int
+zbc_append_get_zone(zbc_device_t *dev,
+                    uint64_t start_lba,
+                    zbc_append_zone_t **pazone)
+{
+    zbc_append_zone_t *azone;
+    zbc_append_t *za;
+    zbc_zone_t zone;
+    unsigned int h;
+    int ret;
+
+    ret = zbc_append_get(dev, &za);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    h = zbc_append_hash(start_lba);
+
+    pthread_mutex_lock(&za->za_mutex);
+
+    for(azone = za->za_zones[h]; azone; azone = azone->zaz_next) {
+        if ( azone->zaz_start == start_lba ) {
+            goto out;
+        }
+    }
+
+    /* First append to this zone */
+    ret = zbc_zone_lookup(dev, start_lba, &zone);
+    if ( ret != 0 ) {
+        goto out;
+    }
+
+    if ( (zbc_zone_start_lba(&zone) != start_lba)
+         || (! zbc_zone_sequential(&zone)) ) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    azone = (zbc_append_zone_t *) calloc(1, sizeof(zbc_append_zone_t));
+    if ( ! azone ) {
+        zbc_error("No memory\n");
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    azone->zaz_start = start_lba;
+    azone->zaz_end = zbc_zone_next_lba(&zone);
+    pthread_mutex_init(&azone->zaz_mutex, NULL);
+    pthread_cond_init(&azone->zaz_cond, NULL);
+    azone->zaz_tail = &azone->zaz_head;
+    azone->zaz_next = za->za_zones[h];
+    za->za_zones[h] = azone;
+    za->za_nr_zones++;
+
+out:
+
+    pthread_mutex_unlock(&za->za_mutex);
+
+    if ( ret == 0 ) {
+        *pazone = azone;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Remove the first append request of a zone queue.
+ */
+static inline zbc_append_req_t *
+zbc_append_dequeue(zbc_append_zone_t *azone)
+{
+    zbc_append_req_t *req = azone->zaz_head;
+
+    azone->zaz_head = req->zar_next;
+    if ( ! azone->zaz_head ) {
+        azone->zaz_tail = &azone->zaz_head;
+    }
+
+    return( req );
+
+}
+
+/**
+ * Complete an append request.
+ */
+static inline void
+zbc_append_complete(zbc_append_req_t *req,
+                    int32_t ret)
+{
+
+    req->zar_ret = ret;
+    req->zar_done = 1;
+
+    return;
+
+}
+
+/**
+ * Find the append state of the zone starting at @start_lba.
+ */
+static zbc_append_zone_t *
+zbc_append_find_zone(zbc_append_t *za,
+                     uint64_t start_lba)
+{
+    zbc_append_zone_t *azone;
+
+    pthread_mutex_lock(&za->za_mutex);
+
+    for(azone = za->za_zones[zbc_append_hash(start_lba)]; azone; azone = azone->zaz_next) {
+        if ( azone->zaz_start == start_lba ) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&za->za_mutex);
+
+    return( azone );
+
+}
+
+/**
+ * Write the data staged in a zone write-combining buffer (zone mutex
+ * held and zone marked busy by the caller). The backend driver is called
+ * directly as the staged data never exceeds the device maximum command size.
+ */
+static int
+zbc_append_wc_write(zbc_device_t *dev,
+                    zbc_append_zone_t *azone)
+{
+    uint32_t count = azone->zaz_wc_count;
+    uint64_t lba_ofst = azone->zaz_wc_lba - azone->zaz_start;
+    zbc_zone_t zone;
+    int32_t ret;
+
+    if ( ! count ) {
+        return( 0 );
+    }
+
+    ret = zbc_zone_lookup(dev, azone->zaz_start, &zone);
+    if ( ret == 0 ) {
+
+        pthread_mutex_unlock(&azone->zaz_mutex);
+
+        ret = (dev->zbd_ops->zbd_pwrite)(dev, &zone, azone->zaz_wc_buf, count, lba_ofst);
+        zbc_zone_cache_write(dev, azone->zaz_start, lba_ofst, count, ret);
+
+        pthread_mutex_lock(&azone->zaz_mutex);
+
+        if ( (ret >= 0) && ((uint32_t)ret != count) ) {
+            ret = -EIO;
+        }
+
+    }
+
+    azone->zaz_wc_count = 0;
+
+    if ( ret < 0 ) {
+        /* The staged data is lost: latch the error until it is reported */
+        zbc_error("Write-combining flush of %u blocks at block %llu + %llu failed %d (%s)\n",
+                  count,
+                  (unsigned long long) azone->zaz_start,
+                  (unsigned long long) lba_ofst,
+                  ret,
+                  strerror(-ret));
+        azone->zaz_wc_error = ret;
+        return( ret );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Flush or discard a zone write-combining buffer.
+ */
+static int
+zbc_append_wc_sync_zone(zbc_device_t *dev,
+                        zbc_append_zone_t *azone,
+                        enum zbc_wc_sync mode)
+{
+    struct timespec now;
+    long age;
+    int ret = 0;
+
+    pthread_mutex_lock(&azone->zaz_mutex);
+
+    if ( mode == ZBC_WC_FLUSH_EXPIRED ) {
+
+        /* Do not wait for busy zones: they will be checked again */
+        if ( azone->zaz_wc_count && (! azone->zaz_busy) ) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            age = (now.tv_sec - azone->zaz_wc_time.tv_sec) * 1000
+                + (now.tv_nsec - azone->zaz_wc_time.tv_nsec) / 1000000;
+            if ( age >= (long)dev->zbd_append->za_wc_timeout ) {
+                azone->zaz_busy = 1;
+                zbc_append_wc_write(dev, azone);
+                azone->zaz_busy = 0;
+                pthread_cond_broadcast(&azone->zaz_cond);
+            }
+        }
+
+        goto out;
+
+    }
+
+    /* Wait for flushes in progress */
+    while( azone->zaz_wc_count && azone->zaz_busy ) {
+        pthread_cond_wait(&azone->zaz_cond, &azone->zaz_mutex);
+    }
+
+    if ( mode == ZBC_WC_DISCARD ) {
+        azone->zaz_wc_count = 0;
+    } else if ( azone->zaz_wc_count ) {
+        azone->zaz_busy = 1;
+        zbc_append_wc_write(dev, azone);
+        azone->zaz_busy = 0;
+        pthread_cond_broadcast(&azone->zaz_cond);
+    }
+
+    /* Report and clear asynchronous flush errors */
+    if ( mode != ZBC_WC_WRITEBACK ) {
+        ret = azone->zaz_wc_error;
+        azone->zaz_wc_error = 0;
+    }
+
+out:
+
+    pthread_mutex_unlock(&azone->zaz_mutex);
+
+    return( ret );
+
+}
+
+/**
+ * Flush or discard the write-combining buffers of all zones. The list
+ * of zones is copied so that no lock is held while waiting for zones.
+ */
+static int
+zbc_append_wc_sync_all(zbc_device_t *dev,
+                       enum zbc_wc_sync mode)
+{
+    zbc_append_t *za = dev->zbd_append;
+    zbc_append_zone_t **azones, *azone;
+    unsigned int nr_zones = 0, i;
+    int ret = 0, h;
+
+    pthread_mutex_lock(&za->za_mutex);
+
+    azones = (zbc_append_zone_t **) malloc(sizeof(zbc_append_zone_t *) * (za->za_nr_zones + 1));
+    if ( azones ) {
+        for(h = 0; h < ZBC_APPEND_HASH_SIZE; h++) {
+            for(azone = za->za_zones[h]; azone; azone = azone->zaz_next) {
+                azones[nr_zones++] = azone;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&za->za_mutex);
+
+    if ( ! azones ) {
+        zbc_error("No memory\n");
+        return( -ENOMEM );
+    }
+
+    for(i = 0; i < nr_zones; i++) {
+        h = zbc_append_wc_sync_zone(dev, azones[i], mode);
+        if ( h && (! ret) ) {
+            ret = h;
+        }
+    }
+
+    free(azones);
+
+    return( ret );
+
+}
+
+/**
+ * Write-combining flusher thread.
+ */
+static void *
+zbc_append_wc_flusher(void *arg)
+{
+    zbc_device_t *dev = (zbc_device_t *) arg;
+    zbc_append_t *za = dev->zbd_append;
+    unsigned int period = za->za_wc_timeout / 2;
+    struct timespec ts;
+
+    if ( ! period ) {
+        period = 1;
+    }
+
+    pthread_mutex_lock(&za->za_mutex);
+
+    while( ! za->za_wc_stop ) {
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += period / 1000;
+        ts.tv_nsec += (long)(period % 1000) * 1000000;
+        if ( ts.tv_nsec >= 1000000000 ) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+
+        pthread_cond_timedwait(&za->za_wc_cond, &za->za_mutex, &ts);
+        if ( za->za_wc_stop ) {
+            break;
+        }
+
+        pthread_mutex_unlock(&za->za_mutex);
+        zbc_append_wc_sync_all(dev, ZBC_WC_FLUSH_EXPIRED);
+        pthread_mutex_lock(&za->za_mutex);
+
+    }
+
+    pthread_mutex_unlock(&za->za_mutex);
+
+    return( NULL );
+
+}
+
+/**
+ * Stage an append in a zone write-combining buffer (zone mutex held).
+ */
+static int32_t
+zbc_append_wc_stage(zbc_device_t *dev,
+                    zbc_append_zone_t *azone,
+                    zbc_append_req_t *req)
+{
+    zbc_append_t *za = dev->zbd_append;
+    size_t lba_size = dev->zbd_info.zbd_logical_block_size;
+    zbc_zone_t zone;
+    uint64_t wp;
+    int ret;
+
+    /* Wait for any write to the zone in progress */
+    while( azone->zaz_busy ) {
+        pthread_cond_wait(&azone->zaz_cond, &azone->zaz_mutex);
+    }
+
+    /*
+     * Staged data was lost: the error stays latched until reported by
+     * zbc_flush(), zbc_write_combining_disable() or zbc_close() and no
+     * data can be staged behind it until then.
+     */
+    if ( azone->zaz_wc_error ) {
+        return( -EIO );
+    }
+
+    if ( ! azone->zaz_wc_buf ) {
+        ret = posix_memalign((void **) &azone->zaz_wc_buf,
+                             sysconf(_SC_PAGESIZE),
+                             (size_t)za->za_wc_max_count * lba_size);
+        if ( ret != 0 ) {
+            azone->zaz_wc_buf = NULL;
+            zbc_error("No memory\n");
+            return( -ENOMEM );
+        }
+    }
+
+    if ( (azone->zaz_wc_count + req->zar_lba_count) > za->za_wc_max_count ) {
+        azone->zaz_busy = 1;
+        ret = zbc_append_wc_write(dev, azone);
+        azone->zaz_busy = 0;
+        pthread_cond_broadcast(&azone->zaz_cond);
+        if ( ret != 0 ) {
+            /* The error is latched: it is reported by zbc_flush() */
+            return( -EIO );
+        }
+    }
+
+    /* Get the zone write pointer, accounting for staged data */
+    if ( azone->zaz_wc_count ) {
+        wp = azone->zaz_wc_lba + azone->zaz_wc_count;
+    } else {
+        ret = zbc_zone_lookup(dev, azone->zaz_start, &zone);
+        if ( ret != 0 ) {
+            return( ret );
+        }
+        wp = zbc_zone_full(&zone) ? zbc_zone_next_lba(&zone) : zbc_zone_wp_lba(&zone);
+        azone->zaz_wc_lba = wp;
+        clock_gettime(CLOCK_MONOTONIC, &azone->zaz_wc_time);
+    }
+
+    if ( (wp + req->zar_lba_count) > azone->zaz_end ) {
+        return( -ENOSPC );
+    }
+
+    memcpy(azone->zaz_wc_buf + (size_t)azone->zaz_wc_count * lba_size,
+           req->zar_buf,
+           (size_t)req->zar_lba_count * lba_size);
+    azone->zaz_wc_count += req->zar_lba_count;
+    req->zar_lba = wp;
+
+    if ( azone->zaz_wc_count == za->za_wc_max_count ) {
+        /* Buffer full */
+        azone->zaz_busy = 1;
+        zbc_append_wc_write(dev, azone);
+        azone->zaz_busy = 0;
+        pthread_cond_broadcast(&azone->zaz_cond);
+    }
+
+    return( req->zar_lba_count );
+
+}
+
+/**
+ * Write the appends queued for a zone as a single command
+ * at the zone write pointer (zone mutex held, released during
+ * the command execution).
+ */
+static void
+zbc_append_commit(zbc_device_t *dev,
+                  zbc_append_zone_t *azone)
+{
+    size_t lba_size = dev->zbd_info.zbd_logical_block_size;
+    zbc_append_req_t *batch[ZBC_APPEND_MAX_BATCH], *req;
+    struct iovec iov[ZBC_APPEND_MAX_BATCH];
+    uint64_t wp, avail;
+    uint32_t count = 0, done = 0;
+    int32_t ret;
+    zbc_zone_t zone;
+    int i, n = 0;
+
+    /* Staged data goes first and appends cannot go past lost staged data */
+    ret = zbc_append_wc_write(dev, azone);
+    if ( (ret == 0) && azone->zaz_wc_error ) {
+        ret = -EIO;
+    }
+    if ( ret == 0 ) {
+        ret = zbc_zone_lookup(dev, azone->zaz_start, &zone);
+    }
+    if ( ret != 0 ) {
+        while( azone->zaz_head ) {
+            zbc_append_complete(zbc_append_dequeue(azone), ret);
+        }
+        return;
+    }
+
+    if ( zbc_zone_full(&zone) ) {
+        wp = zbc_zone_next_lba(&zone);
+    } else {
+        wp = zbc_zone_wp_lba(&zone);
+    }
+    avail = zbc_zone_next_lba(&zone) - wp;
+
+    /* Merge queued appends */
+    while( (req = azone->zaz_head) && (n < ZBC_APPEND_MAX_BATCH) ) {
+
+        if ( (count + req->zar_lba_count) > avail ) {
+            if ( n ) {
+                /* Retry with the next batch */
+                break;
+            }
+            zbc_append_complete(zbc_append_dequeue(azone), -ENOSPC);
+            continue;
+        }
+
+        if ( n && ((count + req->zar_lba_count) > dev->zbd_info.zbd_max_rw_logical_blocks) ) {
+            break;
+        }
+
+        zbc_append_dequeue(azone);
+        req->zar_lba = wp + count;
+        iov[n].iov_base = (void *) req->zar_buf;
+        iov[n].iov_len = (size_t)req->zar_lba_count * lba_size;
+        batch[n++] = req;
+        count += req->zar_lba_count;
+
+    }
+
+    if ( ! n ) {
+        return;
+    }
+
+    pthread_mutex_unlock(&azone->zaz_mutex);
+
+    if ( count > dev->zbd_info.zbd_max_rw_logical_blocks ) {
+        ret = zbc_pwrite(dev, &zone, batch[0]->zar_buf, count, wp - zbc_zone_start_lba(&zone));
+    } else {
+        ret = zbc_pwritev(dev, &zone, iov, n, wp - zbc_zone_start_lba(&zone));
+        if ( (ret == -ENOTSUP) && (n > 1) ) {
+            /* No vector support (bsg): write the batch one append at a time */
+            int32_t sz;
+            for(i = 0, ret = 0; i < n; i++) {
+                sz = zbc_pwrite(dev, &zone, batch[i]->zar_buf, batch[i]->zar_lba_count,
+                                batch[i]->zar_lba - zbc_zone_start_lba(&zone));
+                if ( sz != (int32_t)batch[i]->zar_lba_count ) {
+                    if ( ! ret ) {
+                        ret = (sz < 0) ? sz : -EIO;
+                    }
+                    break;
+                }
+                ret += sz;
+            }
+        }
+    }
+
+    pthread_mutex_lock(&azone->zaz_mutex);
+
+    for(i = 0; i < n; i++) {
+        req = batch[i];
+        done += req->zar_lba_count;
+        if ( (ret > 0) && ((uint32_t)ret >= done) ) {
+            zbc_append_complete(req, req->zar_lba_count);
+        } else {
+            zbc_append_complete(req, (ret < 0) ? ret : -EIO);
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * Stop the write-combining flusher thread of a device.
+ */
+static void
+zbc_append_wc_stop(zbc_append_t *za)
+{
+
+    if ( za->za_wc_thread_started ) {
+
+        pthread_mutex_lock(&za->za_mutex);
+        za->za_wc_stop = 1;
+        pthread_cond_signal(&za->za_wc_cond);
+        pthread_mutex_unlock(&za->za_mutex);
+
+        pthread_join(za->za_wc_thread, NULL);
+
+        za->za_wc_thread_started = 0;
+        za->za_wc_stop = 0;
+
+    }
+
+    return;
+
+}
+
+/***** Definition of internal functions *****/
+
+/**
+ * Write (or discard if @discard is not 0) the data staged in the
+ * write-combining buffer of the zone starting at @start_lba, or of
+ * all zones if @start_lba is -1. For all zones, the first write error
+ * of staged data not yet reported is returned and cleared. Write errors
+ * of a single zone stay latched until reported by zbc_flush(),
+ * zbc_write_combining_disable() or zbc_close().
+ */
+int
+zbc_append_wc_sync(zbc_device_t *dev,
+                   uint64_t start_lba,
+                   int discard)
+{
+    zbc_append_t *za = dev->zbd_append;
+    zbc_append_zone_t *azone;
+
+    if ( (! za) || (! za->za_wc_enabled) ) {
+        return( 0 );
+    }
+
+    if ( start_lba == (uint64_t)-1 ) {
+        return( zbc_append_wc_sync_all(dev, discard ? ZBC_WC_DISCARD : ZBC_WC_FLUSH) );
+    }
+
+    azone = zbc_append_find_zone(za, start_lba);
+    if ( azone ) {
+        zbc_append_wc_sync_zone(dev, azone, discard ? ZBC_WC_DISCARD : ZBC_WC_WRITEBACK);
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Free a device append state, writing staged data first.
+ * Returns the first write error of staged data not yet reported.
+ */
+int
+zbc_append_free(zbc_device_t *dev)
+{
+    zbc_append_t *za = dev->zbd_append;
+    zbc_append_zone_t *azone;
+    int h, ret;
+
+    if ( ! za ) {
+        return( 0 );
+    }
+
+    zbc_append_wc_stop(za);
+    ret = zbc_append_wc_sync(dev, (uint64_t)-1, 0);
+
+    for(h = 0; h < ZBC_APPEND_HASH_SIZE; h++) {
+        while( (azone = za->za_zones[h]) ) {
+            za->za_zones[h] = azone->zaz_next;
+            free(azone->zaz_wc_buf);
+            pthread_cond_destroy(&azone->zaz_cond);
+            pthread_mutex_destroy(&azone->zaz_mutex);
+            free(azone);
+        }
+    }
+
+    pthread_cond_destroy(&za->za_wc_cond);
+    pthread_mutex_destroy(&za->za_mutex);
+    free(za);
+    dev->zbd_append = NULL;
+
+    return( ret );
+
+}
+
+/***** Definition of public functions *****/
+
+/**
+ * zbc_zone_append - append data to a zone
+ * @dev:                (IN) ZBC device handle to write to
+ * @zone_lba:           (IN) Start LBA of the zone to write to
+ * @buf:                (IN) Caller supplied buffer to write from
+ * @lba_count:          (IN) Number of LBAs to write
+ * @lba:                (OUT) Address where to return the LBA where the data was written
+ *
+ * Write @buf at the write pointer of the zone starting at @zone_lba.
+ * Appends to the same zone by concurrent threads are serialized and
+ * merged into a single write command. With write-combining enabled,
+ * the data may only be staged: it is durable once zbc_flush() succeeds.
+ *
+ * All errors returned by write(2) can be returned. Returns -ENOSPC if the
+ * zone remaining space is too small. On success, @lba_count is returned.
+ */
+int32_t
+zbc_zone_append(zbc_device_t *dev,
+                uint64_t zone_lba,
+                const void *buf,
+                uint32_t lba_count,
+                uint64_t *lba)
+{
+    zbc_append_zone_t *azone;
+    zbc_append_req_t req;
+    int ret;
+
+    if ( (! dev) || (! buf) ) {
+        return( -EFAULT );
+    }
+
+    if ( (! lba_count) || (lba_count > INT32_MAX) ) {
+        return( -EINVAL );
+    }
+
+    ret = zbc_append_get_zone(dev, zone_lba, &azone);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    memset(&req, 0, sizeof(zbc_append_req_t));
+    req.zar_buf = buf;
+    req.zar_lba_count = lba_count;
+
+    pthread_mutex_lock(&azone->zaz_mutex);
+
+    if ( dev->zbd_append->za_wc_enabled
+         && (lba_count <= dev->zbd_append->za_wc_max_count) ) {
+        /* Write-combining */
+        req.zar_ret = zbc_append_wc_stage(dev, azone, &req);
+        req.zar_done = 1;
+    } else {
+        *azone->zaz_tail = &req;
+        azone->zaz_tail = &req.zar_next;
+    }
+
+    while( ! req.zar_done ) {
+
+        if ( azone->zaz_busy ) {
+            /* Wait for the current leader */
+            pthread_cond_wait(&azone->zaz_cond, &azone->zaz_mutex);
+            continue;
+        }
+
+        /* Become the leader and write queued appends */
+        azone->zaz_busy = 1;
+        zbc_append_commit(dev, azone);
+        azone->zaz_busy = 0;
+        pthread_cond_broadcast(&azone->zaz_cond);
+
+    }
+
+    pthread_mutex_unlock(&azone->zaz_mutex);
+
+    if ( (req.zar_ret > 0) && lba ) {
+        *lba = req.zar_lba;
+    }
+
+    return( req.zar_ret );
+
+}
+
+/**
+ * zbc_write_combining_enable - Enable write-combining of zone appends
+ * @dev:                (IN) ZBC device handle
+ * @timeout:            (IN) Maximum time in milliseconds data stays buffered (0 for no limit)
+ *
+ * Staged write errors are latched per zone until reported by zbc_flush(),
+ * zbc_write_combining_disable() or zbc_close().
+ *
+ * Returns -ENOMEM if memory could not be allocated.
+ */
+int
+zbc_write_combining_enable(zbc_device_t *dev,
+                           unsigned int timeout)
+{
+    zbc_append_t *za;
+    int ret;
+
+    if ( ! dev ) {
+        return( -EFAULT );
+    }
+
+    ret = zbc_append_get(dev, &za);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    /* Restart from a clean state if already enabled */
+    zbc_append_wc_stop(za);
+
+    za->za_wc_max_count = dev->zbd_info.zbd_max_rw_logical_blocks;
+    za->za_wc_timeout = timeout;
+    za->za_wc_enabled = 1;
+
+    if ( timeout ) {
+        ret = pthread_create(&za->za_wc_thread, NULL, zbc_append_wc_flusher, dev);
+        if ( ret != 0 ) {
+            zbc_error("Create write-combining flusher thread failed %d (%s)\n",
+                      ret,
+                      strerror(ret));
+            zbc_write_combining_disable(dev);
+            return( -ret );
+        }
+        za->za_wc_thread_started = 1;
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_write_combining_disable - Disable write-combining of zone appends
+ * @dev:                (IN) ZBC device handle
+ *
+ * Returns the first error of buffered data writes not yet reported.
+ */
+int
+zbc_write_combining_disable(zbc_device_t *dev)
+{
+    zbc_append_t *za = dev->zbd_append;
+    int ret;
+
+    if ( (! za) || (! za->za_wc_enabled) ) {
+        return( 0 );
+    }
+
+    zbc_append_wc_stop(za);
+    ret = zbc_append_wc_sync(dev, (uint64_t)-1, 0);
+    za->za_wc_enabled = 0;
+
+    return( ret );
+
+}
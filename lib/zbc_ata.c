@@ -29,16 +29,6 @@
 
 /***** Macro definitions *****/
 
-/**
- * Number of bytes in a Zone Descriptor.
- */
-#define ZBC_ZONE_DESCRIPTOR_LENGTH		64
-
-/**
- * Number of bytes in the buffer before the first Zone Descriptor.
- */
-#define ZBC_ZONE_DESCRIPTOR_OFFSET		64
-
 /**
  * ATA commands.
  */
@@ -49,6 +39,8 @@
 #define ZBC_ATA_REQUEST_SENSE_DATA_EXT          0x0B
 #define ZBC_ATA_READ_DMA_EXT			0x25
 #define ZBC_ATA_WRITE_DMA_EXT			0x35
+#define ZBC_ATA_READ_FPDMA_QUEUED		0x60
+#define ZBC_ATA_WRITE_FPDMA_QUEUED		0x61
 #define ZBC_ATA_FLUSH_CACHE_EXT			0xEA
 #define ZBC_ATA_ZAC_MANAGEMENT_IN               0x4A
 #define ZBC_ATA_ZAC_MANAGEMENT_OUT              0x9F
@@ -107,6 +99,16 @@
  */
 #define ZBC_ATA_SCSI_RW                         0x00000001
 
+/**
+ * This device flag indicates that ATA read/write commands are sent as
+ * READ FPDMA QUEUED and WRITE FPDMA QUEUED (NCQ) commands, which the disk
+ * can execute in any order. The tag field of the commands is left to 0
+ * and the SAT layer assigns the command tag. The flag is cleared if the
+ * SAT layer rejects FPDMA commands (see zbc_ata_ncq_rejected()), and READ
+ * DMA EXT and WRITE DMA EXT commands are used from then on.
+ */
+#define ZBC_ATA_NCQ                             0x00000002
+
 /***** Definition of private functions *****/
 
 /**
@@ -162,7 +164,7 @@ zbc_ata_read_log(zbc_device_t *dev,
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, buf, bufsz);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, buf, bufsz);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -246,7 +248,7 @@ zbc_ata_classify(zbc_device_t *dev)
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -372,7 +374,7 @@ zbc_ata_set_features(zbc_device_t *dev,
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -476,7 +478,7 @@ zbc_ata_request_sense_data_ext(zbc_device_t *dev)
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -646,33 +648,56 @@ zbc_ata_get_zbd_info(zbc_device_t *dev)
 }
 
 /**
- * Read from a ZAC device using READ DMA EXT packed in an ATA PASSTHROUGH command.
+ * Test if a command is a queued (NCQ) command.
  */
-static int32_t
-zbc_ata_pread_ata(zbc_device_t *dev,
-                  zbc_zone_t *zone,
-                  void *buf,
-                  uint32_t lba_count,
-                  uint64_t lba_ofst)
+#define zbc_ata_cmd_ncq(cmd)                                    \
+    (((cmd)->code == ZBC_SG_ATA16)                              \
+     && (((cmd)->cdb[14] == ZBC_ATA_READ_FPDMA_QUEUED)          \
+         || ((cmd)->cdb[14] == ZBC_ATA_WRITE_FPDMA_QUEUED)))
+
+/**
+ * Test if a queued command failed because FPDMA commands are not
+ * supported by the SAT layer (e.g. SAS HBA). NCQ is then disabled
+ * and the command must be executed again without NCQ.
+ */
+static int
+zbc_ata_ncq_rejected(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd,
+                     int ret)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
-    uint64_t lba = zone->zbz_start + lba_ofst;
-    zbc_sg_cmd_t cmd;
-    int ret;
 
-    /* Check */
-    if ( lba_count > 65536 ) {
-	zbc_error("Read operation too large (limited to 65536 x 512 B sectors)\n");
-        return( -EINVAL );
+    if ( (ret != -EIO)
+         || (! zbc_ata_cmd_ncq(cmd))
+         || (dev->zbd_errno.sk != ZBC_E_ILLEGAL_REQUEST)
+         || (dev->zbd_errno.asc_ascq != ZBC_E_INVALID_FIELD_IN_CDB) ) {
+        return( 0 );
     }
 
-    /* Initialize the command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, buf, sz);
-    if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
-        return( ret );
+    zbc_debug("%s: FPDMA commands not supported, disabling NCQ\n",
+              dev->zbd_filename);
+
+    dev->zbd_flags &= ~ZBC_ATA_NCQ;
+    if ( dev->zbd_aio_qd ) {
+        dev->zbd_aio_qd = ZBC_SG_AIO_MAX_QD;
     }
 
+    return( 1 );
+
+}
+
+/**
+ * zbc_ata_rw_cdb - Build the ATA PASSTHROUGH (16) CDB of a read or write.
+ * READ FPDMA QUEUED or WRITE FPDMA QUEUED is used if @ncq is not 0,
+ * READ DMA EXT or WRITE DMA EXT otherwise.
+ */
+void
+zbc_ata_rw_cdb(uint8_t *cdb,
+               int write,
+               int ncq,
+               uint32_t lba_count,
+               uint64_t lba)
+{
+
     /* Fill command CDB:
      * +=============================================================================+
      * |  Bit|   7    |   6    |   5    |   4    |   3    |   2    |   1    |   0    |
@@ -711,25 +736,121 @@ zbc_ata_pread_ata(zbc_device_t *dev,
      * | 15  |                           Control                                     |
      * +=============================================================================+
      */
-    cmd.io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
-    cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
-    cmd.cdb[1] = (0x6 << 1) | 0x01;	/* DMA protocol, ext=1 */
-    cmd.cdb[2] = 0x0e;			/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
-    cmd.cdb[5] = (lba_count >> 8) & 0xff;
-    cmd.cdb[6] = lba_count & 0xff;
-    cmd.cdb[7] = (lba >> 24) & 0xff;
-    cmd.cdb[8] = lba & 0xff;
-    cmd.cdb[9] = (lba >> 32) & 0xff;
-    cmd.cdb[10] = (lba >> 8) & 0xff;
-    cmd.cdb[11] = (lba >> 40) & 0xff;
-    cmd.cdb[12] = (lba >> 16) & 0xff;
-    cmd.cdb[13] = 1 << 6;
-    cmd.cdb[14] = ZBC_ATA_READ_DMA_EXT;
+    memset(cdb, 0, ZBC_SG_ATA16_CDB_LENGTH);
+    cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+    if ( ncq ) {
+        /* Sector count in features. The tag field of count (7:3)
+         * is left to 0: the SAT layer assigns the command tag */
+        cdb[1] = (0xc << 1) | 0x01;	/* FPDMA protocol, ext=1 */
+        if ( ! write ) {
+            cdb[2] = 0x0d;		/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=01 */
+            cdb[14] = ZBC_ATA_READ_FPDMA_QUEUED;
+        } else {
+            cdb[2] = 0x05;		/* off_line=0, ck_cond=0, t_type=0, t_dir=0, byt_blk=1, t_length=01 */
+            cdb[14] = ZBC_ATA_WRITE_FPDMA_QUEUED;
+        }
+        cdb[3] = (lba_count >> 8) & 0xff;
+        cdb[4] = lba_count & 0xff;
+    } else {
+        cdb[1] = (0x6 << 1) | 0x01;	/* DMA protocol, ext=1 */
+        if ( ! write ) {
+            cdb[2] = 0x0e;		/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
+            cdb[14] = ZBC_ATA_READ_DMA_EXT;
+        } else {
+            cdb[2] = 0x06;		/* off_line=0, ck_cond=0, t_type=1, t_dir=0, byt_blk=1, t_length=10 */
+            cdb[14] = ZBC_ATA_WRITE_DMA_EXT;
+        }
+        cdb[5] = (lba_count >> 8) & 0xff;
+        cdb[6] = lba_count & 0xff;
+    }
+    cdb[7] = (lba >> 24) & 0xff;
+    cdb[8] = lba & 0xff;
+    cdb[9] = (lba >> 32) & 0xff;
+    cdb[10] = (lba >> 8) & 0xff;
+    cdb[11] = (lba >> 40) & 0xff;
+    cdb[12] = (lba >> 16) & 0xff;
+    cdb[13] = 1 << 6;
+
+    return;
+
+}
+
+/**
+ * Initialize a read or write command packed in an ATA PASSTHROUGH
+ * command, transferring data from or to a vector of @iovcnt buffers:
+ * READ FPDMA QUEUED or WRITE FPDMA QUEUED if NCQ is enabled, READ DMA
+ * EXT or WRITE DMA EXT otherwise.
+ */
+static int
+zbc_ata_rw_cmd_init(zbc_device_t *dev,
+                    zbc_sg_cmd_t *cmd,
+                    enum zbc_aio_op op,
+                    const struct iovec *iov,
+                    int iovcnt,
+                    uint32_t lba_count,
+                    uint64_t lba)
+{
+    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
+    int ret;
+
+    /* Check */
+    if ( lba_count > 65536 ) {
+	zbc_error("%s operation too large (limited to 65536 x 512 B sectors)\n",
+		  (op == ZBC_AIO_READ) ? "Read" : "Write");
+        return( -EINVAL );
+    }
+
+    /* Initialize the command */
+    ret = zbc_sg_cmd_init(dev, cmd, ZBC_SG_ATA16, iov[0].iov_base, sz);
+    if ( ret != 0 ) {
+        zbc_error("zbc_sg_cmd_init failed\n");
+        return( ret );
+    }
+    zbc_sg_cmd_set_class(dev, cmd, ZBC_CMD_CLASS_IO);
+    zbc_sg_cmd_set_iov(cmd, iov, iovcnt);
+    zbc_sg_cmd_set_direct_io(dev, cmd, iov, iovcnt);
+
+    zbc_ata_rw_cdb(cmd->cdb, op == ZBC_AIO_WRITE, dev->zbd_flags & ZBC_ATA_NCQ, lba_count, lba);
+    cmd->io_hdr.dxfer_direction = (op == ZBC_AIO_READ) ? SG_DXFER_FROM_DEV : SG_DXFER_TO_DEV;
+
+    return( 0 );
+
+}
+
+/**
+ * Read or write a ZAC device using an ATA read or write command packed
+ * in an ATA PASSTHROUGH command (see zbc_ata_rw_cmd_init()). If the SAT
+ * layer rejects the queued command, NCQ is disabled and the command is
+ * executed again with READ DMA EXT or WRITE DMA EXT.
+ */
+static int32_t
+zbc_ata_rw_ata(zbc_device_t *dev,
+               enum zbc_aio_op op,
+               zbc_zone_t *zone,
+               const struct iovec *iov,
+               int iovcnt,
+               uint32_t lba_count,
+               uint64_t lba_ofst)
+{
+    zbc_sg_cmd_t cmd;
+    int ret;
+
+again:
+
+    /* Initialize the command */
+    ret = zbc_ata_rw_cmd_init(dev, &cmd, op, iov, iovcnt, lba_count, zone->zbz_start + lba_ofst);
+    if ( ret != 0 ) {
+        return( ret );
+    }
 
     /* Execute the command */
     ret = zbc_sg_cmd_exec(dev, &cmd);
+    if ( zbc_ata_ncq_rejected(dev, &cmd, ret) ) {
+        zbc_sg_cmd_destroy(&cmd);
+        goto again;
+    }
     if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
+        ret = cmd.out_bufsz / dev->zbd_info.zbd_logical_block_size;
     } else {
         /* Request sense data */
         if ( ret == -EIO ) {
@@ -747,36 +868,32 @@ zbc_ata_pread_ata(zbc_device_t *dev,
 }
 
 /**
- * Read from a ZAC device using native SCSI command.
+ * Read or write a ZAC device using native SCSI commands.
  */
 static int32_t
-zbc_ata_pread_scsi(zbc_device_t *dev,
-                   zbc_zone_t *zone,
-                   void *buf,
-                   uint32_t lba_count,
-                   uint64_t lba_ofst)
+zbc_ata_rw_scsi(zbc_device_t *dev,
+                enum zbc_aio_op op,
+                zbc_zone_t *zone,
+                const struct iovec *iov,
+                int iovcnt,
+                uint32_t lba_count,
+                uint64_t lba_ofst)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
     zbc_sg_cmd_t cmd;
     int ret;
 
-    /* READ 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_READ, buf, sz);
+    /* READ 16 or WRITE 16 */
+    ret = zbc_sg_cmd_rw_init(dev, &cmd,
+                             (op == ZBC_AIO_READ) ? ZBC_SG_READ : ZBC_SG_WRITE,
+                             iov, iovcnt, lba_count, zone->zbz_start + lba_ofst);
     if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
 
-    /* Fill command CDB */
-    cmd.cdb[0] = ZBC_SG_READ_CDB_OPCODE;
-    cmd.cdb[1] = 0x10;
-    zbc_sg_cmd_set_int64(&cmd.cdb[2], (zone->zbz_start + lba_ofst));
-    zbc_sg_cmd_set_int32(&cmd.cdb[10], lba_count);
-
     /* Send the command */
     ret = zbc_sg_cmd_exec(dev, &cmd);
     if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
+        ret = cmd.out_bufsz / dev->zbd_info.zbd_logical_block_size;
     }
 
     /* Done */
@@ -787,22 +904,24 @@ zbc_ata_pread_scsi(zbc_device_t *dev,
 }
 
 /**
- * Read from a ZAC device.
+ * Read or write a ZAC device.
  */
 static int32_t
-zbc_ata_pread(zbc_device_t *dev,
-              zbc_zone_t *zone,
-              void *buf,
-              uint32_t lba_count,
-              uint64_t lba_ofst)
+zbc_ata_rw(zbc_device_t *dev,
+           enum zbc_aio_op op,
+           zbc_zone_t *zone,
+           const struct iovec *iov,
+           int iovcnt,
+           uint32_t lba_count,
+           uint64_t lba_ofst)
 {
     int ret;
 
     /* ATA command or native SCSI command ? */
     if ( dev->zbd_flags & ZBC_ATA_SCSI_RW ) {
-        ret = zbc_ata_pread_scsi(dev, zone, buf, lba_count, lba_ofst);
+        ret = zbc_ata_rw_scsi(dev, op, zone, iov, iovcnt, lba_count, lba_ofst);
     } else {
-        ret = zbc_ata_pread_ata(dev, zone, buf, lba_count, lba_ofst);
+        ret = zbc_ata_rw_ata(dev, op, zone, iov, iovcnt, lba_count, lba_ofst);
     }
 
     return( ret );
@@ -810,146 +929,109 @@ zbc_ata_pread(zbc_device_t *dev,
 }
 
 /**
- * Write to a ZAC device using WRITE DMA EXT packed in an ATA PASSTHROUGH command.
+ * Vectored read from a ZAC device.
  */
 static int32_t
-zbc_ata_pwrite_ata(zbc_device_t *dev,
-                   zbc_zone_t *zone,
-                   const void *buf,
-                   uint32_t lba_count,
-                   uint64_t lba_ofst)
+zbc_ata_preadv(zbc_device_t *dev,
+               zbc_zone_t *zone,
+               const struct iovec *iov,
+               int iovcnt,
+               uint32_t lba_count,
+               uint64_t lba_ofst)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
-    uint64_t lba = zone->zbz_start + lba_ofst;
-    zbc_sg_cmd_t cmd;
-    int ret;
-
-    /* Check */
-    if ( lba_count > 65536 ) {
-	zbc_error("Write operation too large (limited to 65536 x 512 B sectors)\n");
-        return( -EINVAL );
-    }
-
-    /* Initialize the command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, (uint8_t *)buf, sz);
-    if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
-        return( ret );
-    }
 
-    /* Fill command CDB:
-     * +=============================================================================+
-     * |  Bit|   7    |   6    |   5    |   4    |   3    |   2    |   1    |   0    |
-     * |Byte |        |        |        |        |        |        |        |        |
-     * |=====+==========================+============================================|
-     * | 0   |                           Operation Code (85h)                        |
-     * |-----+-----------------------------------------------------------------------|
-     * | 1   |      Multiple count      |              Protocol             |  ext   |
-     * |-----+-----------------------------------------------------------------------|
-     * | 2   |    off_line     |ck_cond | t_type | t_dir  |byt_blk |    t_length     |
-     * |-----+-----------------------------------------------------------------------|
-     * | 3   |                          features (15:8)                              |
-     * |-----+-----------------------------------------------------------------------|
-     * | 4   |                          features (7:0)                               |
-     * |-----+-----------------------------------------------------------------------|
-     * | 5   |                           count (15:8)                                |
-     * |-----+-----------------------------------------------------------------------|
-     * | 6   |                           count (7:0)                                 |
-     * |-----+-----------------------------------------------------------------------|
-     * | 7   |                           LBA (31:24)                                 |
-     * |-----+-----------------------------------------------------------------------|
-     * | 8   |                            LBA (7:0)                                  |
-     * |-----+-----------------------------------------------------------------------|
-     * | 9   |                           LBA (39:32)                                 |
-     * |-----+-----------------------------------------------------------------------|
-     * | 10  |                           LBA (15:8)                                  |
-     * |-----+-----------------------------------------------------------------------|
-     * | 11  |                           LBA (47:40)                                 |
-     * |-----+-----------------------------------------------------------------------|
-     * | 12  |                           LBA (23:16)                                 |
-     * |-----+-----------------------------------------------------------------------|
-     * | 13  |                             Device                                    |
-     * |-----+-----------------------------------------------------------------------|
-     * | 14  |                             Command                                   |
-     * |-----+-----------------------------------------------------------------------|
-     * | 15  |                             Control                                   |
-     * +=============================================================================+
-     */
-    cmd.io_hdr.dxfer_direction = SG_DXFER_TO_DEV;
-    cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
-    cmd.cdb[1] = (0x6 << 1) | 0x01;	/* DMA protocol, ext=1 */
-    cmd.cdb[2] = 0x06;			/* off_line=0, ck_cond=0, t_type=1, t_dir=0, byt_blk=1, t_length=10 */
-    cmd.cdb[5] = (lba_count >> 8) & 0xff;
-    cmd.cdb[6] = lba_count & 0xff;
-    cmd.cdb[7] = (lba >> 24) & 0xff;
-    cmd.cdb[8] = lba & 0xff;
-    cmd.cdb[9] = (lba >> 32) & 0xff;
-    cmd.cdb[10] = (lba >> 8) & 0xff;
-    cmd.cdb[11] = (lba >> 40) & 0xff;
-    cmd.cdb[12] = (lba >> 16) & 0xff;
-    cmd.cdb[13] = 1 << 6;
-    cmd.cdb[14] = ZBC_ATA_WRITE_DMA_EXT;
+    return( zbc_ata_rw(dev, ZBC_AIO_READ, zone, iov, iovcnt, lba_count, lba_ofst) );
 
-    /* Execute the command */
-    ret = zbc_sg_cmd_exec(dev, &cmd);
-    if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
-    } else {
-        /* Request sense data */
-        if ( ret == -EIO ) {
-            if ( zbc_ata_sense_data_enabled(&cmd) ) {
-                zbc_ata_request_sense_data_ext(dev);
-            }
-        }
-    }
+}
 
-    /* Done */
-    zbc_sg_cmd_destroy(&cmd);
+/**
+ * Read from a ZAC device.
+ */
+static int32_t
+zbc_ata_pread(zbc_device_t *dev,
+              zbc_zone_t *zone,
+              void *buf,
+              uint32_t lba_count,
+              uint64_t lba_ofst)
+{
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
 
-    return( ret );
+    return( zbc_ata_rw(dev, ZBC_AIO_READ, zone, &iov, 1, lba_count, lba_ofst) );
 
 }
 
 /**
- * Write to a ZAC device using native SCSI commands.
+ * Read from a ZAC device into the memory mapped reserved buffer of its SG node.
  */
 static int32_t
-zbc_ata_pwrite_scsi(zbc_device_t *dev,
-                    zbc_zone_t *zone,
-                    const void *buf,
-                    uint32_t lba_count,
-                    uint64_t lba_ofst)
+zbc_ata_pread_borrow(zbc_device_t *dev,
+                     zbc_zone_t *zone,
+                     const void **buf,
+                     uint32_t lba_count,
+                     uint64_t lba_ofst)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
+    uint64_t lba = zone->zbz_start + lba_ofst;
+    struct iovec iov;
     zbc_sg_cmd_t cmd;
     int ret;
 
-    /* WRITE 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_WRITE, (uint8_t *)buf, sz);
+    ret = zbc_sg_mmap_iov(dev, (size_t) lba_count * dev->zbd_info.zbd_logical_block_size, &iov);
     if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
 
-    /* Fill command CDB */
-    cmd.cdb[0] = ZBC_SG_WRITE_CDB_OPCODE;
-    cmd.cdb[1] = 0x10;
-    zbc_sg_cmd_set_int64(&cmd.cdb[2], (zone->zbz_start + lba_ofst));
-    zbc_sg_cmd_set_int32(&cmd.cdb[10], lba_count);
+again:
 
-    /* Send the command */
-    ret = zbc_sg_cmd_exec(dev, &cmd);
+    /* ATA command or native SCSI command ? */
+    if ( dev->zbd_flags & ZBC_ATA_SCSI_RW ) {
+        ret = zbc_sg_cmd_rw_init(dev, &cmd, ZBC_SG_READ, &iov, 1, lba_count, lba);
+    } else {
+        ret = zbc_ata_rw_cmd_init(dev, &cmd, ZBC_AIO_READ, &iov, 1, lba_count, lba);
+    }
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    ret = zbc_sg_cmd_exec_mmap(dev, &cmd);
+    if ( zbc_ata_ncq_rejected(dev, &cmd, ret) ) {
+        zbc_sg_cmd_destroy(&cmd);
+        goto again;
+    }
     if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
+        *buf = iov.iov_base;
+        ret = cmd.out_bufsz / dev->zbd_info.zbd_logical_block_size;
+    } else if ( (ret == -EIO)
+                && (cmd.code == ZBC_SG_ATA16)
+                && zbc_ata_sense_data_enabled(&cmd) ) {
+        /* Request sense data */
+        zbc_ata_request_sense_data_ext(dev);
     }
 
-    /* Done */
     zbc_sg_cmd_destroy(&cmd);
 
     return( ret );
 
 }
 
+/**
+ * Vectored write to a ZAC device.
+ */
+static int32_t
+zbc_ata_pwritev(zbc_device_t *dev,
+                zbc_zone_t *zone,
+                const struct iovec *iov,
+                int iovcnt,
+                uint32_t lba_count,
+                uint64_t lba_ofst)
+{
+
+    return( zbc_ata_rw(dev, ZBC_AIO_WRITE, zone, iov, iovcnt, lba_count, lba_ofst) );
+
+}
+
 /**
  * Write to a ZAC device.
  */
@@ -960,19 +1042,140 @@ zbc_ata_pwrite(zbc_device_t *dev,
                uint32_t lba_count,
                uint64_t lba_ofst)
 {
+    struct iovec iov = {
+        .iov_base = (void *) buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
+
+    return( zbc_ata_rw(dev, ZBC_AIO_WRITE, zone, &iov, 1, lba_count, lba_ofst) );
+
+}
+
+/**
+ * Initialize the command of an asynchronous read or write.
+ */
+static int
+zbc_ata_aio_cmd_init(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd,
+                     zbc_aio_t *aio)
+{
+    uint64_t lba = aio->zba_zone->zbz_start + aio->zba_lba_ofst;
+    struct iovec iov = {
+        .iov_base = aio->zba_buf,
+        .iov_len = (size_t) aio->zba_lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
     int ret;
 
     /* ATA command or native SCSI command ? */
     if ( dev->zbd_flags & ZBC_ATA_SCSI_RW ) {
-        ret = zbc_ata_pwrite_scsi(dev, zone, buf, lba_count, lba_ofst);
+        ret = zbc_sg_cmd_rw_init(dev, cmd,
+                                 (aio->zba_op == ZBC_AIO_READ) ? ZBC_SG_READ : ZBC_SG_WRITE,
+                                 &iov, 1, aio->zba_lba_count, lba);
     } else {
-        ret = zbc_ata_pwrite_ata(dev, zone, buf, lba_count, lba_ofst);
+        ret = zbc_ata_rw_cmd_init(dev, cmd, aio->zba_op,
+                                  &iov, 1, aio->zba_lba_count, lba);
+    }
+    if ( ret == 0 ) {
+        cmd->aio = aio;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Submit an asynchronous read or write.
+ */
+static int
+zbc_ata_aio_submit(zbc_device_t *dev,
+                   zbc_aio_t *aio)
+{
+    zbc_sg_cmd_t *cmd;
+    int ret;
+
+    cmd = zbc_sg_cmd_alloc(dev);
+    if ( ! cmd ) {
+        return( -ENOMEM );
+    }
+
+    ret = zbc_ata_aio_cmd_init(dev, cmd, aio);
+    if ( ret != 0 ) {
+        goto out;
+    }
+
+    /* Queue the command */
+    ret = zbc_sg_cmd_submit(dev, cmd);
+    if ( ret != 0 ) {
+        zbc_sg_cmd_destroy(cmd);
+    }
+
+out:
+
+    if ( ret != 0 ) {
+        zbc_sg_cmd_free(dev, cmd);
     }
 
     return( ret );
 
 }
 
+/**
+ * Get a completed asynchronous read or write.
+ */
+static int
+zbc_ata_aio_reap(zbc_device_t *dev,
+                 int timeout,
+                 zbc_aio_t **paio)
+{
+    zbc_sg_cmd_t *cmd;
+    zbc_aio_t *aio;
+    int ret;
+
+again:
+
+    ret = zbc_sg_cmd_reap(dev, timeout, &cmd);
+    if ( ! cmd ) {
+        return( ret );
+    }
+
+    if ( zbc_ata_ncq_rejected(dev, cmd, ret) ) {
+        /* Execute the command again without NCQ */
+        aio = cmd->aio;
+        zbc_sg_cmd_destroy(cmd);
+        ret = zbc_ata_aio_cmd_init(dev, cmd, aio);
+        if ( ret == 0 ) {
+            ret = zbc_sg_cmd_submit(dev, cmd);
+            if ( ret == 0 ) {
+                goto again;
+            }
+            zbc_sg_cmd_destroy(cmd);
+        }
+        aio->zba_ret = ret;
+        *paio = aio;
+        zbc_sg_cmd_free(dev, cmd);
+        return( 0 );
+    }
+
+    if ( ret == 0 ) {
+        cmd->aio->zba_ret = cmd->out_bufsz / dev->zbd_info.zbd_logical_block_size;
+    } else {
+        /* Request sense data */
+        if ( (ret == -EIO)
+             && (cmd->code == ZBC_SG_ATA16)
+             && zbc_ata_sense_data_enabled(cmd) ) {
+            zbc_ata_request_sense_data_ext(dev);
+        }
+        cmd->aio->zba_ret = ret;
+    }
+    *paio = cmd->aio;
+
+    zbc_sg_cmd_destroy(cmd);
+    zbc_sg_cmd_free(dev, cmd);
+
+    return( 0 );
+
+}
+
 /**
  * Flush a ZAC device cache.
  */
@@ -986,11 +1189,12 @@ zbc_ata_flush(zbc_device_t *dev,
     int ret;
 
     /* Initialize the command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, &cmd, ZBC_CMD_CLASS_FLUSH);
 
     /* Fill command CDB */
     cmd.io_hdr.dxfer_direction = SG_DXFER_NONE;
@@ -1020,7 +1224,7 @@ zbc_ata_report_zones(zbc_device_t *dev,
 		     unsigned int *nr_zones)
 {
     size_t bufsz = ZBC_ZONE_DESCRIPTOR_OFFSET;
-    unsigned int i, nz, buf_nz;
+    unsigned int nz, buf_nz;
     size_t max_bufsz;
     zbc_sg_cmd_t cmd;
     uint8_t *buf;
@@ -1037,11 +1241,12 @@ zbc_ata_report_zones(zbc_device_t *dev,
     }
 
     /* Allocate and intialize report zones command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, bufsz);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, bufsz);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, &cmd, ZBC_CMD_CLASS_REPORT);
 
     /* Fill command CDB:
      * +=============================================================================+
@@ -1140,19 +1345,7 @@ zbc_ata_report_zones(zbc_device_t *dev,
         }
 
         /* Get zone descriptors */
-	buf += ZBC_ZONE_DESCRIPTOR_OFFSET;
-        for(i = 0; i < nz; i++) {
-
-            zones[i].zbz_type = buf[0] & 0x0f;
-            zones[i].zbz_condition = (buf[1] >> 4) & 0x0f;
-            zones[i].zbz_length = zbc_ata_get_qword(&buf[8]);
-            zones[i].zbz_start = zbc_ata_get_qword(&buf[16]);
-            zones[i].zbz_write_pointer = zbc_ata_get_qword(&buf[24]);
-            zones[i].zbz_flags = buf[1] & 0x03;
-
-            buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
-
-        }
+        zbc_sg_get_zones(buf + ZBC_ZONE_DESCRIPTOR_OFFSET, zones, nz, ZBC_SG_ZD_LE);
 
     }
 
@@ -1240,11 +1433,12 @@ zbc_ata_open_zone(zbc_device_t *dev,
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, &cmd, ZBC_CMD_CLASS_ZONE);
 
     /* Fill command CDB:
      * +=============================================================================+
@@ -1331,11 +1525,12 @@ zbc_ata_close_zone(zbc_device_t *dev,
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, &cmd, ZBC_CMD_CLASS_ZONE);
 
     /* Fill command CDB:
      * +=============================================================================+
@@ -1422,11 +1617,12 @@ zbc_ata_finish_zone(zbc_device_t *dev,
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, &cmd, ZBC_CMD_CLASS_ZONE);
 
     /* Fill command CDB:
      * +=============================================================================+
@@ -1503,21 +1699,22 @@ zbc_ata_finish_zone(zbc_device_t *dev,
 }
 
 /**
- * Reset zone(s) write pointer.
+ * Initialize a RESET WRITE POINTER EXT command.
  */
 static int
-zbc_ata_reset_write_pointer(zbc_device_t *dev,
-			    uint64_t start_lba)
+zbc_ata_reset_wp_cmd_init(zbc_device_t *dev,
+                          zbc_sg_cmd_t *cmd,
+                          uint64_t start_lba)
 {
-    zbc_sg_cmd_t cmd;
     int ret;
 
     /* Intialize command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_ATA16, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, cmd, ZBC_SG_ATA16, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
+    zbc_sg_cmd_set_class(dev, cmd, ZBC_CMD_CLASS_ZONE);
 
     /* Fill command CDB:
      * +=============================================================================+
@@ -1557,35 +1754,64 @@ zbc_ata_reset_write_pointer(zbc_device_t *dev,
      * | 15  |                           Control                                     |
      * +=============================================================================+
      */
-    cmd.io_hdr.dxfer_direction = SG_DXFER_NONE;
-    cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
-    cmd.cdb[1] = (0x3 << 1) | 0x01;	/* Non-Data protocol, ext=1 */
-    cmd.cdb[4] = ZBC_ATA_RESET_WRITE_POINTER_EXT_AF;
+    cmd->io_hdr.dxfer_direction = SG_DXFER_NONE;
+    cmd->cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+    cmd->cdb[1] = (0x3 << 1) | 0x01;	/* Non-Data protocol, ext=1 */
+    cmd->cdb[4] = ZBC_ATA_RESET_WRITE_POINTER_EXT_AF;
     if ( start_lba == (uint64_t)-1 ) {
         /* Reset all zones */
-        cmd.cdb[3] = 0x01;
+        cmd->cdb[3] = 0x01;
     } else {
         /* Reset only the zone at start_lba */
-	cmd.cdb[8] = start_lba & 0xff;
-	cmd.cdb[10] = (start_lba >> 8) & 0xff;
-	cmd.cdb[12] = (start_lba >> 16) & 0xff;
-	cmd.cdb[7] = (start_lba >> 24) & 0xff;
-	cmd.cdb[9] = (start_lba >> 32) & 0xff;
-	cmd.cdb[11] = (start_lba >> 40) & 0xff;
+	cmd->cdb[8] = start_lba & 0xff;
+	cmd->cdb[10] = (start_lba >> 8) & 0xff;
+	cmd->cdb[12] = (start_lba >> 16) & 0xff;
+	cmd->cdb[7] = (start_lba >> 24) & 0xff;
+	cmd->cdb[9] = (start_lba >> 32) & 0xff;
+	cmd->cdb[11] = (start_lba >> 40) & 0xff;
     }
-    cmd.cdb[13] = 1 << 6;
-    cmd.cdb[14] = ZBC_ATA_RESET_WRITE_POINTER_EXT_CMD;
+    cmd->cdb[13] = 1 << 6;
+    cmd->cdb[14] = ZBC_ATA_RESET_WRITE_POINTER_EXT_CMD;
 
-    /* Execute the command */
-    ret = zbc_sg_cmd_exec(dev, &cmd);
+    return( 0 );
 
-    /* Request sense data */
-    if ( ret == -EIO ) {
-        if ( zbc_ata_sense_data_enabled(&cmd) ) {
-            zbc_ata_request_sense_data_ext(dev);
-        }
+}
+
+/**
+ * Request sense data of a failed command.
+ */
+static int
+zbc_ata_cmd_done(zbc_device_t *dev,
+                 zbc_sg_cmd_t *cmd,
+                 int ret)
+{
+
+    if ( (ret == -EIO) && zbc_ata_sense_data_enabled(cmd) ) {
+        zbc_ata_request_sense_data_ext(dev);
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Reset zone(s) write pointer.
+ */
+static int
+zbc_ata_reset_write_pointer(zbc_device_t *dev,
+			    uint64_t start_lba)
+{
+    zbc_sg_cmd_t cmd;
+    int ret;
+
+    ret = zbc_ata_reset_wp_cmd_init(dev, &cmd, start_lba);
+    if ( ret != 0 ) {
+        return( ret );
     }
 
+    /* Execute the command */
+    ret = zbc_ata_cmd_done(dev, &cmd, zbc_sg_cmd_exec(dev, &cmd));
+
     /* Done */
     zbc_sg_cmd_destroy(&cmd);
 
@@ -1593,6 +1819,99 @@ zbc_ata_reset_write_pointer(zbc_device_t *dev,
 
 }
 
+/**
+ * Initialize the reset write pointer command of the @idx zone of a list.
+ */
+static int
+zbc_ata_reset_zones_init(zbc_device_t *dev,
+                         zbc_sg_cmd_t *cmd,
+                         unsigned int idx,
+                         void *arg)
+{
+
+    return( zbc_ata_reset_wp_cmd_init(dev, cmd, ((const uint64_t *)arg)[idx]) );
+
+}
+
+/**
+ * Reset the write pointer of a list of zones.
+ */
+static int
+zbc_ata_reset_zones(zbc_device_t *dev,
+                    const uint64_t *start_lbas,
+                    unsigned int nr_zones)
+{
+
+    return( zbc_sg_cmd_exec_pipelined(dev, nr_zones,
+                                      zbc_ata_reset_zones_init, zbc_ata_cmd_done,
+                                      (void *) start_lbas) );
+
+}
+
+/**
+ * Enable NCQ if the disk supports it (IDENTIFY DEVICE word 76 bit 8),
+ * with the queue depth of the disk (word 75 bits 4:0, plus one).
+ */
+static void
+zbc_ata_ncq_init(zbc_device_t *dev)
+{
+    unsigned int depth;
+    uint16_t w75, w76;
+    zbc_sg_cmd_t cmd;
+    int ret;
+
+    /* Intialize command */
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_ATA16, NULL, 512);
+    if ( ret != 0 ) {
+        zbc_error("zbc_sg_cmd_init failed\n");
+        return;
+    }
+
+    /* Fill command CDB (see zbc_ata_read_log) */
+    cmd.io_hdr.dxfer_direction = SG_DXFER_FROM_DEV;
+    cmd.cdb[0] = ZBC_SG_ATA16_CDB_OPCODE;
+    cmd.cdb[1] = 0x4 << 1;		/* PIO Data-In protocol */
+    cmd.cdb[2] = 0x0e;			/* off_line=0, ck_cond=0, t_type=0, t_dir=1, byt_blk=1, t_length=10 */
+    cmd.cdb[6] = 1;
+    cmd.cdb[14] = ZBC_ATA_IDENTIFY;
+
+    /* Execute the command */
+    ret = zbc_sg_cmd_exec(dev, &cmd);
+    if ( ret != 0 ) {
+        zbc_debug("%s: IDENTIFY DEVICE failed %d, NCQ disabled\n",
+                  dev->zbd_filename,
+                  ret);
+        goto out;
+    }
+
+    w75 = zbc_ata_get_word(&cmd.out_buf[75 * 2]);
+    w76 = zbc_ata_get_word(&cmd.out_buf[76 * 2]);
+    if ( (w76 == 0x0000) || (w76 == 0xffff) || (! (w76 & (1 << 8))) ) {
+        zbc_debug("%s: NCQ not supported\n",
+                  dev->zbd_filename);
+        goto out;
+    }
+
+    depth = (w75 & 0x1f) + 1;
+    if ( depth < 2 ) {
+        goto out;
+    }
+
+    dev->zbd_sg_pool->ncq_depth = depth;
+    dev->zbd_flags |= ZBC_ATA_NCQ;
+
+    zbc_debug("%s: Using NCQ R/W commands, queue depth %u\n",
+              dev->zbd_filename,
+              depth);
+
+out:
+
+    zbc_sg_cmd_destroy(&cmd);
+
+    return;
+
+}
+
 /**
  * If the disk is connected to a SAS HBA, test if command translation is
  * working properly with HM disks (as those do not have a standard device
@@ -1605,6 +1924,7 @@ static int
 zbc_ata_scsi_rw(zbc_device_t *dev)
 {
     unsigned int nr_zones = 1;
+    struct iovec iov;
     zbc_zone_t zone;
     void *buf;
     int ret;
@@ -1661,7 +1981,9 @@ zbc_ata_scsi_rw(zbc_device_t *dev)
     }
 
     /* Test SCSI command */
-    ret = zbc_ata_pread_scsi(dev, &zone, buf, 1, 0);
+    iov.iov_base = buf;
+    iov.iov_len = dev->zbd_info.zbd_logical_block_size;
+    ret = zbc_ata_rw_scsi(dev, ZBC_AIO_READ, &zone, &iov, 1, 1, 0);
     if ( ret > 0 ) {
         ret = 1;
     } else {
@@ -1726,17 +2048,25 @@ zbc_ata_open(const char *filename,
         goto out_free_dev;
     }
 
+    zbc_sg_set_interface(dev);
+
     ret = zbc_ata_get_info(dev);
     if ( ret ) {
         goto out_free_filename;
     }
 
+    /* Preallocate command descriptors and buffers */
+    ret = zbc_sg_pool_init(dev, flags);
+    if ( ret ) {
+        goto out_free_filename;
+    }
+
     /* Set sense data reporting */
     ret = zbc_ata_enable_sense_data(dev);
     if ( ret ) {
 	zbc_error("%s: Enable sense data reporting failed\n",
                   filename);
-        goto out_free_filename;
+        goto out_free_pool;
     }
 
     /* Test if the disk accepts native SCSI read/write commands */
@@ -1749,6 +2079,17 @@ zbc_ata_open(const char *filename,
 	zbc_debug("%s: Using ATA R/W commands\n",
 		  filename);
 	dev->zbd_flags &= ~ZBC_ATA_SCSI_RW;
+	zbc_ata_ncq_init(dev);
+    }
+
+    /* Commands can be queued only through the SG node (not bsg) */
+    if ( S_ISCHR(st.st_mode) && (! (dev->zbd_flags & ZBC_SG_BSG)) ) {
+        dev->zbd_aio_qd = ZBC_SG_AIO_MAX_QD;
+        if ( (dev->zbd_flags & ZBC_ATA_NCQ)
+             && (dev->zbd_sg_pool->ncq_depth < dev->zbd_aio_qd) ) {
+            /* No more commands than the disk can queue */
+            dev->zbd_aio_qd = dev->zbd_sg_pool->ncq_depth;
+        }
     }
 
     *pdev = dev;
@@ -1758,6 +2099,10 @@ zbc_ata_open(const char *filename,
 
     return( 0 );
 
+out_free_pool:
+
+    zbc_sg_pool_free(dev);
+
 out_free_filename:
 
     free(dev->zbd_filename);
@@ -1788,6 +2133,7 @@ zbc_ata_close(zbc_device_t *dev)
         return( -errno );
     }
 
+    zbc_sg_pool_free(dev);
     free(dev->zbd_filename);
     free(dev);
 
@@ -1804,11 +2150,17 @@ zbc_ops_t zbc_ata_ops =
     .zbd_close        = zbc_ata_close,
     .zbd_pread        = zbc_ata_pread,
     .zbd_pwrite       = zbc_ata_pwrite,
+    .zbd_preadv       = zbc_ata_preadv,
+    .zbd_pwritev      = zbc_ata_pwritev,
+    .zbd_pread_borrow = zbc_ata_pread_borrow,
     .zbd_flush        = zbc_ata_flush,
     .zbd_report_zones = zbc_ata_report_zones,
     .zbd_open_zone    = zbc_ata_open_zone,
     .zbd_close_zone   = zbc_ata_close_zone,
     .zbd_finish_zone  = zbc_ata_finish_zone,
     .zbd_reset_wp     = zbc_ata_reset_write_pointer,
+    .zbd_reset_zones  = zbc_ata_reset_zones,
+    .zbd_aio_submit   = zbc_ata_aio_submit,
+    .zbd_aio_reap     = zbc_ata_aio_reap,
 };
 
@@ -28,9 +28,42 @@
 
 #include "zbc.h"
 #include "zbc_sg.h"
+#include "zbc_uring.h"
 
 /***** Macro and types definitions *****/
 
+#ifdef HAVE_LINUX_IO_URING_H
+
+/**
+ * Asynchronous I/O request.
+ */
+typedef struct zbc_block_req {
+
+    zbc_aio_t                   *aio;
+    struct iovec                iov;
+
+    struct zbc_block_req        *next;
+
+} zbc_block_req_t;
+
+/**
+ * Sequential zone with a write in flight: writes to the
+ * same zone are queued and issued one at a time so that
+ * they reach the device in write pointer order.
+ */
+typedef struct zbc_block_zone_wq {
+
+    uint64_t                    start_lba;
+
+    zbc_block_req_t             *head;
+    zbc_block_req_t             *tail;
+
+    struct zbc_block_zone_wq    *next;
+
+} zbc_block_zone_wq_t;
+
+#endif
+
 /**
  * Block device descriptor data.
  */
@@ -40,6 +73,35 @@ typedef struct zbc_block_device {
 
     unsigned int        zone_sectors;
 
+#ifdef HAVE_LINUX_IO_URING_H
+
+    /**
+     * io_uring instance (NULL if not supported). The ring, the registered
+     * buffers, the zone write queues and the failed requests are shared
+     * by all threads using the device and protected by @ring_mutex.
+     */
+    zbc_uring_t         *ring;
+    int                 fixed_file;
+    pthread_mutex_t     ring_mutex;
+
+    /**
+     * Registered (fixed) buffers.
+     */
+    struct iovec        *bufs;
+    unsigned int        nr_bufs;
+
+    /**
+     * Sequential zones with a write in flight.
+     */
+    zbc_block_zone_wq_t *zone_wq;
+
+    /**
+     * Requests that failed before reaching the device.
+     */
+    zbc_block_req_t     *failed;
+
+#endif
+
 } zbc_block_device_t;
 
 /***** Definition of private functions *****/
@@ -323,6 +385,239 @@ zbc_block_set_info(struct zbc_device *dev)
 
 }
 
+#ifdef HAVE_LINUX_IO_URING_H
+
+/**
+ * Setup the io_uring data path. Failures are not fatal: I/Os
+ * are then executed synchronously.
+ */
+static void
+zbc_block_uring_init(struct zbc_device *dev)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    int ret;
+
+    bdev->ring = malloc(sizeof(zbc_uring_t));
+    if ( ! bdev->ring ) {
+        return;
+    }
+
+    ret = zbc_uring_init(bdev->ring, ZBC_AIO_MAX_QD);
+    if ( ret != 0 ) {
+        zbc_debug("%s: io_uring setup failed %d (%s)\n",
+                  dev->zbd_filename,
+                  -ret,
+                  strerror(-ret));
+        free(bdev->ring);
+        bdev->ring = NULL;
+        return;
+    }
+
+    /* Avoid the file reference lookup on each I/O */
+    bdev->fixed_file = (zbc_uring_register_file(bdev->ring, dev->zbd_fd) == 0);
+    pthread_mutex_init(&bdev->ring_mutex, NULL);
+
+    dev->zbd_aio_qd = ZBC_AIO_MAX_QD;
+
+    return;
+
+}
+
+/**
+ * Release the io_uring data path.
+ */
+static void
+zbc_block_uring_exit(struct zbc_device *dev)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+
+    if ( bdev->ring ) {
+        zbc_uring_exit(bdev->ring);
+        free(bdev->ring);
+        bdev->ring = NULL;
+        pthread_mutex_destroy(&bdev->ring_mutex);
+    }
+
+    free(bdev->bufs);
+    bdev->bufs = NULL;
+    bdev->nr_bufs = 0;
+
+    dev->zbd_aio_qd = 0;
+
+    return;
+
+}
+
+/**
+ * Get the index of the registered buffer containing a request buffer.
+ */
+static int
+zbc_block_fixed_buf(zbc_block_device_t *bdev,
+                    const struct iovec *iov)
+{
+    uint8_t *base = iov->iov_base, *buf;
+    unsigned int i;
+
+    for(i = 0; i < bdev->nr_bufs; i++) {
+        buf = bdev->bufs[i].iov_base;
+        if ( (base >= buf)
+             && ((base + iov->iov_len) <= (buf + bdev->bufs[i].iov_len)) ) {
+            return i;
+        }
+    }
+
+    return -1;
+
+}
+
+/**
+ * Prepare a request submission queue entry (ring mutex held). The entry
+ * is submitted on the next reap or when the queue is full, or right away
+ * if a thread is waiting for completions.
+ */
+static int
+zbc_block_uring_queue(struct zbc_device *dev,
+                      zbc_block_req_t *req)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    zbc_aio_t *aio = req->aio;
+    struct io_uring_sqe *sqe;
+    int idx, ret;
+
+    sqe = zbc_uring_get_sqe(bdev->ring);
+    if ( ! sqe ) {
+        ret = zbc_uring_submit(bdev->ring);
+        if ( ret != 0 ) {
+            return ret;
+        }
+        sqe = zbc_uring_get_sqe(bdev->ring);
+        if ( ! sqe ) {
+            return -EAGAIN;
+        }
+    }
+
+    idx = zbc_block_fixed_buf(bdev, &req->iov);
+    if ( idx >= 0 ) {
+        sqe->opcode = (aio->zba_op == ZBC_AIO_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->addr = (unsigned long) req->iov.iov_base;
+        sqe->len = req->iov.iov_len;
+        sqe->buf_index = idx;
+    } else {
+        sqe->opcode = (aio->zba_op == ZBC_AIO_READ) ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (unsigned long) &req->iov;
+        sqe->len = 1;
+    }
+
+    if ( bdev->fixed_file ) {
+        sqe->fd = 0;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = dev->zbd_fd;
+    }
+    sqe->off = (aio->zba_zone->zbz_start + aio->zba_lba_ofst) * dev->zbd_info.zbd_logical_block_size;
+    sqe->user_data = (unsigned long) req;
+
+    if ( dev->zbd_aio_reaping ) {
+        /* On failure, submitted again on the next reap */
+        zbc_uring_submit(bdev->ring);
+    }
+
+    return 0;
+
+}
+
+/**
+ * Get the write queue of a sequential zone with a write in flight.
+ */
+static zbc_block_zone_wq_t *
+zbc_block_zone_wq(zbc_block_device_t *bdev,
+                  uint64_t start_lba,
+                  zbc_block_zone_wq_t ***pprev)
+{
+    zbc_block_zone_wq_t **prev = &bdev->zone_wq, *wq;
+
+    while( (wq = *prev) ) {
+        if ( wq->start_lba == start_lba ) {
+            break;
+        }
+        prev = &wq->next;
+    }
+
+    if ( pprev ) {
+        *pprev = prev;
+    }
+
+    return wq;
+
+}
+
+/**
+ * Complete a request that could not be issued.
+ */
+static void
+zbc_block_req_fail(zbc_block_device_t *bdev,
+                   zbc_block_req_t *req,
+                   int ret)
+{
+    zbc_block_req_t **prev = &bdev->failed;
+
+    req->aio->zba_ret = ret;
+
+    /* Keep completion order */
+    while( *prev ) {
+        prev = &(*prev)->next;
+    }
+    req->next = NULL;
+    *prev = req;
+
+    return;
+
+}
+
+/**
+ * A write to a sequential zone completed: issue the next queued write.
+ */
+static void
+zbc_block_zone_wq_next(struct zbc_device *dev,
+                       uint64_t start_lba)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    zbc_block_zone_wq_t *wq, **prev;
+    zbc_block_req_t *req;
+    int ret;
+
+    wq = zbc_block_zone_wq(bdev, start_lba, &prev);
+    if ( ! wq ) {
+        return;
+    }
+
+    while( (req = wq->head) ) {
+
+        wq->head = req->next;
+        if ( ! wq->head ) {
+            wq->tail = NULL;
+        }
+        req->next = NULL;
+
+        ret = zbc_block_uring_queue(dev, req);
+        if ( ret == 0 ) {
+            return;
+        }
+
+        zbc_block_req_fail(bdev, req, ret);
+
+    }
+
+    /* Zone idle */
+    *prev = wq->next;
+    free(wq);
+
+    return;
+
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
 /**
  * Open a block device.
  */
@@ -370,6 +665,10 @@ zbc_block_open(const char *filename,
         goto out_free_filename;
     }
 
+#ifdef HAVE_LINUX_IO_URING_H
+    zbc_block_uring_init(dev);
+#endif
+
     *pdev = dev;
 
     zbc_debug("%s: ########## BLOCK driver succeeded ##########\n",
@@ -408,6 +707,10 @@ zbc_block_close(zbc_device_t *dev)
     zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
     int ret = 0;
 
+#ifdef HAVE_LINUX_IO_URING_H
+    zbc_block_uring_exit(dev);
+#endif
+
     /* Close device */
     if ( close(dev->zbd_fd) < 0 ) {
         ret = -errno;
@@ -514,6 +817,45 @@ zbc_block_reset_wp(struct zbc_device *dev,
 
 }
 
+/**
+ * Reset the write pointer of a sorted list of zones: zones
+ * with contiguous LBA ranges are reset with a single discard.
+ */
+static int
+zbc_block_reset_zones(struct zbc_device *dev,
+                      const uint64_t *start_lbas,
+                      unsigned int nr_zones)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    uint64_t zone_lbas = ((uint64_t)bdev->zone_sectors << 9) / dev->zbd_info.zbd_logical_block_size;
+    uint64_t range[2];
+    unsigned int i = 0, j;
+    int ret = 0;
+
+    while( i < nr_zones ) {
+
+        /* Get a range of contiguous zones */
+        for(j = i + 1; j < nr_zones; j++) {
+            if ( start_lbas[j] != (start_lbas[j - 1] + zone_lbas) ) {
+                break;
+            }
+        }
+
+        /* Discard */
+        range[0] = start_lbas[i] * dev->zbd_info.zbd_logical_block_size;
+        range[1] = (uint64_t)(j - i) * ((uint64_t)bdev->zone_sectors << 9);
+        if ( (ioctl(dev->zbd_fd, BLKDISCARD, &range) != 0) && (! ret) ) {
+            ret = -errno;
+        }
+
+        i = j;
+
+    }
+
+    return ret;
+
+}
+
 /**
  * Read from the block device.
  */
@@ -568,15 +910,300 @@ zbc_block_pwrite(struct zbc_device *dev,
 
 }
 
+/**
+ * Vectored read from the block device.
+ */
+static int32_t
+zbc_block_preadv(struct zbc_device *dev,
+		 zbc_zone_t *zone,
+		 const struct iovec *iov,
+		 int iovcnt,
+		 uint32_t lba_count,
+		 uint64_t lba_ofst)
+{
+    ssize_t ret;
+
+    /* Read */
+    ret = preadv(dev->zbd_fd,
+		 iov,
+		 iovcnt,
+		 (zone->zbz_start + lba_ofst) * dev->zbd_info.zbd_logical_block_size);
+    if ( ret < 0 ) {
+        ret = -errno;
+    } else {
+        ret /= dev->zbd_info.zbd_logical_block_size;
+    }
+
+    return ret;
+
+}
+
+/**
+ * Vectored write to the block device.
+ */
+static int32_t
+zbc_block_pwritev(struct zbc_device *dev,
+		  zbc_zone_t *zone,
+		  const struct iovec *iov,
+		  int iovcnt,
+		  uint32_t lba_count,
+		  uint64_t lba_ofst)
+{
+    ssize_t ret;
+
+    /* Write */
+    ret = pwritev(dev->zbd_fd,
+		  iov,
+		  iovcnt,
+		  (zone->zbz_start + lba_ofst) * dev->zbd_info.zbd_logical_block_size);
+    if ( ret < 0 ) {
+        ret = -errno;
+    } else {
+        ret /= dev->zbd_info.zbd_logical_block_size;
+    }
+
+    return ret;
+
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+/**
+ * Submit an asynchronous read or write.
+ */
+static int
+zbc_block_aio_submit(struct zbc_device *dev,
+                     zbc_aio_t *aio)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    zbc_block_zone_wq_t *wq = NULL;
+    zbc_block_req_t *req;
+    int ret;
+
+    if ( ! bdev->ring ) {
+        return -ENXIO;
+    }
+
+    req = calloc(1, sizeof(zbc_block_req_t));
+    if ( ! req ) {
+        return -ENOMEM;
+    }
+    req->aio = aio;
+    req->iov.iov_base = aio->zba_buf;
+    req->iov.iov_len = (size_t) aio->zba_lba_count * dev->zbd_info.zbd_logical_block_size;
+
+    pthread_mutex_lock(&bdev->ring_mutex);
+
+    if ( (aio->zba_op == ZBC_AIO_WRITE) && zbc_zone_sequential(aio->zba_zone) ) {
+
+        /* One write at a time per sequential zone */
+        wq = zbc_block_zone_wq(bdev, aio->zba_zone->zbz_start, NULL);
+        if ( wq ) {
+            if ( wq->tail ) {
+                wq->tail->next = req;
+            } else {
+                wq->head = req;
+            }
+            wq->tail = req;
+            ret = 0;
+            goto out;
+        }
+
+        wq = calloc(1, sizeof(zbc_block_zone_wq_t));
+        if ( ! wq ) {
+            free(req);
+            ret = -ENOMEM;
+            goto out;
+        }
+        wq->start_lba = aio->zba_zone->zbz_start;
+
+    }
+
+    ret = zbc_block_uring_queue(dev, req);
+    if ( ret != 0 ) {
+        free(wq);
+        free(req);
+        goto out;
+    }
+
+    if ( wq ) {
+        wq->next = bdev->zone_wq;
+        bdev->zone_wq = wq;
+    }
+
+out:
+
+    pthread_mutex_unlock(&bdev->ring_mutex);
+
+    return ret;
+
+}
+
+/**
+ * Get a completed asynchronous read or write. Called with the device
+ * asynchronous I/O mutex held, which is released with the ring mutex
+ * while waiting so that other threads can submit requests.
+ */
+static int
+zbc_block_aio_reap(struct zbc_device *dev,
+                   int timeout,
+                   zbc_aio_t **paio)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    struct io_uring_cqe *cqe;
+    zbc_block_req_t *req;
+    zbc_aio_t *aio;
+    int ret;
+
+    if ( ! bdev->ring ) {
+        return -ENXIO;
+    }
+
+    pthread_mutex_lock(&bdev->ring_mutex);
+
+    while( 1 ) {
+
+        req = bdev->failed;
+        if ( req ) {
+            bdev->failed = req->next;
+            goto out;
+        }
+
+        ret = zbc_uring_wait_cqe(bdev->ring, 0, &cqe);
+        if ( (ret != -EAGAIN) || (! timeout) ) {
+            break;
+        }
+
+        pthread_mutex_unlock(&bdev->ring_mutex);
+        pthread_mutex_unlock(&dev->zbd_aio_mutex);
+
+        ret = zbc_uring_poll(bdev->ring, timeout);
+
+        pthread_mutex_lock(&dev->zbd_aio_mutex);
+        pthread_mutex_lock(&bdev->ring_mutex);
+
+        if ( (ret < 0) || (timeout > 0) ) {
+            /* Failed or timed out: last check */
+            if ( ret >= 0 ) {
+                ret = zbc_uring_wait_cqe(bdev->ring, 0, &cqe);
+            }
+            break;
+        }
+
+    }
+
+    if ( ret != 0 ) {
+        pthread_mutex_unlock(&bdev->ring_mutex);
+        return ret;
+    }
+
+    req = (zbc_block_req_t *)(unsigned long) cqe->user_data;
+    aio = req->aio;
+    if ( cqe->res < 0 ) {
+        aio->zba_ret = cqe->res;
+    } else {
+        aio->zba_ret = cqe->res / dev->zbd_info.zbd_logical_block_size;
+    }
+
+    zbc_uring_cqe_seen(bdev->ring);
+
+    if ( (aio->zba_op == ZBC_AIO_WRITE) && zbc_zone_sequential(aio->zba_zone) ) {
+        zbc_block_zone_wq_next(dev, aio->zba_zone->zbz_start);
+    }
+
+out:
+
+    pthread_mutex_unlock(&bdev->ring_mutex);
+
+    *paio = req->aio;
+    free(req);
+
+    return 0;
+
+}
+
+/**
+ * Register (@nr_iov > 0) or unregister (@nr_iov == 0) fixed buffers.
+ */
+static int
+zbc_block_register_buffers(struct zbc_device *dev,
+                           const struct iovec *iov,
+                           unsigned int nr_iov)
+{
+    zbc_block_device_t *bdev = zbc_dev_to_block_dev(dev);
+    struct iovec *bufs = NULL;
+    int ret;
+
+    if ( ! bdev->ring ) {
+        return -ENXIO;
+    }
+
+    if ( nr_iov ) {
+        bufs = malloc(sizeof(struct iovec) * nr_iov);
+        if ( ! bufs ) {
+            return -ENOMEM;
+        }
+        memcpy(bufs, iov, sizeof(struct iovec) * nr_iov);
+    }
+
+    pthread_mutex_lock(&bdev->ring_mutex);
+
+    if ( bdev->nr_bufs ) {
+        ret = zbc_uring_register_buffers(bdev->ring, NULL, 0);
+        if ( ret != 0 ) {
+            goto out;
+        }
+        free(bdev->bufs);
+        bdev->bufs = NULL;
+        bdev->nr_bufs = 0;
+    }
+
+    if ( nr_iov ) {
+        ret = zbc_uring_register_buffers(bdev->ring, bufs, nr_iov);
+        if ( ret != 0 ) {
+            zbc_error("%s: register %u buffers failed %d (%s)\n",
+                      dev->zbd_filename,
+                      nr_iov,
+                      -ret,
+                      strerror(-ret));
+            goto out;
+        }
+        bdev->bufs = bufs;
+        bdev->nr_bufs = nr_iov;
+        bufs = NULL;
+    }
+
+    ret = 0;
+
+out:
+
+    pthread_mutex_unlock(&bdev->ring_mutex);
+
+    free(bufs);
+
+    return ret;
+
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
 struct zbc_ops zbc_block_ops = {
     .zbd_open         = zbc_block_open,
     .zbd_close        = zbc_block_close,
     .zbd_pread        = zbc_block_pread,
     .zbd_pwrite       = zbc_block_pwrite,
+    .zbd_preadv       = zbc_block_preadv,
+    .zbd_pwritev      = zbc_block_pwritev,
     .zbd_flush        = zbc_block_flush,
     .zbd_report_zones = zbc_block_report_zones,
     .zbd_open_zone    = zbc_block_open_zone,
     .zbd_close_zone   = zbc_block_close_zone,
     .zbd_finish_zone  = zbc_block_finish_zone,
     .zbd_reset_wp     = zbc_block_reset_wp,
+    .zbd_reset_zones  = zbc_block_reset_zones,
+#ifdef HAVE_LINUX_IO_URING_H
+    .zbd_aio_submit   = zbc_block_aio_submit,
+    .zbd_aio_reap     = zbc_block_aio_reap,
+    .zbd_register_buffers = zbc_block_register_buffers,
+#endif
 };
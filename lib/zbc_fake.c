@@ -15,22 +15,31 @@
 
 /***** Including files *****/
 
+#include <config.h>
+
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include <linux/fs.h>
+#include <linux/falloc.h>
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <pthread.h>
 
 #include "zbc.h"
 #include "zbc_sg.h"
+#include "zbc_fake_perf.h"
 
 /***** Macro and types definitions *****/
 
@@ -46,16 +55,59 @@
  */
 #define ZBC_FAKE_MAX_OPEN_NR_ZONES      32
 
+/**
+ * Polling interval (us) of a zone reset or finish waiting
+ * for a write in progress to the zone to complete.
+ */
+#define ZBC_FAKE_BUSY_WAIT_US           100
+
 /*
  * Meta-data directory.
  */
 #define ZBC_FAKE_META_DIR       	"/var/local"
 
+/**
+ * Default zone size (B) of memory devices.
+ */
+#define ZBC_FAKE_MEM_ZONE_SIZE          (256ULL << 20)
+
+/**
+ * Number of possible zone conditions (4 bits).
+ */
+#define ZBC_FAKE_NR_COND        16
+
+/**
+ * Zone geometry file line: a run of zones of the
+ * same type, initial condition and size.
+ */
+typedef struct zbc_fake_geom {
+
+    uint32_t            zfg_nr_zones;
+    uint8_t             zfg_type;
+    uint8_t             zfg_cond;
+    uint64_t            zfg_length;
+
+} zbc_fake_geom_t;
+
+/**
+ * Metadata file magic ("ZBCF") and format version. The version must be
+ * incremented whenever the layout of the metadata header or of the arrays
+ * following the zone descriptors changes.
+ */
+#define ZBC_FAKE_META_MAGIC             0x4643425aU
+#define ZBC_FAKE_META_VERSION           2
+
 /**
  * Metadata header.
  */
 typedef struct zbc_fake_meta {
 
+    /**
+     * Metadata file magic and format version.
+     */
+    uint32_t            zbd_magic;
+    uint32_t            zbd_version;
+
     /**
      * Capacity in B.
      */
@@ -91,8 +143,33 @@ typedef struct zbc_fake_meta {
      */
     pthread_mutex_t     zbd_mutex;
 
+    /**
+     * Least (head) and most (tail) recently
+     * written implicitly open zones.
+     */
+    uint32_t            zbd_imp_open_head;
+    uint32_t            zbd_imp_open_tail;
+
+    /**
+     * Number of zones in each condition.
+     */
+    uint32_t            zbd_nr_cond_zones[ZBC_FAKE_NR_COND];
+
 } zbc_fake_meta_t;
 
+/**
+ * Implicitly open zone LRU list links, indexed by zone number
+ * (stored in the metadata file after the zone descriptors).
+ */
+typedef struct zbc_fake_lru {
+
+    uint32_t            prev;
+    uint32_t            next;
+
+} zbc_fake_lru_t;
+
+#define ZBC_FAKE_LRU_NONE       ((uint32_t)-1)
+
 /**
  * Fake device descriptor data.
  */
@@ -108,6 +185,66 @@ typedef struct zbc_fake_device {
 
     uint32_t            zbd_nr_zones;
     struct zbc_zone     *zbd_zones;
+    zbc_fake_lru_t      *zbd_lru;
+
+    /**
+     * Per condition bitmaps of zones (stored in the
+     * metadata file after the LRU list links).
+     */
+    uint64_t            *zbd_cond_bmap;
+    uint32_t            zbd_bmap_words;
+
+    /**
+     * Per zone ID of the process executing a write to the zone, 0 if
+     * none (stored in the metadata file after the condition bitmaps).
+     */
+    pid_t               *zbd_writer;
+
+    /**
+     * Zone size if zone i starts at LBA i * zbd_zone_length
+     * (all zones except possibly the last one have the same size),
+     * 0 otherwise.
+     */
+    uint64_t            zbd_zone_length;
+
+    /**
+     * Shared mapping of the device data (ZBC_FAKE_MMAP),
+     * NULL if reads and writes use system calls.
+     */
+    uint8_t             *zbd_data;
+    size_t              zbd_data_size;
+    int                 zbd_data_prot;
+
+    /**
+     * Memory device: data and metadata are kept in
+     * anonymous memory files (no filesystem state).
+     */
+    bool                zbd_mem;
+
+    /**
+     * Number of logical blocks of the emulation file or device,
+     * which the zones may not entirely cover.
+     */
+    uint64_t            zbd_dev_lbas;
+
+    /**
+     * Deallocate the storage of reset and finished zones
+     * (emulation files only).
+     */
+    bool                zbd_punch_holes;
+
+    /**
+     * File descriptor used to deallocate storage: the device
+     * file descriptor if writable, or the file opened again for
+     * writing, as zones are also reset and finished through
+     * handles opened read-only (-1 if not open).
+     */
+    int                 zbd_punch_fd;
+
+    /**
+     * Drive performance model (NULL if commands are not timed).
+     */
+    zbc_fake_perf_t     *zbd_perf;
 
 } zbc_fake_device_t;
 
@@ -137,19 +274,71 @@ zbc_fake_to_file_dev(struct zbc_device *dev)
 }
 
 /**
- * Find a zone using its start LBA.
+ * Time a command with the drive performance model.
+ */
+static inline void
+zbc_fake_perf(zbc_fake_device_t *fdev,
+              enum zbc_fake_perf_op op,
+              uint64_t lba,
+              uint32_t lba_count)
+{
+
+    if ( fdev->zbd_perf ) {
+        zbc_fake_perf_cmd(fdev->zbd_perf, op, lba, lba_count);
+    }
+
+    return;
+
+}
+
+/**
+ * Find a zone using its start LBA: direct indexing if all zones have
+ * the same size, binary search (zones are sorted by start LBA) otherwise.
  */
 static struct zbc_zone *
 zbc_fake_find_zone(zbc_fake_device_t *fdev,
                    uint64_t zone_start_lba)
 {
-    unsigned int i;
+    struct zbc_zone *zone;
+    unsigned int lo, hi, mid;
+    uint64_t z;
 
-    if ( fdev->zbd_zones ) {
-        for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( fdev->zbd_zones[i].zbz_start == zone_start_lba ) {
-                return &fdev->zbd_zones[i];
-            }
+    if ( (! fdev->zbd_zones) || (! fdev->zbd_nr_zones) ) {
+        return NULL;
+    }
+
+    if ( fdev->zbd_zone_length ) {
+
+        if ( zone_start_lba % fdev->zbd_zone_length ) {
+            return NULL;
+        }
+
+        z = zone_start_lba / fdev->zbd_zone_length;
+        if ( z >= fdev->zbd_nr_zones ) {
+            return NULL;
+        }
+
+        zone = &fdev->zbd_zones[z];
+        if ( zone->zbz_start == zone_start_lba ) {
+            return zone;
+        }
+
+        return NULL;
+
+    }
+
+    lo = 0;
+    hi = fdev->zbd_nr_zones;
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        zone = &fdev->zbd_zones[mid];
+        if ( zone->zbz_start == zone_start_lba ) {
+            return zone;
+        }
+        if ( zone->zbz_start < zone_start_lba ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
 
@@ -158,541 +347,1592 @@ zbc_fake_find_zone(zbc_fake_device_t *fdev,
 }
 
 /**
- * Lock a device metadata.
+ * Check if zones can be found by direct indexing.
  */
 static void
-zbc_fake_lock(zbc_fake_device_t *fdev)
+zbc_fake_set_zone_length(zbc_fake_device_t *fdev)
 {
+    uint64_t len;
+    unsigned int i;
+
+    fdev->zbd_zone_length = 0;
+
+    if ( (! fdev->zbd_zones) || (! fdev->zbd_nr_zones) ) {
+        return;
+    }
 
-    pthread_mutex_lock(&fdev->zbd_meta->zbd_mutex);
+    len = fdev->zbd_zones[0].zbz_length;
+    if ( ! len ) {
+        return;
+    }
+
+    for(i = 0; i < fdev->zbd_nr_zones; i++) {
+        if ( (fdev->zbd_zones[i].zbz_start != (uint64_t)i * len)
+             || ((i < (fdev->zbd_nr_zones - 1)) && (fdev->zbd_zones[i].zbz_length != len)) ) {
+            return;
+        }
+    }
+
+    fdev->zbd_zone_length = len;
 
     return;
 
 }
 
 /**
- * Unlock a device metadata.
+ * Set the device model: host-aware if the device has
+ * sequential write preferred zones, host-managed otherwise.
  */
 static void
-zbc_fake_unlock(zbc_fake_device_t *fdev)
+zbc_fake_set_model(zbc_fake_device_t *fdev)
 {
+    struct zbc_device_info *info = &fdev->dev.zbd_info;
+    unsigned int i;
 
-    pthread_mutex_unlock(&fdev->zbd_meta->zbd_mutex);
+    info->zbd_model = ZBC_DM_HOST_MANAGED;
+    for(i = 0; i < fdev->zbd_nr_zones; i++) {
+        if ( zbc_zone_sequential_pref(&fdev->zbd_zones[i]) ) {
+            info->zbd_model = ZBC_DM_HOST_AWARE;
+            break;
+        }
+    }
+
+    if ( info->zbd_model == ZBC_DM_HOST_AWARE ) {
+        strncpy(info->zbd_vendor_id, "FAKE HGST HA libzbc", ZBC_DEVICE_INFO_LENGTH - 1);
+        info->zbd_opt_nr_open_seq_pref = ZBC_FAKE_MAX_OPEN_NR_ZONES;
+        info->zbd_opt_nr_non_seq_write_seq_pref = ZBC_FAKE_MAX_OPEN_NR_ZONES;
+    } else {
+        strncpy(info->zbd_vendor_id, "FAKE HGST HM libzbc", ZBC_DEVICE_INFO_LENGTH - 1);
+        info->zbd_opt_nr_open_seq_pref = 0;
+        info->zbd_opt_nr_non_seq_write_seq_pref = 0;
+    }
 
     return;
 
 }
 
 /**
- * Close metadata file of a fake device.
+ * Size of the metadata of a device with @nr_zones zones.
+ */
+static inline size_t
+zbc_fake_meta_size(uint32_t nr_zones)
+{
+    return sizeof(zbc_fake_meta_t)
+        + (size_t)nr_zones * (sizeof(struct zbc_zone) + sizeof(zbc_fake_lru_t))
+        + (size_t)ZBC_FAKE_NR_COND * ((nr_zones + 63) / 64) * sizeof(uint64_t)
+        + (size_t)nr_zones * sizeof(pid_t);
+}
+
+/**
+ * Setup pointers to the metadata zone arrays.
  */
 static void
-zbc_fake_close_metadata(zbc_fake_device_t *fdev)
+zbc_fake_set_meta_arrays(zbc_fake_device_t *fdev)
 {
 
-    if ( fdev->zbd_meta_fd > 0 ) {
+    fdev->zbd_nr_zones = fdev->zbd_meta->zbd_nr_zones;
+    fdev->zbd_zones = (struct zbc_zone *) (fdev->zbd_meta + 1);
+    fdev->zbd_lru = (zbc_fake_lru_t *) (fdev->zbd_zones + fdev->zbd_nr_zones);
+    fdev->zbd_cond_bmap = (uint64_t *) (fdev->zbd_lru + fdev->zbd_nr_zones);
+    fdev->zbd_bmap_words = (fdev->zbd_nr_zones + 63) / 64;
+    fdev->zbd_writer = (pid_t *) (fdev->zbd_cond_bmap + (size_t)ZBC_FAKE_NR_COND * fdev->zbd_bmap_words);
 
-        if ( fdev->zbd_meta ) {
-            msync(fdev->zbd_meta, fdev->zbd_meta_size, MS_SYNC);
-            munmap(fdev->zbd_meta, fdev->zbd_meta_size);
-            fdev->zbd_meta = NULL;
-            fdev->zbd_meta_size = 0;
-        }
+    return;
 
-        close(fdev->zbd_meta_fd);
-        fdev->zbd_meta_fd = -1;
+}
 
-        pthread_mutexattr_destroy(&fdev->zbd_mutex_attr);
+/**
+ * Get the bitmap of the zones in condition @cond.
+ */
+static inline uint64_t *
+zbc_fake_cond_bmap(zbc_fake_device_t *fdev,
+                   int cond)
+{
+    return fdev->zbd_cond_bmap + (size_t)(cond & 0x0f) * fdev->zbd_bmap_words;
+}
+
+/**
+ * Change a zone condition. All condition changes of initialized zones
+ * must go through this function to keep the condition bitmaps exact.
+ */
+static void
+zbc_fake_set_cond(zbc_fake_device_t *fdev,
+                  struct zbc_zone *zone,
+                  int cond)
+{
+    uint32_t z = zone - fdev->zbd_zones;
+    uint64_t bit = 1ULL << (z & 63);
 
+    if ( zone->zbz_condition == cond ) {
+        return;
     }
 
+    zbc_fake_cond_bmap(fdev, zone->zbz_condition)[z / 64] &= ~bit;
+    fdev->zbd_meta->zbd_nr_cond_zones[zone->zbz_condition & 0x0f]--;
+
+    zone->zbz_condition = cond;
+
+    zbc_fake_cond_bmap(fdev, cond)[z / 64] |= bit;
+    fdev->zbd_meta->zbd_nr_cond_zones[cond & 0x0f]++;
+
     return;
 
 }
 
 /**
- * Open metadata file of a fake device.
+ * Build the condition bitmaps from the zone descriptors.
  */
-static int
-zbc_fake_open_metadata(zbc_fake_device_t *fdev)
+static void
+zbc_fake_init_cond(zbc_fake_device_t *fdev)
 {
-    char meta_path[512];
-    struct stat st;
-    int ret;
+    uint32_t z;
+    int cond;
 
-    zbc_fake_dev_meta_path(fdev, meta_path);
+    memset(fdev->zbd_cond_bmap, 0,
+           (size_t)ZBC_FAKE_NR_COND * fdev->zbd_bmap_words * sizeof(uint64_t));
+    memset(fdev->zbd_meta->zbd_nr_cond_zones, 0, sizeof(fdev->zbd_meta->zbd_nr_cond_zones));
 
-    zbc_debug("%s: using meta file %s\n",
-              fdev->dev.zbd_filename,
-              meta_path);
+    for(z = 0; z < fdev->zbd_nr_zones; z++) {
+        cond = fdev->zbd_zones[z].zbz_condition & 0x0f;
+        zbc_fake_cond_bmap(fdev, cond)[z / 64] |= 1ULL << (z & 63);
+        fdev->zbd_meta->zbd_nr_cond_zones[cond]++;
+    }
 
-    pthread_mutexattr_init(&fdev->zbd_mutex_attr);
-    pthread_mutexattr_setpshared(&fdev->zbd_mutex_attr, PTHREAD_PROCESS_SHARED);
+    return;
 
-    fdev->zbd_meta_fd = open(meta_path, O_RDWR);
-    if ( fdev->zbd_meta_fd < 0 ) {
-        /* Metadata does not exist yet, we'll have to wait for a set_zones call */
-        if ( errno == ENOENT ) {
-            return 0;
-        }
-        ret = -errno;
-        zbc_error("%s: open metadata file %s failed %d (%s)\n",
-                  fdev->dev.zbd_filename,
-                  meta_path,
-                  errno,
-                  strerror(errno));
-        goto out;
-    }
+}
 
-    if ( fstat(fdev->zbd_meta_fd, &st) < 0 ) {
-        zbc_error("%s: fstat metadata file %s failed %d (%s)\n",
-                  fdev->dev.zbd_filename,
-                  meta_path,
-                  errno,
-                  strerror(errno));
-        ret = -errno;
-        goto out;
+/**
+ * Get the index of the first zone starting at or after @lba.
+ */
+static uint32_t
+zbc_fake_first_zone(zbc_fake_device_t *fdev,
+                    uint64_t lba)
+{
+    unsigned int lo = 0, hi = fdev->zbd_nr_zones, mid;
+
+    if ( ! lba ) {
+        return 0;
     }
 
-    /* mmap metadata file */
-    fdev->zbd_meta_size = st.st_size;
-    fdev->zbd_meta = mmap(NULL,
-                          fdev->zbd_meta_size,
-                          PROT_READ | PROT_WRITE,
-                          MAP_SHARED,
-                          fdev->zbd_meta_fd,
-                          0);
-    if ( fdev->zbd_meta == MAP_FAILED ) {
-        fdev->zbd_meta = NULL;
-        zbc_error("%s: mmap metadata file %s failed\n",
-                  fdev->dev.zbd_filename,
-                  meta_path);
-        ret = -ENOMEM;
-        goto out;
+    if ( fdev->zbd_zone_length ) {
+        lba = (lba + fdev->zbd_zone_length - 1) / fdev->zbd_zone_length;
+        return (lba < hi) ? lba : hi;
     }
 
-    /* Check */
-    if ( (fdev->zbd_meta->zbd_capacity > (fdev->dev.zbd_info.zbd_logical_block_size * fdev->dev.zbd_info.zbd_logical_blocks))
-         || (! fdev->zbd_meta->zbd_nr_zones) ) {
-	/* Do not report an error here to allow the execution of zbc_set_zones */
-        zbc_debug("%s: invalid metadata file %s\n",
-                  fdev->dev.zbd_filename,
-                  meta_path);
-	zbc_fake_close_metadata(fdev);
-        ret = 0;
-        goto out;
+    while( lo < hi ) {
+        mid = lo + (hi - lo) / 2;
+        if ( fdev->zbd_zones[mid].zbz_start < lba ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
 
-    zbc_debug("%s: %llu sectors of %zuB, %u zones\n",
-              fdev->dev.zbd_filename,
-	      (unsigned long long)fdev->dev.zbd_info.zbd_logical_blocks,
-	      (size_t)fdev->dev.zbd_info.zbd_logical_block_size,
-              fdev->zbd_meta->zbd_nr_zones);
+    return lo;
 
-    fdev->zbd_nr_zones = fdev->zbd_meta->zbd_nr_zones;
-    fdev->zbd_zones = (struct zbc_zone *) (fdev->zbd_meta + 1);
-    if ( fdev->dev.zbd_info.zbd_max_nr_open_seq_req > fdev->zbd_meta->zbd_nr_seq_zones ) {
-	fdev->dev.zbd_info.zbd_max_nr_open_seq_req = fdev->zbd_meta->zbd_nr_seq_zones - 1;
-    }
+}
 
-    ret = 0;
+/**
+ * Get the index of the first zone at or after index @z
+ * in a condition bitmap (the number of zones if none).
+ */
+static uint32_t
+zbc_fake_next_cond_zone(zbc_fake_device_t *fdev,
+                        uint64_t *bmap,
+                        uint32_t z)
+{
+    uint32_t w = z / 64;
+    uint64_t bits;
 
-out:
+    if ( z >= fdev->zbd_nr_zones ) {
+        return fdev->zbd_nr_zones;
+    }
 
-    if ( ret != 0 ) {
-        zbc_fake_close_metadata(fdev);
+    bits = bmap[w] & (~0ULL << (z & 63));
+    while( ! bits ) {
+        if ( ++w >= fdev->zbd_bmap_words ) {
+            return fdev->zbd_nr_zones;
+        }
+        bits = bmap[w];
     }
 
-    return ret;
+    return w * 64 + __builtin_ctzll(bits);
+
 }
 
 /**
- * Set a device info.
+ * Count the zones at or after index @z in a condition bitmap.
  */
-static int
-zbc_fake_set_info(struct zbc_device *dev)
+static uint32_t
+zbc_fake_count_cond_zones(zbc_fake_device_t *fdev,
+                          uint64_t *bmap,
+                          uint32_t z)
 {
-    unsigned long long size64;
-    struct stat st;
-    int size32;
-    int ret;
+    uint32_t w = z / 64, count;
 
-    /* Get device stats */
-    if ( fstat(dev->zbd_fd, &st) < 0 ) {
-        ret = -errno;
-        zbc_error("%s: stat failed %d (%s)\n",
-                  dev->zbd_filename,
-                  errno,
-                  strerror(errno));
-        return ret;
+    if ( z >= fdev->zbd_nr_zones ) {
+        return 0;
     }
 
-    if ( S_ISBLK(st.st_mode) ) {
+    count = __builtin_popcountll(bmap[w] & (~0ULL << (z & 63)));
+    for(w++; w < fdev->zbd_bmap_words; w++) {
+        count += __builtin_popcountll(bmap[w]);
+    }
 
-        /* Get logical block size */
-        ret = ioctl(dev->zbd_fd, BLKSSZGET, &size32);
-        if ( ret != 0 ) {
-            ret = -errno;
-            zbc_error("%s: ioctl BLKSSZGET failed %d (%s)\n",
-                      dev->zbd_filename,
-                      errno,
-                      strerror(errno));
-            return ret;
-        }
-
-        dev->zbd_info.zbd_logical_block_size = size32;
-
-        /* Get physical block size */
-        ret = ioctl(dev->zbd_fd, BLKPBSZGET, &size32);
-        if ( ret != 0 ) {
-            ret = -errno;
-            zbc_error("%s: ioctl BLKPBSZGET failed %d (%s)\n",
-                      dev->zbd_filename,
-                      errno,
-                      strerror(errno));
-            return ret;
-        }
-        dev->zbd_info.zbd_physical_block_size = size32;
-
-        /* Get capacity (B) */
-        ret = ioctl(dev->zbd_fd, BLKGETSIZE64, &size64);
-        if ( ret != 0 ) {
-            ret = -errno;
-            zbc_error("%s: ioctl BLKGETSIZE64 failed %d (%s)\n",
-                      dev->zbd_filename,
-                      errno,
-                      strerror(errno));
-            return ret;
-        }
-
-        if ( dev->zbd_info.zbd_logical_block_size <= 0 ) {
-            zbc_error("%s: invalid logical sector size %d\n",
-                      dev->zbd_filename,
-                      size32);
-            return -EINVAL;
-        }
-        dev->zbd_info.zbd_logical_blocks = size64 / dev->zbd_info.zbd_logical_block_size;
-
-        if ( dev->zbd_info.zbd_physical_block_size <= 0 ) {
-            zbc_error("%s: invalid physical sector size %d\n",
-                      dev->zbd_filename,
-                      size32);
-            return -EINVAL;
-        }
-        dev->zbd_info.zbd_physical_blocks = size64 / dev->zbd_info.zbd_physical_block_size;
+    return count;
 
-    } else if ( S_ISREG(st.st_mode) ) {
-
-        /* Default value for files */
-        dev->zbd_info.zbd_logical_block_size = ZBC_FAKE_FILE_SECTOR_SIZE;
-        dev->zbd_info.zbd_logical_blocks = st.st_size / ZBC_FAKE_FILE_SECTOR_SIZE;
-        dev->zbd_info.zbd_physical_block_size = dev->zbd_info.zbd_logical_block_size;
-        dev->zbd_info.zbd_physical_blocks = dev->zbd_info.zbd_logical_blocks;
+}
 
+/**
+ * Remove an implicitly open zone from the LRU list.
+ */
+static void
+zbc_fake_lru_del(zbc_fake_device_t *fdev,
+                 struct zbc_zone *zone)
+{
+    zbc_fake_meta_t *meta = fdev->zbd_meta;
+    uint32_t z = zone - fdev->zbd_zones;
+    zbc_fake_lru_t *lru = &fdev->zbd_lru[z];
+
+    if ( lru->prev != ZBC_FAKE_LRU_NONE ) {
+        fdev->zbd_lru[lru->prev].next = lru->next;
+    } else if ( meta->zbd_imp_open_head == z ) {
+        meta->zbd_imp_open_head = lru->next;
     } else {
-
-        return -ENXIO;
-
-    }
-
-    /* Check */
-    if ( ! dev->zbd_info.zbd_logical_blocks ) {
-        zbc_error("%s: invalid capacity (logical blocks)\n",
-                  dev->zbd_filename);
-        return -EINVAL;
+        /* Not in the list */
+        return;
     }
 
-    if ( ! dev->zbd_info.zbd_physical_blocks ) {
-        zbc_error("%s: invalid capacity (physical blocks)\n",
-                  dev->zbd_filename);
-        return -EINVAL;
+    if ( lru->next != ZBC_FAKE_LRU_NONE ) {
+        fdev->zbd_lru[lru->next].prev = lru->prev;
+    } else {
+        meta->zbd_imp_open_tail = lru->prev;
     }
 
-    /* Finish setting */
-    dev->zbd_info.zbd_type = ZBC_DT_FAKE;
-    dev->zbd_info.zbd_model = ZBC_DM_HOST_MANAGED;
-    strncpy(dev->zbd_info.zbd_vendor_id, "FAKE HGST HM libzbc", ZBC_DEVICE_INFO_LENGTH - 1);
-
-    dev->zbd_info.zbd_opt_nr_open_seq_pref = 0;
-    dev->zbd_info.zbd_opt_nr_non_seq_write_seq_pref = 0;
-    dev->zbd_info.zbd_max_nr_open_seq_req = ZBC_FAKE_MAX_OPEN_NR_ZONES;
-
-    /* Get maximum command size */
-    zbc_sg_get_max_cmd_blocks(dev);
+    lru->prev = lru->next = ZBC_FAKE_LRU_NONE;
 
-    return 0;
+    return;
 
 }
 
 /**
- * Open an emulation device or file.
+ * Add an implicitly open zone at the most recently used end of the LRU list.
  */
-static int
-zbc_fake_open(const char *filename,
-              int flags,
-              struct zbc_device **pdev)
+static void
+zbc_fake_lru_add(zbc_fake_device_t *fdev,
+                 struct zbc_zone *zone)
 {
-    zbc_fake_device_t *fdev;
-    int fd, ret;
+    zbc_fake_meta_t *meta = fdev->zbd_meta;
+    uint32_t z = zone - fdev->zbd_zones;
+    zbc_fake_lru_t *lru = &fdev->zbd_lru[z];
 
-    zbc_debug("%s: ########## Trying FAKE driver ##########\n",
-	      filename);
+    lru->prev = meta->zbd_imp_open_tail;
+    lru->next = ZBC_FAKE_LRU_NONE;
 
-    /* Open emulation device/file */
-    fd = open(filename, zbc_open_flags(flags));
-    if ( fd < 0 ) {
-        zbc_error("%s: open failed %d (%s)\n",
-                  filename,
-                  errno,
-                  strerror(errno));
-        ret = -errno;
-	goto out;
+    if ( meta->zbd_imp_open_tail != ZBC_FAKE_LRU_NONE ) {
+        fdev->zbd_lru[meta->zbd_imp_open_tail].next = z;
+    } else {
+        meta->zbd_imp_open_head = z;
     }
+    meta->zbd_imp_open_tail = z;
 
-    /* Allocate a handle */
-    ret = -ENOMEM;
-    fdev = calloc(1, sizeof(*fdev));
-    if ( ! fdev ) {
-        goto out;
-    }
+    return;
 
-    fdev->dev.zbd_fd = fd;
-    fdev->zbd_meta_fd = -1;
-    fdev->dev.zbd_filename = strdup(filename);
-    if ( ! fdev->dev.zbd_filename ) {
-        goto out_free_dev;
-    }
+}
 
-    /* Set the fake device information */
-    ret = zbc_fake_set_info(&fdev->dev);
-    if ( ret != 0 ) {
-        goto out_free_filename;
-    }
+/**
+ * Mark a sequential write required zone as being written (or not).
+ * Data transfers are done without the metadata lock held, so this marker
+ * prevents another write at the same write pointer position until the
+ * write pointer is advanced, and makes resets and finishes of the zone wait
+ * for the transfer to complete. The marker is kept in the shared metadata
+ * so that all processes see it and records the writer process ID, so that
+ * a marker left by a process killed during a write can be detected.
+ */
+static inline void
+zbc_fake_set_zone_busy(zbc_fake_device_t *fdev,
+                       struct zbc_zone *zone,
+                       bool busy)
+{
+    fdev->zbd_writer[zone - fdev->zbd_zones] = busy ? getpid() : 0;
+}
 
-    /* Open metadata */
-    ret = zbc_fake_open_metadata(fdev);
-    if ( ret ) {
-        goto out_free_filename;
+/**
+ * Test if a write to a zone is in progress. A marker left by a writer
+ * process that does not exist anymore is cleared. Must be called with
+ * the metadata lock held.
+ */
+static bool
+zbc_fake_zone_busy(zbc_fake_device_t *fdev,
+                   struct zbc_zone *zone)
+{
+    pid_t pid = fdev->zbd_writer[zone - fdev->zbd_zones];
+
+    if ( ! pid ) {
+        return false;
     }
 
-    *pdev = &fdev->dev;
+    if ( (pid != getpid()) && (kill(pid, 0) < 0) && (errno == ESRCH) ) {
+        zbc_debug("%s: Clear zone %llu write marker of exited process %d\n",
+                  fdev->dev.zbd_filename,
+                  (unsigned long long) zbc_zone_start_lba(zone),
+                  (int) pid);
+        zbc_fake_set_zone_busy(fdev, zone, false);
+        return false;
+    }
 
-    zbc_debug("%s: ########## FAKE driver succeeded ##########\n",
-	      filename);
+    return true;
 
-    return 0;
+}
 
-out_free_filename:
+/**
+ * Get the least recently written implicitly open zone
+ * without a write in progress.
+ */
+static struct zbc_zone *
+zbc_fake_lru_oldest(zbc_fake_device_t *fdev)
+{
+    uint32_t z = fdev->zbd_meta->zbd_imp_open_head;
 
-    free(fdev->dev.zbd_filename);
+    while( z != ZBC_FAKE_LRU_NONE ) {
+        if ( ! zbc_fake_zone_busy(fdev, &fdev->zbd_zones[z]) ) {
+            return &fdev->zbd_zones[z];
+        }
+        z = fdev->zbd_lru[z].next;
+    }
 
-out_free_dev:
+    return NULL;
 
-    free(fdev);
+}
 
-out:
+/**
+ * Lock a device metadata.
+ */
+static void
+zbc_fake_lock(zbc_fake_device_t *fdev)
+{
 
-    if ( fd >= 0 ) {
-	close(fd);
+    /* The lock owner process exited: the zone being
+     * changed by this process may be left inconsistent */
+    if ( pthread_mutex_lock(&fdev->zbd_meta->zbd_mutex) == EOWNERDEAD ) {
+        zbc_error("%s: metadata lock owner exited\n",
+                  fdev->dev.zbd_filename);
+        pthread_mutex_consistent(&fdev->zbd_meta->zbd_mutex);
     }
 
-    zbc_debug("%s: ########## FAKE driver failed %d ##########\n",
-	      filename,
-	      ret);
-
-    return ret;
+    return;
 
 }
 
 /**
- * close a device.
+ * Unlock a device metadata.
  */
-static int
-zbc_fake_close(zbc_device_t *dev)
+static void
+zbc_fake_unlock(zbc_fake_device_t *fdev)
 {
-    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    int ret = 0;
 
-    /* Close metadata */
-    zbc_fake_close_metadata(fdev);
+    pthread_mutex_unlock(&fdev->zbd_meta->zbd_mutex);
 
-    /* Close device */
-    if ( close(dev->zbd_fd) < 0 ) {
-        ret = -errno;
-    }
+    return;
 
-    if ( ret == 0 ) {
-        free(dev->zbd_filename);
-        free(dev);
+}
+
+/**
+ * Wait for a write in progress to a zone to complete, so that the write
+ * data cannot land after the zone is reset or finished. Must be called
+ * with the metadata lock held, which is released while waiting: the
+ * caller must not rely on the state of other zones across this call.
+ */
+static void
+zbc_fake_zone_wait_idle(zbc_fake_device_t *fdev,
+                        struct zbc_zone *zone)
+{
+
+    while( zbc_fake_zone_busy(fdev, zone) ) {
+        zbc_fake_unlock(fdev);
+        usleep(ZBC_FAKE_BUSY_WAIT_US);
+        zbc_fake_lock(fdev);
     }
 
-    return ret;
+    return;
 
 }
 
 /**
- * Test if a zone must be reported.
+ * Close metadata file of a fake device.
  */
-static bool
-zbc_fake_must_report_zone(struct zbc_zone *zone,
-                          uint64_t start_lba,
-                          enum zbc_reporting_options ro)
+static void
+zbc_fake_close_metadata(zbc_fake_device_t *fdev)
 {
-    enum zbc_reporting_options options = ro & (~ZBC_RO_PARTIAL);
 
-    if ( (zbc_zone_length(zone) == 0)
-         || (zbc_zone_start_lba(zone) < start_lba) ) {
-        return false;
-    }
+    if ( fdev->zbd_meta_fd > 0 ) {
+
+        if ( fdev->zbd_meta ) {
+            msync(fdev->zbd_meta, fdev->zbd_meta_size, MS_SYNC);
+            munmap(fdev->zbd_meta, fdev->zbd_meta_size);
+            fdev->zbd_meta = NULL;
+            fdev->zbd_meta_size = 0;
+        }
+
+        close(fdev->zbd_meta_fd);
+        fdev->zbd_meta_fd = -1;
+
+        pthread_mutexattr_destroy(&fdev->zbd_mutex_attr);
 
-    switch( options ) {
-    case ZBC_RO_ALL:
-        return true;
-    case ZBC_RO_EMPTY:
-        return zbc_zone_empty(zone);
-    case ZBC_RO_IMP_OPEN:
-        return zbc_zone_imp_open(zone);
-    case ZBC_RO_EXP_OPEN:
-        return zbc_zone_exp_open(zone);
-    case ZBC_RO_CLOSED:
-        return zbc_zone_closed(zone);
-    case ZBC_RO_FULL:
-        return zbc_zone_full(zone);
-    case ZBC_RO_RDONLY:
-        return zbc_zone_rdonly(zone);
-    case ZBC_RO_OFFLINE:
-        return zbc_zone_offline(zone);
-    case ZBC_RO_RESET:
-        return zbc_zone_need_reset(zone);
-    case ZBC_RO_NON_SEQ:
-        return zbc_zone_non_seq(zone);
-    case ZBC_RO_NOT_WP:
-        return zbc_zone_not_wp(zone);
-    default:
-	break;
     }
 
-    return false;
+    return;
 
 }
 
 /**
- * Get device zone information.
+ * Open metadata file of a fake device.
  */
 static int
-zbc_fake_report_zones(struct zbc_device *dev,
-                      uint64_t start_lba,
-                      enum zbc_reporting_options ro,
-		      uint64_t *max_lba,
-                      struct zbc_zone *zones,
-                      unsigned int *nr_zones)
+zbc_fake_open_metadata(zbc_fake_device_t *fdev)
 {
-    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    unsigned int max_nr_zones = *nr_zones;
-    enum zbc_reporting_options options = ro & (~ZBC_RO_PARTIAL);
-    unsigned int in, out = 0;
+    char meta_path[512];
+    struct stat st;
+    int ret;
 
-    if ( ! fdev->zbd_meta ) {
-        return -ENXIO;
+    zbc_fake_dev_meta_path(fdev, meta_path);
+
+    zbc_debug("%s: using meta file %s\n",
+              fdev->dev.zbd_filename,
+              meta_path);
+
+    pthread_mutexattr_init(&fdev->zbd_mutex_attr);
+    pthread_mutexattr_setpshared(&fdev->zbd_mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&fdev->zbd_mutex_attr, PTHREAD_MUTEX_ROBUST);
+
+    fdev->zbd_meta_fd = open(meta_path, O_RDWR);
+    if ( fdev->zbd_meta_fd < 0 ) {
+        /* Metadata does not exist yet, we'll have to wait for a set_zones call */
+        if ( errno == ENOENT ) {
+            return 0;
+        }
+        ret = -errno;
+        zbc_error("%s: open metadata file %s failed %d (%s)\n",
+                  fdev->dev.zbd_filename,
+                  meta_path,
+                  errno,
+                  strerror(errno));
+        goto out;
     }
 
-    /* Check reporting option */
-    if ( (options != ZBC_RO_ALL)
-	 && (options != ZBC_RO_EMPTY)
-         && (options != ZBC_RO_IMP_OPEN)
-	 && (options != ZBC_RO_EXP_OPEN)
-         && (options != ZBC_RO_CLOSED)
-	 && (options != ZBC_RO_FULL)
-         && (options != ZBC_RO_RDONLY)
-	 && (options != ZBC_RO_OFFLINE)
-         && (options != ZBC_RO_RESET)
-	 && (options != ZBC_RO_NON_SEQ)
-	 && (options != ZBC_RO_NOT_WP) ) {
-        dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-        dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
-        return -EIO;
+    if ( fstat(fdev->zbd_meta_fd, &st) < 0 ) {
+        zbc_error("%s: fstat metadata file %s failed %d (%s)\n",
+                  fdev->dev.zbd_filename,
+                  meta_path,
+                  errno,
+                  strerror(errno));
+        ret = -errno;
+        goto out;
     }
 
-    /* Check start_lba */
-    if ( start_lba >= dev->zbd_info.zbd_logical_blocks) {
-        dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-        dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-        return -EIO;
+    /* mmap metadata file */
+    fdev->zbd_meta_size = st.st_size;
+    fdev->zbd_meta = mmap(NULL,
+                          fdev->zbd_meta_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED,
+                          fdev->zbd_meta_fd,
+                          0);
+    if ( fdev->zbd_meta == MAP_FAILED ) {
+        fdev->zbd_meta = NULL;
+        zbc_error("%s: mmap metadata file %s failed\n",
+                  fdev->dev.zbd_filename,
+                  meta_path);
+        ret = -ENOMEM;
+        goto out;
     }
 
-    zbc_fake_lock(fdev);
+    /* Check format */
+    if ( (fdev->zbd_meta_size >= sizeof(zbc_fake_meta_t))
+         && ((fdev->zbd_meta->zbd_magic != ZBC_FAKE_META_MAGIC)
+             || (fdev->zbd_meta->zbd_version != ZBC_FAKE_META_VERSION)) ) {
+        /* Still allow the execution of zbc_set_zones to reformat */
+        if ( fdev->zbd_meta->zbd_magic == ZBC_FAKE_META_MAGIC ) {
+            zbc_error("%s: metadata file %s has format version %u (expected %u): "
+                      "use zbc_set_zones to reformat\n",
+                      fdev->dev.zbd_filename,
+                      meta_path,
+                      fdev->zbd_meta->zbd_version,
+                      ZBC_FAKE_META_VERSION);
+        } else {
+            zbc_error("%s: metadata file %s has an unknown format: "
+                      "use zbc_set_zones to reformat\n",
+                      fdev->dev.zbd_filename,
+                      meta_path);
+        }
+        zbc_fake_close_metadata(fdev);
+        ret = 0;
+        goto out;
+    }
 
-    if ( max_lba ) {
-	*max_lba = dev->zbd_info.zbd_logical_blocks - 1;
+    /* Check */
+    if ( (fdev->zbd_meta_size < sizeof(zbc_fake_meta_t))
+         || (fdev->zbd_meta->zbd_capacity > (fdev->dev.zbd_info.zbd_logical_block_size * fdev->dev.zbd_info.zbd_logical_blocks))
+         || (! fdev->zbd_meta->zbd_nr_zones)
+         || (fdev->zbd_meta_size < zbc_fake_meta_size(fdev->zbd_meta->zbd_nr_zones)) ) {
+	/* Do not report an error here to allow the execution of zbc_set_zones */
+        zbc_debug("%s: invalid metadata file %s\n",
+                  fdev->dev.zbd_filename,
+                  meta_path);
+	zbc_fake_close_metadata(fdev);
+        ret = 0;
+        goto out;
     }
 
-    if ( (! zones)
-	 && (! max_nr_zones) ) {
-	max_nr_zones = fdev->zbd_nr_zones;
+    /* The zones may not cover the entire file */
+    fdev->dev.zbd_info.zbd_logical_blocks = fdev->zbd_meta->zbd_capacity /
+        fdev->dev.zbd_info.zbd_logical_block_size;
+    fdev->dev.zbd_info.zbd_physical_blocks = fdev->dev.zbd_info.zbd_logical_blocks /
+        (fdev->dev.zbd_info.zbd_physical_block_size / fdev->dev.zbd_info.zbd_logical_block_size);
+
+    zbc_debug("%s: %llu sectors of %zuB, %u zones\n",
+              fdev->dev.zbd_filename,
+	      (unsigned long long)fdev->dev.zbd_info.zbd_logical_blocks,
+	      (size_t)fdev->dev.zbd_info.zbd_logical_block_size,
+              fdev->zbd_meta->zbd_nr_zones);
+
+    zbc_fake_set_meta_arrays(fdev);
+    zbc_fake_set_zone_length(fdev);
+    zbc_fake_set_model(fdev);
+    if ( fdev->dev.zbd_info.zbd_max_nr_open_seq_req > fdev->zbd_meta->zbd_nr_seq_zones ) {
+	fdev->dev.zbd_info.zbd_max_nr_open_seq_req = fdev->zbd_meta->zbd_nr_seq_zones - 1;
     }
 
-    /* Get matching zones */
-    for(in = 0; in < fdev->zbd_nr_zones; in++) {
-        if ( zbc_fake_must_report_zone(&fdev->zbd_zones[in], start_lba, options) ) {
-	    if ( zones && (out < max_nr_zones) ) {
-	        memcpy(&zones[out], &fdev->zbd_zones[in], sizeof(struct zbc_zone));
-	    }
-	    out++;
-         }
-	 if ( (out >= max_nr_zones) && (ro & ZBC_RO_PARTIAL) ) {
-	     break;
-	 }
+    ret = 0;
+
+out:
+
+    if ( ret != 0 ) {
+        zbc_fake_close_metadata(fdev);
     }
 
-    if ( out > max_nr_zones ) {
-	out = max_nr_zones;
+    return ret;
+}
+
+/**
+ * Set a device info.
+ */
+static int
+zbc_fake_set_info(struct zbc_device *dev)
+{
+    unsigned long long size64;
+    struct stat st;
+    int size32;
+    int ret;
+
+    /* Get device stats */
+    if ( fstat(dev->zbd_fd, &st) < 0 ) {
+        ret = -errno;
+        zbc_error("%s: stat failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        return ret;
     }
 
-    *nr_zones = out;
+    if ( S_ISBLK(st.st_mode) ) {
 
-    zbc_fake_unlock(fdev);
+        /* Get logical block size */
+        ret = ioctl(dev->zbd_fd, BLKSSZGET, &size32);
+        if ( ret != 0 ) {
+            ret = -errno;
+            zbc_error("%s: ioctl BLKSSZGET failed %d (%s)\n",
+                      dev->zbd_filename,
+                      errno,
+                      strerror(errno));
+            return ret;
+        }
+
+        dev->zbd_info.zbd_logical_block_size = size32;
+
+        /* Get physical block size */
+        ret = ioctl(dev->zbd_fd, BLKPBSZGET, &size32);
+        if ( ret != 0 ) {
+            ret = -errno;
+            zbc_error("%s: ioctl BLKPBSZGET failed %d (%s)\n",
+                      dev->zbd_filename,
+                      errno,
+                      strerror(errno));
+            return ret;
+        }
+        dev->zbd_info.zbd_physical_block_size = size32;
+
+        /* Get capacity (B) */
+        ret = ioctl(dev->zbd_fd, BLKGETSIZE64, &size64);
+        if ( ret != 0 ) {
+            ret = -errno;
+            zbc_error("%s: ioctl BLKGETSIZE64 failed %d (%s)\n",
+                      dev->zbd_filename,
+                      errno,
+                      strerror(errno));
+            return ret;
+        }
+
+        if ( dev->zbd_info.zbd_logical_block_size <= 0 ) {
+            zbc_error("%s: invalid logical sector size %d\n",
+                      dev->zbd_filename,
+                      size32);
+            return -EINVAL;
+        }
+        dev->zbd_info.zbd_logical_blocks = size64 / dev->zbd_info.zbd_logical_block_size;
+
+        if ( dev->zbd_info.zbd_physical_block_size <= 0 ) {
+            zbc_error("%s: invalid physical sector size %d\n",
+                      dev->zbd_filename,
+                      size32);
+            return -EINVAL;
+        }
+        dev->zbd_info.zbd_physical_blocks = size64 / dev->zbd_info.zbd_physical_block_size;
+
+    } else if ( S_ISREG(st.st_mode) ) {
+
+        /* Default value for files */
+        zbc_fake_to_file_dev(dev)->zbd_punch_holes = true;
+        dev->zbd_info.zbd_logical_block_size = ZBC_FAKE_FILE_SECTOR_SIZE;
+        dev->zbd_info.zbd_logical_blocks = st.st_size / ZBC_FAKE_FILE_SECTOR_SIZE;
+        dev->zbd_info.zbd_physical_block_size = dev->zbd_info.zbd_logical_block_size;
+        dev->zbd_info.zbd_physical_blocks = dev->zbd_info.zbd_logical_blocks;
+
+    } else {
+
+        return -ENXIO;
+
+    }
+
+    /* Check */
+    if ( ! dev->zbd_info.zbd_logical_blocks ) {
+        zbc_error("%s: invalid capacity (logical blocks)\n",
+                  dev->zbd_filename);
+        return -EINVAL;
+    }
+
+    if ( ! dev->zbd_info.zbd_physical_blocks ) {
+        zbc_error("%s: invalid capacity (physical blocks)\n",
+                  dev->zbd_filename);
+        return -EINVAL;
+    }
+
+    /* Finish setting */
+    dev->zbd_info.zbd_type = ZBC_DT_FAKE;
+    dev->zbd_info.zbd_model = ZBC_DM_HOST_MANAGED;
+    strncpy(dev->zbd_info.zbd_vendor_id, "FAKE HGST HM libzbc", ZBC_DEVICE_INFO_LENGTH - 1);
+
+    dev->zbd_info.zbd_opt_nr_open_seq_pref = 0;
+    dev->zbd_info.zbd_opt_nr_non_seq_write_seq_pref = 0;
+    dev->zbd_info.zbd_max_nr_open_seq_req = ZBC_FAKE_MAX_OPEN_NR_ZONES;
+
+    /* Get maximum command size */
+    zbc_sg_get_max_cmd_blocks(dev);
 
     return 0;
 
 }
 
 /**
- * Close a zone.
+ * Parse a memory device name: "mem:size=<size>[,zone=<size>][,conv=<size>]".
+ * Sizes are in bytes, with an optional K, M, G or T suffix.
  */
-static void
-zbc_zone_do_close(zbc_fake_device_t *fdev,
-                  struct zbc_zone *zone)
+static int
+zbc_fake_parse_mem(const char *filename,
+                   uint64_t *size,
+                   uint64_t *conv_sz,
+                   uint64_t *zone_sz)
 {
+    const char *p = filename + strlen(ZBC_FAKE_MEM_PREFIX);
+    uint64_t *val;
+    char *end;
+
+    *size = 0;
+    *conv_sz = 0;
+    *zone_sz = ZBC_FAKE_MEM_ZONE_SIZE;
+
+    while( *p ) {
+
+        if ( strncmp(p, "size=", 5) == 0 ) {
+            val = size;
+        } else if ( strncmp(p, "zone=", 5) == 0 ) {
+            val = zone_sz;
+        } else if ( strncmp(p, "conv=", 5) == 0 ) {
+            val = conv_sz;
+        } else {
+            goto err;
+        }
+        p += 5;
 
-    if ( zbc_zone_is_open(zone) ) {
+        *val = strtoull(p, &end, 10);
+        if ( end == p ) {
+            goto err;
+        }
 
-        if ( zbc_zone_imp_open(zone) ) {
-            fdev->zbd_meta->zbd_nr_imp_open_zones--;;
-        } else if ( zbc_zone_exp_open(zone) ) {
-            fdev->zbd_meta->zbd_nr_exp_open_zones--;
+        switch( *end ) {
+        case 'K':
+        case 'k':
+            *val <<= 10;
+            end++;
+            break;
+        case 'M':
+        case 'm':
+            *val <<= 20;
+            end++;
+            break;
+        case 'G':
+        case 'g':
+            *val <<= 30;
+            end++;
+            break;
+        case 'T':
+        case 't':
+            *val <<= 40;
+            end++;
+            break;
+        default:
+            break;
         }
 
-        if ( zbc_zone_wp_lba(zone) == zbc_zone_start_lba(zone) ) {
-            zone->zbz_condition = ZBC_ZC_EMPTY;
-        } else {
-            zone->zbz_condition = ZBC_ZC_CLOSED;
+        if ( *end == ',' ) {
+            end++;
+        } else if ( *end ) {
+            goto err;
         }
+        p = end;
+
+    }
 
+    if ( (! *size) || (! *zone_sz)
+         || (*size % ZBC_FAKE_FILE_SECTOR_SIZE)
+         || (*zone_sz % ZBC_FAKE_FILE_SECTOR_SIZE)
+         || (*conv_sz % ZBC_FAKE_FILE_SECTOR_SIZE) ) {
+        goto err;
     }
 
+    return 0;
+
+err:
+
+    zbc_error("%s: invalid memory device name\n",
+              filename);
+
+    return -EINVAL;
+
+}
+
+/**
+ * Create an anonymous memory file.
+ */
+static inline int
+zbc_fake_memfd(const char *name)
+{
+    return syscall(__NR_memfd_create, name, 0);
+}
+
+/**
+ * Map an emulation device or file data.
+ */
+static int
+zbc_fake_map_data(zbc_fake_device_t *fdev,
+                  int flags)
+{
+    struct zbc_device *dev = &fdev->dev;
+    void *data;
+    int ret;
+
+    fdev->zbd_data_prot = PROT_READ;
+    if ( (flags & O_ACCMODE) != O_RDONLY ) {
+        fdev->zbd_data_prot |= PROT_WRITE;
+    }
+
+    fdev->zbd_data_size = dev->zbd_info.zbd_logical_blocks * dev->zbd_info.zbd_logical_block_size;
+    data = mmap(NULL, fdev->zbd_data_size, fdev->zbd_data_prot, MAP_SHARED, dev->zbd_fd, 0);
+    if ( data == MAP_FAILED ) {
+        ret = -errno;
+        zbc_error("%s: mmap data failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        return ret;
+    }
+
+    fdev->zbd_data = data;
+
+    return 0;
+
+}
+
+static int
+zbc_fake_set_zones(struct zbc_device *dev,
+                   uint64_t conv_sz,
+                   uint64_t zone_sz);
+
+/**
+ * Open an emulation device or file.
+ */
+static int
+zbc_fake_open(const char *filename,
+              int flags,
+              struct zbc_device **pdev)
+{
+    bool mem = zbc_fake_mem_dev(filename);
+    uint64_t mem_size, conv_sz, zone_sz;
+    zbc_fake_device_t *fdev;
+    int fd = -1, ret;
+
+    zbc_debug("%s: ########## Trying FAKE driver ##########\n",
+	      filename);
+
+    if ( mem ) {
+
+        /* Create the memory device data file */
+        ret = zbc_fake_parse_mem(filename, &mem_size, &conv_sz, &zone_sz);
+        if ( ret != 0 ) {
+            goto out;
+        }
+
+        fd = zbc_fake_memfd("zbc-mem-data");
+        if ( fd < 0 ) {
+            ret = -errno;
+            zbc_error("%s: memfd_create failed %d (%s)\n",
+                      filename,
+                      errno,
+                      strerror(errno));
+            goto out;
+        }
+
+        if ( ftruncate(fd, mem_size) < 0 ) {
+            ret = -errno;
+            zbc_error("%s: truncate to %llu B failed %d (%s)\n",
+                      filename,
+                      (unsigned long long) mem_size,
+                      errno,
+                      strerror(errno));
+            goto out;
+        }
+
+        flags = O_RDWR | ZBC_FAKE_MMAP;
+
+    } else {
+
+        /* Open emulation device/file */
+        fd = open(filename, zbc_open_flags(flags));
+        if ( fd < 0 ) {
+            zbc_error("%s: open failed %d (%s)\n",
+                      filename,
+                      errno,
+                      strerror(errno));
+            ret = -errno;
+            goto out;
+        }
+
+    }
+
+    /* Allocate a handle */
+    ret = -ENOMEM;
+    fdev = calloc(1, sizeof(*fdev));
+    if ( ! fdev ) {
+        goto out;
+    }
+
+    fdev->dev.zbd_fd = fd;
+    fdev->zbd_meta_fd = -1;
+    fdev->zbd_punch_fd = -1;
+    fdev->zbd_mem = mem;
+    fdev->dev.zbd_filename = strdup(filename);
+    if ( ! fdev->dev.zbd_filename ) {
+        goto out_free_dev;
+    }
+
+    /* Set the fake device information */
+    ret = zbc_fake_set_info(&fdev->dev);
+    if ( ret != 0 ) {
+        goto out_free_filename;
+    }
+    fdev->zbd_dev_lbas = fdev->dev.zbd_info.zbd_logical_blocks;
+
+    /* Deallocating storage needs write access to the file */
+    if ( fdev->zbd_punch_holes ) {
+        if ( (zbc_open_flags(flags) & O_ACCMODE) != O_RDONLY ) {
+            fdev->zbd_punch_fd = fd;
+        } else {
+            fdev->zbd_punch_fd = open(filename, O_RDWR);
+            if ( fdev->zbd_punch_fd < 0 ) {
+                zbc_debug("%s: no write access, zone storage will not be deallocated\n",
+                          filename);
+                fdev->zbd_punch_holes = false;
+            }
+        }
+    }
+
+    /* Map the device data */
+    if ( flags & ZBC_FAKE_MMAP ) {
+        ret = zbc_fake_map_data(fdev, flags);
+        if ( ret != 0 ) {
+            goto out_close_punch;
+        }
+    }
+
+    /* Open metadata: memory devices have no persistent state */
+    if ( mem ) {
+        ret = zbc_fake_set_zones(&fdev->dev,
+                                 conv_sz / ZBC_FAKE_FILE_SECTOR_SIZE,
+                                 zone_sz / ZBC_FAKE_FILE_SECTOR_SIZE);
+    } else {
+        ret = zbc_fake_open_metadata(fdev);
+    }
+    if ( ret ) {
+        goto out_unmap_data;
+    }
+
+    *pdev = &fdev->dev;
+
+    zbc_debug("%s: ########## FAKE driver succeeded ##########\n",
+	      filename);
+
+    return 0;
+
+out_unmap_data:
+
+    if ( fdev->zbd_data ) {
+        munmap(fdev->zbd_data, fdev->zbd_data_size);
+    }
+
+out_close_punch:
+
+    if ( (fdev->zbd_punch_fd >= 0) && (fdev->zbd_punch_fd != fd) ) {
+        close(fdev->zbd_punch_fd);
+    }
+
+out_free_filename:
+
+    free(fdev->dev.zbd_filename);
+
+out_free_dev:
+
+    free(fdev);
+
+out:
+
+    if ( fd >= 0 ) {
+	close(fd);
+    }
+
+    zbc_debug("%s: ########## FAKE driver failed %d ##########\n",
+	      filename,
+	      ret);
+
+    return ret;
+
+}
+
+/**
+ * close a device.
+ */
+static int
+zbc_fake_close(zbc_device_t *dev)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    int ret = 0;
+
+    /* Close metadata */
+    zbc_fake_close_metadata(fdev);
+
+    /* Unmap data */
+    if ( fdev->zbd_data ) {
+        munmap(fdev->zbd_data, fdev->zbd_data_size);
+        fdev->zbd_data = NULL;
+    }
+
+    zbc_fake_perf_free(fdev->zbd_perf);
+    fdev->zbd_perf = NULL;
+
+    if ( (fdev->zbd_punch_fd >= 0) && (fdev->zbd_punch_fd != dev->zbd_fd) ) {
+        close(fdev->zbd_punch_fd);
+    }
+    fdev->zbd_punch_fd = -1;
+
+    /* Close device */
+    if ( close(dev->zbd_fd) < 0 ) {
+        ret = -errno;
+    }
+
+    if ( ret == 0 ) {
+        free(dev->zbd_filename);
+        free(dev);
+    }
+
+    return ret;
+
+}
+
+/**
+ * Test if a zone must be reported.
+ */
+static bool
+zbc_fake_must_report_zone(struct zbc_zone *zone,
+                          uint64_t start_lba,
+                          enum zbc_reporting_options ro)
+{
+    enum zbc_reporting_options options = ro & (~ZBC_RO_PARTIAL);
+
+    if ( (zbc_zone_length(zone) == 0)
+         || (zbc_zone_start_lba(zone) < start_lba) ) {
+        return false;
+    }
+
+    switch( options ) {
+    case ZBC_RO_ALL:
+        return true;
+    case ZBC_RO_EMPTY:
+        return zbc_zone_empty(zone);
+    case ZBC_RO_IMP_OPEN:
+        return zbc_zone_imp_open(zone);
+    case ZBC_RO_EXP_OPEN:
+        return zbc_zone_exp_open(zone);
+    case ZBC_RO_CLOSED:
+        return zbc_zone_closed(zone);
+    case ZBC_RO_FULL:
+        return zbc_zone_full(zone);
+    case ZBC_RO_RDONLY:
+        return zbc_zone_rdonly(zone);
+    case ZBC_RO_OFFLINE:
+        return zbc_zone_offline(zone);
+    case ZBC_RO_RESET:
+        return zbc_zone_need_reset(zone);
+    case ZBC_RO_NON_SEQ:
+        return zbc_zone_non_seq(zone);
+    case ZBC_RO_NOT_WP:
+        return zbc_zone_not_wp(zone);
+    default:
+	break;
+    }
+
+    return false;
+
+}
+
+/**
+ * Get the zone condition selected by a reporting option,
+ * or -1 if the option is not a single condition filter.
+ */
+static int
+zbc_fake_ro_cond(enum zbc_reporting_options ro)
+{
+
+    switch( ro ) {
+    case ZBC_RO_EMPTY:
+        return ZBC_ZC_EMPTY;
+    case ZBC_RO_IMP_OPEN:
+        return ZBC_ZC_IMP_OPEN;
+    case ZBC_RO_EXP_OPEN:
+        return ZBC_ZC_EXP_OPEN;
+    case ZBC_RO_CLOSED:
+        return ZBC_ZC_CLOSED;
+    case ZBC_RO_FULL:
+        return ZBC_ZC_FULL;
+    case ZBC_RO_RDONLY:
+        return ZBC_ZC_RDONLY;
+    case ZBC_RO_OFFLINE:
+        return ZBC_ZC_OFFLINE;
+    case ZBC_RO_NOT_WP:
+        return ZBC_ZC_NOT_WP;
+    default:
+        break;
+    }
+
+    return -1;
+
+}
+
+/**
+ * Get device zone information.
+ */
+static int
+zbc_fake_report_zones(struct zbc_device *dev,
+                      uint64_t start_lba,
+                      enum zbc_reporting_options ro,
+		      uint64_t *max_lba,
+                      struct zbc_zone *zones,
+                      unsigned int *nr_zones)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    unsigned int max_nr_zones = *nr_zones;
+    enum zbc_reporting_options options = ro & (~ZBC_RO_PARTIAL);
+    unsigned int in, out = 0;
+    uint64_t *bmap = NULL;
+    int cond;
+
+    if ( ! fdev->zbd_meta ) {
+        return -ENXIO;
+    }
+
+    /* Check reporting option */
+    if ( (options != ZBC_RO_ALL)
+	 && (options != ZBC_RO_EMPTY)
+         && (options != ZBC_RO_IMP_OPEN)
+	 && (options != ZBC_RO_EXP_OPEN)
+         && (options != ZBC_RO_CLOSED)
+	 && (options != ZBC_RO_FULL)
+         && (options != ZBC_RO_RDONLY)
+	 && (options != ZBC_RO_OFFLINE)
+         && (options != ZBC_RO_RESET)
+	 && (options != ZBC_RO_NON_SEQ)
+	 && (options != ZBC_RO_NOT_WP) ) {
+        dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+        dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+        return -EIO;
+    }
+
+    /* Check start_lba */
+    if ( start_lba >= dev->zbd_info.zbd_logical_blocks) {
+        dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+        dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+        return -EIO;
+    }
+
+    zbc_fake_lock(fdev);
+
+    if ( max_lba ) {
+	*max_lba = dev->zbd_info.zbd_logical_blocks - 1;
+    }
+
+    if ( (! zones)
+	 && (! max_nr_zones) ) {
+	max_nr_zones = fdev->zbd_nr_zones;
+    }
+
+    in = zbc_fake_first_zone(fdev, start_lba);
+
+    cond = zbc_fake_ro_cond(options);
+    if ( cond < 0 ) {
+
+        /* Get matching zones */
+        for(; in < fdev->zbd_nr_zones; in++) {
+            if ( zbc_fake_must_report_zone(&fdev->zbd_zones[in], start_lba, options) ) {
+                if ( zones && (out < max_nr_zones) ) {
+                    memcpy(&zones[out], &fdev->zbd_zones[in], sizeof(struct zbc_zone));
+                }
+                out++;
+            }
+            if ( (out >= max_nr_zones) && (ro & ZBC_RO_PARTIAL) ) {
+                break;
+            }
+        }
+
+        goto done;
+
+    }
+
+    /* Use the condition bitmap: only matching zones are looked at */
+    bmap = zbc_fake_cond_bmap(fdev, cond);
+    if ( zones ) {
+        for(in = zbc_fake_next_cond_zone(fdev, bmap, in);
+            (in < fdev->zbd_nr_zones) && (out < max_nr_zones);
+            in = zbc_fake_next_cond_zone(fdev, bmap, in + 1)) {
+            memcpy(&zones[out], &fdev->zbd_zones[in], sizeof(struct zbc_zone));
+            out++;
+        }
+    }
+
+    if ( (! (ro & ZBC_RO_PARTIAL)) || (! zones) ) {
+        /* Count the remaining matching zones */
+        if ( in == 0 ) {
+            out = fdev->zbd_meta->zbd_nr_cond_zones[cond];
+        } else {
+            out += zbc_fake_count_cond_zones(fdev, bmap, in);
+        }
+    }
+
+done:
+
+    if ( out > max_nr_zones ) {
+	out = max_nr_zones;
+    }
+
+    *nr_zones = out;
+
+    zbc_fake_unlock(fdev);
+
+    return 0;
+
+}
+
+/**
+ * Close a zone.
+ */
+static void
+zbc_zone_do_close(zbc_fake_device_t *fdev,
+                  struct zbc_zone *zone)
+{
+
+    if ( zbc_zone_is_open(zone) ) {
+
+        if ( zbc_zone_imp_open(zone) ) {
+            fdev->zbd_meta->zbd_nr_imp_open_zones--;;
+            zbc_fake_lru_del(fdev, zone);
+        } else if ( zbc_zone_exp_open(zone) ) {
+            fdev->zbd_meta->zbd_nr_exp_open_zones--;
+        }
+
+        if ( zbc_zone_wp_lba(zone) == zbc_zone_start_lba(zone) ) {
+            zbc_fake_set_cond(fdev, zone, ZBC_ZC_EMPTY);
+        } else {
+            zbc_fake_set_cond(fdev, zone, ZBC_ZC_CLOSED);
+        }
+
+    }
+
+    return;
+
+}
+
+/**
+ * Check that a zone can be accessed: offline zones cannot be accessed
+ * at all and read-only zones cannot be written nor change condition.
+ * Sets the sense data and returns -EIO if the access is not allowed.
+ */
+static int
+zbc_fake_check_access(struct zbc_device *dev,
+                      struct zbc_zone *zone,
+                      bool write)
+{
+
+    if ( zbc_zone_offline(zone) ) {
+        dev->zbd_errno.sk = ZBC_E_DATA_PROTECT;
+        dev->zbd_errno.asc_ascq = ZBC_E_ZONE_IS_OFFLINE;
+        return -EIO;
+    }
+
+    if ( write && zbc_zone_rdonly(zone) ) {
+        dev->zbd_errno.sk = ZBC_E_DATA_PROTECT;
+        dev->zbd_errno.asc_ascq = ZBC_E_ZONE_IS_READ_ONLY;
+        return -EIO;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Open zone(s).
+ */
+static int
+zbc_fake_open_zone(zbc_device_t *dev,
+                   uint64_t start_lba)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    unsigned int i;
+    int ret = 0;
+
+    if ( ! fdev->zbd_meta ) {
+        return -ENXIO;
+    }
+
+    zbc_fake_lock(fdev);
+
+    if ( start_lba == (uint64_t)-1 ) {
+
+        unsigned int need_open = 0;
+
+        /* Check if all closed zones can be open */
+        for(i = 0; i < fdev->zbd_nr_zones; i++) {
+            if ( zbc_zone_closed(&fdev->zbd_zones[i]) ) {
+                need_open++;
+            }
+        }
+        if ( (fdev->zbd_meta->zbd_nr_exp_open_zones + need_open) > fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
+            dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
+            dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
+            ret = -EIO;
+            goto out;
+        }
+
+        /* Open all closed zones */
+        for(i = 0; i < fdev->zbd_nr_zones; i++) {
+            if ( zbc_zone_closed(&fdev->zbd_zones[i]) ) {
+                zbc_fake_set_cond(fdev, &fdev->zbd_zones[i], ZBC_ZC_EXP_OPEN);
+            }
+        }
+        fdev->zbd_meta->zbd_nr_exp_open_zones += need_open;
+
+    } else {
+
+        struct zbc_zone *zone, *lru_zone;
+
+        /* Check start_lba */
+        if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            ret = -EIO;
+            goto out;
+        }
+
+        /* Check target zone */
+        zone = zbc_fake_find_zone(fdev, start_lba);
+        if ( ! zone ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+            ret = -EIO;
+            goto out;
+        }
+
+        if ( zbc_zone_conventional(zone) ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+            ret = -EIO;
+            goto out;
+        }
+
+        ret = zbc_fake_check_access(dev, zone, true);
+        if ( ret != 0 ) {
+            goto out;
+        }
+
+        if ( zbc_zone_full(zone) ) {
+            /* Full zone open: do nothing (condition remains full) */
+            goto out;
+        }
+
+        if ( zbc_zone_exp_open(zone) ) {
+            /* Already open: nothing to do */
+            goto out;
+        }
+
+        if ( ! (zbc_zone_closed(zone)
+                || zbc_zone_imp_open(zone)
+                || zbc_zone_empty(zone)) ) {
+            ret = -EIO;
+            goto out;
+        }
+
+        if ( zbc_zone_imp_open(zone) ) {
+            zbc_zone_do_close(fdev, zone);
+        }
+
+        /* Check limit */
+        if ( (fdev->zbd_meta->zbd_nr_exp_open_zones + fdev->zbd_meta->zbd_nr_imp_open_zones + 1)
+             > fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
+
+            if ( ! fdev->zbd_meta->zbd_nr_imp_open_zones ) {
+                dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
+                dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
+                ret = -EIO;
+                goto out;
+            }
+
+            /* Close the least recently written implicitely open zone */
+            lru_zone = zbc_fake_lru_oldest(fdev);
+            if ( ! lru_zone ) {
+                dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
+                dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
+                ret = -EIO;
+                goto out;
+            }
+            zbc_zone_do_close(fdev, lru_zone);
+
+        }
+
+        /* Open the specified zone */
+        zbc_fake_set_cond(fdev, zone, ZBC_ZC_EXP_OPEN);
+        fdev->zbd_meta->zbd_nr_exp_open_zones++;
+
+    }
+
+out:
+
+    zbc_fake_unlock(fdev);
+
+    if ( ret == 0 ) {
+        zbc_fake_perf(fdev, ZBC_FAKE_PERF_OPEN, start_lba, 0);
+    }
+
+    return ret;
+
+}
+
+/**
+ * Test if a zone can be closed.
+ */
+static bool
+zbc_zone_close_allowed(struct zbc_zone *zone)
+{
+    return zbc_zone_sequential(zone)
+        && (zbc_zone_empty(zone)
+            || zbc_zone_full(zone)
+            || zbc_zone_imp_open(zone)
+            || zbc_zone_exp_open(zone));
+}
+
+/**
+ * Close zone(s).
+ */
+static int
+zbc_fake_close_zone(zbc_device_t *dev,
+                    uint64_t start_lba)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    int ret = 0;
+
+    if ( ! fdev->zbd_meta ) {
+        return -ENXIO;
+    }
+
+    zbc_fake_lock(fdev);
+
+    if ( start_lba == (uint64_t)-1 ) {
+
+        unsigned int i;
+
+        /* Close all open zones */
+        for(i = 0; i < fdev->zbd_nr_zones; i++) {
+            if ( zbc_zone_close_allowed(&fdev->zbd_zones[i]) ) {
+                zbc_zone_do_close(fdev, &fdev->zbd_zones[i]);
+            }
+        }
+
+    } else {
+
+        struct zbc_zone *zone;
+
+        /* Check start_lba */
+        if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            ret = -EIO;
+            goto out;
+        }
+
+        /* Close the specified zone */
+        zone = zbc_fake_find_zone(fdev, start_lba);
+        if ( ! zone ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+            ret = -EIO;
+            goto out;
+        }
+
+        if ( zbc_zone_conventional(zone) ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+            ret = -EIO;
+            goto out;
+        }
+
+        ret = zbc_fake_check_access(dev, zone, true);
+        if ( ret != 0 ) {
+            goto out;
+        }
+
+        if ( zbc_zone_close_allowed(zone) ) {
+            zbc_zone_do_close(fdev, zone);
+        } else if ( ! zbc_zone_closed(zone) ) {
+            ret = -EIO;
+        }
+
+    }
+
+out:
+
+    zbc_fake_unlock(fdev);
+
+    if ( ret == 0 ) {
+        zbc_fake_perf(fdev, ZBC_FAKE_PERF_CLOSE, start_lba, 0);
+    }
+
+    return ret;
+
+}
+
+/**
+ * Test if a zone can be finished.
+ */
+static bool
+zbc_zone_finish_allowed(struct zbc_zone *zone)
+{
+    return zbc_zone_sequential(zone)
+        && (zbc_zone_imp_open(zone)
+            || zbc_zone_exp_open(zone)
+            || zbc_zone_closed(zone));
+}
+
+/**
+ * Deallocate the backing storage of a range of LBAs: the range then
+ * reads as zeroes without any I/O. Ignored if the file system does
+ * not support it. Must be called with the metadata lock held and, for
+ * sequential write required zones, after any write in progress to the
+ * zone completed (see zbc_fake_zone_wait_idle). Writes to sequential write
+ * preferred zones are not tracked: the data of such a write executing
+ * concurrently with the reset or finish of its zone may still land after
+ * the range is deallocated.
+ */
+static void
+zbc_fake_punch_hole(zbc_fake_device_t *fdev,
+                    uint64_t lba,
+                    uint64_t count)
+{
+    struct zbc_device *dev = &fdev->dev;
+
+    if ( (! count) || (! fdev->zbd_punch_holes) ) {
+        return;
+    }
+
+    if ( fallocate(fdev->zbd_punch_fd,
+                   FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   lba * dev->zbd_info.zbd_logical_block_size,
+                   count * dev->zbd_info.zbd_logical_block_size) < 0 ) {
+        zbc_debug("%s: punch hole at block %llu + %llu failed %d (%s)\n",
+                  dev->zbd_filename,
+                  (unsigned long long) lba,
+                  (unsigned long long) count,
+                  errno,
+                  strerror(errno));
+        if ( (errno == EOPNOTSUPP) || (errno == ENOSYS) ) {
+            fdev->zbd_punch_holes = false;
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * Finish a zone.
+ */
+static void
+zbc_zone_do_finish(zbc_fake_device_t *fdev,
+                   struct zbc_zone *zone)
+{
+
+    zbc_fake_zone_wait_idle(fdev, zone);
+
+    if ( zbc_zone_is_open(zone) ) {
+        zbc_zone_do_close(fdev, zone);
+    }
+
+    /* Nothing was written above the write pointer */
+    if ( ! zbc_zone_full(zone) ) {
+        zbc_fake_punch_hole(fdev, zbc_zone_wp_lba(zone),
+                            zbc_zone_next_lba(zone) - zbc_zone_wp_lba(zone));
+    }
+
+    zone->zbz_write_pointer = (uint64_t)-1;
+    zbc_fake_set_cond(fdev, zone, ZBC_ZC_FULL);
+
     return;
 
 }
 
 /**
- * Open zone(s).
+ * Finish zone(s).
  */
 static int
-zbc_fake_open_zone(zbc_device_t *dev,
-                   uint64_t start_lba)
+zbc_fake_finish_zone(zbc_device_t *dev,
+                     uint64_t start_lba)
 {
     zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    unsigned int i;
     int ret = 0;
 
     if ( ! fdev->zbd_meta ) {
@@ -703,28 +1943,14 @@ zbc_fake_open_zone(zbc_device_t *dev,
 
     if ( start_lba == (uint64_t)-1 ) {
 
-        unsigned int need_open = 0;
-
-        /* Check if all closed zones can be open */
-        for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( zbc_zone_closed(&fdev->zbd_zones[i]) ) {
-                need_open++;
-            }
-        }
-        if ( (fdev->zbd_meta->zbd_nr_exp_open_zones + need_open) > fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
-            dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
-            dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
-            ret = -EIO;
-            goto out;
-        }
+        unsigned int i;
 
-        /* Open all closed zones */
+        /* Finish all open and closed zones */
         for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( zbc_zone_closed(&fdev->zbd_zones[i]) ) {
-                fdev->zbd_zones[i].zbz_condition = ZBC_ZC_EXP_OPEN;
+            if ( zbc_zone_finish_allowed(&fdev->zbd_zones[i]) ) {
+                zbc_zone_do_finish(fdev, &fdev->zbd_zones[i]);
             }
         }
-        fdev->zbd_meta->zbd_nr_exp_open_zones += need_open;
 
     } else {
 
@@ -734,10 +1960,11 @@ zbc_fake_open_zone(zbc_device_t *dev,
         if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
             dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-            return -EIO;
+            ret = -EIO;
+            goto out;
         }
 
-        /* Check target zone */
+        /* Finish the specified zone */
         zone = zbc_fake_find_zone(fdev, start_lba);
         if ( ! zone ) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
@@ -753,81 +1980,85 @@ zbc_fake_open_zone(zbc_device_t *dev,
             goto out;
         }
 
-        if ( zbc_zone_full(zone) ) {
-            /* Full zone open: do nothing (condition remains full) */
-            goto out;
-        }
-
-        if ( zbc_zone_exp_open(zone) ) {
-            /* Already open: nothing to do */
+        ret = zbc_fake_check_access(dev, zone, true);
+        if ( ret != 0 ) {
             goto out;
         }
 
-        if ( ! (zbc_zone_closed(zone)
-                || zbc_zone_imp_open(zone)
-                || zbc_zone_empty(zone)) ) {
+        if ( zbc_zone_finish_allowed(zone) || zbc_zone_empty(zone) ) {
+            zbc_zone_do_finish(fdev, zone);
+        } else if ( ! zbc_zone_full(zone) ) {
             ret = -EIO;
-            goto out;
-        }
-
-        if ( zbc_zone_imp_open(zone) ) {
-            zbc_zone_do_close(fdev, zone);
-        }
-
-        /* Check limit */
-        if ( (fdev->zbd_meta->zbd_nr_exp_open_zones + fdev->zbd_meta->zbd_nr_imp_open_zones + 1)
-             > fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
-
-            if ( ! fdev->zbd_meta->zbd_nr_imp_open_zones ) {
-                dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
-                dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
-                ret = -EIO;
-                goto out;
-            }
-
-            /* Close an implicitely open zone */
-            for(i = 0; i < fdev->zbd_nr_zones; i++) {
-                if ( zbc_zone_imp_open(&fdev->zbd_zones[i]) ) {
-                    zbc_zone_do_close(fdev, &fdev->zbd_zones[i]);
-                    break;
-                }
-            }
-
         }
 
-        /* Open the specified zone */
-        zone->zbz_condition = ZBC_ZC_EXP_OPEN;
-        fdev->zbd_meta->zbd_nr_exp_open_zones++;
-
     }
 
 out:
 
     zbc_fake_unlock(fdev);
 
+    if ( ret == 0 ) {
+        zbc_fake_perf(fdev, ZBC_FAKE_PERF_FINISH, start_lba, 0);
+    }
+
     return ret;
 
 }
 
 /**
- * Test if a zone can be closed.
+ * Test if a zone write pointer can be reset.
  */
 static bool
-zbc_zone_close_allowed(struct zbc_zone *zone)
+zbc_zone_reset_allowed(struct zbc_zone *zone)
 {
     return zbc_zone_sequential(zone)
-        && (zbc_zone_empty(zone)
-            || zbc_zone_full(zone)
-            || zbc_zone_imp_open(zone)
-            || zbc_zone_exp_open(zone));
+        && (zbc_zone_imp_open(zone)
+            || zbc_zone_exp_open(zone)
+            || zbc_zone_closed(zone)
+            || zbc_zone_empty(zone)
+            || zbc_zone_full(zone));
 }
 
 /**
- * Close zone(s).
+ * Reset a zone write pointer.
+ */
+static void
+zbc_zone_do_reset(zbc_fake_device_t *fdev,
+                  struct zbc_zone *zone)
+{
+
+    zbc_fake_zone_wait_idle(fdev, zone);
+
+    if ( ! zbc_zone_empty(zone) ) {
+
+        if ( zbc_zone_is_open(zone) ) {
+            zbc_zone_do_close(fdev, zone);
+        }
+
+        /* Drop the zone data */
+        if ( zbc_zone_full(zone) ) {
+            zbc_fake_punch_hole(fdev, zbc_zone_start_lba(zone), zbc_zone_length(zone));
+        } else {
+            zbc_fake_punch_hole(fdev, zbc_zone_start_lba(zone),
+                                zbc_zone_wp_lba(zone) - zbc_zone_start_lba(zone));
+        }
+
+        zone->zbz_write_pointer = zbc_zone_start_lba(zone);
+        zone->zbz_flags &= ~ZBC_ZF_NON_SEQ;
+        zbc_fake_set_cond(fdev, zone, ZBC_ZC_EMPTY);
+
+    }
+
+    return;
+
+}
+
+/**
+ * Reset zone(s) write pointer.
  */
 static int
-zbc_fake_close_zone(zbc_device_t *dev,
-                    uint64_t start_lba)
+zbc_fake_reset_wp(struct zbc_device *dev,
+                  uint64_t start_lba)
 {
     zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
     int ret = 0;
@@ -842,10 +2073,10 @@ zbc_fake_close_zone(zbc_device_t *dev,
 
         unsigned int i;
 
-        /* Close all open zones */
+        /* Reset all open, closed and full zones */
         for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( zbc_zone_close_allowed(&fdev->zbd_zones[i]) ) {
-                zbc_zone_do_close(fdev, &fdev->zbd_zones[i]);
+            if ( zbc_zone_reset_allowed(&fdev->zbd_zones[i]) ) {
+                zbc_zone_do_reset(fdev, &fdev->zbd_zones[i]);
             }
         }
 
@@ -857,10 +2088,11 @@ zbc_fake_close_zone(zbc_device_t *dev,
         if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
             dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-            return -EIO;
+            ret = -EIO;
+            goto out;
         }
 
-        /* Close the specified zone */
+        /* Reset the specified zone */
         zone = zbc_fake_find_zone(fdev, start_lba);
         if ( ! zone ) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
@@ -876,9 +2108,14 @@ zbc_fake_close_zone(zbc_device_t *dev,
             goto out;
         }
 
-        if ( zbc_zone_close_allowed(zone) ) {
-            zbc_zone_do_close(fdev, zone);
-        } else if ( ! zbc_zone_closed(zone) ) {
+        ret = zbc_fake_check_access(dev, zone, true);
+        if ( ret != 0 ) {
+            goto out;
+        }
+
+        if ( zbc_zone_reset_allowed(zone) ) {
+            zbc_zone_do_reset(fdev, zone);
+        } else if ( ! zbc_zone_empty(zone) ) {
             ret = -EIO;
         }
 
@@ -888,215 +2125,385 @@ out:
 
     zbc_fake_unlock(fdev);
 
+    if ( ret == 0 ) {
+        zbc_fake_perf(fdev, ZBC_FAKE_PERF_RESET, start_lba, 0);
+    }
+
     return ret;
 
 }
 
 /**
- * Test if a zone can be finished.
+ * Reset the write pointer of a sorted list of zones
+ * in a single pass over the zone array.
  */
-static bool
-zbc_zone_finish_allowed(struct zbc_zone *zone)
+static int
+zbc_fake_reset_zones(struct zbc_device *dev,
+                     const uint64_t *start_lbas,
+                     unsigned int nr_zones)
 {
-    return zbc_zone_sequential(zone)
-        && (zbc_zone_imp_open(zone)
-            || zbc_zone_exp_open(zone)
-            || zbc_zone_closed(zone));
-}
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    struct zbc_zone *zone;
+    unsigned int i, z = 0;
+    int ret = 0;
 
-/**
- * Finish a zone.
- */
-static void
-zbc_zone_do_finish(zbc_fake_device_t *fdev,
-                   struct zbc_zone *zone)
-{
+    if ( ! fdev->zbd_meta ) {
+        return -ENXIO;
+    }
+
+    zbc_fake_lock(fdev);
+
+    for(i = 0; i < nr_zones; i++) {
+
+        while( (z < fdev->zbd_nr_zones)
+               && (fdev->zbd_zones[z].zbz_start < start_lbas[i]) ) {
+            z++;
+        }
+
+        if ( (z >= fdev->zbd_nr_zones)
+             || (fdev->zbd_zones[z].zbz_start != start_lbas[i])
+             || zbc_zone_conventional(&fdev->zbd_zones[z]) ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            if ( start_lbas[i] > dev->zbd_info.zbd_logical_blocks - 1 ) {
+                dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            } else {
+                dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
+            }
+            ret = -EIO;
+            continue;
+        }
+
+        zone = &fdev->zbd_zones[z];
+        if ( zbc_fake_check_access(dev, zone, true) != 0 ) {
+            ret = -EIO;
+        } else if ( zbc_zone_reset_allowed(zone) ) {
+            zbc_zone_do_reset(fdev, zone);
+        } else if ( ! zbc_zone_empty(zone) ) {
+            ret = -EIO;
+        }
 
-    if ( zbc_zone_is_open(zone) ) {
-        zbc_zone_do_close(fdev, zone);
     }
 
-    zone->zbz_write_pointer = (uint64_t)-1;
-    zone->zbz_condition = ZBC_ZC_FULL;
+    zbc_fake_unlock(fdev);
 
-    return;
+    /* One command per zone */
+    for(i = 0; i < nr_zones; i++) {
+        zbc_fake_perf(fdev, ZBC_FAKE_PERF_RESET, start_lbas[i], 0);
+    }
+
+    return ret;
 
 }
 
 /**
- * Finish zone(s).
+ * Check a read and get its start LBA in the device. If @data_count is
+ * not NULL, it returns the number of blocks to transfer, the remaining
+ * blocks being above the write pointer of a zone (and so read as zeroes).
+ * Must be called with the metadata lock held.
  */
 static int
-zbc_fake_finish_zone(zbc_device_t *dev,
-                     uint64_t start_lba)
+zbc_fake_check_read(zbc_fake_device_t *fdev,
+                    struct zbc_zone *z,
+                    uint32_t lba_count,
+                    uint64_t *start_lba,
+                    uint32_t *data_count)
 {
-    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    int ret = 0;
+    struct zbc_device *dev = &fdev->dev;
+    struct zbc_zone *zone, *next_zone;
+    uint64_t lba;
 
-    if ( ! fdev->zbd_meta ) {
-        return -ENXIO;
+    /* Find the target zone */
+    zone = zbc_fake_find_zone(fdev, zbc_zone_start_lba(z));
+    if ( ! zone ) {
+        return -EIO;
     }
 
-    zbc_fake_lock(fdev);
+    if ( *start_lba > zbc_zone_length(zone) ) {
+        return -EIO;
+    }
 
-    if ( start_lba == (uint64_t)-1 ) {
+    if ( zbc_fake_check_access(dev, zone, false) != 0 ) {
+        return -EIO;
+    }
 
-        unsigned int i;
+    lba = zbc_zone_next_lba(zone);
+    next_zone = zbc_fake_find_zone(fdev, lba);
+    *start_lba += zbc_zone_start_lba(zone);
+
+    /* Note: unrestricted read will be added to the standard */
+    /* and supported by a drive if the URSWRZ bit is set in  */
+    /* VPD page. So this test will need to change.           */
+    if ( zone->zbz_type == ZBC_ZT_SEQUENTIAL_REQ ) {
+
+        /* Cannot read unwritten data */
+        if ( (*start_lba + lba_count) > lba ) {
+            if ( next_zone ) {
+                dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+                dev->zbd_errno.asc_ascq = ZBC_E_READ_BOUNDARY_VIOLATION;
+            } else {
+                dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+                dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            }
+            return -EIO;
+        }
+
+        if ( (*start_lba + lba_count) > zbc_zone_wp_lba(zone) ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_ATTEMPT_TO_READ_INVALID_DATA;
+            return -EIO;
+        }
+
+    } else {
+
+        /* Unwritten blocks of a sequential preferred zone read as zeroes */
+        if ( data_count
+             && zbc_zone_sequential_pref(zone)
+             && (! zbc_zone_full(zone))
+             && ((*start_lba + lba_count) <= lba)
+             && ((*start_lba + lba_count) > zbc_zone_wp_lba(zone)) ) {
+            if ( *start_lba >= zbc_zone_wp_lba(zone) ) {
+                *data_count = 0;
+            } else {
+                *data_count = zbc_zone_wp_lba(zone) - *start_lba;
+            }
+        }
+
+        /* Reads spanning other types of zones are OK. */
+
+        if ( (*start_lba + lba_count) > lba ) {
+
+            uint64_t count = *start_lba + lba_count - lba;
+
+            while( count && next_zone ) {
+                if ( zbc_zone_sequential_req(next_zone) ) {
+                    dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+                    dev->zbd_errno.asc_ascq = ZBC_E_ATTEMPT_TO_READ_INVALID_DATA;
+                    return -EIO;
+                }
+                if ( zbc_fake_check_access(dev, next_zone, false) != 0 ) {
+                    return -EIO;
+                }
+                if ( count > zbc_zone_length(next_zone) ) {
+                    count -= zbc_zone_length(next_zone);
+                } else {
+                    count = 0;
+                }
+                lba += zbc_zone_length(next_zone);
+                next_zone = zbc_fake_find_zone(fdev, lba);
+            }
 
-        /* Finish all open and closed zones */
-        for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( zbc_zone_finish_allowed(&fdev->zbd_zones[i]) ) {
-                zbc_zone_do_finish(fdev, &fdev->zbd_zones[i]);
+            if ( count ) {
+                dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+                dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+                return -EIO;
             }
+
         }
 
-    } else {
+    }
 
-        struct zbc_zone *zone;
+    return 0;
 
-        /* Check start_lba */
-        if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-            return -EIO;
-        }
+}
 
-        /* Finish the specified zone */
-        zone = zbc_fake_find_zone(fdev, start_lba);
-        if ( ! zone ) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
-            ret = -EIO;
-            goto out;
-        }
+/**
+ * Copy data between a vector and the device data mapping.
+ * Returns the number of bytes copied.
+ */
+static size_t
+zbc_fake_copy_data(zbc_fake_device_t *fdev,
+                   const struct iovec *iov,
+                   int iovcnt,
+                   off_t offset,
+                   int write)
+{
+    size_t len, done = 0;
+    int i;
 
-        if ( zbc_zone_conventional(zone) ) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
-            ret = -EIO;
-            goto out;
+    for(i = 0; (i < iovcnt) && ((size_t)offset < fdev->zbd_data_size); i++) {
+        len = iov[i].iov_len;
+        if ( len > fdev->zbd_data_size - offset ) {
+            len = fdev->zbd_data_size - offset;
         }
-
-        if ( zbc_zone_finish_allowed(zone) || zbc_zone_empty(zone) ) {
-            zbc_zone_do_finish(fdev, zone);
-        } else if ( ! zbc_zone_full(zone) ) {
-            ret = -EIO;
+        if ( write ) {
+            memcpy(fdev->zbd_data + offset, iov[i].iov_base, len);
+        } else {
+            memcpy(iov[i].iov_base, fdev->zbd_data + offset, len);
         }
-
+        offset += len;
+        done += len;
     }
 
-out:
-
-    zbc_fake_unlock(fdev);
-
-    return ret;
+    return done;
 
 }
 
 /**
- * Test if a zone write pointer can be reset.
+ * Zero the buffers of a vector from byte @ofst.
  */
-static bool
-zbc_zone_reset_allowed(struct zbc_zone *zone)
+static void
+zbc_fake_zero_iov(const struct iovec *iov,
+                  int iovcnt,
+                  size_t ofst)
 {
-    return zbc_zone_sequential(zone)
-        && (zbc_zone_imp_open(zone)
-            || zbc_zone_exp_open(zone)
-            || zbc_zone_closed(zone)
-            || zbc_zone_empty(zone)
-            || zbc_zone_full(zone));
+    int i;
+
+    for(i = 0; i < iovcnt; i++) {
+        if ( ofst < iov[i].iov_len ) {
+            memset((uint8_t *)iov[i].iov_base + ofst, 0, iov[i].iov_len - ofst);
+            ofst = 0;
+        } else {
+            ofst -= iov[i].iov_len;
+        }
+    }
+
+    return;
+
 }
 
 /**
- * Reset a zone write pointer.
+ * Read the first @size bytes of a vector from the device.
+ * Returns the number of bytes read or a negative error code.
  */
-static void
-zbc_zone_do_reset(zbc_fake_device_t *fdev,
-                  struct zbc_zone *zone)
+static ssize_t
+zbc_fake_read_data(zbc_fake_device_t *fdev,
+                   const struct iovec *iov,
+                   int iovcnt,
+                   off_t offset,
+                   size_t size)
 {
+    struct iovec *tiov;
+    ssize_t ret;
+    int i;
 
-    if ( ! zbc_zone_empty(zone) ) {
+    tiov = malloc(sizeof(struct iovec) * iovcnt);
+    if ( ! tiov ) {
+        return -ENOMEM;
+    }
 
-        if ( zbc_zone_is_open(zone) ) {
-            zbc_zone_do_close(fdev, zone);
+    for(i = 0; (i < iovcnt) && size; i++) {
+        tiov[i] = iov[i];
+        if ( tiov[i].iov_len > size ) {
+            tiov[i].iov_len = size;
         }
+        size -= tiov[i].iov_len;
+    }
 
-        zone->zbz_write_pointer = zbc_zone_start_lba(zone);
-        zone->zbz_condition = ZBC_ZC_EMPTY;
-
+    if ( fdev->zbd_data ) {
+        ret = zbc_fake_copy_data(fdev, tiov, i, offset, 0);
+    } else {
+        ret = preadv(fdev->dev.zbd_fd, tiov, i, offset);
+        if ( ret < 0 ) {
+            ret = -errno;
+        }
     }
 
-    return;
+    free(tiov);
+
+    return ret;
 
 }
 
 /**
- * Reset zone(s) write pointer.
+ * Vectored read from the emulated device/file.
  */
-static int
-zbc_fake_reset_wp(struct zbc_device *dev,
-                  uint64_t start_lba)
+static int32_t
+zbc_fake_preadv(struct zbc_device *dev,
+                struct zbc_zone *z,
+                const struct iovec *iov,
+                int iovcnt,
+                uint32_t lba_count,
+                uint64_t start_lba)
 {
     zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    int ret = 0;
+    uint32_t data_count = lba_count;
+    ssize_t ret;
+    off_t offset;
+    size_t size;
 
     if ( ! fdev->zbd_meta ) {
         return -ENXIO;
     }
 
     zbc_fake_lock(fdev);
+    ret = zbc_fake_check_read(fdev, z, lba_count, &start_lba, &data_count);
 
-    if ( start_lba == (uint64_t)-1 ) {
+    /* The data read is below the write pointer (or in a zone without one):
+     * transfer it without holding the metadata lock */
+    zbc_fake_unlock(fdev);
 
-        unsigned int i;
+    if ( ret != 0 ) {
+        return ret;
+    }
 
-        /* Reset all open, closed and full zones */
-        for(i = 0; i < fdev->zbd_nr_zones; i++) {
-            if ( zbc_zone_reset_allowed(&fdev->zbd_zones[i]) ) {
-                zbc_zone_do_reset(fdev, &fdev->zbd_zones[i]);
-            }
+    zbc_fake_perf(fdev, ZBC_FAKE_PERF_READ, start_lba, lba_count);
+
+    /* XXX: check for overflows */
+    offset = start_lba * dev->zbd_info.zbd_logical_block_size;
+
+    if ( data_count < lba_count ) {
+        /* Zero-fill unwritten blocks and transfer the others */
+        size = (size_t) data_count * dev->zbd_info.zbd_logical_block_size;
+        zbc_fake_zero_iov(iov, iovcnt, size);
+        ret = 0;
+        if ( size ) {
+            ret = zbc_fake_read_data(fdev, iov, iovcnt, offset, size);
+        }
+        if ( ret >= 0 ) {
+            ret = lba_count;
         }
+        return ret;
+    }
 
+    if ( fdev->zbd_data ) {
+        ret = zbc_fake_copy_data(fdev, iov, iovcnt, offset, 0);
     } else {
+        ret = preadv(dev->zbd_fd, iov, iovcnt, offset);
+    }
+    if ( ret < 0 ) {
+        ret = -errno;
+    } else {
+        ret /= dev->zbd_info.zbd_logical_block_size;
+    }
 
-        struct zbc_zone *zone;
+    return ret;
 
-        /* Check start_lba */
-        if ( start_lba > dev->zbd_info.zbd_logical_blocks - 1) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-            return -EIO;
-        }
+}
 
-        /* Reset the specified zone */
-        zone = zbc_fake_find_zone(fdev, start_lba);
-        if ( ! zone ) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
-            ret = -EIO;
-            goto out;
-        }
+/**
+ * Get the address of data in the device data mapping.
+ */
+static int32_t
+zbc_fake_pread_borrow(struct zbc_device *dev,
+                      struct zbc_zone *z,
+                      const void **buf,
+                      uint32_t lba_count,
+                      uint64_t start_lba)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    int ret;
 
-        if ( zbc_zone_conventional(zone) ) {
-            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_INVALID_FIELD_IN_CDB;
-            ret = -EIO;
-            goto out;
-        }
+    if ( ! fdev->zbd_meta ) {
+        return -ENXIO;
+    }
 
-        if ( zbc_zone_reset_allowed(zone) ) {
-            zbc_zone_do_reset(fdev, zone);
-        } else if ( ! zbc_zone_empty(zone) ) {
-            ret = -EIO;
-        }
+    if ( ! fdev->zbd_data ) {
+        return -ENOTSUP;
+    }
 
+    zbc_fake_lock(fdev);
+    ret = zbc_fake_check_read(fdev, z, lba_count, &start_lba, NULL);
+    zbc_fake_unlock(fdev);
+
+    if ( ret != 0 ) {
+        return ret;
     }
 
-out:
+    zbc_fake_perf(fdev, ZBC_FAKE_PERF_READ, start_lba, lba_count);
 
-    zbc_fake_unlock(fdev);
+    *buf = fdev->zbd_data + start_lba * dev->zbd_info.zbd_logical_block_size;
 
-    return ret;
+    return lba_count;
 
 }
 
@@ -1110,120 +2517,169 @@ zbc_fake_pread(struct zbc_device *dev,
                uint32_t lba_count,
                uint64_t start_lba)
 {
-    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    struct zbc_zone *zone, *next_zone;
-    uint64_t lba;
-    ssize_t ret = -EIO;
-    off_t offset;
-    size_t count;
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
 
-    if ( ! fdev->zbd_meta ) {
-        return -ENXIO;
-    }
+    return( zbc_fake_preadv(dev, z, &iov, 1, lba_count, start_lba) );
 
-    zbc_fake_lock(fdev);
+}
 
-    /* Find the target zone */
-    zone = zbc_fake_find_zone(fdev, zbc_zone_start_lba(z));
-    if ( ! zone ) {
-        goto out;
-    }
+/**
+ * Implicitly open a zone being written, closing the least recently
+ * written implicitly open zone if too many zones are open. If the
+ * zone is already implicitly open, make it the most recently written.
+ */
+static void
+zbc_fake_zone_write(zbc_fake_device_t *fdev,
+                    struct zbc_zone *zone)
+{
+    struct zbc_zone *lru_zone;
+
+    if ( ! zbc_zone_is_open(zone) ) {
+
+        if ( fdev->zbd_meta->zbd_nr_imp_open_zones >= fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
+            lru_zone = zbc_fake_lru_oldest(fdev);
+            if ( lru_zone ) {
+                zbc_zone_do_close(fdev, lru_zone);
+            }
+        }
+
+        zbc_fake_set_cond(fdev, zone, ZBC_ZC_IMP_OPEN);
+        fdev->zbd_meta->zbd_nr_imp_open_zones++;
+        zbc_fake_lru_add(fdev, zone);
+
+    } else if ( zbc_zone_imp_open(zone) ) {
+
+        /* Most recently written */
+        zbc_fake_lru_del(fdev, zone);
+        zbc_fake_lru_add(fdev, zone);
 
-    if ( start_lba > zbc_zone_length(zone) ) {
-        goto out;
     }
 
-    lba = zbc_zone_next_lba(zone);
-    next_zone = zbc_fake_find_zone(fdev, lba);
-    start_lba += zbc_zone_start_lba(zone);
+    return;
 
-    /* Note: unrestricted read will be added to the standard */
-    /* and supported by a drive if the URSWRZ bit is set in  */
-    /* VPD page. So this test will need to change.           */
-    if ( zone->zbz_type == ZBC_ZT_SEQUENTIAL_REQ ) {
+}
 
-        /* Cannot read unwritten data */
-        if ( (start_lba + lba_count) > lba ) {
-            if ( next_zone ) {
-                dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-                dev->zbd_errno.asc_ascq = ZBC_E_READ_BOUNDARY_VIOLATION;
-            } else {
-                dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-                dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-            }
-            goto out;
+/**
+ * Check that the @count blocks from @lba, written by a write crossing the
+ * end of a sequential write preferred zone, are in zones that can be
+ * written: not sequential write required, read-only or offline zones.
+ * Must be called with the metadata lock held.
+ */
+static int
+zbc_fake_check_write_span(zbc_fake_device_t *fdev,
+                          uint64_t lba,
+                          uint64_t count)
+{
+    struct zbc_device *dev = &fdev->dev;
+    struct zbc_zone *zone;
+
+    while( count ) {
+
+        zone = zbc_fake_find_zone(fdev, lba);
+        if ( ! zone ) {
+            dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
+            dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            return -EIO;
         }
 
-        if ( (start_lba + lba_count) > zbc_zone_wp_lba(zone) ) {
+        if ( zbc_zone_sequential_req(zone) ) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-            dev->zbd_errno.asc_ascq = ZBC_E_ATTEMPT_TO_READ_INVALID_DATA;
-            goto out;
+            dev->zbd_errno.asc_ascq = ZBC_E_WRITE_BOUNDARY_VIOLATION;
+            return -EIO;
         }
 
-    } else {
+        if ( zbc_fake_check_access(dev, zone, true) != 0 ) {
+            return -EIO;
+        }
 
-        /* Reads spanning other types of zones are OK. */
+        if ( count <= zbc_zone_length(zone) ) {
+            break;
+        }
+        count -= zbc_zone_length(zone);
+        lba = zbc_zone_next_lba(zone);
 
-        if ( (start_lba + lba_count) > lba ) {
+    }
 
-            uint64_t count = start_lba + lba_count - lba;
+    return 0;
 
-            while( count && next_zone ) {
-                if ( zbc_zone_sequential_req(next_zone) ) {
-                    dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
-                    dev->zbd_errno.asc_ascq = ZBC_E_ATTEMPT_TO_READ_INVALID_DATA;
-                    goto out;
-                }
-                if ( count > zbc_zone_length(next_zone) ) {
-                    count -= zbc_zone_length(next_zone);
-                }
-                lba += zbc_zone_length(next_zone);
-            }
+}
 
-        }
+/**
+ * Update a sequential write preferred zone written from @lba up to
+ * @end_lba (excluded, possibly beyond the zone end). Returns true if
+ * the write made the zone non-sequential. Must be called with the
+ * metadata lock held.
+ */
+static bool
+zbc_fake_pref_zone_write(zbc_fake_device_t *fdev,
+                         struct zbc_zone *zone,
+                         uint64_t lba,
+                         uint64_t end_lba)
+{
+    bool non_seq = false;
 
+    if ( end_lba > zbc_zone_next_lba(zone) ) {
+        end_lba = zbc_zone_next_lba(zone);
     }
 
-    /* XXX: check for overflows */
-    count = lba_count * dev->zbd_info.zbd_logical_block_size;
-    offset = start_lba * dev->zbd_info.zbd_logical_block_size;
-
-    ret = pread(dev->zbd_fd, buf, count, offset);
-    if ( ret < 0 ) {
-        ret = -errno;
-    } else {
-        ret /= dev->zbd_info.zbd_logical_block_size;
+    /* Any write is accepted, but writes not starting at
+     * the write pointer make the zone non-sequential. */
+    if ( zbc_zone_full(zone) || (lba != zbc_zone_wp_lba(zone)) ) {
+        zone->zbz_flags |= ZBC_ZF_NON_SEQ;
+        non_seq = true;
     }
 
-out:
+    /* The write pointer is the end of the highest write. Update it
+     * before the transfer as nothing serializes the writes. */
+    if ( ! zbc_zone_full(zone) ) {
+
+        zbc_fake_zone_write(fdev, zone);
 
-    zbc_fake_unlock(fdev);
+        if ( end_lba > zbc_zone_wp_lba(zone) ) {
+            zone->zbz_write_pointer = end_lba;
+        }
 
-    return ret;
+        if ( zbc_zone_wp_lba(zone) >= zbc_zone_next_lba(zone) ) {
+            zbc_zone_do_close(fdev, zone);
+            zone->zbz_write_pointer = zbc_zone_next_lba(zone);
+            zbc_fake_set_cond(fdev, zone, ZBC_ZC_FULL);
+        }
+
+    }
+
+    return non_seq;
 
 }
 
 /**
- * Write to the emulated device/file.
+ * Vectored write to the emulated device/file.
  */
 static int32_t
-zbc_fake_pwrite(struct zbc_device *dev,
-                struct zbc_zone *z,
-                const void *buf,
-                uint32_t lba_count,
-                uint64_t start_lba)
+zbc_fake_pwritev(struct zbc_device *dev,
+                 struct zbc_zone *z,
+                 const struct iovec *iov,
+                 int iovcnt,
+                 uint32_t lba_count,
+                 uint64_t start_lba)
 {
     zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
     struct zbc_zone *zone, *next_zone;
+    bool non_seq = false;
     uint64_t lba;
     off_t offset;
-    size_t count;
     ssize_t ret = -EIO;
 
     if ( ! fdev->zbd_meta ) {
         return -ENXIO;
     }
 
+    if ( fdev->zbd_data && (! (fdev->zbd_data_prot & PROT_WRITE)) ) {
+        return -EBADF;
+    }
+
     zbc_fake_lock(fdev);
 
     /* Find the target zone */
@@ -1232,98 +2688,126 @@ zbc_fake_pwrite(struct zbc_device *dev,
         goto out;
     }
 
-    /* Writes cannot span zones */
     if ( start_lba > zbc_zone_length(zone) ) {
         goto out;
     }
 
+    if ( zbc_fake_check_access(dev, zone, true) != 0 ) {
+        goto out;
+    }
+
     lba = zbc_zone_next_lba(zone);
     next_zone = zbc_fake_find_zone(fdev, lba);
     start_lba += zone->zbz_start;
 
     if ( (start_lba + lba_count) > lba ) {
-        if ( next_zone ) {
+        if ( zbc_zone_sequential_pref(zone) ) {
+            /* Writes spanning other types of zones are OK */
+            if ( zbc_fake_check_write_span(fdev, lba, start_lba + lba_count - lba) != 0 ) {
+                goto out;
+            }
+        } else if ( next_zone ) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
             dev->zbd_errno.asc_ascq = ZBC_E_WRITE_BOUNDARY_VIOLATION;
+            goto out;
         } else {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
             dev->zbd_errno.asc_ascq = ZBC_E_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            goto out;
         }
-        goto out;
     }
 
     if ( zbc_zone_sequential_req(zone) ) {
 
-        /* Can only write at the write pointer */
-        if ( start_lba != zbc_zone_wp_lba(zone) ) {
+        /* Can only write at the write pointer, once */
+        if ( (start_lba != zbc_zone_wp_lba(zone)) || zbc_fake_zone_busy(fdev, zone) ) {
             dev->zbd_errno.sk = ZBC_E_ILLEGAL_REQUEST;
             dev->zbd_errno.asc_ascq = ZBC_E_UNALIGNED_WRITE_COMMAND;
             goto out;
         }
 
         /* Can only write an open zone */
-        if ( ! zbc_zone_is_open(zone) ) {
+        if ( (! zbc_zone_is_open(zone))
+             && (fdev->zbd_meta->zbd_nr_exp_open_zones >= fdev->dev.zbd_info.zbd_max_nr_open_seq_req) ) {
+            /* Too many explicit open on-going */
+            dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
+            dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
+            ret = -EIO;
+            goto out;
+        }
 
-            if ( fdev->zbd_meta->zbd_nr_exp_open_zones >= fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
-                /* Too many explicit open on-going */
-                dev->zbd_errno.sk = ZBC_E_ABORTED_COMMAND;
-                dev->zbd_errno.asc_ascq = ZBC_E_INSUFFICIENT_ZONE_RESOURCES;
-                ret = -EIO;
-                goto out;
-            }
+        zbc_fake_zone_write(fdev, zone);
 
-            /* Implicitely open the zone */
-            if ( fdev->zbd_meta->zbd_nr_imp_open_zones >= fdev->dev.zbd_info.zbd_max_nr_open_seq_req ) {
-                unsigned int i;
-                for(i = 0; i < fdev->zbd_nr_zones; i++) {
-                    if ( zbc_zone_imp_open(&fdev->zbd_zones[i]) ) {
-                        zbc_zone_do_close(fdev, &fdev->zbd_zones[i]);
-                        break;
-                    }
-                }
-            }
+        zbc_fake_set_zone_busy(fdev, zone, true);
 
-            zone->zbz_condition = ZBC_ZC_IMP_OPEN;
-            fdev->zbd_meta->zbd_nr_imp_open_zones++;
+    } else if ( zbc_zone_sequential_pref(zone) ) {
 
+        /* Update the zones written, the write continuing
+         * into the following zones if it crosses the zone end */
+        next_zone = zone;
+        lba = start_lba;
+        while( next_zone && (lba < (start_lba + lba_count)) ) {
+            if ( zbc_zone_sequential_pref(next_zone) ) {
+                non_seq |= zbc_fake_pref_zone_write(fdev, next_zone, lba,
+                                                    start_lba + lba_count);
+            }
+            lba = zbc_zone_next_lba(next_zone);
+            next_zone = zbc_fake_find_zone(fdev, lba);
         }
 
     }
 
+    /* Transfer data without holding the metadata lock */
+    zbc_fake_unlock(fdev);
+
+    zbc_fake_perf(fdev, non_seq ? ZBC_FAKE_PERF_NON_SEQ_WRITE : ZBC_FAKE_PERF_WRITE,
+                  start_lba, lba_count);
+
     /* XXX: check for overflows */
-    count = (size_t)lba_count * dev->zbd_info.zbd_logical_block_size;
     offset = start_lba * dev->zbd_info.zbd_logical_block_size;
 
-    ret = pwrite(dev->zbd_fd, buf, count, offset);
+    if ( fdev->zbd_data ) {
+        ret = zbc_fake_copy_data(fdev, iov, iovcnt, offset, 1);
+    } else {
+        ret = pwritev(dev->zbd_fd, iov, iovcnt, offset);
+    }
     if ( ret < 0 ) {
-
         ret = -errno;
-
     } else {
-
         ret /= dev->zbd_info.zbd_logical_block_size;
+    }
 
-        if ( zbc_zone_sequential_req(zone) ) {
-
-            /*
-             * XXX: What protects us from a return value that's not LBA aligned?
-             * (Except for hoping the OS implementation isn't insane..)
-             */
-            if ( (zbc_zone_wp_lba(zone) + lba_count) >= zbc_zone_next_lba(zone) ) {
-                if ( zbc_zone_imp_open(zone) ) {
-                    fdev->zbd_meta->zbd_nr_imp_open_zones--;
-                } else {
-                    fdev->zbd_meta->zbd_nr_exp_open_zones--;
-                }
-            }
+    if ( ! zbc_zone_sequential_req(zone) ) {
+        return ret;
+    }
 
-            /* Advance write pointer */
-            zbc_zone_wp_lba_inc(zone, lba_count);
+    zbc_fake_lock(fdev);
 
+    /* Advance the write pointer: resets and finishes of the
+     * zone waited for the transfer to complete */
+    if ( (zbc_zone_wp_lba(zone) == start_lba) && (ret > 0) ) {
+
+        /*
+         * XXX: What protects us from a return value that's not LBA aligned?
+         * (Except for hoping the OS implementation isn't insane..)
+         */
+        if ( (zbc_zone_wp_lba(zone) + ret) >= zbc_zone_next_lba(zone) ) {
+            if ( zbc_zone_imp_open(zone) ) {
+                fdev->zbd_meta->zbd_nr_imp_open_zones--;
+                zbc_fake_lru_del(fdev, zone);
+            } else if ( zbc_zone_exp_open(zone) ) {
+                fdev->zbd_meta->zbd_nr_exp_open_zones--;
+            }
+            zone->zbz_write_pointer = zbc_zone_next_lba(zone);
+            zbc_fake_set_cond(fdev, zone, ZBC_ZC_FULL);
+        } else {
+            zone->zbz_write_pointer += ret;
         }
 
     }
 
+    zbc_fake_set_zone_busy(fdev, zone, false);
+
 out:
 
     zbc_fake_unlock(fdev);
@@ -1332,6 +2816,25 @@ out:
 
 }
 
+/**
+ * Write to the emulated device/file.
+ */
+static int32_t
+zbc_fake_pwrite(struct zbc_device *dev,
+                struct zbc_zone *z,
+                const void *buf,
+                uint32_t lba_count,
+                uint64_t start_lba)
+{
+    struct iovec iov = {
+        .iov_base = (void *) buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
+
+    return( zbc_fake_pwritev(dev, z, &iov, 1, lba_count, start_lba) );
+
+}
+
 /**
  * Flush the emulated device data and metadata.
  */
@@ -1348,7 +2851,12 @@ zbc_fake_flush(struct zbc_device *dev,
         return -ENXIO;
     }
 
+    zbc_fake_perf(fdev, ZBC_FAKE_PERF_FLUSH, 0, 0);
+
     ret = msync(fdev->zbd_meta, fdev->zbd_meta_size, MS_SYNC);
+    if ( (ret == 0) && fdev->zbd_data && (fdev->zbd_data_prot & PROT_WRITE) ) {
+        ret = msync(fdev->zbd_data, fdev->zbd_data_size, MS_SYNC);
+    }
     if ( ret == 0 ) {
         ret = fsync(dev->zbd_fd);
     }
@@ -1358,19 +2866,19 @@ zbc_fake_flush(struct zbc_device *dev,
 }
 
 /**
- * Initialize an emulated device metadata.
+ * Create an emulated device metadata for @nr_zones zones
+ * covering @nr_lbas logical blocks. The zone descriptors
+ * must then be filled and zbc_fake_init_zones() called.
  */
 static int
-zbc_fake_set_zones(struct zbc_device *dev,
-                   uint64_t conv_sz,
-                   uint64_t zone_sz)
+zbc_fake_create_metadata(zbc_fake_device_t *fdev,
+                         uint32_t nr_conv_zones,
+                         uint32_t nr_seq_zones,
+                         uint64_t nr_lbas)
 {
-    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
-    uint64_t lba = 0, device_size = dev->zbd_info.zbd_logical_blocks;
+    struct zbc_device *dev = &fdev->dev;
     zbc_fake_meta_t fmeta;
     char meta_path[512];
-    struct zbc_zone *zone;
-    unsigned int z = 0;
     int ret;
 
     /* Initialize metadata */
@@ -1382,37 +2890,26 @@ zbc_fake_set_zones(struct zbc_device *dev,
 
     pthread_mutexattr_init(&fdev->zbd_mutex_attr);
     pthread_mutexattr_setpshared(&fdev->zbd_mutex_attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&fdev->zbd_mutex_attr, PTHREAD_MUTEX_ROBUST);
 
-    /* Calculate zone configuration */
-    if ( (conv_sz + zone_sz) > device_size ) {
-        zbc_error("%s: invalid zone sizes (too large)\n",
-                  fdev->dev.zbd_filename);
-        return -EINVAL;
-    }
-
-    fmeta.zbd_nr_conv_zones = conv_sz / zone_sz;
-    if ( conv_sz && (! fmeta.zbd_nr_conv_zones) ) {
-        fmeta.zbd_nr_conv_zones = 1;
-    }
-
-    fmeta.zbd_nr_seq_zones = (device_size - (fmeta.zbd_nr_conv_zones * zone_sz)) / zone_sz;
-    if ( ! fmeta.zbd_nr_seq_zones ) {
-        zbc_error("%s: invalid zone sizes (too large)\n",
-                  fdev->dev.zbd_filename);
-        return -EINVAL;
-    }
-
-    fmeta.zbd_nr_zones = fmeta.zbd_nr_conv_zones + fmeta.zbd_nr_seq_zones;
+    fmeta.zbd_nr_conv_zones = nr_conv_zones;
+    fmeta.zbd_nr_seq_zones = nr_seq_zones;
+    fmeta.zbd_nr_zones = nr_conv_zones + nr_seq_zones;
     fdev->zbd_nr_zones = fmeta.zbd_nr_zones;
 
-    dev->zbd_info.zbd_logical_blocks = fdev->zbd_nr_zones * zone_sz;
+    dev->zbd_info.zbd_logical_blocks = nr_lbas;
     dev->zbd_info.zbd_physical_blocks = dev->zbd_info.zbd_logical_blocks /
                                         (dev->zbd_info.zbd_physical_block_size / dev->zbd_info.zbd_logical_block_size);
     fmeta.zbd_capacity = dev->zbd_info.zbd_logical_blocks * dev->zbd_info.zbd_logical_block_size;
 
     /* Open metadata file */
-    zbc_fake_dev_meta_path(fdev, meta_path);
-    fdev->zbd_meta_fd = open(meta_path, O_RDWR | O_CREAT, 0600);
+    if ( fdev->zbd_mem ) {
+        strcpy(meta_path, "memfd");
+        fdev->zbd_meta_fd = zbc_fake_memfd("zbc-mem-meta");
+    } else {
+        zbc_fake_dev_meta_path(fdev, meta_path);
+        fdev->zbd_meta_fd = open(meta_path, O_RDWR | O_CREAT, 0600);
+    }
     if ( fdev->zbd_meta_fd < 0 ) {
         ret = -errno;
         zbc_error("%s: open metadata file %s failed %d (%s)\n",
@@ -1424,7 +2921,7 @@ zbc_fake_set_zones(struct zbc_device *dev,
     }
 
     /* Truncate metadata file */
-    fdev->zbd_meta_size = sizeof(zbc_fake_meta_t) + (fdev->zbd_nr_zones * sizeof(struct zbc_zone));
+    fdev->zbd_meta_size = zbc_fake_meta_size(fdev->zbd_nr_zones);
     if ( ftruncate(fdev->zbd_meta_fd, fdev->zbd_meta_size) < 0) {
         ret = -errno;
         zbc_error("%s: truncate metadata file %s to %zu B failed %d (%s)\n",
@@ -1447,10 +2944,13 @@ zbc_fake_set_zones(struct zbc_device *dev,
         goto out;
     }
 
-    fdev->zbd_zones = (struct zbc_zone *) (fdev->zbd_meta + 1);
-
     /* Setup metadata header */
+    fmeta.zbd_magic = ZBC_FAKE_META_MAGIC;
+    fmeta.zbd_version = ZBC_FAKE_META_VERSION;
+    fmeta.zbd_imp_open_head = ZBC_FAKE_LRU_NONE;
+    fmeta.zbd_imp_open_tail = ZBC_FAKE_LRU_NONE;
     memcpy(fdev->zbd_meta, &fmeta, sizeof(zbc_fake_meta_t));
+    zbc_fake_set_meta_arrays(fdev);
     ret = pthread_mutex_init(&fdev->zbd_meta->zbd_mutex, &fdev->zbd_mutex_attr);
     if ( ret != 0 ) {
         zbc_error("%s: Initialize metadata mutex failed %d (%s)\n",
@@ -1460,53 +2960,326 @@ zbc_fake_set_zones(struct zbc_device *dev,
         goto out;
     }
 
-    /* Setup conventional zones descriptors */
-    for(z = 0; z < fmeta.zbd_nr_conv_zones; z++) {
+out:
 
-        zone = &fdev->zbd_zones[z];
+    if ( ret != 0 ) {
+        zbc_fake_close_metadata(fdev);
+    }
+
+    return ret;
+
+}
+
+/**
+ * Setup a zone descriptor.
+ */
+static void
+zbc_fake_init_zone(struct zbc_zone *zone,
+                   uint8_t type,
+                   uint8_t cond,
+                   uint64_t start,
+                   uint64_t length)
+{
+
+    zone->zbz_type = type;
+    zone->zbz_condition = cond;
+    zone->zbz_start = start;
+    zone->zbz_length = length;
+    zone->zbz_flags = 0;
 
-        zone->zbz_type = ZBC_ZT_CONVENTIONAL;
-        zone->zbz_condition = ZBC_ZC_NOT_WP;
-        zone->zbz_start = lba;
+    if ( (type == ZBC_ZT_CONVENTIONAL)
+         || (cond == ZBC_ZC_RDONLY)
+         || (cond == ZBC_ZC_OFFLINE) ) {
         zone->zbz_write_pointer = (uint64_t)-1;
-        zone->zbz_length = zone_sz;
+    } else {
+        zone->zbz_write_pointer = start;
+    }
 
-        memset(&zone->__pad, 0, sizeof(zone->__pad));
+    memset(&zone->__pad, 0, sizeof(zone->__pad));
 
-        lba += zone_sz;
+    return;
+
+}
+
+/**
+ * Finish the initialization of the metadata once
+ * all zone descriptors are setup.
+ */
+static void
+zbc_fake_init_zones(zbc_fake_device_t *fdev)
+{
+
+    /* No implicitly open zone */
+    memset(fdev->zbd_lru, 0xff, sizeof(zbc_fake_lru_t) * fdev->zbd_nr_zones);
 
+    /* No write in progress */
+    memset(fdev->zbd_writer, 0, sizeof(pid_t) * fdev->zbd_nr_zones);
+
+    zbc_fake_init_cond(fdev);
+
+    zbc_fake_set_zone_length(fdev);
+
+    zbc_fake_set_model(fdev);
+
+    if ( fdev->dev.zbd_info.zbd_max_nr_open_seq_req > fdev->zbd_meta->zbd_nr_seq_zones ) {
+        fdev->dev.zbd_info.zbd_max_nr_open_seq_req = fdev->zbd_meta->zbd_nr_seq_zones - 1;
+    }
+
+    return;
+
+}
+
+/**
+ * Initialize an emulated device metadata.
+ */
+static int
+zbc_fake_set_zones(struct zbc_device *dev,
+                   uint64_t conv_sz,
+                   uint64_t zone_sz)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    uint64_t lba = 0, device_size = fdev->zbd_dev_lbas;
+    uint32_t nr_conv_zones, nr_seq_zones;
+    unsigned int z = 0;
+    int ret;
+
+    /* Calculate zone configuration */
+    if ( (conv_sz + zone_sz) > device_size ) {
+        zbc_error("%s: invalid zone sizes (too large)\n",
+                  fdev->dev.zbd_filename);
+        return -EINVAL;
+    }
+
+    nr_conv_zones = conv_sz / zone_sz;
+    if ( conv_sz && (! nr_conv_zones) ) {
+        nr_conv_zones = 1;
+    }
+
+    nr_seq_zones = (device_size - (nr_conv_zones * zone_sz)) / zone_sz;
+    if ( ! nr_seq_zones ) {
+        zbc_error("%s: invalid zone sizes (too large)\n",
+                  fdev->dev.zbd_filename);
+        return -EINVAL;
+    }
+
+    ret = zbc_fake_create_metadata(fdev, nr_conv_zones, nr_seq_zones,
+                                   (uint64_t)(nr_conv_zones + nr_seq_zones) * zone_sz);
+    if ( ret != 0 ) {
+        return ret;
+    }
+
+    /* Setup conventional zones descriptors */
+    for(z = 0; z < nr_conv_zones; z++) {
+        zbc_fake_init_zone(&fdev->zbd_zones[z], ZBC_ZT_CONVENTIONAL, ZBC_ZC_NOT_WP, lba, zone_sz);
+        lba += zone_sz;
     }
 
     /* Setup sequential zones descriptors */
     for (; z < fdev->zbd_nr_zones; z++) {
+        zbc_fake_init_zone(&fdev->zbd_zones[z], ZBC_ZT_SEQUENTIAL_REQ, ZBC_ZC_EMPTY, lba, zone_sz);
+        lba += zone_sz;
+    }
 
-        zone = &fdev->zbd_zones[z];
+    zbc_fake_init_zones(fdev);
+
+    return 0;
 
-        zone->zbz_type = ZBC_ZT_SEQUENTIAL_REQ;
-        zone->zbz_condition = ZBC_ZC_EMPTY;
+}
 
-        zone->zbz_start = lba;
-        zone->zbz_write_pointer = zone->zbz_start;
-        zone->zbz_length = zone_sz;
+/**
+ * Parse a zone geometry line "<nr zones> <type> <zone size> [<condition>]".
+ * Returns 1 if the line describes zones, 0 for blank and comment lines.
+ */
+static int
+zbc_fake_parse_geometry(char *line,
+                        zbc_fake_geom_t *geom)
+{
+    char type[16], cond[16], *c;
+    unsigned long long nr_zones, length;
+    int n;
+
+    c = strchr(line, '#');
+    if ( c ) {
+        *c = '\0';
+    }
+
+    strcpy(cond, "empty");
+    n = sscanf(line, "%llu %15s %llu %15s", &nr_zones, type, &length, cond);
+    if ( n <= 0 ) {
+        /* Blank line */
+        for(c = line; *c; c++) {
+            if ( ! isspace(*c) ) {
+                return -EINVAL;
+            }
+        }
+        return 0;
+    }
 
-        memset(&zone->__pad, 0, sizeof(zone->__pad));
+    if ( (n < 3) || (! nr_zones) || (nr_zones > UINT32_MAX) || (! length) ) {
+        return -EINVAL;
+    }
 
-        lba += zone_sz;
+    geom->zfg_nr_zones = nr_zones;
+    geom->zfg_length = length;
 
+    if ( strcmp(type, "conv") == 0 ) {
+        geom->zfg_type = ZBC_ZT_CONVENTIONAL;
+    } else if ( strcmp(type, "seq") == 0 ) {
+        geom->zfg_type = ZBC_ZT_SEQUENTIAL_REQ;
+    } else if ( strcmp(type, "pref") == 0 ) {
+        geom->zfg_type = ZBC_ZT_SEQUENTIAL_PREF;
+    } else {
+        return -EINVAL;
     }
 
-    ret = 0;
+    if ( strcmp(cond, "empty") == 0 ) {
+        if ( geom->zfg_type == ZBC_ZT_CONVENTIONAL ) {
+            geom->zfg_cond = ZBC_ZC_NOT_WP;
+        } else {
+            geom->zfg_cond = ZBC_ZC_EMPTY;
+        }
+    } else if ( strcmp(cond, "rdonly") == 0 ) {
+        geom->zfg_cond = ZBC_ZC_RDONLY;
+    } else if ( strcmp(cond, "offline") == 0 ) {
+        geom->zfg_cond = ZBC_ZC_OFFLINE;
+    } else {
+        return -EINVAL;
+    }
 
-out:
+    return 1;
+
+}
+
+/**
+ * Initialize an emulated device metadata from a zone geometry file.
+ */
+static int
+zbc_fake_set_geometry(struct zbc_device *dev,
+                      const char *path)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    uint64_t lba = 0, device_size = fdev->zbd_dev_lbas;
+    uint64_t nr_zones = 0, nr_conv_zones = 0;
+    zbc_fake_geom_t *geom = NULL, *g;
+    unsigned int nr_geom = 0, i, n = 0;
+    char line[256];
+    uint32_t j, z = 0;
+    FILE *f;
+    int ret = 0;
+
+    f = fopen(path, "r");
+    if ( ! f ) {
+        ret = -errno;
+        zbc_error("Open zone geometry file %s failed %d (%s)\n",
+                  path,
+                  errno,
+                  strerror(errno));
+        return ret;
+    }
+
+    /* Parse the file */
+    while( fgets(line, sizeof(line), f) ) {
+
+        n++;
+
+        g = realloc(geom, sizeof(zbc_fake_geom_t) * (nr_geom + 1));
+        if ( ! g ) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        geom = g;
+
+        ret = zbc_fake_parse_geometry(line, &geom[nr_geom]);
+        if ( ret < 0 ) {
+            zbc_error("%s: invalid line %u\n",
+                      path,
+                      n);
+            goto out;
+        }
+        if ( ! ret ) {
+            continue;
+        }
+
+        g = &geom[nr_geom];
+        nr_zones += g->zfg_nr_zones;
+        if ( g->zfg_type == ZBC_ZT_CONVENTIONAL ) {
+            nr_conv_zones += g->zfg_nr_zones;
+        }
+        if ( (nr_zones > UINT32_MAX)
+             || (g->zfg_length > ((device_size - lba) / g->zfg_nr_zones)) ) {
+            zbc_error("%s: zones exceed the device capacity (%llu sectors)\n",
+                      path,
+                      (unsigned long long)device_size);
+            ret = -EINVAL;
+            goto out;
+        }
+        lba += g->zfg_length * g->zfg_nr_zones;
+        nr_geom++;
 
+    }
+
+    if ( nr_zones == nr_conv_zones ) {
+        zbc_error("%s: no sequential zone defined\n",
+                  path);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ret = zbc_fake_create_metadata(fdev, nr_conv_zones, nr_zones - nr_conv_zones, lba);
     if ( ret != 0 ) {
-        zbc_fake_close_metadata(fdev);
+        goto out;
+    }
+
+    /* Setup zone descriptors */
+    lba = 0;
+    for(i = 0; i < nr_geom; i++) {
+        g = &geom[i];
+        for(j = 0; j < g->zfg_nr_zones; j++) {
+            zbc_fake_init_zone(&fdev->zbd_zones[z], g->zfg_type, g->zfg_cond, lba, g->zfg_length);
+            lba += g->zfg_length;
+            z++;
+        }
     }
 
+    zbc_fake_init_zones(fdev);
+
+out:
+
+    free(geom);
+    fclose(f);
+
     return ret;
 
 }
 
+/**
+ * Set (or remove if @profile is NULL) the drive performance model.
+ */
+static int
+zbc_fake_set_perf_model(struct zbc_device *dev,
+                        const char *profile)
+{
+    zbc_fake_device_t *fdev = zbc_fake_to_file_dev(dev);
+    zbc_fake_perf_t *perf = NULL;
+    int ret;
+
+    if ( profile ) {
+        ret = zbc_fake_perf_load(profile,
+                                 dev->zbd_info.zbd_logical_blocks,
+                                 dev->zbd_info.zbd_logical_block_size,
+                                 &perf);
+        if ( ret != 0 ) {
+            return ret;
+        }
+    }
+
+    zbc_fake_perf_free(fdev->zbd_perf);
+    fdev->zbd_perf = perf;
+
+    return 0;
+
+}
+
 /**
  * Change the value of a zone write pointer.
  */
@@ -1528,8 +3301,10 @@ zbc_fake_set_write_pointer(struct zbc_device *dev,
     zone = zbc_fake_find_zone(fdev, start_lba);
     if ( zone ) {
 
-        /* Do nothing for conventional zones */
-        if ( zbc_zone_sequential_req(zone) ) {
+        /* Do nothing for conventional, read-only and offline zones */
+        if ( zbc_zone_sequential(zone)
+             && (! zbc_zone_rdonly(zone))
+             && (! zbc_zone_offline(zone)) ) {
 
             if ( zbc_zone_is_open(zone) ) {
                 zbc_zone_do_close(fdev, zone);
@@ -1537,11 +3312,11 @@ zbc_fake_set_write_pointer(struct zbc_device *dev,
 
             zone->zbz_write_pointer = wp_lba;
             if ( zbc_zone_wp_lba(zone) == zbc_zone_start_lba(zone) ) {
-                zone->zbz_condition = ZBC_ZC_EMPTY;
+                zbc_fake_set_cond(fdev, zone, ZBC_ZC_EMPTY);
             } else if ( zbc_zone_wp_within_zone(zone) ) {
-                zone->zbz_condition = ZBC_ZC_CLOSED;
+                zbc_fake_set_cond(fdev, zone, ZBC_ZC_CLOSED);
             } else {
-                zone->zbz_condition = ZBC_ZC_FULL;
+                zbc_fake_set_cond(fdev, zone, ZBC_ZC_FULL);
                 zone->zbz_write_pointer = (uint64_t)-1;
             }
 
@@ -1562,12 +3337,18 @@ struct zbc_ops zbc_fake_ops = {
     .zbd_close        = zbc_fake_close,
     .zbd_pread        = zbc_fake_pread,
     .zbd_pwrite       = zbc_fake_pwrite,
+    .zbd_preadv       = zbc_fake_preadv,
+    .zbd_pwritev      = zbc_fake_pwritev,
+    .zbd_pread_borrow = zbc_fake_pread_borrow,
     .zbd_flush        = zbc_fake_flush,
     .zbd_report_zones = zbc_fake_report_zones,
     .zbd_open_zone    = zbc_fake_open_zone,
     .zbd_close_zone   = zbc_fake_close_zone,
     .zbd_finish_zone  = zbc_fake_finish_zone,
     .zbd_reset_wp     = zbc_fake_reset_wp,
+    .zbd_reset_zones  = zbc_fake_reset_zones,
     .zbd_set_zones    = zbc_fake_set_zones,
+    .zbd_set_geometry = zbc_fake_set_geometry,
     .zbd_set_wp       = zbc_fake_set_write_pointer,
+    .zbd_set_perf_model = zbc_fake_set_perf_model,
 };
@@ -0,0 +1,323 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ */
+
+/***** Including files *****/
+
+#include <config.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "zbc.h"
+#include "zbc_fake_perf.h"
+
+/***** Macro and types definitions *****/
+
+#define ZBC_FAKE_PERF_NSEC_PER_SEC      1000000000ULL
+
+/**
+ * Profile keys.
+ */
+typedef struct zbc_fake_perf_key {
+
+    const char          *name;
+
+    /**
+     * Offset of the field in zbc_fake_perf_t and
+     * multiplier converting the value to its unit.
+     */
+    size_t              offset;
+    double              mult;
+
+} zbc_fake_perf_key_t;
+
+static zbc_fake_perf_key_t zbc_fake_perf_keys[] = {
+    { "seek_min_us",    offsetof(zbc_fake_perf_t, zfp_seek_min),        1000.0 },
+    { "seek_full_us",   offsetof(zbc_fake_perf_t, zfp_seek_full),       1000.0 },
+    { "rotation_us",    offsetof(zbc_fake_perf_t, zfp_rotation),        1000.0 },
+    { "transfer_mbps",  offsetof(zbc_fake_perf_t, zfp_transfer_rate),   1000000.0 },
+    { "open_us",        offsetof(zbc_fake_perf_t, zfp_open),            1000.0 },
+    { "close_us",       offsetof(zbc_fake_perf_t, zfp_close),           1000.0 },
+    { "finish_us",      offsetof(zbc_fake_perf_t, zfp_finish),          1000.0 },
+    { "reset_us",       offsetof(zbc_fake_perf_t, zfp_reset),           1000.0 },
+    { "flush_us",       offsetof(zbc_fake_perf_t, zfp_flush),           1000.0 },
+    { "non_seq_write_us", offsetof(zbc_fake_perf_t, zfp_non_seq_write),  1000.0 },
+    { NULL, 0, 0.0 }
+};
+
+/***** Definition of private functions *****/
+
+/**
+ * Get the current time in nanoseconds.
+ */
+static inline uint64_t
+zbc_fake_perf_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * ZBC_FAKE_PERF_NSEC_PER_SEC + ts.tv_nsec;
+
+}
+
+/**
+ * Square root of a value in [0, 1] (avoids depending on libm).
+ */
+static double
+zbc_fake_perf_sqrt(double x)
+{
+    double r = 1.0;
+    int i;
+
+    if ( x <= 0.0 ) {
+        return 0.0;
+    }
+
+    for(i = 0; i < 64; i++) {
+        r = (r + x / r) / 2.0;
+    }
+
+    return r;
+
+}
+
+/**
+ * Seek time for a distance in LBAs.
+ */
+static uint64_t
+zbc_fake_perf_seek(zbc_fake_perf_t *perf,
+                   uint64_t dist)
+{
+    double frac = (double) dist / (double) perf->zfp_nr_lbas;
+
+    if ( frac > 1.0 ) {
+        frac = 1.0;
+    }
+
+    return perf->zfp_seek_min
+        + (uint64_t)((double)(perf->zfp_seek_full - perf->zfp_seek_min) * zbc_fake_perf_sqrt(frac));
+
+}
+
+/**
+ * Parse a profile line "<key> [=] <value>".
+ */
+static int
+zbc_fake_perf_parse(zbc_fake_perf_t *perf,
+                    char *line)
+{
+    zbc_fake_perf_key_t *key;
+    char *name, *end;
+    size_t len;
+    double val;
+
+    /* Skip blank lines and comments */
+    while( isspace(*line) ) {
+        line++;
+    }
+    if ( (*line == '\0') || (*line == '#') ) {
+        return 0;
+    }
+
+    name = line;
+    while( *line && (! isspace(*line)) && (*line != '=') ) {
+        line++;
+    }
+    len = line - name;
+
+    while( isspace(*line) || (*line == '=') ) {
+        line++;
+    }
+
+    val = strtod(line, &end);
+    if ( (end == line) || (val < 0.0) ) {
+        return -EINVAL;
+    }
+    while( isspace(*end) ) {
+        end++;
+    }
+    if ( *end && (*end != '#') ) {
+        return -EINVAL;
+    }
+
+    for(key = zbc_fake_perf_keys; key->name; key++) {
+        if ( (strlen(key->name) == len) && (strncmp(key->name, name, len) == 0) ) {
+            *(uint64_t *)((char *)perf + key->offset) = (uint64_t)(val * key->mult);
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+
+}
+
+/***** Definition of public functions *****/
+
+/**
+ * Load a performance model profile.
+ */
+int
+zbc_fake_perf_load(const char *profile,
+                   uint64_t nr_lbas,
+                   uint32_t lba_size,
+                   zbc_fake_perf_t **pperf)
+{
+    zbc_fake_perf_t *perf;
+    char line[256];
+    int ret = 0, n = 0;
+    FILE *f;
+
+    f = fopen(profile, "r");
+    if ( ! f ) {
+        ret = -errno;
+        zbc_error("Open performance profile %s failed %d (%s)\n",
+                  profile,
+                  errno,
+                  strerror(errno));
+        return ret;
+    }
+
+    perf = calloc(1, sizeof(zbc_fake_perf_t));
+    if ( ! perf ) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    while( fgets(line, sizeof(line), f) ) {
+        n++;
+        ret = zbc_fake_perf_parse(perf, line);
+        if ( ret != 0 ) {
+            zbc_error("%s: invalid line %d\n",
+                      profile,
+                      n);
+            free(perf);
+            goto out;
+        }
+    }
+
+    if ( perf->zfp_seek_full < perf->zfp_seek_min ) {
+        perf->zfp_seek_full = perf->zfp_seek_min;
+    }
+
+    perf->zfp_nr_lbas = nr_lbas ? nr_lbas : 1;
+    perf->zfp_lba_size = lba_size;
+    pthread_mutex_init(&perf->zfp_mutex, NULL);
+
+    *pperf = perf;
+
+out:
+
+    fclose(f);
+
+    return ret;
+
+}
+
+/**
+ * Free a performance model.
+ */
+void
+zbc_fake_perf_free(zbc_fake_perf_t *perf)
+{
+
+    if ( perf ) {
+        pthread_mutex_destroy(&perf->zfp_mutex);
+        free(perf);
+    }
+
+    return;
+
+}
+
+/**
+ * Wait until a command completes according to the model: the command
+ * starts when the previous one completes, and the caller sleeps until
+ * the end of the command.
+ */
+void
+zbc_fake_perf_cmd(zbc_fake_perf_t *perf,
+                  enum zbc_fake_perf_op op,
+                  uint64_t lba,
+                  uint32_t lba_count)
+{
+    uint64_t cost = 0, now, dist;
+    struct timespec ts;
+
+    pthread_mutex_lock(&perf->zfp_mutex);
+
+    switch( op ) {
+
+    case ZBC_FAKE_PERF_READ:
+    case ZBC_FAKE_PERF_WRITE:
+    case ZBC_FAKE_PERF_NON_SEQ_WRITE:
+        if ( lba != perf->zfp_head_lba ) {
+            dist = (lba > perf->zfp_head_lba) ? lba - perf->zfp_head_lba : perf->zfp_head_lba - lba;
+            cost = zbc_fake_perf_seek(perf, dist) + perf->zfp_rotation;
+        }
+        if ( perf->zfp_transfer_rate ) {
+            cost += (uint64_t)lba_count * perf->zfp_lba_size * ZBC_FAKE_PERF_NSEC_PER_SEC
+                / perf->zfp_transfer_rate;
+        }
+        if ( op == ZBC_FAKE_PERF_NON_SEQ_WRITE ) {
+            cost += perf->zfp_non_seq_write;
+        }
+        perf->zfp_head_lba = lba + lba_count;
+        break;
+
+    case ZBC_FAKE_PERF_OPEN:
+        cost = perf->zfp_open;
+        break;
+
+    case ZBC_FAKE_PERF_CLOSE:
+        cost = perf->zfp_close;
+        break;
+
+    case ZBC_FAKE_PERF_FINISH:
+        cost = perf->zfp_finish;
+        break;
+
+    case ZBC_FAKE_PERF_RESET:
+        cost = perf->zfp_reset;
+        break;
+
+    case ZBC_FAKE_PERF_FLUSH:
+        cost = perf->zfp_flush;
+        break;
+
+    }
+
+    now = zbc_fake_perf_now();
+    if ( perf->zfp_busy_until < now ) {
+        perf->zfp_busy_until = now;
+    }
+    perf->zfp_busy_until += cost;
+    now = perf->zfp_busy_until;
+
+    pthread_mutex_unlock(&perf->zfp_mutex);
+
+    ts.tv_sec = now / ZBC_FAKE_PERF_NSEC_PER_SEC;
+    ts.tv_nsec = now % ZBC_FAKE_PERF_NSEC_PER_SEC;
+    while( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR ) {
+        continue;
+    }
+
+    return;
+
+}
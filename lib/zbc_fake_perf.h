@@ -0,0 +1,110 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ */
+
+#ifndef __LIBZBC_FAKE_PERF_H__
+#define __LIBZBC_FAKE_PERF_H__
+
+/***** Including files *****/
+
+#include <stdint.h>
+#include <pthread.h>
+
+/***** Type definitions *****/
+
+/**
+ * Commands timed by the performance model.
+ */
+enum zbc_fake_perf_op {
+    ZBC_FAKE_PERF_READ,
+    ZBC_FAKE_PERF_WRITE,
+    ZBC_FAKE_PERF_NON_SEQ_WRITE,
+    ZBC_FAKE_PERF_OPEN,
+    ZBC_FAKE_PERF_CLOSE,
+    ZBC_FAKE_PERF_FINISH,
+    ZBC_FAKE_PERF_RESET,
+    ZBC_FAKE_PERF_FLUSH,
+};
+
+/**
+ * Drive performance model of an emulated device.
+ *
+ * Commands are executed one at a time by a single actuator. A read or a
+ * write that does not start where the previous one ended costs a seek,
+ * growing with the square root of the seek distance from seek_min_us
+ * (one track) to seek_full_us (full stroke), plus an average rotational
+ * latency. All reads and writes then cost their size divided by the
+ * sequential transfer rate. Writes not starting at the write pointer of
+ * a sequential write preferred zone also pay a fixed penalty for the
+ * cleaning of the media cache they go to. Zone operations and cache
+ * flushes have fixed costs. All times are kept in nanoseconds.
+ */
+typedef struct zbc_fake_perf {
+
+    /**
+     * Profile.
+     */
+    uint64_t            zfp_seek_min;
+    uint64_t            zfp_seek_full;
+    uint64_t            zfp_rotation;
+    uint64_t            zfp_transfer_rate;      /* B/s */
+    uint64_t            zfp_open;
+    uint64_t            zfp_close;
+    uint64_t            zfp_finish;
+    uint64_t            zfp_reset;
+    uint64_t            zfp_flush;
+    uint64_t            zfp_non_seq_write;
+
+    /**
+     * Device geometry.
+     */
+    uint64_t            zfp_nr_lbas;
+    uint32_t            zfp_lba_size;
+
+    /**
+     * Drive state: head position and end time
+     * of the last command queued.
+     */
+    pthread_mutex_t     zfp_mutex;
+    uint64_t            zfp_head_lba;
+    uint64_t            zfp_busy_until;
+
+} zbc_fake_perf_t;
+
+/***** Function declarations *****/
+
+/**
+ * Load a performance model profile.
+ */
+extern int
+zbc_fake_perf_load(const char *profile,
+                   uint64_t nr_lbas,
+                   uint32_t lba_size,
+                   zbc_fake_perf_t **pperf);
+
+/**
+ * Free a performance model.
+ */
+extern void
+zbc_fake_perf_free(zbc_fake_perf_t *perf);
+
+/**
+ * Wait until a command completes according to the model.
+ */
+extern void
+zbc_fake_perf_cmd(zbc_fake_perf_t *perf,
+                  enum zbc_fake_perf_op op,
+                  uint64_t lba,
+                  uint32_t lba_count);
+
+#endif /* __LIBZBC_FAKE_PERF_H__ */
@@ -27,16 +27,6 @@
 
 /***** Macro definitions *****/
 
-/**
- * Number of bytes in a Zone Descriptor.
- */
-#define ZBC_ZONE_DESCRIPTOR_LENGTH              64
-
-/**
- * Number of bytes in the buffer before the first Zone Descriptor.
- */
-#define ZBC_ZONE_DESCRIPTOR_OFFSET              64
-
 /**
  * ZBC Device types.
  */
@@ -56,7 +46,7 @@ zbc_scsi_classify(zbc_device_t *dev)
     int n, ret;
 
     /* Allocate and intialize inquiry command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -178,6 +168,55 @@ out:
 
 }
 
+/**
+ * Execute a READ 16 or WRITE 16 command.
+ */
+static int32_t
+zbc_scsi_rw(zbc_device_t *dev,
+            int cmd_code,
+            zbc_zone_t *zone,
+            const struct iovec *iov,
+            int iovcnt,
+            uint32_t lba_count,
+            uint64_t lba_ofst)
+{
+    zbc_sg_cmd_t cmd;
+    int ret;
+
+    ret = zbc_sg_cmd_rw_init(dev, &cmd, cmd_code, iov, iovcnt, lba_count, zone->zbz_start + lba_ofst);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    /* Send the SG_IO command */
+    ret = zbc_sg_cmd_exec(dev, &cmd);
+    if ( ret == 0 ) {
+        ret = cmd.out_bufsz / dev->zbd_info.zbd_logical_block_size;
+    }
+
+    zbc_sg_cmd_destroy(&cmd);
+
+    return( ret );
+
+}
+
+/**
+ * Vectored read from a ZBC device
+ */
+static int32_t
+zbc_scsi_preadv(zbc_device_t *dev,
+                zbc_zone_t *zone,
+                const struct iovec *iov,
+                int iovcnt,
+                uint32_t lba_count,
+                uint64_t lba_ofst)
+{
+
+    /* READ 16 */
+    return( zbc_scsi_rw(dev, ZBC_SG_READ, zone, iov, iovcnt, lba_count, lba_ofst) );
+
+}
+
 /**
  * Read from a ZBC device
  */
@@ -188,27 +227,44 @@ zbc_scsi_pread(zbc_device_t *dev,
                uint32_t lba_count,
                uint64_t lba_ofst)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
+
+    return( zbc_scsi_preadv(dev, zone, &iov, 1, lba_count, lba_ofst) );
+
+}
+
+/**
+ * Read from a ZBC device into the memory mapped reserved buffer of its SG node.
+ */
+static int32_t
+zbc_scsi_pread_borrow(zbc_device_t *dev,
+                      zbc_zone_t *zone,
+                      const void **buf,
+                      uint32_t lba_count,
+                      uint64_t lba_ofst)
+{
+    struct iovec iov;
     zbc_sg_cmd_t cmd;
     int ret;
 
-    /* READ 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_READ, buf, sz);
+    ret = zbc_sg_mmap_iov(dev, (size_t) lba_count * dev->zbd_info.zbd_logical_block_size, &iov);
     if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
     }
 
-    /* Fill command CDB */
-    cmd.cdb[0] = ZBC_SG_READ_CDB_OPCODE;
-    cmd.cdb[1] = 0x10;
-    zbc_sg_cmd_set_int64(&cmd.cdb[2], (zone->zbz_start + lba_ofst));
-    zbc_sg_cmd_set_int32(&cmd.cdb[10], lba_count);
+    /* READ 16 */
+    ret = zbc_sg_cmd_rw_init(dev, &cmd, ZBC_SG_READ, &iov, 1, lba_count, zone->zbz_start + lba_ofst);
+    if ( ret != 0 ) {
+        return( ret );
+    }
 
-    /* Send the SG_IO command */
-    ret = zbc_sg_cmd_exec(dev, &cmd);
+    ret = zbc_sg_cmd_exec_mmap(dev, &cmd);
     if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
+        *buf = iov.iov_base;
+        ret = cmd.out_bufsz / dev->zbd_info.zbd_logical_block_size;
     }
 
     zbc_sg_cmd_destroy(&cmd);
@@ -217,6 +273,23 @@ zbc_scsi_pread(zbc_device_t *dev,
 
 }
 
+/**
+ * Vectored write to a ZBC device
+ */
+static int32_t
+zbc_scsi_pwritev(zbc_device_t *dev,
+                 zbc_zone_t *zone,
+                 const struct iovec *iov,
+                 int iovcnt,
+                 uint32_t lba_count,
+                 uint64_t lba_ofst)
+{
+
+    /* WRITE 16 */
+    return( zbc_scsi_rw(dev, ZBC_SG_WRITE, zone, iov, iovcnt, lba_count, lba_ofst) );
+
+}
+
 /**
  * Write to a ZBC device
  */
@@ -227,32 +300,88 @@ zbc_scsi_pwrite(zbc_device_t *dev,
                 uint32_t lba_count,
                 uint64_t lba_ofst)
 {
-    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
-    zbc_sg_cmd_t cmd;
+    struct iovec iov = {
+        .iov_base = (void *) buf,
+        .iov_len = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
+
+    return( zbc_scsi_pwritev(dev, zone, &iov, 1, lba_count, lba_ofst) );
+
+}
+
+/**
+ * Submit an asynchronous read or write.
+ */
+static int
+zbc_scsi_aio_submit(zbc_device_t *dev,
+                    zbc_aio_t *aio)
+{
+    struct iovec iov = {
+        .iov_base = aio->zba_buf,
+        .iov_len = (size_t) aio->zba_lba_count * dev->zbd_info.zbd_logical_block_size,
+    };
+    zbc_sg_cmd_t *cmd;
     int ret;
 
-    /* WRITE 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_WRITE, (uint8_t *)buf, sz);
+    cmd = zbc_sg_cmd_alloc(dev);
+    if ( ! cmd ) {
+        return( -ENOMEM );
+    }
+
+    /* READ 16 or WRITE 16 */
+    ret = zbc_sg_cmd_rw_init(dev, cmd,
+                             (aio->zba_op == ZBC_AIO_READ) ? ZBC_SG_READ : ZBC_SG_WRITE,
+                             &iov, 1,
+                             aio->zba_lba_count,
+                             aio->zba_zone->zbz_start + aio->zba_lba_ofst);
     if ( ret != 0 ) {
-        zbc_error("zbc_sg_cmd_init failed\n");
-        return( ret );
+        goto out;
     }
+    cmd->aio = aio;
 
-    /* Fill command CDB */
-    cmd.cdb[0] = ZBC_SG_WRITE_CDB_OPCODE;
-    cmd.cdb[1] = 0x10;
-    zbc_sg_cmd_set_int64(&cmd.cdb[2], (zone->zbz_start + lba_ofst));
-    zbc_sg_cmd_set_int32(&cmd.cdb[10], lba_count);
+    /* Queue the command */
+    ret = zbc_sg_cmd_submit(dev, cmd);
+    if ( ret != 0 ) {
+        zbc_sg_cmd_destroy(cmd);
+    }
+
+out:
+
+    if ( ret != 0 ) {
+        zbc_sg_cmd_free(dev, cmd);
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Get a completed asynchronous read or write.
+ */
+static int
+zbc_scsi_aio_reap(zbc_device_t *dev,
+                  int timeout,
+                  zbc_aio_t **paio)
+{
+    zbc_sg_cmd_t *cmd;
+    int ret;
+
+    ret = zbc_sg_cmd_reap(dev, timeout, &cmd);
+    if ( ! cmd ) {
+        return( ret );
+    }
 
-    /* Send the SG_IO command */
-    ret = zbc_sg_cmd_exec(dev, &cmd);
     if ( ret == 0 ) {
-        ret = (sz - cmd.io_hdr.resid) / dev->zbd_info.zbd_logical_block_size;
+        cmd->aio->zba_ret = cmd->out_bufsz / dev->zbd_info.zbd_logical_block_size;
+    } else {
+        cmd->aio->zba_ret = ret;
     }
+    *paio = cmd->aio;
 
-    zbc_sg_cmd_destroy(&cmd);
+    zbc_sg_cmd_destroy(cmd);
+    zbc_sg_cmd_free(dev, cmd);
 
-    return( ret );
+    return( 0 );
 
 }
 
@@ -269,7 +398,7 @@ zbc_scsi_flush(zbc_device_t *dev,
     int ret;
 
     /* SYNCHRONIZE CACHE 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_SYNC_CACHE, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_SYNC_CACHE, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -308,7 +437,7 @@ zbc_scsi_report_zones(zbc_device_t *dev,
                       unsigned int *nr_zones)
 {
     size_t bufsz = ZBC_ZONE_DESCRIPTOR_OFFSET;
-    unsigned int i, nz, buf_nz;
+    unsigned int nz, buf_nz;
     zbc_sg_cmd_t cmd;
     size_t max_bufsz;
     uint8_t *buf;
@@ -326,7 +455,7 @@ zbc_scsi_report_zones(zbc_device_t *dev,
     }
 
     /* Allocate and intialize report zones command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_REPORT_ZONES, NULL, bufsz);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_REPORT_ZONES, NULL, bufsz);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -462,19 +591,7 @@ zbc_scsi_report_zones(zbc_device_t *dev,
          * | 63  |                                                                       |
          * +=============================================================================+
          */
-        buf += ZBC_ZONE_DESCRIPTOR_OFFSET;
-        for(i = 0; i < nz; i++) {
-
-            zones[i].zbz_type = buf[0] & 0x0f;
-            zones[i].zbz_condition = (buf[1] >> 4) & 0x0f;
-            zones[i].zbz_length = zbc_sg_cmd_get_int64(&buf[8]);
-            zones[i].zbz_start = zbc_sg_cmd_get_int64(&buf[16]);
-            zones[i].zbz_write_pointer = zbc_sg_cmd_get_int64(&buf[24]);
-            zones[i].zbz_flags = buf[1] & 0x03;
-
-            buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
-
-        }
+        zbc_sg_get_zones(buf + ZBC_ZONE_DESCRIPTOR_OFFSET, zones, nz, ZBC_SG_ZD_BE);
 
     }
 
@@ -501,7 +618,7 @@ zbc_scsi_open_zone(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize open zone command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_OPEN_ZONE, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_OPEN_ZONE, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -560,7 +677,7 @@ zbc_scsi_close_zone(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize close zone command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_CLOSE_ZONE, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_CLOSE_ZONE, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -619,7 +736,7 @@ zbc_scsi_finish_zone(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize finish zone command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_FINISH_ZONE, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_FINISH_ZONE, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -668,17 +785,17 @@ zbc_scsi_finish_zone(zbc_device_t *dev,
 }
 
 /**
- * Reset zone(s) write pointer.
+ * Initialize a RESET WRITE POINTER command.
  */
 static int
-zbc_scsi_reset_write_pointer(zbc_device_t *dev,
-                             uint64_t start_lba)
+zbc_scsi_reset_wp_cmd_init(zbc_device_t *dev,
+                           zbc_sg_cmd_t *cmd,
+                           uint64_t start_lba)
 {
-    zbc_sg_cmd_t cmd;
     int ret;
 
     /* Allocate and intialize reset write pointer command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_RESET_WRITE_POINTER, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, cmd, ZBC_SG_RESET_WRITE_POINTER, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -706,14 +823,33 @@ zbc_scsi_reset_write_pointer(zbc_device_t *dev,
      * | 15  |                           Control                                     |
      * +=============================================================================+
      */
-    cmd.cdb[0] = ZBC_SG_RESET_WRITE_POINTER_CDB_OPCODE;
-    cmd.cdb[1] = ZBC_SG_RESET_WRITE_POINTER_CDB_SA;
+    cmd->cdb[0] = ZBC_SG_RESET_WRITE_POINTER_CDB_OPCODE;
+    cmd->cdb[1] = ZBC_SG_RESET_WRITE_POINTER_CDB_SA;
     if ( start_lba == (uint64_t)-1 ) {
         /* Reset ALL zones */
-        cmd.cdb[14] = 0x01;
+        cmd->cdb[14] = 0x01;
     } else {
         /* Reset only the zone at start_lba */
-        zbc_sg_cmd_set_int64(&cmd.cdb[2], start_lba);
+        zbc_sg_cmd_set_int64(&cmd->cdb[2], start_lba);
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Reset zone(s) write pointer.
+ */
+static int
+zbc_scsi_reset_write_pointer(zbc_device_t *dev,
+                             uint64_t start_lba)
+{
+    zbc_sg_cmd_t cmd;
+    int ret;
+
+    ret = zbc_scsi_reset_wp_cmd_init(dev, &cmd, start_lba);
+    if ( ret != 0 ) {
+        return( ret );
     }
 
     /* Send the SG_IO command */
@@ -726,6 +862,35 @@ zbc_scsi_reset_write_pointer(zbc_device_t *dev,
 
 }
 
+/**
+ * Initialize the reset write pointer command of the @idx zone of a list.
+ */
+static int
+zbc_scsi_reset_zones_init(zbc_device_t *dev,
+                          zbc_sg_cmd_t *cmd,
+                          unsigned int idx,
+                          void *arg)
+{
+
+    return( zbc_scsi_reset_wp_cmd_init(dev, cmd, ((const uint64_t *)arg)[idx]) );
+
+}
+
+/**
+ * Reset the write pointer of a list of zones.
+ */
+static int
+zbc_scsi_reset_zones(zbc_device_t *dev,
+                     const uint64_t *start_lbas,
+                     unsigned int nr_zones)
+{
+
+    return( zbc_sg_cmd_exec_pipelined(dev, nr_zones,
+                                      zbc_scsi_reset_zones_init, NULL,
+                                      (void *) start_lbas) );
+
+}
+
 /**
  * Configure zones of a "emulated" ZBC device
  */
@@ -738,7 +903,7 @@ zbc_scsi_set_zones(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize set zone command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_SET_ZONES, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_SET_ZONES, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -789,7 +954,7 @@ zbc_scsi_set_write_pointer(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize set zone command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_SET_WRITE_POINTER, NULL, 0);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_SET_WRITE_POINTER, NULL, 0);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -839,7 +1004,7 @@ zbc_scsi_get_zbd_chars(zbc_device_t *dev)
     int ret;
 
     /* READ CAPACITY 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN_VPD_PAGE_B6);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN_VPD_PAGE_B6);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -971,11 +1136,24 @@ zbc_scsi_open(const char *filename,
         goto out_free_dev;
     }
 
+    zbc_sg_set_interface(dev);
+
     ret = zbc_scsi_get_info(dev);
     if ( ret ) {
         goto out_free_filename;
     }
 
+    /* Preallocate command descriptors and buffers */
+    ret = zbc_sg_pool_init(dev, flags);
+    if ( ret ) {
+        goto out_free_filename;
+    }
+
+    /* Commands can be queued only through the SG node (not bsg) */
+    if ( S_ISCHR(st.st_mode) && (! (dev->zbd_flags & ZBC_SG_BSG)) ) {
+        dev->zbd_aio_qd = ZBC_SG_AIO_MAX_QD;
+    }
+
     *pdev = dev;
 
     zbc_debug("%s: ########## SCSI driver succeeded ##########\n",
@@ -1016,6 +1194,7 @@ zbc_scsi_close(zbc_device_t *dev)
         return( -errno );
     }
 
+    zbc_sg_pool_free(dev);
     free(dev->zbd_filename);
     free(dev);
 
@@ -1032,13 +1211,19 @@ zbc_ops_t zbc_scsi_ops =
     .zbd_close        = zbc_scsi_close,
     .zbd_pread        = zbc_scsi_pread,
     .zbd_pwrite       = zbc_scsi_pwrite,
+    .zbd_preadv       = zbc_scsi_preadv,
+    .zbd_pwritev      = zbc_scsi_pwritev,
+    .zbd_pread_borrow = zbc_scsi_pread_borrow,
     .zbd_flush        = zbc_scsi_flush,
     .zbd_report_zones = zbc_scsi_report_zones,
     .zbd_open_zone    = zbc_scsi_open_zone,
     .zbd_close_zone   = zbc_scsi_close_zone,
     .zbd_finish_zone  = zbc_scsi_finish_zone,
     .zbd_reset_wp     = zbc_scsi_reset_write_pointer,
+    .zbd_reset_zones  = zbc_scsi_reset_zones,
     .zbd_set_zones    = zbc_scsi_set_zones,
     .zbd_set_wp       = zbc_scsi_set_write_pointer,
+    .zbd_aio_submit   = zbc_scsi_aio_submit,
+    .zbd_aio_reap     = zbc_scsi_aio_reap,
 };
 
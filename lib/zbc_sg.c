@@ -20,8 +20,14 @@
 #include <libgen.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/sysmacros.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "zbc.h"
 #include "zbc_sg.h"
@@ -41,6 +47,7 @@ static struct zbc_sg_cmd_s
     int                 cdb_sa;
     size_t              cdb_length;
     int			dir;
+    enum zbc_cmd_class  cls;
 
 } zbc_sg_cmd_list[ZBC_SG_CMD_NUM] = {
 
@@ -50,7 +57,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_TEST_UNIT_READY_CDB_OPCODE,
         0,
         ZBC_SG_TEST_UNIT_READY_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_INQUIRY */
@@ -59,7 +67,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_INQUIRY_CDB_OPCODE,
         0,
         ZBC_SG_INQUIRY_CDB_LENGTH,
-	SG_DXFER_FROM_DEV
+	SG_DXFER_FROM_DEV,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_READ_CAPACITY */
@@ -68,7 +77,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_READ_CAPACITY_CDB_OPCODE,
         ZBC_SG_READ_CAPACITY_CDB_SA,
         ZBC_SG_READ_CAPACITY_CDB_LENGTH,
-	SG_DXFER_FROM_DEV
+	SG_DXFER_FROM_DEV,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_READ */
@@ -77,7 +87,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_READ_CDB_OPCODE,
         0,
         ZBC_SG_READ_CDB_LENGTH,
-	SG_DXFER_FROM_DEV
+	SG_DXFER_FROM_DEV,
+	ZBC_CMD_CLASS_IO
     },
 
     /* ZBC_SG_WRITE */
@@ -86,7 +97,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_WRITE_CDB_OPCODE,
         0,
         ZBC_SG_WRITE_CDB_LENGTH,
-	SG_DXFER_TO_DEV
+	SG_DXFER_TO_DEV,
+	ZBC_CMD_CLASS_IO
     },
 
     /* ZBC_SG_SYNC_CACHE */
@@ -95,7 +107,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_SYNC_CACHE_CDB_OPCODE,
         0,
         ZBC_SG_SYNC_CACHE_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_FLUSH
     },
 
     /* ZBC_SG_REPORT_ZONES */
@@ -104,7 +117,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_REPORT_ZONES_CDB_OPCODE,
         ZBC_SG_REPORT_ZONES_CDB_SA,
         ZBC_SG_REPORT_ZONES_CDB_LENGTH,
-	SG_DXFER_FROM_DEV
+	SG_DXFER_FROM_DEV,
+	ZBC_CMD_CLASS_REPORT
     },
 
     /* ZBC_SG_OPEN_ZONE */
@@ -113,7 +127,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_OPEN_ZONE_CDB_OPCODE,
         ZBC_SG_OPEN_ZONE_CDB_SA,
         ZBC_SG_OPEN_ZONE_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_ZONE
     },
 
     /* ZBC_SG_CLOSE_ZONE */
@@ -122,7 +137,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_CLOSE_ZONE_CDB_OPCODE,
         ZBC_SG_CLOSE_ZONE_CDB_SA,
         ZBC_SG_CLOSE_ZONE_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_ZONE
     },
 
     /* ZBC_SG_FINISH_ZONE */
@@ -131,7 +147,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_FINISH_ZONE_CDB_OPCODE,
         ZBC_SG_FINISH_ZONE_CDB_SA,
         ZBC_SG_FINISH_ZONE_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_ZONE
     },
 
     /* ZBC_SG_RESET_WRITE_POINTER */
@@ -140,7 +157,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_RESET_WRITE_POINTER_CDB_OPCODE,
         ZBC_SG_RESET_WRITE_POINTER_CDB_SA,
         ZBC_SG_RESET_WRITE_POINTER_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_ZONE
     },
 
     /* ZBC_SG_SET_ZONES */
@@ -149,7 +167,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_SET_ZONES_CDB_OPCODE,
         ZBC_SG_SET_ZONES_CDB_SA,
         ZBC_SG_SET_ZONES_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_SET_WRITE_POINTER */
@@ -158,7 +177,8 @@ static struct zbc_sg_cmd_s
         ZBC_SG_SET_WRITE_POINTER_CDB_OPCODE,
         ZBC_SG_SET_WRITE_POINTER_CDB_SA,
         ZBC_SG_SET_WRITE_POINTER_CDB_LENGTH,
-	SG_DXFER_NONE
+	SG_DXFER_NONE,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_ATA12 */
@@ -167,7 +187,8 @@ static struct zbc_sg_cmd_s
 	ZBC_SG_ATA12_CDB_OPCODE,
 	0,
         ZBC_SG_ATA12_CDB_LENGTH,
-	0
+	0,
+	ZBC_CMD_CLASS_MGMT
     },
 
     /* ZBC_SG_ATA16 */
@@ -176,7 +197,8 @@ static struct zbc_sg_cmd_s
 	ZBC_SG_ATA16_CDB_OPCODE,
 	0,
         ZBC_SG_ATA16_CDB_LENGTH,
-	0
+	0,
+	ZBC_CMD_CLASS_MGMT
     }
 
 };
@@ -236,6 +258,299 @@ zbc_sg_set_sense(zbc_device_t *dev,
 
 }
 
+/**
+ * Detect the SG interface of a device file: character device files
+ * of the bsg class only accept sg v4 headers (struct sg_io_v4).
+ */
+void
+zbc_sg_set_interface(zbc_device_t *dev)
+{
+    char path[128], link[128];
+    struct stat st;
+    ssize_t len;
+
+    dev->zbd_flags &= ~(ZBC_SG_BSG | ZBC_NO_AIO);
+
+    if ( (fstat(dev->zbd_fd, &st) < 0) || (! S_ISCHR(st.st_mode)) ) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/subsystem",
+             major(st.st_rdev),
+             minor(st.st_rdev));
+    len = readlink(path, link, sizeof(link) - 1);
+    if ( len <= 0 ) {
+        return;
+    }
+    link[len] = '\0';
+
+    if ( strcmp(basename(link), "bsg") == 0 ) {
+        /* bsg has no asynchronous interface */
+        dev->zbd_flags |= ZBC_SG_BSG | ZBC_NO_AIO;
+        zbc_debug("%s: bsg node, using sg v4 interface\n",
+                  dev->zbd_filename);
+    }
+
+    return;
+
+}
+
+/**
+ * Test if the sg driver allows direct I/O (allow_dio module parameter).
+ * Otherwise, it silently copies the data of direct I/O commands.
+ */
+static int
+zbc_sg_allow_dio(void)
+{
+    FILE *f;
+    int allow = 0;
+
+    f = fopen("/sys/module/sg/parameters/allow_dio", "r");
+    if ( f ) {
+        if ( fscanf(f, "%d", &allow) != 1 ) {
+            allow = 0;
+        }
+        fclose(f);
+    }
+
+    return( allow );
+
+}
+
+/**
+ * Enable direct I/O and map the reserved buffer of an SG node.
+ * Returns -ENOTSUP if data transfers cannot be done without copies.
+ */
+static int
+zbc_sg_pool_init_dio(zbc_device_t *dev,
+                     zbc_sg_pool_t *pool)
+{
+    int sz = dev->zbd_info.zbd_max_rw_logical_blocks * dev->zbd_info.zbd_logical_block_size;
+    struct stat st;
+
+    /* Only SG nodes support direct and memory mapped I/Os */
+    if ( (fstat(dev->zbd_fd, &st) < 0)
+         || (! S_ISCHR(st.st_mode))
+         || (dev->zbd_flags & ZBC_SG_BSG) ) {
+        zbc_error("%s: Direct I/O is supported only with SG nodes\n",
+                  dev->zbd_filename);
+        return( -ENOTSUP );
+    }
+
+    if ( ! zbc_sg_allow_dio() ) {
+        zbc_error("%s: Direct I/O is not allowed by the sg driver "
+                  "(allow_dio module parameter)\n",
+                  dev->zbd_filename);
+        return( -ENOTSUP );
+    }
+
+    pool->dio = 1;
+
+    if ( (sz <= 0) || (sz > ZBC_SG_MMAP_MAX_BUFSZ) ) {
+        sz = ZBC_SG_MMAP_MAX_BUFSZ;
+    }
+
+    if ( (ioctl(dev->zbd_fd, SG_SET_RESERVED_SIZE, &sz) < 0)
+         || (ioctl(dev->zbd_fd, SG_GET_RESERVED_SIZE, &sz) < 0)
+         || (sz <= 0) ) {
+        zbc_error("%s: Set SG reserved buffer size failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        return( -ENOTSUP );
+    }
+
+    pool->mmap_buf = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED, dev->zbd_fd, 0);
+    if ( pool->mmap_buf == MAP_FAILED ) {
+        zbc_error("%s: mmap SG reserved buffer failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        pool->mmap_buf = NULL;
+        return( -ENOTSUP );
+    }
+    pool->mmap_bufsz = sz;
+
+    zbc_debug("%s: Direct I/O enabled, %zu B reserved buffer mapped\n",
+              dev->zbd_filename,
+              pool->mmap_bufsz);
+
+    return( 0 );
+
+}
+
+/**
+ * Allocate the command pool of a device. The transfer buffers size is
+ * the device maximum command size, limited to ZBC_SG_POOL_MAX_BUFSZ.
+ * Commands with larger buffers allocate their buffer.
+ */
+int
+zbc_sg_pool_init(zbc_device_t *dev,
+                 int flags)
+{
+    size_t pgsz = sysconf(_SC_PAGESIZE);
+    zbc_sg_pool_t *pool;
+    unsigned int i;
+    int ret;
+
+    pool = calloc(1, sizeof(zbc_sg_pool_t));
+    if ( ! pool ) {
+        return( -ENOMEM );
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    for(i = 0; i < ZBC_SG_POOL_NR_CMDS; i++) {
+        pool->free_cmds[i] = &pool->cmds[i];
+    }
+    pool->nr_free_cmds = ZBC_SG_POOL_NR_CMDS;
+
+    pool->bufsz = dev->zbd_info.zbd_max_rw_logical_blocks * dev->zbd_info.zbd_logical_block_size;
+    if ( (! pool->bufsz) || (pool->bufsz > ZBC_SG_POOL_MAX_BUFSZ) ) {
+        pool->bufsz = ZBC_SG_POOL_MAX_BUFSZ;
+    }
+    pool->bufsz = (pool->bufsz + pgsz - 1) & ~(pgsz - 1);
+    pool->bufs_size = pool->bufsz * ZBC_SG_POOL_NR_BUFS;
+
+    /* Try huge pages first if requested */
+    pool->bufs = MAP_FAILED;
+    if ( flags & ZBC_SG_HUGE_PAGES ) {
+        pool->bufs_size = (pool->bufs_size + ZBC_SG_HUGE_PAGE_SIZE - 1) & ~((size_t)ZBC_SG_HUGE_PAGE_SIZE - 1);
+        pool->bufs = mmap(NULL, pool->bufs_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if ( pool->bufs == MAP_FAILED ) {
+            zbc_debug("%s: No huge pages for command buffers, using regular pages\n",
+                      dev->zbd_filename);
+            pool->bufs_size = pool->bufsz * ZBC_SG_POOL_NR_BUFS;
+        }
+    }
+
+    if ( pool->bufs == MAP_FAILED ) {
+        pool->bufs = mmap(NULL, pool->bufs_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if ( pool->bufs == MAP_FAILED ) {
+            zbc_error("%s: No memory for command buffers (%zu B)\n",
+                      dev->zbd_filename,
+                      pool->bufs_size);
+            pthread_mutex_destroy(&pool->mutex);
+            free(pool);
+            return( -ENOMEM );
+        }
+    }
+
+    for(i = 0; i < ZBC_SG_POOL_NR_BUFS; i++) {
+        pool->free_bufs[i] = pool->bufs + (size_t)i * pool->bufsz;
+    }
+    pool->nr_free_bufs = ZBC_SG_POOL_NR_BUFS;
+
+    pthread_mutex_init(&pool->mmap_mutex, NULL);
+    dev->zbd_sg_pool = pool;
+
+    if ( flags & ZBC_SG_DIRECT_IO ) {
+        ret = zbc_sg_pool_init_dio(dev, pool);
+        if ( ret != 0 ) {
+            zbc_sg_pool_free(dev);
+            return( ret );
+        }
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Free the command pool of a device.
+ */
+void
+zbc_sg_pool_free(zbc_device_t *dev)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+
+    if ( pool ) {
+        if ( pool->mmap_buf ) {
+            munmap(pool->mmap_buf, pool->mmap_bufsz);
+        }
+        pthread_mutex_destroy(&pool->mmap_mutex);
+        munmap(pool->bufs, pool->bufs_size);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        dev->zbd_sg_pool = NULL;
+    }
+
+    return;
+
+}
+
+/**
+ * Get a command descriptor from the device pool,
+ * or allocate one if the pool is empty.
+ */
+zbc_sg_cmd_t *
+zbc_sg_cmd_alloc(zbc_device_t *dev)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+    zbc_sg_cmd_t *cmd = NULL;
+
+    if ( pool ) {
+        pthread_mutex_lock(&pool->mutex);
+        if ( pool->nr_free_cmds ) {
+            cmd = pool->free_cmds[--pool->nr_free_cmds];
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if ( ! cmd ) {
+        cmd = malloc(sizeof(zbc_sg_cmd_t));
+    }
+
+    return( cmd );
+
+}
+
+/**
+ * Release a command descriptor obtained with zbc_sg_cmd_alloc().
+ */
+void
+zbc_sg_cmd_free(zbc_device_t *dev,
+                zbc_sg_cmd_t *cmd)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+
+    if ( pool
+         && (cmd >= &pool->cmds[0])
+         && (cmd < &pool->cmds[ZBC_SG_POOL_NR_CMDS]) ) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->free_cmds[pool->nr_free_cmds++] = cmd;
+        pthread_mutex_unlock(&pool->mutex);
+    } else {
+        free(cmd);
+    }
+
+    return;
+
+}
+
+/**
+ * Get a transfer buffer from the device pool.
+ */
+static uint8_t *
+zbc_sg_pool_get_buf(zbc_sg_pool_t *pool,
+                    size_t bufsz)
+{
+    uint8_t *buf = NULL;
+
+    if ( pool && (bufsz <= pool->bufsz) ) {
+        pthread_mutex_lock(&pool->mutex);
+        if ( pool->nr_free_bufs ) {
+            buf = pool->free_bufs[--pool->nr_free_bufs];
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return( buf );
+
+}
+
 /**
  * Free a command.
  */
@@ -247,7 +562,14 @@ zbc_sg_cmd_destroy(zbc_sg_cmd_t *cmd)
     if ( cmd ) {
         if ( cmd->out_buf
              && cmd->out_buf_needfree ) {
-            free(cmd->out_buf);
+            if ( cmd->pool ) {
+                pthread_mutex_lock(&cmd->pool->mutex);
+                cmd->pool->free_bufs[cmd->pool->nr_free_bufs++] = cmd->out_buf;
+                pthread_mutex_unlock(&cmd->pool->mutex);
+                cmd->pool = NULL;
+            } else {
+                free(cmd->out_buf);
+            }
             cmd->out_buf = NULL;
             cmd->out_bufsz = 0;
         }
@@ -258,10 +580,12 @@ zbc_sg_cmd_destroy(zbc_sg_cmd_t *cmd)
 }
 
 /**
- * Allocate and initialize a new command.
+ * Allocate and initialize a new command. If @out_buf is NULL, a buffer
+ * of @out_bufsz bytes is taken from the device pool or allocated.
  */
 int
-zbc_sg_cmd_init(zbc_sg_cmd_t *cmd,
+zbc_sg_cmd_init(zbc_device_t *dev,
+                zbc_sg_cmd_t *cmd,
                 int cmd_code,
                 uint8_t *out_buf,
                 size_t out_bufsz)
@@ -298,13 +622,19 @@ zbc_sg_cmd_init(zbc_sg_cmd_t *cmd,
 
     } else if ( out_bufsz ) {
 
-        /* Allocate a buffer */
-        ret = posix_memalign((void **) &cmd->out_buf, sysconf(_SC_PAGESIZE), out_bufsz);
-        if ( ret != 0 ) {
-            zbc_error("No memory for output buffer (%zu B)\n",
-                      out_bufsz);
-            ret = -ENOMEM;
-            goto out;
+        /* Use a pool buffer, or allocate a buffer */
+        cmd->out_buf = zbc_sg_pool_get_buf(dev->zbd_sg_pool, out_bufsz);
+        if ( cmd->out_buf ) {
+            cmd->pool = dev->zbd_sg_pool;
+        } else {
+            ret = posix_memalign((void **) &cmd->out_buf, sysconf(_SC_PAGESIZE), out_bufsz);
+            if ( ret != 0 ) {
+                cmd->out_buf = NULL;
+                zbc_error("No memory for output buffer (%zu B)\n",
+                          out_bufsz);
+                ret = -ENOMEM;
+                goto out;
+            }
         }
         memset(cmd->out_buf, 0, out_bufsz);
         cmd->out_bufsz = out_bufsz;
@@ -315,9 +645,11 @@ zbc_sg_cmd_init(zbc_sg_cmd_t *cmd,
     /* OK: setup SGIO header */
     memset(&cmd->io_hdr, 0, sizeof(sg_io_hdr_t));
 
+    cmd->cls = zbc_sg_cmd_list[cmd_code].cls;
+
     cmd->io_hdr.interface_id    = 'S';
-    cmd->io_hdr.timeout         = 20000;
-    cmd->io_hdr.flags           = 0; //SG_FLAG_DIRECT_IO;
+    cmd->io_hdr.timeout         = zbc_cmd_policy(dev, cmd->cls)->zcp_timeout;
+    cmd->io_hdr.flags           = 0;
 
     cmd->io_hdr.cmd_len         = cmd->cdb_sz;
     cmd->io_hdr.cmdp            = &cmd->cdb[0];
@@ -425,35 +757,12 @@ out:
 }
 
 /**
- * Execute a command.
+ * Check the status of an executed command.
  */
-int
-zbc_sg_cmd_exec(zbc_device_t *dev,
-                zbc_sg_cmd_t *cmd)
+static int
+zbc_sg_cmd_check(zbc_device_t *dev,
+                 zbc_sg_cmd_t *cmd)
 {
-    int ret;
-
-    if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
-        zbc_debug("%s: Sending command 0x%02x:0x%02x (%s):\n",
-                  dev->zbd_filename,
-                  cmd->cdb_opcode,
-                  cmd->cdb_sa,
-                  zbc_sg_cmd_name(cmd));
-	zbc_sg_print_bytes(dev, cmd->cdb, cmd->cdb_sz);
-    }
-
-    /* Send the SG_IO command */
-    ret = ioctl(dev->zbd_fd, SG_IO, &cmd->io_hdr);
-    if ( ret != 0 ) {
-        ret = -errno;
-	if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
-            zbc_error("%s: SG_IO ioctl failed %d (%s)\n",
-		      dev->zbd_filename,
-		      errno,
-		      strerror(errno));
-	}
-        goto out;
-    }
 
     /* Reset errno */
     zbc_sg_set_sense(dev, NULL);
@@ -474,16 +783,14 @@ zbc_sg_cmd_exec(zbc_device_t *dev,
        /* ATA command status */
        if ( cmd->io_hdr.status != ZBC_SG_CHECK_CONDITION ) {
            zbc_sg_set_sense(dev, cmd->sense_buf);
-           ret = -EIO;
-           goto out;
+           return( -EIO );
        }
 
        if ( (zbc_sg_cmd_driver_status(cmd) == ZBC_SG_DRIVER_SENSE)
             && (cmd->io_hdr.sb_len_wr > 21)
             && (cmd->sense_buf[21] != 0x50) ) {
            zbc_sg_set_sense(dev, cmd->sense_buf);
-           ret = -EIO;
-           goto out;
+           return( -EIO );
        }
 
        cmd->io_hdr.status = 0;
@@ -517,9 +824,8 @@ zbc_sg_cmd_exec(zbc_device_t *dev,
 	}
 
         zbc_sg_set_sense(dev, cmd->sense_buf);
-        ret = -EIO;
 
-        goto out;
+        return( -EIO );
 
     }
 
@@ -536,12 +842,761 @@ zbc_sg_cmd_exec(zbc_device_t *dev,
               cmd->io_hdr.duration,
               cmd->out_bufsz);
 
+    return( 0 );
+
+}
+
+/**
+ * Get the current time in microseconds (monotonic clock).
+ */
+static inline uint64_t
+zbc_sg_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 );
+
+}
+
+/**
+ * Test if a failed command can be retried: the command failed because of
+ * a transient condition (transport error, busy device, UNIT ATTENTION,
+ * NOT READY becoming ready or ABORTED COMMAND). ATA errors reported with
+ * an ABORTED COMMAND sense key for ATA pass through commands are not
+ * transient. Except for a busy device or a full task set, these errors do
+ * not prove that no data was written, so commands writing data are not
+ * retried on them: executing a write again after its data reached the
+ * medium fails on a sequential zone, or silently overwrites data written
+ * in the mean time by another command.
+ */
+static int
+zbc_sg_cmd_retryable(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd)
+{
+    int ata = (cmd->code == ZBC_SG_ATA12) || (cmd->code == ZBC_SG_ATA16);
+
+    /* The command was not started */
+    switch( cmd->io_hdr.status ) {
+    case ZBC_SG_BUSY:
+    case ZBC_SG_TASK_SET_FULL:
+        return( 1 );
+    }
+
+    if ( cmd->io_hdr.dxfer_direction == SG_DXFER_TO_DEV ) {
+        return( 0 );
+    }
+
+    switch( cmd->io_hdr.host_status ) {
+    case ZBC_SG_DID_BUS_BUSY:
+    case ZBC_SG_DID_RESET:
+    case ZBC_SG_DID_SOFT_ERROR:
+        return( 1 );
+    }
+
+    if ( zbc_sg_cmd_driver_flags(cmd) == ZBC_SG_DRIVER_SUGGEST_RETRY ) {
+        return( 1 );
+    }
+
+    switch( cmd->io_hdr.status ) {
+
+    case ZBC_SG_CHECK_CONDITION:
+        if ( dev->zbd_errno.sk == ZBC_E_UNIT_ATTENTION ) {
+            return( 1 );
+        }
+        if ( ata ) {
+            break;
+        }
+        if ( (dev->zbd_errno.sk == ZBC_E_ABORTED_COMMAND)
+             || ((dev->zbd_errno.sk == ZBC_E_NOT_READY)
+                 && (dev->zbd_errno.asc_ascq == 0x0401)) ) {
+            return( 1 );
+        }
+        break;
+
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Decide if a failed command is retried according to the policy of its
+ * class, and update the command counters. If the command is retried, set
+ * the time after which it can be executed again (backoff time of the retry)
+ * and return 1. Otherwise, return 0.
+ */
+static int
+zbc_sg_cmd_retry(zbc_device_t *dev,
+                 zbc_sg_cmd_t *cmd)
+{
+    const zbc_cmd_policy_t *policy = zbc_cmd_policy(dev, cmd->cls);
+
+    if ( (cmd->io_hdr.host_status == ZBC_SG_DID_TIME_OUT)
+         || (zbc_sg_cmd_driver_status(cmd) == ZBC_SG_DRIVER_TIMEOUT) ) {
+        zbc_error("%s: Command %s timed out\n",
+                  dev->zbd_filename,
+                  zbc_sg_cmd_name(cmd));
+        zbc_cmd_stats_inc(dev, zcs_timeouts);
+        zbc_cmd_stats_inc(dev, zcs_errors);
+        return( 0 );
+    }
+
+    if ( (cmd->retries >= policy->zcp_max_retries)
+         || (! zbc_sg_cmd_retryable(dev, cmd)) ) {
+        zbc_cmd_stats_inc(dev, zcs_errors);
+        return( 0 );
+    }
+
+    cmd->retries++;
+    zbc_cmd_stats_inc(dev, zcs_retries);
+
+    zbc_debug("%s: Retrying command %s (%u/%u)\n",
+              dev->zbd_filename,
+              zbc_sg_cmd_name(cmd),
+              cmd->retries,
+              policy->zcp_max_retries);
+
+    cmd->retry_time = zbc_sg_time_us()
+        + ((uint64_t) policy->zcp_backoff << (cmd->retries - 1));
+
+    return( 1 );
+
+}
+
+/**
+ * Execute a command on a bsg node: the sg v3 header of the command is
+ * converted to an sg v4 header and the execution status converted back.
+ * The command buffer is passed directly. bsg ignores the iovec counts of
+ * sg v4 headers, so commands using vectors of buffers are rejected with
+ * -ENOTSUP instead of being bounced through a copy.
+ */
+static int
+zbc_sg_cmd_exec_v4(zbc_device_t *dev,
+                   zbc_sg_cmd_t *cmd)
+{
+    struct sg_io_v4 hdr;
+    int ret;
+
+    if ( cmd->io_hdr.iovec_count ) {
+        zbc_debug("%s: vectors of buffers are not supported by bsg\n",
+                  dev->zbd_filename);
+        return( -ENOTSUP );
+    }
+
+    memset(&hdr, 0, sizeof(struct sg_io_v4));
+    hdr.guard = 'Q';
+    hdr.protocol = BSG_PROTOCOL_SCSI;
+    hdr.subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD;
+    hdr.request_len = cmd->io_hdr.cmd_len;
+    hdr.request = (uintptr_t) cmd->io_hdr.cmdp;
+    hdr.max_response_len = cmd->io_hdr.mx_sb_len;
+    hdr.response = (uintptr_t) cmd->io_hdr.sbp;
+    hdr.timeout = cmd->io_hdr.timeout;
+    if ( cmd->io_hdr.dxfer_direction == SG_DXFER_FROM_DEV ) {
+        hdr.din_xfer_len = cmd->io_hdr.dxfer_len;
+        hdr.din_xferp = (uintptr_t) cmd->io_hdr.dxferp;
+    } else if ( cmd->io_hdr.dxfer_direction == SG_DXFER_TO_DEV ) {
+        hdr.dout_xfer_len = cmd->io_hdr.dxfer_len;
+        hdr.dout_xferp = (uintptr_t) cmd->io_hdr.dxferp;
+    }
+
+    ret = ioctl(dev->zbd_fd, SG_IO, &hdr);
+    if ( ret != 0 ) {
+        return( -errno );
+    }
+
+    cmd->io_hdr.status = hdr.device_status;
+    cmd->io_hdr.masked_status = (hdr.device_status >> 1) & 0x7f;
+    cmd->io_hdr.host_status = hdr.transport_status;
+    cmd->io_hdr.driver_status = hdr.driver_status;
+    cmd->io_hdr.sb_len_wr = hdr.response_len;
+    cmd->io_hdr.resid = hdr.din_xfer_len ? hdr.din_resid : hdr.dout_resid;
+    cmd->io_hdr.duration = hdr.duration;
+
+    return( 0 );
+
+}
+
+/**
+ * Execute a command, retrying it on transient errors
+ * according to the policy of its class.
+ */
+int
+zbc_sg_cmd_exec(zbc_device_t *dev,
+                zbc_sg_cmd_t *cmd)
+{
+    int ret;
+
+again:
+
+    if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
+        zbc_debug("%s: Sending command 0x%02x:0x%02x (%s):\n",
+                  dev->zbd_filename,
+                  cmd->cdb_opcode,
+                  cmd->cdb_sa,
+                  zbc_sg_cmd_name(cmd));
+	zbc_sg_print_bytes(dev, cmd->cdb, cmd->cdb_sz);
+    }
+
+    /* Send the SG_IO command */
+    if ( dev->zbd_flags & ZBC_SG_BSG ) {
+        ret = zbc_sg_cmd_exec_v4(dev, cmd);
+    } else if ( ioctl(dev->zbd_fd, SG_IO, &cmd->io_hdr) != 0 ) {
+        ret = -errno;
+    } else {
+        ret = 0;
+    }
+    if ( ret != 0 ) {
+	if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
+            zbc_error("%s: SG_IO ioctl failed %d (%s)\n",
+		      dev->zbd_filename,
+		      -ret,
+		      strerror(-ret));
+	}
+        return( ret );
+    }
+
+    ret = zbc_sg_cmd_check(dev, cmd);
+    if ( (ret != 0) && zbc_sg_cmd_retry(dev, cmd) ) {
+        uint64_t now = zbc_sg_time_us();
+        if ( cmd->retry_time > now ) {
+            usleep((useconds_t)(cmd->retry_time - now));
+        }
+        goto again;
+    }
+
+    return( ret );
+
+}
+
+/**
+ * Submit several commands for asynchronous execution with a single
+ * system call: the sg driver write() interface is called for each
+ * command header by writev(). The commands and their buffers must not
+ * be modified until the commands are returned by zbc_sg_cmd_reap().
+ * Returns the number of commands submitted, which may be less than
+ * @nr_cmds if the sg driver queue is full, or a negative error code
+ * if no command could be submitted (-EAGAIN if the queue is full).
+ */
+int
+zbc_sg_cmd_submitv(zbc_device_t *dev,
+                   zbc_sg_cmd_t **cmds,
+                   unsigned int nr_cmds)
+{
+    struct iovec iov[ZBC_SG_AIO_MAX_QD];
+    unsigned int i;
+    ssize_t ret;
+
+    if ( nr_cmds > ZBC_SG_AIO_MAX_QD ) {
+        nr_cmds = ZBC_SG_AIO_MAX_QD;
+    }
+
+    for(i = 0; i < nr_cmds; i++) {
+
+        if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
+            zbc_debug("%s: Submitting command 0x%02x:0x%02x (%s):\n",
+                      dev->zbd_filename,
+                      cmds[i]->cdb_opcode,
+                      cmds[i]->cdb_sa,
+                      zbc_sg_cmd_name(cmds[i]));
+            zbc_sg_print_bytes(dev, cmds[i]->cdb, cmds[i]->cdb_sz);
+        }
+
+        /* The command is identified on completion using usr_ptr */
+        cmds[i]->io_hdr.usr_ptr = cmds[i];
+        cmds[i]->io_hdr.pack_id = 0;
+
+        iov[i].iov_base = &cmds[i]->io_hdr;
+        iov[i].iov_len = sizeof(sg_io_hdr_t);
+
+    }
+
+    ret = writev(dev->zbd_fd, iov, nr_cmds);
+    if ( ret < 0 ) {
+        ret = -errno;
+	if ( zbc_log_level >= ZBC_LOG_DEBUG ) {
+            zbc_error("%s: SG write failed %d (%s)\n",
+		      dev->zbd_filename,
+		      errno,
+		      strerror(errno));
+	}
+	if ( ret == -EDOM ) {
+	    /* Too many commands queued */
+	    ret = -EAGAIN;
+	}
+        return( ret );
+    }
+
+    return( ret / sizeof(sg_io_hdr_t) );
+
+}
+
+/**
+ * Submit a command for asynchronous execution using the sg driver
+ * write() interface. The command and its buffers must not be
+ * modified until the command is returned by zbc_sg_cmd_reap().
+ */
+int
+zbc_sg_cmd_submit(zbc_device_t *dev,
+                  zbc_sg_cmd_t *cmd)
+{
+    int ret;
+
+    ret = zbc_sg_cmd_submitv(dev, &cmd, 1);
+    if ( ret < 0 ) {
+        return( ret );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Resubmit the commands waiting for a retry whose retry time passed.
+ * Returns the number of milliseconds until the retry time of the next
+ * waiting command, or -1 if no command is waiting. A command that cannot
+ * be resubmitted is returned at the address specified by @pcmd.
+ */
+static int
+zbc_sg_cmd_resubmit(zbc_device_t *dev,
+                    zbc_sg_cmd_t **pcmd)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+    uint64_t now = zbc_sg_time_us(), next = 0;
+    zbc_sg_cmd_t *cmd;
+    unsigned int i = 0;
+
+    while( i < pool->nr_retry ) {
+
+        cmd = pool->retry_cmds[i];
+        if ( cmd->retry_time > now ) {
+            if ( (! next) || (cmd->retry_time < next) ) {
+                next = cmd->retry_time;
+            }
+            i++;
+            continue;
+        }
+
+        pool->retry_cmds[i] = pool->retry_cmds[--pool->nr_retry];
+        if ( zbc_sg_cmd_submitv(dev, &cmd, 1) != 1 ) {
+            *pcmd = cmd;
+            return( 0 );
+        }
+
+    }
+
+    if ( ! next ) {
+        return( -1 );
+    }
+
+    return( (int)((next - now + 999) / 1000) );
+
+}
+
+/**
+ * Get a command completed after submission with zbc_sg_cmd_submit(),
+ * waiting at most @timeout milliseconds (-1 waits forever). Returns -EAGAIN
+ * if no command completed. Otherwise, the completed command is returned
+ * at the address specified by @pcmd and its execution status is returned.
+ * All the commands already completed are read from the SG node with a
+ * single system call, and returned by the following calls. Commands
+ * failing with a transient error are resubmitted according to the
+ * policy of their class: they are kept aside until their backoff time
+ * elapsed, without delaying the completion of other commands. Called with
+ * the device asynchronous I/O mutex held by the only thread waiting for
+ * completions: the mutex is released while waiting.
+ */
+int
+zbc_sg_cmd_reap(zbc_device_t *dev,
+                int timeout,
+                zbc_sg_cmd_t **pcmd)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+    sg_io_hdr_t io_hdr[ZBC_SG_AIO_MAX_QD];
+    struct iovec iov[ZBC_SG_AIO_MAX_QD];
+    struct timespec start, now;
+    struct pollfd pfd;
+    zbc_sg_cmd_t *cmd;
+    int ret, nr = 1, i, wait, retry_wait;
+
+    *pcmd = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+again:
+
+    /* Commands already read first */
+    if ( pool && pool->nr_done ) {
+        cmd = pool->done_cmds[pool->done_head];
+        pool->done_head = (pool->done_head + 1) % ZBC_SG_AIO_MAX_QD;
+        pool->nr_done--;
+        goto check;
+    }
+
+    /* Resubmit the commands which waited long enough */
+    wait = timeout;
+    retry_wait = -1;
+    if ( pool && pool->nr_retry ) {
+        cmd = NULL;
+        retry_wait = zbc_sg_cmd_resubmit(dev, &cmd);
+        if ( cmd ) {
+            /* Report the last error of the command */
+            *pcmd = cmd;
+            return( zbc_sg_cmd_check(dev, cmd) );
+        }
+        if ( timeout >= 0 ) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            wait = timeout - (int)((now.tv_sec - start.tv_sec) * 1000
+                                   + (now.tv_nsec - start.tv_nsec) / 1000000);
+            if ( wait < 0 ) {
+                wait = 0;
+            }
+        }
+        if ( (retry_wait >= 0) && ((wait < 0) || (retry_wait < wait)) ) {
+            wait = retry_wait;
+        } else {
+            retry_wait = -1;
+        }
+    }
+
+    /* Wait for a completion, letting other threads submit commands */
+    pfd.fd = dev->zbd_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if ( wait ) {
+        pthread_mutex_unlock(&dev->zbd_aio_mutex);
+    }
+    do {
+        ret = poll(&pfd, 1, wait);
+    } while( (ret < 0) && (errno == EINTR) );
+    if ( wait ) {
+        pthread_mutex_lock(&dev->zbd_aio_mutex);
+    }
+
+    if ( ret < 0 ) {
+        ret = -errno;
+        zbc_error("%s: poll failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        return( ret );
+    }
+
+    if ( ret == 0 ) {
+        if ( retry_wait >= 0 ) {
+            /* A command is due for resubmission */
+            goto again;
+        }
+        return( -EAGAIN );
+    }
+
+    /* Read all completed commands: none of the reads can block */
+    if ( pool
+         && (ioctl(dev->zbd_fd, SG_GET_NUM_WAITING, &nr) == 0) ) {
+        if ( nr < 1 ) {
+            nr = 1;
+        } else if ( nr > ZBC_SG_AIO_MAX_QD ) {
+            nr = ZBC_SG_AIO_MAX_QD;
+        }
+    } else {
+        nr = 1;
+    }
+
+    for(i = 0; i < nr; i++) {
+        memset(&io_hdr[i], 0, sizeof(sg_io_hdr_t));
+        io_hdr[i].interface_id = 'S';
+        io_hdr[i].pack_id = -1;
+        iov[i].iov_base = &io_hdr[i];
+        iov[i].iov_len = sizeof(sg_io_hdr_t);
+    }
+
+    ret = readv(dev->zbd_fd, iov, nr);
+    if ( ret < 0 ) {
+        ret = -errno;
+        zbc_error("%s: SG read failed %d (%s)\n",
+                  dev->zbd_filename,
+                  errno,
+                  strerror(errno));
+        return( ret );
+    }
+    nr = ret / sizeof(sg_io_hdr_t);
+
+    for(i = 0; i < nr; i++) {
+        cmd = (zbc_sg_cmd_t *) io_hdr[i].usr_ptr;
+        memcpy(&cmd->io_hdr, &io_hdr[i], sizeof(sg_io_hdr_t));
+        if ( i ) {
+            pool->done_cmds[(pool->done_head + pool->nr_done) % ZBC_SG_AIO_MAX_QD] = cmd;
+            pool->nr_done++;
+        }
+    }
+    cmd = (zbc_sg_cmd_t *) io_hdr[0].usr_ptr;
+
+check:
+
+    /* Keep the command aside for a retry if it can be retried */
+    ret = zbc_sg_cmd_check(dev, cmd);
+    if ( (ret != 0)
+         && zbc_sg_cmd_retry(dev, cmd) ) {
+        if ( pool && (pool->nr_retry < ZBC_SG_AIO_MAX_QD) ) {
+            pool->retry_cmds[pool->nr_retry++] = cmd;
+            goto again;
+        }
+        if ( zbc_sg_cmd_submitv(dev, &cmd, 1) == 1 ) {
+            goto again;
+        }
+    }
+
+    *pcmd = cmd;
+
+    return( ret );
+
+}
+
+/**
+ * Execute @nr_cmds commands initialized by @init, keeping up to
+ * ZBC_SG_AIO_MAX_QD commands queued in the sg driver. @done, if not NULL,
+ * is called for each completed command with the command status and
+ * returns the status to report. All commands are executed even if some
+ * fail, and the status of the first failed command is returned.
+ * Commands are initialized and submitted in batches, each batch with
+ * a single system call. Commands are executed one at a time if
+ * asynchronous I/Os are in flight or if another thread is waiting for
+ * completions, as their completions cannot be distinguished from the
+ * commands completions. Otherwise, the calling thread becomes the only
+ * thread waiting for completions, and asynchronous I/Os cannot be
+ * submitted until all commands complete.
+ */
+int
+zbc_sg_cmd_exec_pipelined(zbc_device_t *dev,
+                          unsigned int nr_cmds,
+                          zbc_sg_cmd_init_cb init,
+                          zbc_sg_cmd_done_cb done,
+                          void *arg)
+{
+    zbc_sg_cmd_t cmds[ZBC_SG_AIO_MAX_QD], *free_cmds[ZBC_SG_AIO_MAX_QD];
+    zbc_sg_cmd_t *batch[ZBC_SG_AIO_MAX_QD], *cmd;
+    unsigned int nr_free = ZBC_SG_AIO_MAX_QD, inflight = 0, nr_batch, nr_queued, i, j;
+    int ret, err = 0, queue = 0;
+
+    for(i = 0; i < nr_free; i++) {
+        free_cmds[i] = &cmds[i];
+    }
+    i = 0;
+
+    pthread_mutex_lock(&dev->zbd_aio_mutex);
+    if ( dev->zbd_aio_qd
+         && (! dev->zbd_aio_inflight)
+         && (! dev->zbd_aio_reaping) ) {
+        dev->zbd_aio_reaping = 1;
+        dev->zbd_aio_excl = 1;
+        queue = 1;
+    } else {
+        pthread_mutex_unlock(&dev->zbd_aio_mutex);
+    }
+
+    while( (i < nr_cmds) || inflight ) {
+
+        /* Initialize a batch of commands */
+        nr_batch = 0;
+        while( nr_free && (i < nr_cmds) ) {
+
+            cmd = free_cmds[--nr_free];
+            ret = (init)(dev, cmd, i, arg);
+            i++;
+            if ( ret != 0 ) {
+                free_cmds[nr_free++] = cmd;
+                if ( ! err ) {
+                    err = ret;
+                }
+                continue;
+            }
+
+            batch[nr_batch++] = cmd;
+
+        }
+
+        /* Queue the batch */
+        nr_queued = 0;
+        if ( nr_batch && queue ) {
+            ret = zbc_sg_cmd_submitv(dev, batch, nr_batch);
+            if ( ret > 0 ) {
+                nr_queued = ret;
+                inflight += nr_queued;
+            }
+        }
+
+        /* Execute synchronously the commands that could not be queued */
+        for(j = nr_queued; j < nr_batch; j++) {
+            cmd = batch[j];
+            ret = zbc_sg_cmd_exec(dev, cmd);
+            if ( done ) {
+                ret = (done)(dev, cmd, ret);
+            }
+            if ( ret && (! err) ) {
+                err = ret;
+            }
+            zbc_sg_cmd_destroy(cmd);
+            free_cmds[nr_free++] = cmd;
+        }
+
+        if ( ! inflight ) {
+            continue;
+        }
+
+        /* Get completions, including all those read together */
+        do {
+
+            ret = zbc_sg_cmd_reap(dev, -1, &cmd);
+            if ( ! cmd ) {
+                zbc_error("%s: %u commands lost\n",
+                          dev->zbd_filename,
+                          inflight);
+                err = ret;
+                goto out;
+            }
+
+            if ( done ) {
+                ret = (done)(dev, cmd, ret);
+            }
+            if ( ret && (! err) ) {
+                err = ret;
+            }
+
+            zbc_sg_cmd_destroy(cmd);
+            free_cmds[nr_free++] = cmd;
+            inflight--;
+
+        } while( inflight && dev->zbd_sg_pool && dev->zbd_sg_pool->nr_done );
+
+    }
+
 out:
 
+    if ( queue ) {
+        dev->zbd_aio_reaping = 0;
+        dev->zbd_aio_excl = 0;
+        pthread_cond_broadcast(&dev->zbd_aio_cond);
+        pthread_mutex_unlock(&dev->zbd_aio_mutex);
+    }
+
+    return( err );
+
+}
+
+/**
+ * Use direct I/O for a read or write command transferring data from or
+ * to a single buffer aligned on the logical block size, if enabled.
+ */
+void
+zbc_sg_cmd_set_direct_io(zbc_device_t *dev,
+                         zbc_sg_cmd_t *cmd,
+                         const struct iovec *iov,
+                         int iovcnt)
+{
+    size_t align = dev->zbd_info.zbd_logical_block_size;
+
+    if ( dev->zbd_sg_pool
+         && dev->zbd_sg_pool->dio
+         && (iovcnt == 1)
+         && (! ((uintptr_t)iov[0].iov_base % align))
+         && (! (cmd->out_bufsz % align)) ) {
+        cmd->io_hdr.flags |= SG_FLAG_DIRECT_IO;
+    }
+
+    return;
+
+}
+
+/**
+ * Get the memory mapped reserved buffer of the SG node for a read of
+ * @sz bytes. Returns -ENOTSUP if the reserved buffer is not mapped and
+ * -EINVAL if it is too small.
+ */
+int
+zbc_sg_mmap_iov(zbc_device_t *dev,
+                size_t sz,
+                struct iovec *iov)
+{
+
+    if ( (! dev->zbd_sg_pool) || (! dev->zbd_sg_pool->mmap_buf) ) {
+        return( -ENOTSUP );
+    }
+
+    if ( sz > dev->zbd_sg_pool->mmap_bufsz ) {
+        return( -EINVAL );
+    }
+
+    iov->iov_base = dev->zbd_sg_pool->mmap_buf;
+    iov->iov_len = sz;
+
+    return( 0 );
+
+}
+
+/**
+ * Execute a read command initialized with the buffer returned by
+ * zbc_sg_mmap_iov(): the sg driver transfers the data directly to
+ * its reserved buffer. Commands are serialized as the reserved buffer
+ * can be used by only one command at a time.
+ */
+int
+zbc_sg_cmd_exec_mmap(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd)
+{
+    zbc_sg_pool_t *pool = dev->zbd_sg_pool;
+    int ret;
+
+    cmd->io_hdr.flags &= ~SG_FLAG_DIRECT_IO;
+    cmd->io_hdr.flags |= SG_FLAG_MMAP_IO;
+    cmd->io_hdr.iovec_count = 0;
+    cmd->io_hdr.dxferp = NULL;
+
+    pthread_mutex_lock(&pool->mmap_mutex);
+    ret = zbc_sg_cmd_exec(dev, cmd);
+    pthread_mutex_unlock(&pool->mmap_mutex);
+
     return( ret );
 
 }
 
+/**
+ * Initialize a READ 16 or WRITE 16 command transferring data
+ * from or to a vector of @iovcnt buffers.
+ */
+int
+zbc_sg_cmd_rw_init(zbc_device_t *dev,
+                   zbc_sg_cmd_t *cmd,
+                   int cmd_code,
+                   const struct iovec *iov,
+                   int iovcnt,
+                   uint32_t lba_count,
+                   uint64_t lba)
+{
+    size_t sz = (size_t) lba_count * dev->zbd_info.zbd_logical_block_size;
+    int ret;
+
+    ret = zbc_sg_cmd_init(dev, cmd, cmd_code, iov[0].iov_base, sz);
+    if ( ret != 0 ) {
+        zbc_error("zbc_sg_cmd_init failed\n");
+        return( ret );
+    }
+
+    /* Let the sg driver gather/scatter data */
+    zbc_sg_cmd_set_iov(cmd, iov, iovcnt);
+    zbc_sg_cmd_set_direct_io(dev, cmd, iov, iovcnt);
+
+    /* Fill command CDB */
+    cmd->cdb[0] = zbc_sg_cmd_list[cmd_code].cdb_opcode;
+    cmd->cdb[1] = 0x10;
+    zbc_sg_cmd_set_int64(&cmd->cdb[2], lba);
+    zbc_sg_cmd_set_int32(&cmd->cdb[10], lba_count);
+
+    return( 0 );
+
+}
+
 /**
  * Test if unit is ready. This will retry 5 times if the command
  * returns "UNIT ATTENTION".
@@ -557,7 +1612,7 @@ zbc_sg_cmd_test_unit_ready(zbc_device_t *dev)
 	retries--;
 
 	/* Intialize command */
-	ret = zbc_sg_cmd_init(&cmd, ZBC_SG_TEST_UNIT_READY, NULL, 0);
+	ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_TEST_UNIT_READY, NULL, 0);
 	if ( ret != 0 ) {
 	    zbc_error("%s: zbc_sg_cmd_init TEST UNIT READY failed\n",
 		      dev->zbd_filename);
@@ -600,7 +1655,7 @@ zbc_sg_cmd_inquiry(zbc_device_t *dev,
     int ret;
 
     /* Allocate and intialize inquiry command */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_INQUIRY, NULL, ZBC_SG_INQUIRY_REPLY_LEN);
     if ( ret != 0 ) {
         zbc_error("%s: zbc_sg_cmd_init INQUIRY failed\n",
 		  dev->zbd_filename);
@@ -662,7 +1717,7 @@ zbc_sg_get_capacity(zbc_device_t *dev,
     int ret;
 
     /* READ CAPACITY 16 */
-    ret = zbc_sg_cmd_init(&cmd, ZBC_SG_READ_CAPACITY, NULL, ZBC_SG_READ_CAPACITY_REPLY_LEN);
+    ret = zbc_sg_cmd_init(dev, &cmd, ZBC_SG_READ_CAPACITY, NULL, ZBC_SG_READ_CAPACITY_REPLY_LEN);
     if ( ret != 0 ) {
         zbc_error("zbc_sg_cmd_init failed\n");
         return( ret );
@@ -21,11 +21,36 @@
 #include "zbc.h"
 
 #include <string.h>
+#include <pthread.h>
 #include <scsi/scsi.h>
 #include <scsi/sg.h>
+#include <linux/bsg.h>
 
 /***** Macro definitions *****/
 
+/**
+ * Not defined by all C libraries.
+ */
+#ifndef SG_FLAG_MMAP_IO
+#define SG_FLAG_MMAP_IO                         4
+#endif
+
+/**
+ * Device flag (zbd_flags) set if the device file is a bsg node:
+ * commands are then executed with the sg v4 interface.
+ */
+#define ZBC_SG_BSG                              0x00010000
+
+/**
+ * Number of bytes in a Zone Descriptor.
+ */
+#define ZBC_ZONE_DESCRIPTOR_LENGTH              64
+
+/**
+ * Number of bytes in the buffer before the first Zone Descriptor.
+ */
+#define ZBC_ZONE_DESCRIPTOR_OFFSET              64
+
 /**
  * SG SCSI command names.
  */
@@ -153,6 +178,32 @@ enum {
 #define ZBC_SG_ATA16_CDB_OPCODE			0x85
 #define ZBC_SG_ATA16_CDB_LENGTH			16
 
+/**
+ * Maximum number of commands that can be queued on an SG node
+ * using the asynchronous write()/read() interface.
+ */
+#define ZBC_SG_AIO_MAX_QD                       SG_MAX_QUEUE
+
+/**
+ * Number of command descriptors and of transfer buffers
+ * preallocated for each device, and maximum size of the
+ * preallocated transfer buffers.
+ */
+#define ZBC_SG_POOL_NR_CMDS                     ZBC_SG_AIO_MAX_QD
+#define ZBC_SG_POOL_NR_BUFS                     4
+#define ZBC_SG_POOL_MAX_BUFSZ                   (128 * 1024)
+
+/**
+ * Maximum size of the reserved buffer of an SG node
+ * mapped in memory (ZBC_SG_DIRECT_IO).
+ */
+#define ZBC_SG_MMAP_MAX_BUFSZ                   (4 * 1024 * 1024)
+
+/**
+ * Huge page size for the pool buffers (ZBC_SG_HUGE_PAGES).
+ */
+#define ZBC_SG_HUGE_PAGE_SIZE                   (2 * 1024 * 1024)
+
 /**
  * Command sense buffer maximum length.
  */
@@ -167,6 +218,8 @@ enum {
  * Status codes.
  */
 #define ZBC_SG_CHECK_CONDITION      		0x02
+#define ZBC_SG_BUSY                 		0x08
+#define ZBC_SG_TASK_SET_FULL        		0x28
 
 /**
  * Host status codes.
@@ -217,6 +270,19 @@ typedef struct zbc_sg_cmd {
 
     int                 code;
 
+    /**
+     * Command class (timeout and retry policy)
+     * and number of retries done.
+     */
+    enum zbc_cmd_class  cls;
+    unsigned int        retries;
+
+    /**
+     * Time (us, monotonic clock) after which a command
+     * being retried can be executed again.
+     */
+    uint64_t            retry_time;
+
     int                 cdb_opcode;
     int                 cdb_sa;
     size_t              cdb_sz;
@@ -229,20 +295,117 @@ typedef struct zbc_sg_cmd {
     size_t              out_bufsz;
     uint8_t             *out_buf;
 
+    /**
+     * Pool of the output buffer (NULL if allocated).
+     */
+    struct zbc_sg_pool  *pool;
+
     sg_io_hdr_t         io_hdr;
 
+    zbc_aio_t           *aio;
+
 } zbc_sg_cmd_t;
 
+/**
+ * Per-device pool of command descriptors and page-aligned transfer
+ * buffers, reused across commands instead of being allocated and
+ * freed for each command. The buffers are allocated in a single
+ * prefaulted mapping.
+ */
+typedef struct zbc_sg_pool {
+
+    pthread_mutex_t     mutex;
+
+    /**
+     * Command descriptors.
+     */
+    zbc_sg_cmd_t        cmds[ZBC_SG_POOL_NR_CMDS];
+    zbc_sg_cmd_t        *free_cmds[ZBC_SG_POOL_NR_CMDS];
+    unsigned int        nr_free_cmds;
+
+    /**
+     * Transfer buffers.
+     */
+    uint8_t             *bufs;
+    size_t              bufs_size;
+    size_t              bufsz;
+    uint8_t             *free_bufs[ZBC_SG_POOL_NR_BUFS];
+    unsigned int        nr_free_bufs;
+
+    /**
+     * Direct I/O (ZBC_SG_DIRECT_IO) and reserved buffer
+     * of the SG node mapped in memory (NULL if not mapped).
+     */
+    int                 dio;
+    pthread_mutex_t     mmap_mutex;
+    uint8_t             *mmap_buf;
+    size_t              mmap_bufsz;
+
+    /**
+     * Commands completed and read from the SG node
+     * but not yet returned by zbc_sg_cmd_reap().
+     */
+    zbc_sg_cmd_t        *done_cmds[ZBC_SG_AIO_MAX_QD];
+    unsigned int        done_head;
+    unsigned int        nr_done;
+
+    /**
+     * Commands failed with a transient error and waiting
+     * in zbc_sg_cmd_reap() for their retry time to be resubmitted.
+     */
+    zbc_sg_cmd_t        *retry_cmds[ZBC_SG_AIO_MAX_QD];
+    unsigned int        nr_retry;
+
+    /**
+     * Queue depth of the device for queued (ATA NCQ) commands.
+     */
+    unsigned int        ncq_depth;
+
+} zbc_sg_pool_t;
+
 #define zbc_sg_cmd_driver_status(cmd)		((cmd)->io_hdr.driver_status & ZBC_SG_DRIVER_STATUS_MASK)
 #define zbc_sg_cmd_driver_flags(cmd)		((cmd)->io_hdr.driver_status & ZBC_SG_DRIVER_FLAGS_MASK)
 
 /***** Internal command functions *****/
 
+/**
+ * Detect the SG interface (sg v3 or bsg) of a device file.
+ */
+extern void
+zbc_sg_set_interface(zbc_device_t *dev);
+
+/**
+ * Allocate the command pool of a device.
+ */
+extern int
+zbc_sg_pool_init(zbc_device_t *dev,
+                 int flags);
+
+/**
+ * Free the command pool of a device.
+ */
+extern void
+zbc_sg_pool_free(zbc_device_t *dev);
+
+/**
+ * Get a command descriptor.
+ */
+extern zbc_sg_cmd_t *
+zbc_sg_cmd_alloc(zbc_device_t *dev);
+
+/**
+ * Release a command descriptor obtained with zbc_sg_cmd_alloc().
+ */
+extern void
+zbc_sg_cmd_free(zbc_device_t *dev,
+                zbc_sg_cmd_t *cmd);
+
 /**
  * Allocate and initialize a new command.
  */
 extern int
-zbc_sg_cmd_init(zbc_sg_cmd_t *cmd,
+zbc_sg_cmd_init(zbc_device_t *dev,
+                zbc_sg_cmd_t *cmd,
                 int cmd_code,
                 uint8_t *out_buf,
                 size_t out_bufsz);
@@ -253,6 +416,24 @@ zbc_sg_cmd_init(zbc_sg_cmd_t *cmd,
 extern void
 zbc_sg_cmd_destroy(zbc_sg_cmd_t *cmd);
 
+/**
+ * Set the class of a command, to use the timeout and retry policy
+ * of the class instead of the policy of the command code class
+ * (e.g. for ATA pass through commands).
+ */
+static inline void
+zbc_sg_cmd_set_class(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd,
+                     enum zbc_cmd_class cls)
+{
+
+    cmd->cls = cls;
+    cmd->io_hdr.timeout = zbc_cmd_policy(dev, cls)->zcp_timeout;
+
+    return;
+
+}
+
 /**
  * Get the maximum allowed command size for the device.
  */
@@ -266,6 +447,110 @@ extern int
 zbc_sg_cmd_exec(zbc_device_t *dev,
                 zbc_sg_cmd_t *cmd);
 
+/**
+ * Use direct I/O for a read or write command if possible.
+ */
+extern void
+zbc_sg_cmd_set_direct_io(zbc_device_t *dev,
+                         zbc_sg_cmd_t *cmd,
+                         const struct iovec *iov,
+                         int iovcnt);
+
+/**
+ * Get the memory mapped reserved buffer of the SG node
+ * for a read of @sz bytes.
+ */
+extern int
+zbc_sg_mmap_iov(zbc_device_t *dev,
+                size_t sz,
+                struct iovec *iov);
+
+/**
+ * Execute a read command transferring data
+ * to the memory mapped reserved buffer.
+ */
+extern int
+zbc_sg_cmd_exec_mmap(zbc_device_t *dev,
+                     zbc_sg_cmd_t *cmd);
+
+/**
+ * Submit a command for asynchronous execution.
+ */
+extern int
+zbc_sg_cmd_submit(zbc_device_t *dev,
+                  zbc_sg_cmd_t *cmd);
+
+/**
+ * Submit several commands for asynchronous execution.
+ */
+extern int
+zbc_sg_cmd_submitv(zbc_device_t *dev,
+                   zbc_sg_cmd_t **cmds,
+                   unsigned int nr_cmds);
+
+/**
+ * Get a completed asynchronous command.
+ */
+extern int
+zbc_sg_cmd_reap(zbc_device_t *dev,
+                int timeout,
+                zbc_sg_cmd_t **pcmd);
+
+/**
+ * Command initialization and completion callbacks
+ * for zbc_sg_cmd_exec_pipelined().
+ */
+typedef int (*zbc_sg_cmd_init_cb)(zbc_device_t *dev,
+                                  zbc_sg_cmd_t *cmd,
+                                  unsigned int idx,
+                                  void *arg);
+
+typedef int (*zbc_sg_cmd_done_cb)(zbc_device_t *dev,
+                                  zbc_sg_cmd_t *cmd,
+                                  int ret);
+
+/**
+ * Execute a sequence of commands, keeping several commands queued.
+ */
+extern int
+zbc_sg_cmd_exec_pipelined(zbc_device_t *dev,
+                          unsigned int nr_cmds,
+                          zbc_sg_cmd_init_cb init,
+                          zbc_sg_cmd_done_cb done,
+                          void *arg);
+
+/**
+ * Set the data buffer of a command as a vector of buffers.
+ * The command must have been initialized with the first buffer
+ * of the vector and the total transfer size.
+ */
+static inline void
+zbc_sg_cmd_set_iov(zbc_sg_cmd_t *cmd,
+                   const struct iovec *iov,
+                   int iovcnt)
+{
+
+    if ( iovcnt > 1 ) {
+        cmd->io_hdr.iovec_count = iovcnt;
+        cmd->io_hdr.dxferp = (void *) iov;
+    }
+
+    return;
+
+}
+
+/**
+ * Initialize a READ 16 or WRITE 16 command.
+ */
+extern int
+zbc_sg_cmd_rw_init(zbc_device_t *dev,
+                   zbc_sg_cmd_t *cmd,
+                   int cmd_code,
+                   const struct iovec *iov,
+                   int iovcnt,
+                   uint32_t lba_count,
+                   uint64_t lba);
+
 /**
  * Test if unit is ready. This will retry 5 times if the command
  * returns "UNIT ATTENTION".
@@ -426,6 +711,24 @@ zbc_sg_cmd_get_int16(uint8_t *buf)
 
 }
 
+/**
+ * Zone descriptors byte order: big endian for
+ * REPORT ZONES, little endian for ATA REPORT ZONES EXT.
+ */
+enum zbc_sg_zd_order {
+    ZBC_SG_ZD_BE = 0,
+    ZBC_SG_ZD_LE = 1,
+};
+
+/**
+ * Decode an array of zone descriptors (see zbc_sg_zones.c).
+ */
+extern void
+zbc_sg_get_zones(const uint8_t *buf,
+                 zbc_zone_t *zones,
+                 unsigned int nr_zones,
+                 enum zbc_sg_zd_order order);
+
 /**
  * Print an array of bytes.
  */
@@ -0,0 +1,155 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Author: Damien Le Moal (damien.lemoal@hgst.com)
+ *         Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/***** Including files *****/
+
+#include "zbc_sg.h"
+
+#include <endian.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define ZBC_SG_ZD_SSSE3         1
+#endif
+
+/***** Definition of private functions *****/
+
+/**
+ * Zone descriptor fields other than the 64 bits LBA values.
+ */
+static inline void
+zbc_sg_get_zone_flags(const uint8_t *buf,
+                      zbc_zone_t *zone)
+{
+
+    zone->zbz_type = buf[0] & 0x0f;
+    zone->zbz_condition = (buf[1] >> 4) & 0x0f;
+    zone->zbz_flags = buf[1] & 0x03;
+
+    return;
+
+}
+
+/**
+ * Get a 64 bits value with a single (possibly unaligned) load and a byte swap.
+ */
+static inline uint64_t
+zbc_sg_get_zd_int64(const uint8_t *buf,
+                    enum zbc_sg_zd_order order)
+{
+    uint64_t val;
+
+    memcpy(&val, buf, sizeof(uint64_t));
+
+    if ( order == ZBC_SG_ZD_BE ) {
+        return( be64toh(val) );
+    }
+
+    return( le64toh(val) );
+
+}
+
+/**
+ * Generic decoder.
+ */
+static void
+zbc_sg_get_zones_scalar(const uint8_t *buf,
+                        zbc_zone_t *zones,
+                        unsigned int nr_zones,
+                        enum zbc_sg_zd_order order)
+{
+    unsigned int i;
+
+    for(i = 0; i < nr_zones; i++) {
+
+        zbc_sg_get_zone_flags(buf, &zones[i]);
+        zones[i].zbz_length = zbc_sg_get_zd_int64(&buf[8], order);
+        zones[i].zbz_start = zbc_sg_get_zd_int64(&buf[16], order);
+        zones[i].zbz_write_pointer = zbc_sg_get_zd_int64(&buf[24], order);
+
+        buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
+
+    }
+
+    return;
+
+}
+
+#ifdef ZBC_SG_ZD_SSSE3
+
+/**
+ * Big endian decoder for x86 CPUs with SSSE3: the zone length and start
+ * LBA (bytes 8 to 23 of a descriptor) are byte swapped with a single shuffle
+ * and stored together, as zbz_length and zbz_start are adjacent in zbc_zone_t.
+ */
+__attribute__((target("ssse3")))
+static void
+zbc_sg_get_zones_ssse3(const uint8_t *buf,
+                       zbc_zone_t *zones,
+                       unsigned int nr_zones)
+{
+    const __m128i bswap64 = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15,
+                                         0, 1, 2, 3, 4, 5, 6, 7);
+    __m128i len_start, wp;
+    unsigned int i;
+
+    for(i = 0; i < nr_zones; i++) {
+
+        len_start = _mm_loadu_si128((const __m128i *) &buf[8]);
+        wp = _mm_loadl_epi64((const __m128i *) &buf[24]);
+
+        _mm_storeu_si128((__m128i *) &zones[i].zbz_length,
+                         _mm_shuffle_epi8(len_start, bswap64));
+        _mm_storel_epi64((__m128i *) &zones[i].zbz_write_pointer,
+                         _mm_shuffle_epi8(wp, bswap64));
+
+        zbc_sg_get_zone_flags(buf, &zones[i]);
+
+        buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
+
+    }
+
+    return;
+
+}
+
+#endif /* ZBC_SG_ZD_SSSE3 */
+
+/***** Definition of internal functions *****/
+
+/**
+ * Decode @nr_zones zone descriptors from @buf (which points
+ * to the first descriptor, not to the report header).
+ */
+void
+zbc_sg_get_zones(const uint8_t *buf,
+                 zbc_zone_t *zones,
+                 unsigned int nr_zones,
+                 enum zbc_sg_zd_order order)
+{
+
+#ifdef ZBC_SG_ZD_SSSE3
+    /* Little endian descriptors need no swapping on x86 */
+    if ( (order == ZBC_SG_ZD_BE) && __builtin_cpu_supports("ssse3") ) {
+        zbc_sg_get_zones_ssse3(buf, zones, nr_zones);
+        return;
+    }
+#endif
+
+    zbc_sg_get_zones_scalar(buf, zones, nr_zones, order);
+
+    return;
+
+}
@@ -0,0 +1,393 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christoph Hellwig (hch@infradead.org)
+ */
+
+/***** Including files *****/
+
+#include "zbc_uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/***** Definition of private functions *****/
+
+static inline int
+zbc_uring_setup(unsigned int entries,
+                struct io_uring_params *p)
+{
+
+    return( syscall(__NR_io_uring_setup, entries, p) );
+
+}
+
+static inline int
+zbc_uring_enter(zbc_uring_t *ring,
+                unsigned int to_submit,
+                unsigned int min_complete,
+                unsigned int flags)
+{
+
+    return( syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags, NULL, 0) );
+
+}
+
+static inline int
+zbc_uring_register(zbc_uring_t *ring,
+                   unsigned int opcode,
+                   const void *arg,
+                   unsigned int nr_args)
+{
+
+    return( syscall(__NR_io_uring_register, ring->fd, opcode, arg, nr_args) );
+
+}
+
+/**
+ * Get the oldest completion, if any.
+ */
+static inline struct io_uring_cqe *
+zbc_uring_peek_cqe(zbc_uring_t *ring)
+{
+    unsigned int head = *ring->cq_head;
+
+    if ( head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) ) {
+        return( NULL );
+    }
+
+    return( &ring->cqes[head & ring->cq_mask] );
+
+}
+
+/**
+ * Submit prepared entries and optionally wait for @min_complete completions.
+ */
+static int
+zbc_uring_do_submit(zbc_uring_t *ring,
+                    unsigned int min_complete)
+{
+    unsigned int to_submit = ring->sqe_tail - ring->sqe_submitted;
+    int ret;
+
+    if ( (! to_submit) && (! min_complete) ) {
+        return( 0 );
+    }
+
+    /* Make the new entries visible to the kernel */
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    ret = zbc_uring_enter(ring, to_submit, min_complete,
+                          min_complete ? IORING_ENTER_GETEVENTS : 0);
+    if ( ret < 0 ) {
+        ret = -errno;
+        if ( ret != -EINTR ) {
+            zbc_error("io_uring_enter failed %d (%s)\n",
+                      errno,
+                      strerror(errno));
+        }
+        return( ret );
+    }
+
+    ring->sqe_submitted += ret;
+
+    return( 0 );
+
+}
+
+/***** Definition of internal functions *****/
+
+/**
+ * Setup an io_uring instance.
+ */
+int
+zbc_uring_init(zbc_uring_t *ring,
+               unsigned int entries)
+{
+    struct io_uring_params p;
+    unsigned int i;
+    int ret;
+
+    memset(ring, 0, sizeof(zbc_uring_t));
+    memset(&p, 0, sizeof(struct io_uring_params));
+
+    ring->fd = zbc_uring_setup(entries, &p);
+    if ( ring->fd < 0 ) {
+        return( -errno );
+    }
+
+    /* Map the queues */
+    ring->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    ring->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( ring->cq_sz > ring->sq_sz ) {
+            ring->sq_sz = ring->cq_sz;
+        }
+        ring->cq_sz = ring->sq_sz;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if ( ring->sq_ptr == MAP_FAILED ) {
+        ring->sq_ptr = NULL;
+        ret = -errno;
+        goto err;
+    }
+
+    if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_sz, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if ( ring->cq_ptr == MAP_FAILED ) {
+            ring->cq_ptr = NULL;
+            ret = -errno;
+            goto err;
+        }
+    }
+
+    ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ( ring->sqes == MAP_FAILED ) {
+        ring->sqes = NULL;
+        ret = -errno;
+        goto err;
+    }
+
+    ring->sq_head = (unsigned int *)((uint8_t *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned int *)((uint8_t *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = *(unsigned int *)((uint8_t *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries = *(unsigned int *)((uint8_t *)ring->sq_ptr + p.sq_off.ring_entries);
+    ring->sq_array = (unsigned int *)((uint8_t *)ring->sq_ptr + p.sq_off.array);
+    ring->sqe_tail = ring->sqe_submitted = *ring->sq_tail;
+
+    ring->cq_head = (unsigned int *)((uint8_t *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)((uint8_t *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)((uint8_t *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((uint8_t *)ring->cq_ptr + p.cq_off.cqes);
+
+    /* Submission queue entries are used in order */
+    for(i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+
+    return( 0 );
+
+err:
+
+    zbc_uring_exit(ring);
+
+    return( ret );
+
+}
+
+/**
+ * Release an io_uring instance.
+ */
+void
+zbc_uring_exit(zbc_uring_t *ring)
+{
+
+    if ( ring->sqes ) {
+        munmap(ring->sqes, ring->sqes_sz);
+    }
+
+    if ( ring->cq_ptr && (ring->cq_ptr != ring->sq_ptr) ) {
+        munmap(ring->cq_ptr, ring->cq_sz);
+    }
+
+    if ( ring->sq_ptr ) {
+        munmap(ring->sq_ptr, ring->sq_sz);
+    }
+
+    if ( ring->fd >= 0 ) {
+        close(ring->fd);
+    }
+
+    memset(ring, 0, sizeof(zbc_uring_t));
+    ring->fd = -1;
+
+    return;
+
+}
+
+/**
+ * Register a file.
+ */
+int
+zbc_uring_register_file(zbc_uring_t *ring,
+                        int fd)
+{
+
+    if ( zbc_uring_register(ring, IORING_REGISTER_FILES, &fd, 1) < 0 ) {
+        return( -errno );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Register or unregister fixed buffers.
+ */
+int
+zbc_uring_register_buffers(zbc_uring_t *ring,
+                           const struct iovec *iov,
+                           unsigned int nr_iov)
+{
+    int ret;
+
+    if ( nr_iov ) {
+        ret = zbc_uring_register(ring, IORING_REGISTER_BUFFERS, iov, nr_iov);
+    } else {
+        ret = zbc_uring_register(ring, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+
+    if ( ret < 0 ) {
+        return( -errno );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Get a free submission queue entry.
+ */
+struct io_uring_sqe *
+zbc_uring_get_sqe(zbc_uring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+
+    if ( (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= ring->sq_entries ) {
+        return( NULL );
+    }
+
+    sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sqe_tail++;
+
+    return( sqe );
+
+}
+
+/**
+ * Submit the prepared submission queue entries.
+ */
+int
+zbc_uring_submit(zbc_uring_t *ring)
+{
+    int ret;
+
+    do {
+        ret = zbc_uring_do_submit(ring, 0);
+    } while( ret == -EINTR );
+
+    return( ret );
+
+}
+
+/**
+ * Get a completion.
+ */
+int
+zbc_uring_wait_cqe(zbc_uring_t *ring,
+                   int timeout,
+                   struct io_uring_cqe **pcqe)
+{
+    struct io_uring_cqe *cqe;
+    struct pollfd pfd;
+    int ret;
+
+    cqe = zbc_uring_peek_cqe(ring);
+    if ( cqe ) {
+        goto out;
+    }
+
+    if ( timeout < 0 ) {
+
+        /* Submit and wait */
+        while( ! (cqe = zbc_uring_peek_cqe(ring)) ) {
+            ret = zbc_uring_do_submit(ring, 1);
+            if ( (ret != 0) && (ret != -EINTR) ) {
+                return( ret );
+            }
+        }
+
+        goto out;
+
+    }
+
+    ret = zbc_uring_submit(ring);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    cqe = zbc_uring_peek_cqe(ring);
+    if ( (! cqe) && timeout ) {
+
+        pfd.fd = ring->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        do {
+            ret = poll(&pfd, 1, timeout);
+        } while( (ret < 0) && (errno == EINTR) );
+
+        cqe = zbc_uring_peek_cqe(ring);
+
+    }
+
+    if ( ! cqe ) {
+        return( -EAGAIN );
+    }
+
+out:
+
+    *pcqe = cqe;
+
+    return( 0 );
+
+}
+
+/**
+ * Wait for a completion without getting it.
+ */
+int
+zbc_uring_poll(zbc_uring_t *ring,
+               int timeout)
+{
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = ring->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    do {
+        ret = poll(&pfd, 1, timeout);
+    } while( (ret < 0) && (errno == EINTR) );
+
+    if ( ret < 0 ) {
+        return( -errno );
+    }
+
+    return( ret );
+
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
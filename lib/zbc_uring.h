@@ -0,0 +1,149 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christoph Hellwig (hch@infradead.org)
+ */
+
+#ifndef __LIBZBC_URING_H__
+#define __LIBZBC_URING_H__
+
+/***** Including files *****/
+
+#include <config.h>
+
+#include "zbc.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+
+/***** Type definitions *****/
+
+/**
+ * io_uring instance (submission and completion queues
+ * mapped from the kernel, accessed without liburing).
+ * The queues have a single producer and a single consumer:
+ * callers must serialize all the functions using a ring.
+ */
+typedef struct zbc_uring {
+
+    int                         fd;
+
+    /**
+     * Submission queue.
+     */
+    void                        *sq_ptr;
+    size_t                      sq_sz;
+    unsigned int                *sq_head;
+    unsigned int                *sq_tail;
+    unsigned int                sq_mask;
+    unsigned int                sq_entries;
+    unsigned int                *sq_array;
+    struct io_uring_sqe         *sqes;
+    size_t                      sqes_sz;
+    unsigned int                sqe_tail;
+    unsigned int                sqe_submitted;
+
+    /**
+     * Completion queue.
+     */
+    void                        *cq_ptr;
+    size_t                      cq_sz;
+    unsigned int                *cq_head;
+    unsigned int                *cq_tail;
+    unsigned int                cq_mask;
+    struct io_uring_cqe         *cqes;
+
+} zbc_uring_t;
+
+/***** Internal functions *****/
+
+/**
+ * Setup an io_uring instance with at least @entries submission queue entries.
+ */
+extern int
+zbc_uring_init(zbc_uring_t *ring,
+               unsigned int entries);
+
+/**
+ * Release an io_uring instance.
+ */
+extern void
+zbc_uring_exit(zbc_uring_t *ring);
+
+/**
+ * Register a file with an io_uring instance (the file index is 0).
+ */
+extern int
+zbc_uring_register_file(zbc_uring_t *ring,
+                        int fd);
+
+/**
+ * Register (@nr_iov > 0) or unregister (@nr_iov == 0) fixed buffers.
+ */
+extern int
+zbc_uring_register_buffers(zbc_uring_t *ring,
+                           const struct iovec *iov,
+                           unsigned int nr_iov);
+
+/**
+ * Get a free submission queue entry. The entry is submitted
+ * with the next call to zbc_uring_submit() or zbc_uring_wait_cqe().
+ * Returns NULL if the submission queue is full.
+ */
+extern struct io_uring_sqe *
+zbc_uring_get_sqe(zbc_uring_t *ring);
+
+/**
+ * Submit the prepared submission queue entries.
+ */
+extern int
+zbc_uring_submit(zbc_uring_t *ring);
+
+/**
+ * Submit the prepared submission queue entries and get a completion, waiting
+ * at most @timeout milliseconds (-1 waits forever). Returns -EAGAIN if no
+ * command completed. The completion must be released with zbc_uring_cqe_seen().
+ */
+extern int
+zbc_uring_wait_cqe(zbc_uring_t *ring,
+                   int timeout,
+                   struct io_uring_cqe **pcqe);
+
+/**
+ * Wait at most @timeout milliseconds (-1 waits forever) for a completion
+ * without getting it, which can be done without serializing with the
+ * submissions. Returns 0 if @timeout expired, a positive value if a
+ * completion is available and a negative error code on failure.
+ */
+extern int
+zbc_uring_poll(zbc_uring_t *ring,
+               int timeout);
+
+/**
+ * Release a completion obtained with zbc_uring_wait_cqe().
+ */
+static inline void
+zbc_uring_cqe_seen(zbc_uring_t *ring)
+{
+
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+
+    return;
+
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+#endif
+
+/* __LIBZBC_URING_H__ */
@@ -0,0 +1,562 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+ *
+ * This software is distributed under the terms of the BSD 2-clause license,
+ * "as is," without technical support, and WITHOUT ANY WARRANTY, without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ * PURPOSE. You should have received a copy of the BSD 2-clause license along
+ * with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christoph Hellwig (hch@infradead.org)
+ */
+
+/***** Including files *****/
+
+#include "zbc.h"
+
+#include <string.h>
+
+/***** Definition of private functions *****/
+
+/**
+ * Get the index of the zone containing @lba (cache mutex held).
+ * Returns -1 if @lba is out of range.
+ */
+static int
+zbc_zone_cache_index(zbc_zone_cache_t *zc,
+                     uint64_t lba)
+{
+    zbc_zone_t *zones = zc->zzc_zones;
+    unsigned int lo = 0, hi = zc->zzc_nr_zones, mid;
+
+    if ( (! zc->zzc_nr_zones)
+         || (lba < zbc_zone_start_lba(&zones[0]))
+         || (lba > zbc_zone_last_lba(&zones[zc->zzc_nr_zones - 1])) ) {
+        return( -1 );
+    }
+
+    if ( zc->zzc_zone_length ) {
+        /* Uniform zone size */
+        return( (lba - zbc_zone_start_lba(&zones[0])) / zc->zzc_zone_length );
+    }
+
+    /* Find the last zone starting at or before lba */
+    while( (hi - lo) > 1 ) {
+        mid = lo + (hi - lo) / 2;
+        if ( zbc_zone_start_lba(&zones[mid]) <= lba ) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return( lo );
+
+}
+
+/**
+ * Get the cached zone containing @lba (cache mutex held).
+ */
+static inline zbc_zone_t *
+zbc_zone_cache_get(zbc_zone_cache_t *zc,
+                   uint64_t lba)
+{
+    int idx = zbc_zone_cache_index(zc, lba);
+
+    return( (idx < 0) ? NULL : &zc->zzc_zones[idx] );
+
+}
+
+/**
+ * Initialize a zone cache from a complete list of the device zones.
+ */
+static void
+zbc_zone_cache_set(zbc_zone_cache_t *zc,
+                   zbc_zone_t *zones,
+                   unsigned int nr_zones)
+{
+    uint64_t zone_length = 0;
+    unsigned int i;
+
+    free(zc->zzc_zones);
+    zc->zzc_zones = zones;
+    zc->zzc_nr_zones = nr_zones;
+
+    /* Check if all zones (except possibly the last one) have the same size */
+    if ( nr_zones ) {
+        zone_length = zbc_zone_length(&zones[0]);
+        for(i = 1; i < nr_zones; i++) {
+            if ( (zbc_zone_start_lba(&zones[i]) != zbc_zone_next_lba(&zones[i - 1]))
+                 || ((i < nr_zones - 1) && (zbc_zone_length(&zones[i]) != zone_length))
+                 || (zbc_zone_length(&zones[i]) > zone_length) ) {
+                zone_length = 0;
+                break;
+            }
+        }
+    }
+    zc->zzc_zone_length = zone_length;
+
+    return;
+
+}
+
+/**
+ * Apply a zone operation to a cached zone.
+ */
+static void
+zbc_zone_cache_do_op(zbc_zone_t *zone,
+                     enum zbc_zone_op op)
+{
+
+    if ( (! zbc_zone_sequential(zone))
+         || zbc_zone_rdonly(zone)
+         || zbc_zone_offline(zone) ) {
+        return;
+    }
+
+    switch( op ) {
+
+    case ZBC_OP_OPEN_ZONE:
+        if ( ! zbc_zone_full(zone) ) {
+            zone->zbz_condition = ZBC_ZC_EXP_OPEN;
+        }
+        break;
+
+    case ZBC_OP_CLOSE_ZONE:
+        if ( zbc_zone_is_open(zone) ) {
+            if ( zbc_zone_wp_lba(zone) == zbc_zone_start_lba(zone) ) {
+                zone->zbz_condition = ZBC_ZC_EMPTY;
+            } else {
+                zone->zbz_condition = ZBC_ZC_CLOSED;
+            }
+        }
+        break;
+
+    case ZBC_OP_FINISH_ZONE:
+        zone->zbz_write_pointer = (uint64_t)-1;
+        zone->zbz_condition = ZBC_ZC_FULL;
+        break;
+
+    case ZBC_OP_RESET_ZONE:
+        zbc_zone_wp_lba_reset(zone);
+        break;
+
+    }
+
+    return;
+
+}
+
+/**
+ * Test if a zone operation applied to all zones affects @zone.
+ */
+static int
+zbc_zone_cache_all_op(zbc_zone_t *zone,
+                      enum zbc_zone_op op)
+{
+
+    switch( op ) {
+
+    case ZBC_OP_OPEN_ZONE:
+        return( zbc_zone_closed(zone) );
+
+    case ZBC_OP_CLOSE_ZONE:
+        return( zbc_zone_is_open(zone) );
+
+    case ZBC_OP_FINISH_ZONE:
+        return( zbc_zone_is_open(zone) || zbc_zone_closed(zone) );
+
+    case ZBC_OP_RESET_ZONE:
+        return( ! zbc_zone_empty(zone) );
+
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Test if the zones open in the cache exceed the device limit, in which
+ * case the device closed an implicitly open zone of its choice to open
+ * a zone (zone cache mutex held).
+ */
+static int
+zbc_zone_cache_open_limit(zbc_device_t *dev,
+                          zbc_zone_cache_t *zc)
+{
+    uint32_t max_open = dev->zbd_info.zbd_max_nr_open_seq_req;
+    unsigned int nr_open = 0, i;
+
+    if ( (! max_open) || (max_open == (uint32_t)-1) ) {
+        return( 0 );
+    }
+
+    for(i = 0; i < zc->zzc_nr_zones; i++) {
+        if ( zbc_zone_is_open(&zc->zzc_zones[i]) ) {
+            nr_open++;
+        }
+    }
+
+    return( nr_open > max_open );
+
+}
+
+/**
+ * Refresh the cached implicitly open zones from the device after
+ * a zone was opened with too many zones open: the implicitly open
+ * zones not reported by the device were implicitly closed.
+ */
+static void
+zbc_zone_cache_refresh_open(zbc_device_t *dev)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+    zbc_zone_t *zones, *zone;
+    unsigned int nr_zones, i;
+
+    if ( zbc_list_zones(dev, 0, ZBC_RO_IMP_OPEN, &zones, &nr_zones) != 0 ) {
+        return;
+    }
+
+    pthread_mutex_lock(&zc->zzc_mutex);
+
+    for(i = 0; i < zc->zzc_nr_zones; i++) {
+        if ( zbc_zone_imp_open(&zc->zzc_zones[i]) ) {
+            zbc_zone_cache_do_op(&zc->zzc_zones[i], ZBC_OP_CLOSE_ZONE);
+        }
+    }
+
+    for(i = 0; i < nr_zones; i++) {
+        zone = zbc_zone_cache_get(zc, zbc_zone_start_lba(&zones[i]));
+        if ( zone && (zbc_zone_start_lba(zone) == zbc_zone_start_lba(&zones[i])) ) {
+            memcpy(zone, &zones[i], sizeof(zbc_zone_t));
+        }
+    }
+
+    pthread_mutex_unlock(&zc->zzc_mutex);
+
+    free(zones);
+
+    return;
+
+}
+
+/***** Definition of internal functions *****/
+
+/**
+ * Update the zone cache after a successful zone operation.
+ * @start_lba may be -1 for operations applied to all zones.
+ */
+void
+zbc_zone_cache_op(zbc_device_t *dev,
+                  enum zbc_zone_op op,
+                  uint64_t start_lba)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+    zbc_zone_t *zone;
+    unsigned int i;
+    int refresh = 0;
+
+    if ( ! zc ) {
+        return;
+    }
+
+    pthread_mutex_lock(&zc->zzc_mutex);
+
+    if ( start_lba == (uint64_t)-1 ) {
+        for(i = 0; i < zc->zzc_nr_zones; i++) {
+            if ( zbc_zone_cache_all_op(&zc->zzc_zones[i], op) ) {
+                zbc_zone_cache_do_op(&zc->zzc_zones[i], op);
+            }
+        }
+    } else {
+        zone = zbc_zone_cache_get(zc, start_lba);
+        if ( zone && (zbc_zone_start_lba(zone) == start_lba) ) {
+            zbc_zone_cache_do_op(zone, op);
+        }
+    }
+
+    if ( op == ZBC_OP_OPEN_ZONE ) {
+        refresh = zbc_zone_cache_open_limit(dev, zc);
+    }
+
+    pthread_mutex_unlock(&zc->zzc_mutex);
+
+    if ( refresh ) {
+        zbc_zone_cache_refresh_open(dev);
+    }
+
+    return;
+
+}
+
+/**
+ * Update the zone cache with zone information reported by the device.
+ */
+void
+zbc_zone_cache_update(zbc_device_t *dev,
+                      zbc_zone_t *zones,
+                      unsigned int nr_zones)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+    zbc_zone_t *zone;
+    unsigned int i;
+
+    if ( ! zc ) {
+        return;
+    }
+
+    pthread_mutex_lock(&zc->zzc_mutex);
+
+    for(i = 0; i < nr_zones; i++) {
+        zone = zbc_zone_cache_get(zc, zbc_zone_start_lba(&zones[i]));
+        if ( zone && (zbc_zone_start_lba(zone) == zbc_zone_start_lba(&zones[i])) ) {
+            memcpy(zone, &zones[i], sizeof(zbc_zone_t));
+        }
+    }
+
+    pthread_mutex_unlock(&zc->zzc_mutex);
+
+    return;
+
+}
+
+/**
+ * Refresh a single cached zone from the device, e.g. after a failed write
+ * left the cached write pointer of the zone unknown.
+ */
+void
+zbc_zone_cache_refresh(zbc_device_t *dev,
+                       uint64_t lba)
+{
+    unsigned int nr_zones = 1;
+    zbc_zone_t zone;
+
+    if ( dev->zbd_zone_cache ) {
+        /* zbc_report_zones updates the cache */
+        zbc_report_zones(dev, lba, ZBC_RO_ALL, &zone, &nr_zones);
+    }
+
+    return;
+
+}
+
+/**
+ * Update the zone cache after a write of @lba_count blocks at @lba_ofst
+ * in the zone starting at @start_lba completed with @ret, as the device
+ * does: the zone is implicitly opened (possibly closing another zone),
+ * its write pointer is moved to the end of the write if it is beyond,
+ * and a write to a sequential write preferred zone not starting at the
+ * write pointer makes the zone non-sequential.
+ */
+void
+zbc_zone_cache_write(zbc_device_t *dev,
+                     uint64_t start_lba,
+                     uint64_t lba_ofst,
+                     uint32_t lba_count,
+                     int32_t ret)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+    zbc_zone_t *zone;
+    uint64_t end_lba;
+    int refresh = 0;
+
+    if ( ! zc ) {
+        return;
+    }
+
+    if ( ret > 0 ) {
+
+        end_lba = start_lba + lba_ofst + ret;
+
+        pthread_mutex_lock(&zc->zzc_mutex);
+
+        zone = zbc_zone_cache_get(zc, start_lba);
+        if ( zone && zbc_zone_sequential(zone) ) {
+
+            if ( zbc_zone_sequential_pref(zone)
+                 && (zbc_zone_full(zone)
+                     || ((start_lba + lba_ofst) != zbc_zone_wp_lba(zone))) ) {
+                zone->zbz_flags |= ZBC_ZF_NON_SEQ;
+            }
+
+            if ( ! zbc_zone_full(zone) ) {
+                if ( zbc_zone_empty(zone) || zbc_zone_closed(zone) ) {
+                    zone->zbz_condition = ZBC_ZC_IMP_OPEN;
+                    refresh = zbc_zone_cache_open_limit(dev, zc);
+                }
+                if ( end_lba > zbc_zone_wp_lba(zone) ) {
+                    zbc_zone_wp_lba_inc(zone, end_lba - zbc_zone_wp_lba(zone));
+                }
+            }
+
+        }
+
+        pthread_mutex_unlock(&zc->zzc_mutex);
+
+    }
+
+    if ( refresh ) {
+        zbc_zone_cache_refresh_open(dev);
+    }
+
+    if ( ret != (int32_t)lba_count ) {
+        /* The zone write pointer may have moved anywhere */
+        zbc_zone_cache_refresh(dev, start_lba);
+    }
+
+    return;
+
+}
+
+/***** Definition of public functions *****/
+
+/**
+ * zbc_zone_cache_enable - Enable caching of a device zone information
+ * @dev:                (IN) ZBC device handle
+ *
+ * Allocate and initialize the zone cache of @dev, or resynchronize it
+ * if the cache is already enabled.
+ *
+ * Returns -ENOMEM if memory could not be allocated for the cache.
+ */
+int
+zbc_zone_cache_enable(zbc_device_t *dev)
+{
+    zbc_zone_cache_t *zc;
+    zbc_zone_t *zones;
+    unsigned int nr_zones;
+    int ret;
+
+    if ( ! dev ) {
+        return( -EFAULT );
+    }
+
+    if ( dev->zbd_zone_cache ) {
+        return( zbc_zone_cache_resync(dev) );
+    }
+
+    zc = (zbc_zone_cache_t *) calloc(1, sizeof(zbc_zone_cache_t));
+    if ( ! zc ) {
+        zbc_error("No memory\n");
+        return( -ENOMEM );
+    }
+    pthread_mutex_init(&zc->zzc_mutex, NULL);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        pthread_mutex_destroy(&zc->zzc_mutex);
+        free(zc);
+        return( ret );
+    }
+
+    zbc_zone_cache_set(zc, zones, nr_zones);
+    dev->zbd_zone_cache = zc;
+
+    zbc_debug("Device %s: zone cache enabled (%u zones, %s zone size)\n",
+              dev->zbd_filename,
+              zc->zzc_nr_zones,
+              zc->zzc_zone_length ? "uniform" : "variable");
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_zone_cache_disable - Disable caching of a device zone information
+ * @dev:                (IN) ZBC device handle
+ *
+ * Free the zone cache of @dev.
+ */
+void
+zbc_zone_cache_disable(zbc_device_t *dev)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+
+    if ( zc ) {
+        dev->zbd_zone_cache = NULL;
+        pthread_mutex_destroy(&zc->zzc_mutex);
+        free(zc->zzc_zones);
+        free(zc);
+    }
+
+    return;
+
+}
+
+/**
+ * zbc_zone_cache_resync - Resynchronize a device zone cache
+ * @dev:                (IN) ZBC device handle
+ *
+ * Reload the zone cache of @dev using REPORT ZONES.
+ *
+ * Returns -ENXIO if the zone cache of @dev is not enabled.
+ */
+int
+zbc_zone_cache_resync(zbc_device_t *dev)
+{
+    zbc_zone_cache_t *zc = dev->zbd_zone_cache;
+    zbc_zone_t *zones;
+    unsigned int nr_zones;
+    int ret;
+
+    if ( ! zc ) {
+        return( -ENXIO );
+    }
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    pthread_mutex_lock(&zc->zzc_mutex);
+    zbc_zone_cache_set(zc, zones, nr_zones);
+    pthread_mutex_unlock(&zc->zzc_mutex);
+
+    return( 0 );
+
+}
+
+/**
+ * zbc_zone_lookup - Get the cached information of a zone
+ * @dev:                (IN) ZBC device handle
+ * @lba:                (IN) An LBA within the zone to look for
+ * @zone:               (OUT) Address where to copy the zone information
+ *
+ * Returns -ENXIO if the zone cache of @dev is not enabled and
+ * -EINVAL if @lba is out of range.
+ */
+int
+zbc_zone_lookup(zbc_device_t *dev,
+                uint64_t lba,
+                zbc_zone_t *zone)
+{
+    zbc_zone_cache_t *zc;
+    zbc_zone_t *z;
+    int ret = 0;
+
+    if ( (! dev) || (! zone) ) {
+        return( -EFAULT );
+    }
+
+    zc = dev->zbd_zone_cache;
+    if ( ! zc ) {
+        return( -ENXIO );
+    }
+
+    pthread_mutex_lock(&zc->zzc_mutex);
+
+    z = zbc_zone_cache_get(zc, lba);
+    if ( z ) {
+        memcpy(zone, z, sizeof(zbc_zone_t));
+    } else {
+        ret = -EINVAL;
+    }
+
+    pthread_mutex_unlock(&zc->zzc_mutex);
+
+    return( ret );
+
+}
@@ -0,0 +1,457 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check asynchronous I/Os: writes to several sequential zones are all
+ * submitted at once (they must reach each zone in submission order),
+ * then the data is read back at depth and verified. A second thread
+ * appends to another zone with write-combining enabled while the
+ * asynchronous I/Os are in flight. The zones used are reset first.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <libzbc/zbc.h>
+
+/***** Private data *****/
+
+static struct zbc_device *dev;
+static struct zbc_device_info info;
+
+static struct zbc_test_append {
+
+    uint64_t            zone_lba;
+    unsigned int        nr_appends;
+    int                 ret;
+
+} zbc_test_append;
+
+/***** Private functions *****/
+
+/**
+ * Fill the blocks of a buffer with their LBA.
+ */
+static void
+zbc_test_fill(uint8_t *buf,
+              uint64_t lba,
+              uint32_t lba_count)
+{
+    size_t lba_size = info.zbd_logical_block_size;
+    uint64_t *p;
+    size_t i, j;
+
+    for(i = 0; i < lba_count; i++) {
+        p = (uint64_t *)(buf + i * lba_size);
+        for(j = 0; j < lba_size / sizeof(uint64_t); j++) {
+            p[j] = lba + i;
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * Check that the blocks of a buffer contain their LBA.
+ */
+static int
+zbc_test_check(const uint8_t *buf,
+               uint64_t lba,
+               uint32_t lba_count)
+{
+    size_t lba_size = info.zbd_logical_block_size;
+    const uint64_t *p;
+    size_t i, j;
+
+    for(i = 0; i < lba_count; i++) {
+        p = (const uint64_t *)(buf + i * lba_size);
+        for(j = 0; j < lba_size / sizeof(uint64_t); j++) {
+            if ( p[j] != lba + i ) {
+                printf("[TEST][ERROR],Bad data at block %llu: got block %llu data\n",
+                       (unsigned long long) (lba + i),
+                       (unsigned long long) p[j]);
+                return( -1 );
+            }
+        }
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Submit all the asynchronous I/Os of @aios and collect their completions.
+ */
+static int
+zbc_test_run_aios(struct zbc_aio *aios,
+                  unsigned int nr_aios)
+{
+    struct zbc_aio **paios, **done;
+    unsigned int submitted = 0, completed = 0, i;
+    int ret = 0;
+
+    paios = calloc(nr_aios, sizeof(struct zbc_aio *));
+    done = calloc(nr_aios, sizeof(struct zbc_aio *));
+    if ( (! paios) || (! done) ) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    for(i = 0; i < nr_aios; i++) {
+        paios[i] = &aios[i];
+    }
+
+    while( completed < nr_aios ) {
+
+        if ( submitted < nr_aios ) {
+            ret = zbc_aio_submit(dev, &paios[submitted], nr_aios - submitted);
+            if ( ret > 0 ) {
+                submitted += ret;
+            } else if ( ret != -EAGAIN ) {
+                printf("[TEST][ERROR],Submit failed %d (%s)\n",
+                       ret,
+                       strerror(-ret));
+                break;
+            }
+        }
+
+        ret = zbc_aio_getevents(dev, 1, nr_aios - completed, done, -1);
+        if ( ret < 0 ) {
+            printf("[TEST][ERROR],Get events failed %d (%s)\n",
+                   ret,
+                   strerror(-ret));
+            break;
+        }
+
+        for(i = 0; i < (unsigned int) ret; i++) {
+            if ( done[i]->zba_ret != (int32_t) done[i]->zba_lba_count ) {
+                printf("[TEST][ERROR],%s of %u blocks at block %llu + %llu failed %d\n",
+                       (done[i]->zba_op == ZBC_AIO_READ) ? "Read" : "Write",
+                       done[i]->zba_lba_count,
+                       (unsigned long long) zbc_zone_start_lba(done[i]->zba_zone),
+                       (unsigned long long) done[i]->zba_lba_ofst,
+                       done[i]->zba_ret);
+                ret = -EIO;
+                goto out;
+            }
+        }
+        completed += ret;
+        ret = 0;
+
+    }
+
+    if ( (completed < nr_aios) && (! ret) ) {
+        ret = -EIO;
+    }
+
+out:
+
+    free(paios);
+    free(done);
+
+    return( ret );
+
+}
+
+/**
+ * Append single blocks to a zone with write-combining enabled.
+ */
+static void *
+zbc_test_appender(void *arg)
+{
+    struct zbc_test_append *ta = arg;
+    uint8_t *buf;
+    uint64_t lba;
+    unsigned int i;
+    int ret;
+
+    buf = malloc(info.zbd_logical_block_size);
+    if ( ! buf ) {
+        ta->ret = -ENOMEM;
+        return( NULL );
+    }
+
+    for(i = 0; i < ta->nr_appends; i++) {
+        zbc_test_fill(buf, ta->zone_lba + i, 1);
+        ret = zbc_zone_append(dev, ta->zone_lba, buf, 1, &lba);
+        if ( ret != 1 ) {
+            ta->ret = (ret < 0) ? ret : -EIO;
+            break;
+        }
+        if ( lba != ta->zone_lba + i ) {
+            printf("[TEST][ERROR],Append %u done at block %llu\n",
+                   i,
+                   (unsigned long long) lba);
+            ta->ret = -EIO;
+            break;
+        }
+    }
+
+    free(buf);
+
+    return( NULL );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    unsigned int nr_test_zones = 4, nr_ios = 16, nr_zones, nr, i, j, k;
+    uint32_t lba_count = 64;
+    struct zbc_zone *zones = NULL, **test_zones = NULL, zone;
+    struct zbc_zone *append_zone = NULL;
+    struct zbc_aio *aios = NULL;
+    pthread_t appender;
+    uint8_t *buf = NULL;
+    size_t iosize;
+    int ret = 1;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <dev>\n"
+               "  Write, read back and check zones using asynchronous I/Os\n"
+               "Options:\n"
+               "    -v         : Verbose mode\n"
+               "    -z <num>   : Number of zones written (default 4)\n"
+               "    -n <num>   : Number of writes per zone (default 16)\n"
+               "    -c <num>   : Number of logical blocks per write (default 64)\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (unsigned int) (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+            zbc_set_log_level("debug");
+        } else if ( (strcmp(argv[i], "-z") == 0) && (i < (unsigned int) (argc - 2)) ) {
+            nr_test_zones = strtoul(argv[++i], NULL, 10);
+        } else if ( (strcmp(argv[i], "-n") == 0) && (i < (unsigned int) (argc - 2)) ) {
+            nr_ios = strtoul(argv[++i], NULL, 10);
+        } else if ( (strcmp(argv[i], "-c") == 0) && (i < (unsigned int) (argc - 2)) ) {
+            lba_count = strtoul(argv[++i], NULL, 10);
+        } else {
+            goto usage;
+        }
+
+    }
+
+    if ( (i != (unsigned int) (argc - 1)) || (! nr_test_zones) || (! nr_ios) || (! lba_count) ) {
+        goto usage;
+    }
+
+    /* Open device */
+    ret = zbc_open(argv[i], O_RDWR, &dev);
+    if ( ret != 0 ) {
+        fprintf(stderr, "[TEST][ERROR],Open device failed %d (%s)\n",
+                ret,
+                strerror(-ret));
+        return( 1 );
+    }
+    ret = 1;
+
+    zbc_get_device_info(dev, &info);
+
+    if ( lba_count > info.zbd_max_rw_logical_blocks ) {
+        lba_count = info.zbd_max_rw_logical_blocks;
+    }
+
+    if ( zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones) != 0 ) {
+        goto out;
+    }
+
+    /* Use the first sequential zones large enough, and one more for appends */
+    test_zones = calloc(nr_test_zones, sizeof(struct zbc_zone *));
+    if ( ! test_zones ) {
+        goto out;
+    }
+
+    for(i = 0, nr = 0; (i < nr_zones) && (! append_zone); i++) {
+        if ( zbc_zone_sequential(&zones[i])
+             && (zbc_zone_length(&zones[i]) >= (unsigned long long) nr_ios * lba_count) ) {
+            if ( nr < nr_test_zones ) {
+                test_zones[nr++] = &zones[i];
+            } else {
+                append_zone = &zones[i];
+            }
+        }
+    }
+
+    if ( ! append_zone ) {
+        printf("[TEST][ERROR],Not enough sequential zones\n");
+        goto out;
+    }
+
+    for(i = 0; i < nr_test_zones; i++) {
+        if ( zbc_reset_write_pointer(dev, zbc_zone_start_lba(test_zones[i])) != 0 ) {
+            goto out;
+        }
+        zbc_zone_wp_lba_reset(test_zones[i]);
+    }
+    if ( zbc_reset_write_pointer(dev, zbc_zone_start_lba(append_zone)) != 0 ) {
+        goto out;
+    }
+
+    iosize = (size_t) lba_count * info.zbd_logical_block_size;
+    if ( posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE),
+                        iosize * nr_test_zones * nr_ios) != 0 ) {
+        buf = NULL;
+        goto out;
+    }
+
+    aios = calloc(nr_test_zones * nr_ios, sizeof(struct zbc_aio));
+    if ( ! aios ) {
+        goto out;
+    }
+
+    /* Appends run concurrently with the asynchronous I/Os */
+    zbc_test_append.zone_lba = zbc_zone_start_lba(append_zone);
+    zbc_test_append.nr_appends = nr_ios * lba_count;
+    if ( zbc_test_append.nr_appends > zbc_zone_length(append_zone) ) {
+        zbc_test_append.nr_appends = zbc_zone_length(append_zone);
+    }
+    if ( zbc_write_combining_enable(dev, 1) != 0 ) {
+        goto out;
+    }
+    if ( pthread_create(&appender, NULL, zbc_test_appender, &zbc_test_append) != 0 ) {
+        goto out;
+    }
+
+    /* Writes, interleaving zones */
+    for(j = 0, k = 0; j < nr_ios; j++) {
+        for(i = 0; i < nr_test_zones; i++, k++) {
+            aios[k].zba_op = ZBC_AIO_WRITE;
+            aios[k].zba_zone = test_zones[i];
+            aios[k].zba_buf = buf + iosize * k;
+            aios[k].zba_lba_count = lba_count;
+            aios[k].zba_lba_ofst = (uint64_t) j * lba_count;
+            zbc_test_fill(aios[k].zba_buf, zbc_zone_start_lba(test_zones[i]) + aios[k].zba_lba_ofst, lba_count);
+        }
+    }
+
+    ret = zbc_test_run_aios(aios, k);
+
+    pthread_join(appender, NULL);
+    if ( ret != 0 ) {
+        ret = 1;
+        goto out;
+    }
+    ret = 1;
+
+    if ( zbc_test_append.ret != 0 ) {
+        printf("[TEST][ERROR],Append failed %d (%s)\n",
+               zbc_test_append.ret,
+               strerror(-zbc_test_append.ret));
+        goto out;
+    }
+
+    if ( zbc_flush(dev) != 0 ) {
+        printf("[TEST][ERROR],Flush failed\n");
+        goto out;
+    }
+
+    /* Check write pointers */
+    for(i = 0; i <= nr_test_zones; i++) {
+
+        struct zbc_zone *z = (i < nr_test_zones) ? test_zones[i] : append_zone;
+        uint64_t expected = zbc_zone_start_lba(z);
+
+        expected += (i < nr_test_zones) ? (uint64_t) nr_ios * lba_count : zbc_test_append.nr_appends;
+
+        nr = 1;
+        if ( (zbc_report_zones(dev, zbc_zone_start_lba(z), ZBC_RO_ALL, &zone, &nr) != 0) || (nr != 1) ) {
+            goto out;
+        }
+
+        if ( zbc_zone_full(&zone) ) {
+            zone.zbz_write_pointer = zbc_zone_next_lba(&zone);
+        }
+
+        if ( zbc_zone_wp_lba(&zone) != expected ) {
+            printf("[TEST][ERROR],Zone %llu: write pointer at %llu instead of %llu\n",
+                   (unsigned long long) zbc_zone_start_lba(z),
+                   zbc_zone_wp_lba(&zone),
+                   (unsigned long long) expected);
+            goto out;
+        }
+
+    }
+
+    /* Read back at depth */
+    memset(buf, 0, iosize * nr_test_zones * nr_ios);
+    for(k = 0; k < nr_test_zones * nr_ios; k++) {
+        aios[k].zba_op = ZBC_AIO_READ;
+    }
+
+    if ( zbc_test_run_aios(aios, k) != 0 ) {
+        goto out;
+    }
+
+    for(k = 0; k < nr_test_zones * nr_ios; k++) {
+        if ( zbc_test_check(aios[k].zba_buf,
+                            zbc_zone_start_lba(aios[k].zba_zone) + aios[k].zba_lba_ofst,
+                            lba_count) != 0 ) {
+            goto out;
+        }
+    }
+
+    /* Check the appended data */
+    for(j = 0; j < zbc_test_append.nr_appends; j += nr) {
+        nr = zbc_test_append.nr_appends - j;
+        if ( nr > lba_count ) {
+            nr = lba_count;
+        }
+        if ( (zbc_pread(dev, append_zone, buf, nr, j) != (int32_t) nr)
+             || (zbc_test_check(buf, zbc_zone_start_lba(append_zone) + j, nr) != 0) ) {
+            goto out;
+        }
+    }
+
+    printf("%u zones written and read back with %u asynchronous I/Os of %u blocks, %u blocks appended\n",
+           nr_test_zones,
+           nr_test_zones * nr_ios,
+           lba_count,
+           zbc_test_append.nr_appends);
+
+    ret = 0;
+
+out:
+
+    if ( ret != 0 ) {
+        printf("[TEST][ERROR],Asynchronous I/O test failed\n");
+    }
+
+    free(aios);
+    free(buf);
+    free(test_zones);
+    free(zones);
+    if ( zbc_close(dev) != 0 ) {
+        ret = 1;
+    }
+
+    return( ret );
+
+}
@@ -0,0 +1,124 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check the encoding of the ATA PASSTHROUGH (16) CDBs used by the ATA
+ * backend for reads and writes (READ/WRITE DMA EXT and READ/WRITE FPDMA
+ * QUEUED). No device is needed.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libzbc/zbc.h>
+
+#include <zbc_private.h>
+
+/***** Private data *****/
+
+static struct zbc_test_cdb {
+
+    int                 write;
+    int                 ncq;
+    uint32_t            lba_count;
+    uint64_t            lba;
+    uint8_t             cdb[16];
+
+} zbc_test_cdbs[] = {
+
+    /* READ DMA EXT: count in count field */
+    { 0, 0, 8, 0x123456789abcULL,
+      { 0x85, 0x0d, 0x0e, 0x00, 0x00, 0x00, 0x08, 0x56,
+        0xbc, 0x34, 0x9a, 0x12, 0x78, 0x40, 0x25, 0x00 } },
+
+    /* WRITE DMA EXT */
+    { 1, 0, 0x1234, 0x1000ULL,
+      { 0x85, 0x0d, 0x06, 0x00, 0x00, 0x12, 0x34, 0x00,
+        0x00, 0x00, 0x10, 0x00, 0x00, 0x40, 0x35, 0x00 } },
+
+    /* READ FPDMA QUEUED: count in features, tag left to 0 */
+    { 0, 1, 8, 0x123456789abcULL,
+      { 0x85, 0x19, 0x0d, 0x00, 0x08, 0x00, 0x00, 0x56,
+        0xbc, 0x34, 0x9a, 0x12, 0x78, 0x40, 0x60, 0x00 } },
+
+    /* WRITE FPDMA QUEUED */
+    { 1, 1, 0x1234, 0x1000ULL,
+      { 0x85, 0x19, 0x05, 0x12, 0x34, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x10, 0x00, 0x00, 0x40, 0x61, 0x00 } },
+
+    /* 65536 sectors are encoded as 0 */
+    { 1, 1, 65536, 0ULL,
+      { 0x85, 0x19, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x61, 0x00 } },
+
+    { 0, 0, 65536, 0ULL,
+      { 0x85, 0x0d, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x25, 0x00 } },
+
+};
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    unsigned int nr_cdbs = sizeof(zbc_test_cdbs) / sizeof(zbc_test_cdbs[0]);
+    struct zbc_test_cdb *t;
+    uint8_t cdb[16];
+    unsigned int i, j;
+    int ret = 0;
+
+    for(i = 0; i < nr_cdbs; i++) {
+
+        t = &zbc_test_cdbs[i];
+
+        /* Garbage must be overwritten */
+        memset(cdb, 0xa5, sizeof(cdb));
+        zbc_ata_rw_cdb(cdb, t->write, t->ncq, t->lba_count, t->lba);
+
+        if ( memcmp(cdb, t->cdb, sizeof(cdb)) == 0 ) {
+            continue;
+        }
+
+        printf("[TEST][ERROR],%s %s of %u sectors at %llu: bad CDB\n",
+               t->ncq ? "Queued" : "Non queued",
+               t->write ? "write" : "read",
+               t->lba_count,
+               (unsigned long long) t->lba);
+        printf("    Got     ");
+        for(j = 0; j < sizeof(cdb); j++) {
+            printf(" %02x", cdb[j]);
+        }
+        printf("\n    Expected");
+        for(j = 0; j < sizeof(cdb); j++) {
+            printf(" %02x", t->cdb[j]);
+        }
+        printf("\n");
+
+        ret = 1;
+
+    }
+
+    if ( ! ret ) {
+        printf("%u CDBs checked\n", nr_cdbs);
+    }
+
+    return( ret );
+
+}
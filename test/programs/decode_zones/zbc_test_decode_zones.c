@@ -0,0 +1,242 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check the zone descriptor decoder against a byte by byte reference
+ * decoder and measure the decoding time of both. No device is needed.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "zbc_sg.h"
+
+/***** Private functions *****/
+
+/**
+ * Reference decoder: assemble values one byte at a time.
+ */
+static uint64_t
+zbc_test_get_int64(const uint8_t *buf,
+                   enum zbc_sg_zd_order order)
+{
+    uint64_t val = 0;
+    int i;
+
+    for(i = 0; i < 8; i++) {
+        if ( order == ZBC_SG_ZD_BE ) {
+            val = (val << 8) | buf[i];
+        } else {
+            val = (val << 8) | buf[7 - i];
+        }
+    }
+
+    return( val );
+
+}
+
+static void
+zbc_test_get_zones(const uint8_t *buf,
+                   zbc_zone_t *zones,
+                   unsigned int nr_zones,
+                   enum zbc_sg_zd_order order)
+{
+    unsigned int i;
+
+    for(i = 0; i < nr_zones; i++) {
+
+        zones[i].zbz_type = buf[0] & 0x0f;
+        zones[i].zbz_condition = (buf[1] >> 4) & 0x0f;
+        zones[i].zbz_length = zbc_test_get_int64(&buf[8], order);
+        zones[i].zbz_start = zbc_test_get_int64(&buf[16], order);
+        zones[i].zbz_write_pointer = zbc_test_get_int64(&buf[24], order);
+        zones[i].zbz_flags = buf[1] & 0x03;
+
+        buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
+
+    }
+
+    return;
+
+}
+
+static void
+zbc_test_set_int64(uint8_t *buf,
+                   uint64_t val,
+                   enum zbc_sg_zd_order order)
+{
+    int i;
+
+    for(i = 0; i < 8; i++) {
+        if ( order == ZBC_SG_ZD_BE ) {
+            buf[7 - i] = val >> (i * 8);
+        } else {
+            buf[i] = val >> (i * 8);
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * Fill a buffer with descriptors of @nr_zones zones of 256 MiB.
+ */
+static void
+zbc_test_fill(uint8_t *buf,
+              unsigned int nr_zones,
+              enum zbc_sg_zd_order order)
+{
+    uint64_t len = 524288;
+    unsigned int i;
+
+    memset(buf, 0, (size_t)nr_zones * ZBC_ZONE_DESCRIPTOR_LENGTH);
+
+    for(i = 0; i < nr_zones; i++) {
+        buf[0] = (i < 64) ? ZBC_ZT_CONVENTIONAL : ZBC_ZT_SEQUENTIAL_REQ;
+        buf[1] = ((i % 15) << 4) | (i & 0x03);
+        zbc_test_set_int64(&buf[8], len, order);
+        zbc_test_set_int64(&buf[16], i * len, order);
+        zbc_test_set_int64(&buf[24], i * len + (i * 7919) % len, order);
+        buf += ZBC_ZONE_DESCRIPTOR_LENGTH;
+    }
+
+    return;
+
+}
+
+static unsigned long long
+zbc_test_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 );
+
+}
+
+static int
+zbc_test_zones_equal(zbc_zone_t *z1,
+                     zbc_zone_t *z2,
+                     unsigned int nr_zones)
+{
+    unsigned int i;
+
+    for(i = 0; i < nr_zones; i++) {
+        if ( (z1[i].zbz_type != z2[i].zbz_type)
+             || (z1[i].zbz_condition != z2[i].zbz_condition)
+             || (z1[i].zbz_flags != z2[i].zbz_flags)
+             || (z1[i].zbz_length != z2[i].zbz_length)
+             || (z1[i].zbz_start != z2[i].zbz_start)
+             || (z1[i].zbz_write_pointer != z2[i].zbz_write_pointer) ) {
+            fprintf(stderr, "Zone %u differs\n", i);
+            return( 0 );
+        }
+    }
+
+    return( 1 );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    unsigned int nr_zones = 100000, loops = 100, l;
+    enum zbc_sg_zd_order order;
+    unsigned long long ref_usec, usec;
+    zbc_zone_t *ref = NULL, *zones = NULL;
+    uint8_t *buf = NULL;
+    int i, ret = 1;
+
+    /* Parse options */
+    for(i = 1; i < argc; i++) {
+
+        if ( (strcmp(argv[i], "-n") == 0) && (i < (argc - 1)) ) {
+            nr_zones = strtoul(argv[++i], NULL, 10);
+        } else if ( (strcmp(argv[i], "-l") == 0) && (i < (argc - 1)) ) {
+            loops = strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("Usage: %s [options]\n"
+                   "Options:\n"
+                   "    -n <num> : Number of zone descriptors (default 100000)\n"
+                   "    -l <num> : Number of decoding loops (default 100)\n",
+                   argv[0]);
+            return( 1 );
+        }
+
+    }
+
+    if ( (! nr_zones) || (! loops) ) {
+        fprintf(stderr, "Invalid number of zones or loops\n");
+        return( 1 );
+    }
+
+    buf = malloc((size_t)nr_zones * ZBC_ZONE_DESCRIPTOR_LENGTH);
+    ref = calloc(nr_zones, sizeof(zbc_zone_t));
+    zones = calloc(nr_zones, sizeof(zbc_zone_t));
+    if ( (! buf) || (! ref) || (! zones) ) {
+        fprintf(stderr, "No memory\n");
+        goto out;
+    }
+
+    for(order = ZBC_SG_ZD_BE; order <= ZBC_SG_ZD_LE; order++) {
+
+        zbc_test_fill(buf, nr_zones, order);
+
+        usec = zbc_test_usec();
+        for(l = 0; l < loops; l++) {
+            zbc_test_get_zones(buf, ref, nr_zones, order);
+        }
+        ref_usec = zbc_test_usec() - usec;
+
+        usec = zbc_test_usec();
+        for(l = 0; l < loops; l++) {
+            zbc_sg_get_zones(buf, zones, nr_zones, order);
+        }
+        usec = zbc_test_usec() - usec;
+
+        if ( ! zbc_test_zones_equal(ref, zones, nr_zones) ) {
+            fprintf(stderr, "%s endian decoding failed\n",
+                    (order == ZBC_SG_ZD_BE) ? "Big" : "Little");
+            goto out;
+        }
+
+        printf("%s endian, %u zones x %u: byte by byte %.2f ns/zone, zbc_sg_get_zones %.2f ns/zone\n",
+               (order == ZBC_SG_ZD_BE) ? "Big" : "Little",
+               nr_zones, loops,
+               (double) ref_usec * 1000.0 / ((double) nr_zones * loops),
+               (double) usec * 1000.0 / ((double) nr_zones * loops));
+
+    }
+
+    ret = 0;
+
+out:
+
+    free(buf);
+    free(ref);
+    free(zones);
+
+    return( ret );
+
+}
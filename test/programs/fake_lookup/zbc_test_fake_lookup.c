@@ -0,0 +1,193 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Measure the cost of single block reads on an emulated device
+ * (fake backend) as the number of zones of the device grows.
+ * WARNING: the zone configuration of the device is changed.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <libzbc/zbc.h>
+
+#include <zbc_private.h>
+
+/***** Private functions *****/
+
+static unsigned long long
+zbc_test_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+
+}
+
+/**
+ * Read one block at the start of @zone @nr_io times, return the mean time in ns.
+ */
+static long long
+zbc_test_read(struct zbc_device *dev,
+              struct zbc_zone *zone,
+              void *buf,
+              unsigned int nr_io)
+{
+    unsigned long long start;
+    unsigned int i;
+    int ret;
+
+    start = zbc_test_nsec();
+
+    for(i = 0; i < nr_io; i++) {
+        ret = zbc_pread(dev, zone, buf, 1, 0);
+        if ( ret != 1 ) {
+            fprintf(stderr, "Read zone %llu failed %d\n",
+                    zbc_zone_start_lba(zone),
+                    ret);
+            return( -1 );
+        }
+    }
+
+    return( (zbc_test_nsec() - start) / nr_io );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    unsigned int nr_zones, max_nr_zones = 262144, nr_io = 10000, nz;
+    unsigned long long capacity, zone_sz;
+    struct zbc_device_info info;
+    struct zbc_device *dev;
+    zbc_zone_t *zones = NULL;
+    long long first_ns, last_ns;
+    void *buf = NULL;
+    int i, ret = 1;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <emulated device file>\n"
+               "Options:\n"
+               "    -z <num> : Maximum number of zones (default 262144)\n"
+               "    -n <num> : Number of reads per measurement (default 10000)\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( (strcmp(argv[i], "-z") == 0) && (i < (argc - 2)) ) {
+            max_nr_zones = strtoul(argv[++i], NULL, 10);
+        } else if ( (strcmp(argv[i], "-n") == 0) && (i < (argc - 2)) ) {
+            nr_io = strtoul(argv[++i], NULL, 10);
+        } else {
+            goto usage;
+        }
+
+    }
+
+    if ( (i != (argc - 1)) || (! nr_io) ) {
+        goto usage;
+    }
+
+    /* Open device */
+    ret = zbc_open(argv[i], O_RDWR, &dev);
+    if ( ret != 0 ) {
+        fprintf(stderr, "Open %s failed %d\n", argv[i], ret);
+        return( 1 );
+    }
+    ret = 1;
+
+    zbc_get_device_info(dev, &info);
+    if ( info.zbd_type != ZBC_DT_FAKE ) {
+        fprintf(stderr, "%s is not an emulated device\n", argv[i]);
+        goto out;
+    }
+
+    buf = malloc(info.zbd_logical_block_size);
+    if ( ! buf ) {
+        fprintf(stderr, "No memory\n");
+        goto out;
+    }
+
+    /* Use a power of 2 capacity so that all zone counts divide it */
+    capacity = 1;
+    while( (capacity << 1) <= info.zbd_logical_blocks ) {
+        capacity <<= 1;
+    }
+
+    printf("%10s %14s %14s\n", "Zones", "First zone ns", "Last zone ns");
+
+    for(nr_zones = 1024; nr_zones <= max_nr_zones; nr_zones <<= 1) {
+
+        zone_sz = capacity / nr_zones;
+        if ( zone_sz < 8 ) {
+            break;
+        }
+
+        /* All zones conventional except the last one */
+        ret = zbc_set_zones(dev, (nr_zones - 1) * zone_sz, zone_sz);
+        if ( ret != 0 ) {
+            fprintf(stderr, "Set %u zones failed %d\n", nr_zones, ret);
+            ret = 1;
+            goto out;
+        }
+
+        free(zones);
+        zones = NULL;
+        ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nz);
+        if ( (ret != 0) || (nz != nr_zones) ) {
+            fprintf(stderr, "List zones failed %d (%u zones)\n", ret, nz);
+            ret = 1;
+            goto out;
+        }
+
+        first_ns = zbc_test_read(dev, &zones[0], buf, nr_io);
+        last_ns = zbc_test_read(dev, &zones[nz - 2], buf, nr_io);
+        if ( (first_ns < 0) || (last_ns < 0) ) {
+            ret = 1;
+            goto out;
+        }
+
+        printf("%10u %14lld %14lld\n", nr_zones, first_ns, last_ns);
+
+    }
+
+    ret = 0;
+
+out:
+
+    free(zones);
+    free(buf);
+    zbc_close(dev);
+
+    return( ret );
+
+}
@@ -0,0 +1,270 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check a memory device ("mem:size=<size>[,zone=<size>][,conv=<size>]"):
+ * data written to the first conventional zone (if any) and to the first
+ * sequential zone must read back, the sequential zone write pointer must
+ * advance, and the device must be empty again once closed and reopened,
+ * as the device is private to the handle that opened it.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libzbc/zbc.h>
+
+/***** Private data *****/
+
+#define ZBC_TEST_LBA_COUNT      8
+
+static struct zbc_device *dev;
+static struct zbc_device_info info;
+
+/***** Private functions *****/
+
+/**
+ * Print an error of the test: @sk is printed as both the sense key and
+ * the additional sense code, or the sense data of @dev if @sk is NULL.
+ */
+static void
+zbc_test_print_error(const char *msg,
+                     const char *sk)
+{
+    zbc_errno_t zbc_err;
+
+    printf("[TEST][ERROR],%s\n", msg);
+
+    if ( sk ) {
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", sk);
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", sk);
+    } else {
+        zbc_errno(dev, &zbc_err);
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", zbc_sk_str(zbc_err.sk));
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", zbc_asc_ascq_str(zbc_err.asc_ascq));
+    }
+
+    return;
+
+}
+
+/**
+ * Open the device and get its first conventional zone (if any) and its
+ * first sequential zone.
+ */
+static int
+zbc_test_open(const char *path,
+              struct zbc_zone **zones,
+              struct zbc_zone **conv_zone,
+              struct zbc_zone **seq_zone)
+{
+    unsigned int nr_zones, i;
+    int ret;
+
+    ret = zbc_open(path, O_RDWR, &dev);
+    if ( ret != 0 ) {
+        dev = NULL;
+        zbc_test_print_error("open device failed", "open-device-failed");
+        return( -1 );
+    }
+
+    zbc_get_device_info(dev, &info);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, zones, &nr_zones);
+    if ( ret != 0 ) {
+        zbc_test_print_error("zbc_list_zones failed", NULL);
+        return( -1 );
+    }
+
+    *conv_zone = NULL;
+    *seq_zone = NULL;
+    for(i = 0; i < nr_zones; i++) {
+        if ( zbc_zone_conventional(&(*zones)[i]) ) {
+            if ( ! *conv_zone ) {
+                *conv_zone = &(*zones)[i];
+            }
+        } else if ( ! *seq_zone ) {
+            *seq_zone = &(*zones)[i];
+        }
+    }
+
+    if ( ! *seq_zone ) {
+        zbc_test_print_error("No sequential zone", "no-target-zone");
+        return( -1 );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Close the device.
+ */
+static void
+zbc_test_close(struct zbc_zone **zones)
+{
+
+    free(*zones);
+    *zones = NULL;
+
+    if ( dev ) {
+        zbc_close(dev);
+        dev = NULL;
+    }
+
+    return;
+
+}
+
+/**
+ * Read the first blocks of @zone and compare them with @ref.
+ */
+static int
+zbc_test_read_check(struct zbc_zone *zone,
+                    const uint8_t *ref,
+                    uint8_t *buf)
+{
+    size_t sz = ZBC_TEST_LBA_COUNT * info.zbd_logical_block_size;
+    int ret;
+
+    memset(buf, 0xa5, sz);
+    ret = zbc_pread(dev, zone, buf, ZBC_TEST_LBA_COUNT, 0);
+    if ( ret != ZBC_TEST_LBA_COUNT ) {
+        zbc_test_print_error("zbc_pread failed", NULL);
+        return( -1 );
+    }
+
+    if ( memcmp(buf, ref, sz) != 0 ) {
+        zbc_test_print_error("Bad data read", "data-mismatch");
+        return( -1 );
+    }
+
+    return( 0 );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    struct zbc_zone *zones = NULL, *conv_zone, *seq_zone, zone;
+    uint8_t *data = NULL, *zeroes = NULL, *buf = NULL;
+    unsigned int nz;
+    size_t sz, j;
+    char *path;
+    int i, ret = 1;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <mem device name>\n"
+               "  Check the data and privacy of a memory device\n"
+               "Options:\n"
+               "    -v         : Verbose mode\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+            zbc_set_log_level("debug");
+        } else {
+            goto usage;
+        }
+
+    }
+
+    path = argv[i];
+    if ( zbc_test_open(path, &zones, &conv_zone, &seq_zone) != 0 ) {
+        goto out;
+    }
+
+    sz = ZBC_TEST_LBA_COUNT * info.zbd_logical_block_size;
+    data = malloc(sz);
+    zeroes = calloc(1, sz);
+    buf = malloc(sz);
+    if ( (! data) || (! zeroes) || (! buf) ) {
+        zbc_test_print_error("No memory", "no-memory");
+        goto out;
+    }
+    for(j = 0; j < sz; j++) {
+        data[j] = j * 7 + 1;
+    }
+
+    /* Write and read back */
+    if ( conv_zone ) {
+        if ( zbc_pwrite(dev, conv_zone, data, ZBC_TEST_LBA_COUNT, 0) != ZBC_TEST_LBA_COUNT ) {
+            zbc_test_print_error("zbc_pwrite to a conventional zone failed", NULL);
+            goto out;
+        }
+        if ( zbc_test_read_check(conv_zone, data, buf) != 0 ) {
+            goto out;
+        }
+    }
+
+    if ( zbc_write(dev, seq_zone, data, ZBC_TEST_LBA_COUNT) != ZBC_TEST_LBA_COUNT ) {
+        zbc_test_print_error("zbc_write to a sequential zone failed", NULL);
+        goto out;
+    }
+    if ( zbc_test_read_check(seq_zone, data, buf) != 0 ) {
+        goto out;
+    }
+
+    nz = 1;
+    if ( (zbc_report_zones(dev, zbc_zone_start_lba(seq_zone), ZBC_RO_ALL, &zone, &nz) != 0)
+         || (nz != 1)
+         || (zbc_zone_wp_lba(&zone) != zbc_zone_start_lba(seq_zone) + ZBC_TEST_LBA_COUNT) ) {
+        zbc_test_print_error("Bad sequential zone write pointer", "bad-write-pointer");
+        goto out;
+    }
+
+    zbc_test_close(&zones);
+
+    /* Check that a new device was created */
+    if ( zbc_test_open(path, &zones, &conv_zone, &seq_zone) != 0 ) {
+        goto out;
+    }
+
+    if ( ! zbc_zone_empty(seq_zone) ) {
+        zbc_test_print_error("Sequential zone not empty after reopening", "not-private");
+        goto out;
+    }
+
+    if ( conv_zone && (zbc_test_read_check(conv_zone, zeroes, buf) != 0) ) {
+        goto out;
+    }
+
+    printf("Memory device %s checked\n", path);
+    ret = 0;
+
+out:
+
+    zbc_test_close(&zones);
+    free(data);
+    free(zeroes);
+    free(buf);
+
+    return( ret );
+
+}
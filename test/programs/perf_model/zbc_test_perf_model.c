@@ -0,0 +1,337 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check the drive performance model of an emulated device: a sequence of
+ * commands is executed on the first empty sequential write required zone,
+ * or sequential write preferred zone for "pref-" sequences, with the model
+ * of a profile attached to the device handle, and the time the sequence
+ * took must be within the bounds given. Data read is written before the
+ * model is attached, and the zone used is reset when done.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <libzbc/zbc.h>
+
+#include <zbc_private.h>
+
+/***** Private data *****/
+
+#define ZBC_TEST_LBA_COUNT      8
+
+static struct zbc_device *dev;
+
+/***** Private functions *****/
+
+/**
+ * Print an error of the test: @sk is printed as both the sense key and
+ * the additional sense code, or the sense data of @dev if @sk is NULL.
+ */
+static void
+zbc_test_print_error(const char *msg,
+                     const char *sk)
+{
+    zbc_errno_t zbc_err;
+
+    printf("[TEST][ERROR],%s\n", msg);
+
+    if ( sk ) {
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", sk);
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", sk);
+    } else {
+        zbc_errno(dev, &zbc_err);
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", zbc_sk_str(zbc_err.sk));
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", zbc_asc_ascq_str(zbc_err.asc_ascq));
+    }
+
+    return;
+
+}
+
+/**
+ * Get the current time in microseconds.
+ */
+static unsigned long long
+zbc_test_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 );
+
+}
+
+/**
+ * Execute command @i of the sequence @op on @zone.
+ */
+static int
+zbc_test_cmd(const char *op,
+             struct zbc_zone *zone,
+             uint8_t *buf,
+             unsigned int i,
+             unsigned int count)
+{
+    uint64_t lba = zbc_zone_start_lba(zone);
+    uint64_t ofst;
+
+    if ( (strcmp(op, "write") == 0) || (strcmp(op, "reverse-write") == 0) ) {
+
+        /* Reverse: from the last blocks down to the zone start */
+        if ( op[0] == 'r' ) {
+            ofst = (uint64_t)(count - 1 - i) * ZBC_TEST_LBA_COUNT;
+        } else {
+            ofst = (uint64_t)i * ZBC_TEST_LBA_COUNT;
+        }
+        if ( zbc_pwrite(dev, zone, buf, ZBC_TEST_LBA_COUNT, ofst) != ZBC_TEST_LBA_COUNT ) {
+            zbc_test_print_error("zbc_pwrite failed", NULL);
+            return( -1 );
+        }
+
+    } else if ( (strcmp(op, "read") == 0) || (strcmp(op, "seek") == 0) ) {
+
+        /* Seek: alternate between the first and the last blocks written */
+        if ( (op[0] == 's') && (i & 1) ) {
+            ofst = (uint64_t)(count - 1) * ZBC_TEST_LBA_COUNT;
+        } else if ( op[0] == 's' ) {
+            ofst = 0;
+        } else {
+            ofst = (uint64_t)i * ZBC_TEST_LBA_COUNT;
+        }
+        if ( zbc_pread(dev, zone, buf, ZBC_TEST_LBA_COUNT, ofst) != ZBC_TEST_LBA_COUNT ) {
+            zbc_test_print_error("zbc_pread failed", NULL);
+            return( -1 );
+        }
+
+    } else if ( strcmp(op, "open-close") == 0 ) {
+
+        if ( zbc_open_zone(dev, lba) != 0 ) {
+            zbc_test_print_error("zbc_open_zone failed", NULL);
+            return( -1 );
+        }
+        if ( zbc_close_zone(dev, lba) != 0 ) {
+            zbc_test_print_error("zbc_close_zone failed", NULL);
+            return( -1 );
+        }
+
+    } else if ( strcmp(op, "finish-reset") == 0 ) {
+
+        if ( zbc_finish_zone(dev, lba) != 0 ) {
+            zbc_test_print_error("zbc_finish_zone failed", NULL);
+            return( -1 );
+        }
+        if ( zbc_reset_write_pointer(dev, lba) != 0 ) {
+            zbc_test_print_error("zbc_reset_write_pointer failed", NULL);
+            return( -1 );
+        }
+
+    } else if ( strcmp(op, "flush") == 0 ) {
+
+        if ( zbc_flush(dev) != 0 ) {
+            zbc_test_print_error("zbc_flush failed", NULL);
+            return( -1 );
+        }
+
+    } else {
+
+        zbc_test_print_error("Unknown command sequence", "invalid-argument");
+        return( -1 );
+
+    }
+
+    return( 0 );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    struct zbc_device_info info;
+    struct zbc_zone *zones = NULL, *zone = NULL;
+    unsigned long long min_us, max_us, start, elapsed;
+    unsigned int nr_zones, count, j;
+    char *path, *profile, *op;
+    enum zbc_zone_type type = ZBC_ZT_SEQUENTIAL_REQ;
+    uint8_t *buf = NULL;
+    int i, ret = 1;
+
+    /* Check command line */
+    if ( argc < 7 ) {
+usage:
+        printf("Usage: %s [options] <dev> <profile> <op> <count> <min us> <max us>\n"
+               "  Execute <count> times the commands <op> with the performance\n"
+               "  model of <profile> and check that this takes at least <min us>\n"
+               "  and at most <max us> microseconds. <op> can be:\n"
+               "    write        : Sequential writes of %d blocks\n"
+               "    read         : Sequential reads of %d blocks\n"
+               "    seek         : Reads of %d blocks alternating between two locations\n"
+               "    reverse-write: Writes of %d blocks from the last one to the first one\n"
+               "    open-close   : Open and close a zone\n"
+               "    finish-reset : Finish and reset a zone\n"
+               "    flush        : Flush the device write cache\n"
+               "  The commands are executed on a sequential write required zone, or\n"
+               "  on a sequential write preferred zone if <op> is prefixed by \"pref-\"\n"
+               "Options:\n"
+               "    -v   : Verbose mode\n",
+               argv[0],
+               ZBC_TEST_LBA_COUNT,
+               ZBC_TEST_LBA_COUNT,
+               ZBC_TEST_LBA_COUNT,
+               ZBC_TEST_LBA_COUNT);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+
+            zbc_set_log_level("debug");
+
+        } else if ( argv[i][0] == '-' ) {
+
+            printf("Unknown option \"%s\"\n",
+                   argv[i]);
+            goto usage;
+
+        } else {
+
+            break;
+
+        }
+
+    }
+
+    if ( i != (argc - 6) ) {
+        goto usage;
+    }
+
+    /* Get parameters */
+    path = argv[i];
+    profile = argv[i + 1];
+    op = argv[i + 2];
+    count = strtoul(argv[i + 3], NULL, 10);
+    min_us = strtoull(argv[i + 4], NULL, 10);
+    max_us = strtoull(argv[i + 5], NULL, 10);
+    if ( ! count ) {
+        goto usage;
+    }
+
+    if ( strncmp(op, "pref-", 5) == 0 ) {
+        type = ZBC_ZT_SEQUENTIAL_PREF;
+        op += 5;
+    }
+
+    /* Open device */
+    ret = zbc_open(path, O_RDWR, &dev);
+    if ( ret != 0 ) {
+        dev = NULL;
+        zbc_test_print_error("open device failed", "open-device-failed");
+        return( 1 );
+    }
+
+    zbc_get_device_info(dev, &info);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        zbc_test_print_error("zbc_list_zones failed", NULL);
+        ret = 1;
+        goto out;
+    }
+
+    ret = 1;
+    for(j = 0; j < nr_zones; j++) {
+        if ( (zbc_zone_type(&zones[j]) == type)
+             && zbc_zone_empty(&zones[j])
+             && (zbc_zone_length(&zones[j]) >= (uint64_t)count * ZBC_TEST_LBA_COUNT) ) {
+            zone = &zones[j];
+            break;
+        }
+    }
+
+    if ( ! zone ) {
+        zbc_test_print_error("No empty zone", "no-target-zone");
+        goto out;
+    }
+
+    buf = calloc(ZBC_TEST_LBA_COUNT, info.zbd_logical_block_size);
+    if ( ! buf ) {
+        zbc_test_print_error("No memory", "no-memory");
+        goto out;
+    }
+
+    /* Write the data to read without the model */
+    if ( (strcmp(op, "read") == 0) || (strcmp(op, "seek") == 0) ) {
+        for(j = 0; j < count; j++) {
+            if ( zbc_test_cmd("write", zone, buf, j, count) != 0 ) {
+                goto reset;
+            }
+        }
+    }
+
+    /* Attach the model */
+    if ( zbc_set_perf_model(dev, profile) != 0 ) {
+        zbc_test_print_error("zbc_set_perf_model failed", "set-perf-model-failed");
+        goto reset;
+    }
+
+    /* Time the command sequence */
+    start = zbc_test_usec();
+    for(j = 0; j < count; j++) {
+        if ( zbc_test_cmd(op, zone, buf, j, count) != 0 ) {
+            goto reset;
+        }
+    }
+    elapsed = zbc_test_usec() - start;
+
+    printf("%u %s took %llu us (expected %llu to %llu us)\n",
+           count,
+           op,
+           elapsed,
+           min_us,
+           max_us);
+
+    if ( (elapsed < min_us) || (elapsed > max_us) ) {
+        zbc_test_print_error("Bad command sequence time", "bad-timing");
+        goto reset;
+    }
+
+    ret = 0;
+
+reset:
+
+    zbc_set_perf_model(dev, NULL);
+    zbc_reset_write_pointer(dev, zbc_zone_start_lba(zone));
+
+out:
+
+    free(buf);
+    free(zones);
+    zbc_close(dev);
+
+    return( ret );
+
+}
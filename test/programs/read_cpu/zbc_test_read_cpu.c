@@ -0,0 +1,291 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Measure the CPU time used to read data with copies (zbc_pread), with
+ * direct I/O (ZBC_SG_DIRECT_IO for SG nodes, ZBC_FAKE_MMAP for emulated
+ * devices) and without any copy (zbc_pread_borrow). The data read is
+ * summed in all cases so that the cost of consuming it is the same.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <libzbc/zbc.h>
+
+/***** Private data *****/
+
+enum {
+    ZBC_TEST_COPY,
+    ZBC_TEST_DIRECT,
+    ZBC_TEST_BORROW,
+    ZBC_TEST_NR_MODES,
+};
+
+static const char *zbc_test_mode_name[ZBC_TEST_NR_MODES] = {
+    "copy",
+    "direct",
+    "borrow",
+};
+
+/***** Private functions *****/
+
+static unsigned long long
+zbc_test_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return( (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 );
+
+}
+
+static unsigned long long
+zbc_test_cpu_usec(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return( (unsigned long long) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL
+            + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec );
+
+}
+
+/**
+ * Sum the data read.
+ */
+static unsigned long long
+zbc_test_sum(const void *buf,
+             size_t sz)
+{
+    const unsigned long long *p = buf;
+    unsigned long long sum = 0;
+    size_t i;
+
+    for(i = 0; i < sz / sizeof(*p); i++) {
+        sum += p[i];
+    }
+
+    return( sum );
+
+}
+
+/**
+ * Read @total bytes of the readable zone space of the device (conventional
+ * zones and sequential zones up to their write pointer), in chunks of
+ * @chunk logical blocks. Returns 0 on success, -ENOTSUP if the mode is not
+ * supported by the device and another negative error code otherwise.
+ */
+static int
+zbc_test_read(const char *path,
+              int mode,
+              unsigned long long total,
+              uint32_t chunk,
+              unsigned long long *sum,
+              unsigned long long *usec,
+              unsigned long long *cpu_usec)
+{
+    struct zbc_device_info info;
+    struct zbc_device *dev;
+    zbc_zone_t *zones = NULL, *z;
+    unsigned int nr_zones, i;
+    unsigned long long done = 0, start, cpu_start;
+    uint64_t ofst, end;
+    uint32_t count;
+    const void *data;
+    void *buf = NULL;
+    int flags = O_RDONLY, readable, ret;
+
+    if ( mode != ZBC_TEST_COPY ) {
+        flags |= ZBC_SG_DIRECT_IO | ZBC_FAKE_MMAP;
+    }
+
+    ret = zbc_open(path, flags, &dev);
+    if ( ret != 0 ) {
+        return( ret );
+    }
+
+    zbc_get_device_info(dev, &info);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        goto out;
+    }
+
+    ret = posix_memalign(&buf, sysconf(_SC_PAGESIZE),
+                         (size_t) chunk * info.zbd_logical_block_size);
+    if ( ret != 0 ) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    *sum = 0;
+    start = zbc_test_usec();
+    cpu_start = zbc_test_cpu_usec();
+
+    while( done < total ) {
+
+        readable = 0;
+
+        for(i = 0; (i < nr_zones) && (done < total); i++) {
+
+            z = &zones[i];
+            if ( zbc_zone_conventional(z) || zbc_zone_full(z) ) {
+                end = zbc_zone_length(z);
+            } else if ( zbc_zone_sequential(z) && (! zbc_zone_empty(z)) ) {
+                end = zbc_zone_wp_lba(z) - zbc_zone_start_lba(z);
+            } else {
+                continue;
+            }
+            readable = 1;
+
+            for(ofst = 0; (ofst < end) && (done < total); ofst += count) {
+
+                count = chunk;
+                if ( ofst + count > end ) {
+                    count = end - ofst;
+                }
+
+                if ( mode == ZBC_TEST_BORROW ) {
+                    ret = zbc_pread_borrow(dev, z, &data, count, ofst);
+                } else {
+                    ret = zbc_pread(dev, z, buf, count, ofst);
+                    data = buf;
+                }
+                if ( ret != (int) count ) {
+                    if ( ret >= 0 ) {
+                        ret = -EIO;
+                    }
+                    goto out;
+                }
+
+                *sum += zbc_test_sum(data, (size_t) count * info.zbd_logical_block_size);
+                done += (unsigned long long) count * info.zbd_logical_block_size;
+
+            }
+
+        }
+
+        if ( ! readable ) {
+            fprintf(stderr, "No readable data on %s\n", path);
+            ret = -ENODATA;
+            goto out;
+        }
+
+    }
+
+    *cpu_usec = zbc_test_cpu_usec() - cpu_start;
+    *usec = zbc_test_usec() - start;
+    ret = 0;
+
+out:
+
+    free(buf);
+    free(zones);
+    zbc_close(dev);
+
+    return( ret );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    unsigned long long total = 1024ULL << 20, sum, ref_sum = 0, usec, cpu_usec;
+    uint32_t chunk = 256;
+    int i, mode, ret = 0;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <dev>\n"
+               "  Compare the CPU time used by copied, direct and borrowed reads\n"
+               "Options:\n"
+               "    -s <MiB>   : Amount of data read per mode (default 1024 MiB)\n"
+               "    -c <num>   : Number of logical blocks per read (default 256)\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( (strcmp(argv[i], "-s") == 0) && (i < (argc - 2)) ) {
+            total = strtoull(argv[++i], NULL, 10) << 20;
+        } else if ( (strcmp(argv[i], "-c") == 0) && (i < (argc - 2)) ) {
+            chunk = strtoul(argv[++i], NULL, 10);
+        } else {
+            goto usage;
+        }
+
+    }
+
+    if ( (i != (argc - 1)) || (! total) || (! chunk) ) {
+        goto usage;
+    }
+
+    printf("%-8s %12s %12s %16s\n", "Mode", "MB/s", "CPU %", "CPU ms / GiB");
+
+    for(mode = 0; mode < ZBC_TEST_NR_MODES; mode++) {
+
+        ret = zbc_test_read(argv[i], mode, total, chunk, &sum, &usec, &cpu_usec);
+        if ( ret == -ENOTSUP ) {
+            printf("%-8s %12s\n", zbc_test_mode_name[mode], "not supported");
+            ret = 0;
+            continue;
+        }
+        if ( ret != 0 ) {
+            fprintf(stderr, "%s reads failed %d (%s)\n",
+                    zbc_test_mode_name[mode],
+                    ret,
+                    strerror(-ret));
+            return( 1 );
+        }
+
+        if ( mode == ZBC_TEST_COPY ) {
+            ref_sum = sum;
+        } else if ( sum != ref_sum ) {
+            fprintf(stderr, "%s reads returned different data\n",
+                    zbc_test_mode_name[mode]);
+            return( 1 );
+        }
+
+        if ( ! usec ) {
+            usec = 1;
+        }
+        printf("%-8s %12.1f %12.1f %16.1f\n",
+               zbc_test_mode_name[mode],
+               (double) total / usec,
+               (double) cpu_usec * 100.0 / usec,
+               (double) cpu_usec / 1000.0 * (double) (1ULL << 30) / total);
+
+    }
+
+    return( ret );
+
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libzbc/zbc.h>
+
+/***** Main *****/
+
+int main(int argc,
+         char **argv)
+{
+    struct zbc_device *dev;
+    uint64_t *lbas = NULL;
+    unsigned int nr_lbas, j;
+    int i, range = 0, ret = 1;
+    char *path;
+
+    /* Check command line */
+    if ( argc < 3 ) {
+usage:
+        printf("Usage: %s [options] <dev> <lba> [<lba> ...]\n"
+               "  Reset the write pointer of the zones starting at the <lba> list\n"
+               "  (in any order) with zbc_reset_zones\n"
+               "       %s [options] -r <dev> <lba> <num zones>\n"
+               "  Reset the write pointer of <num zones> zones from the zone\n"
+               "  starting at <lba> with zbc_reset_zone_range\n"
+               "Options:\n"
+               "    -v   : Verbose mode\n",
+               argv[0],
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+
+            zbc_set_log_level("debug");
+
+        } else if ( strcmp(argv[i], "-r") == 0 ) {
+
+            range = 1;
+
+        } else if ( argv[i][0] == '-' ) {
+
+            printf("Unknown option \"%s\"\n",
+                   argv[i]);
+            goto usage;
+
+        } else {
+
+            break;
+
+        }
+
+    }
+
+    if ( (i > (argc - 2)) || (range && (i != (argc - 3))) ) {
+        goto usage;
+    }
+
+    /* Get parameters */
+    path = argv[i++];
+    nr_lbas = argc - i;
+    lbas = (uint64_t *) malloc(sizeof(uint64_t) * nr_lbas);
+    if ( ! lbas ) {
+        fprintf(stderr, "[TEST][ERROR],No memory\n");
+        return( 1 );
+    }
+    for(j = 0; j < nr_lbas; j++) {
+        lbas[j] = strtoull(argv[i + j], NULL, 10);
+    }
+
+    /* Open device */
+    ret = zbc_open(path, O_RDWR, &dev);
+    if ( ret != 0 ) {
+	fprintf(stderr, "[TEST][ERROR],open device failed\n");
+	printf("[TEST][ERROR][SENSE_KEY],open-device-failed\n");
+	printf("[TEST][ERROR][ASC_ASCQ],open-device-failed\n");
+        free(lbas);
+        return( 1 );
+    }
+
+    /* Reset write pointers */
+    if ( range ) {
+        ret = zbc_reset_zone_range(dev, lbas[0], (unsigned int)lbas[1]);
+    } else {
+        ret = zbc_reset_zones(dev, lbas, nr_lbas);
+    }
+    if ( ret != 0 ) {
+        fprintf(stderr,
+                "[TEST][ERROR],%s failed %d\n",
+                range ? "zbc_reset_zone_range" : "zbc_reset_zones",
+                ret);
+
+        if ( ret == -EIO ) {
+            zbc_errno_t zbc_err;
+            const char *sk_name;
+            const char *ascq_name;
+
+            zbc_errno(dev, &zbc_err);
+            sk_name = zbc_sk_str(zbc_err.sk);
+            ascq_name = zbc_asc_ascq_str(zbc_err.asc_ascq);
+
+            printf("[TEST][ERROR][SENSE_KEY],%s\n", sk_name);
+            printf("[TEST][ERROR][ASC_ASCQ],%s\n", ascq_name);
+        } else {
+            /* Rejected by the library: no command failed */
+            printf("[TEST][ERROR][SENSE_KEY],%s\n", (ret == -EINVAL) ? "invalid-argument" : "library-error");
+            printf("[TEST][ERROR][ASC_ASCQ],%s\n", (ret == -EINVAL) ? "invalid-argument" : "library-error");
+        }
+
+        ret = 1;
+    }
+
+    free(lbas);
+
+    /* Close device file */
+    zbc_close(dev);
+
+    return( ret );
+
+}
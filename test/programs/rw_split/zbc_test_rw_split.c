@@ -0,0 +1,326 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check reads and writes larger than the device maximum command size,
+ * which the library splits into several commands: an empty sequential
+ * zone is written with zbc_pwritev() using buffers crossing the command
+ * boundaries and read back with zbc_pread() and zbc_preadv(). The same
+ * is done with zbc_pwrite() on the first conventional zone, if any.
+ * The sequential zone used is reset when done.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include <libzbc/zbc.h>
+
+/***** Private data *****/
+
+static struct zbc_device *dev;
+static struct zbc_device_info info;
+
+/***** Private functions *****/
+
+/**
+ * Fill the blocks of a buffer with their LBA and a pass number.
+ */
+static void
+zbc_test_fill(uint8_t *buf,
+              uint64_t lba,
+              uint32_t lba_count,
+              uint64_t pass)
+{
+    size_t lba_size = info.zbd_logical_block_size;
+    uint64_t *p;
+    size_t i, j;
+
+    for(i = 0; i < lba_count; i++) {
+        p = (uint64_t *)(buf + i * lba_size);
+        for(j = 0; j < lba_size / sizeof(uint64_t); j++) {
+            p[j] = ((lba + i) << 8) | pass;
+        }
+    }
+
+    return;
+
+}
+
+/**
+ * Check that the blocks of a buffer contain their LBA and a pass number.
+ */
+static int
+zbc_test_check(const uint8_t *buf,
+               uint64_t lba,
+               uint32_t lba_count,
+               uint64_t pass)
+{
+    size_t lba_size = info.zbd_logical_block_size;
+    const uint64_t *p;
+    size_t i, j;
+
+    for(i = 0; i < lba_count; i++) {
+        p = (const uint64_t *)(buf + i * lba_size);
+        for(j = 0; j < lba_size / sizeof(uint64_t); j++) {
+            if ( p[j] != (((lba + i) << 8) | pass) ) {
+                printf("[TEST][ERROR],Bad data at block %llu\n",
+                       (unsigned long long) (lba + i));
+                printf("[TEST][ERROR][SENSE_KEY],data-mismatch\n");
+                printf("[TEST][ERROR][ASC_ASCQ],data-mismatch\n");
+                return( -1 );
+            }
+        }
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Print the sense data of a failed command.
+ */
+static void
+zbc_test_print_sense(const char *op,
+                     int ret)
+{
+    zbc_errno_t zbc_err;
+
+    printf("[TEST][ERROR],%s failed %d\n",
+           op,
+           ret);
+
+    zbc_errno(dev, &zbc_err);
+    printf("[TEST][ERROR][SENSE_KEY],%s\n", zbc_sk_str(zbc_err.sk));
+    printf("[TEST][ERROR][ASC_ASCQ],%s\n", zbc_asc_ascq_str(zbc_err.asc_ascq));
+
+    return;
+
+}
+
+/**
+ * Split the buffer @buf of @lba_count blocks into 3 buffers crossing the
+ * command boundaries: half a block, one block more than the maximum
+ * command size, and the remaining data.
+ */
+static void
+zbc_test_iov(struct iovec *iov,
+             uint8_t *buf,
+             uint32_t lba_count)
+{
+    size_t lba_size = info.zbd_logical_block_size;
+    size_t sz = (size_t)lba_count * lba_size;
+
+    iov[0].iov_base = buf;
+    iov[0].iov_len = lba_size / 2;
+    iov[1].iov_base = buf + iov[0].iov_len;
+    iov[1].iov_len = (size_t)(info.zbd_max_rw_logical_blocks + 1) * lba_size;
+    iov[2].iov_base = buf + iov[0].iov_len + iov[1].iov_len;
+    iov[2].iov_len = sz - iov[0].iov_len - iov[1].iov_len;
+
+    return;
+
+}
+
+/**
+ * Write @lba_count blocks at the start of @zone, vectored (zbc_pwritev)
+ * or not (zbc_pwrite), and read them back in both ways.
+ */
+static int
+zbc_test_rw(struct zbc_zone *zone,
+            uint8_t *buf,
+            uint32_t lba_count,
+            int vectored,
+            uint64_t pass)
+{
+    size_t sz = (size_t)lba_count * info.zbd_logical_block_size;
+    struct iovec iov[3];
+    int ret;
+
+    zbc_test_fill(buf, zbc_zone_start_lba(zone), lba_count, pass);
+    zbc_test_iov(iov, buf, lba_count);
+
+    if ( vectored ) {
+        ret = zbc_pwritev(dev, zone, iov, 3, 0);
+    } else {
+        ret = zbc_pwrite(dev, zone, buf, lba_count, 0);
+    }
+    if ( ret != (int) lba_count ) {
+        zbc_test_print_sense(vectored ? "zbc_pwritev" : "zbc_pwrite", ret);
+        return( -1 );
+    }
+
+    memset(buf, 0, sz);
+    ret = zbc_pread(dev, zone, buf, lba_count, 0);
+    if ( ret != (int) lba_count ) {
+        zbc_test_print_sense("zbc_pread", ret);
+        return( -1 );
+    }
+    if ( zbc_test_check(buf, zbc_zone_start_lba(zone), lba_count, pass) != 0 ) {
+        return( -1 );
+    }
+
+    memset(buf, 0, sz);
+    ret = zbc_preadv(dev, zone, iov, 3, 0);
+    if ( ret != (int) lba_count ) {
+        zbc_test_print_sense("zbc_preadv", ret);
+        return( -1 );
+    }
+
+    return( zbc_test_check(buf, zbc_zone_start_lba(zone), lba_count, pass) );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    struct zbc_zone *zones = NULL, *seq_zone = NULL, *conv_zone = NULL, zone;
+    unsigned int nr_zones, nz, i;
+    uint32_t lba_count;
+    uint8_t *buf = NULL;
+    int ret = 1;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <dev>\n"
+               "  Write and read back data larger than the maximum command size\n"
+               "Options:\n"
+               "    -v         : Verbose mode\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (unsigned int)(argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+            zbc_set_log_level("debug");
+        } else {
+            goto usage;
+        }
+
+    }
+
+    /* Open device */
+    ret = zbc_open(argv[i], O_RDWR, &dev);
+    if ( ret != 0 ) {
+        fprintf(stderr, "[TEST][ERROR],open device failed\n");
+        printf("[TEST][ERROR][SENSE_KEY],open-device-failed\n");
+        printf("[TEST][ERROR][ASC_ASCQ],open-device-failed\n");
+        return( 1 );
+    }
+
+    zbc_get_device_info(dev, &info);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        fprintf(stderr, "[TEST][ERROR],zbc_list_zones failed\n");
+        zbc_test_print_sense("zbc_list_zones", ret);
+        ret = 1;
+        goto out;
+    }
+
+    /* Three full commands and a partial one */
+    lba_count = info.zbd_max_rw_logical_blocks * 3 + 5;
+
+    for(i = 0; i < nr_zones; i++) {
+        if ( zbc_zone_length(&zones[i]) < lba_count ) {
+            continue;
+        }
+        if ( zbc_zone_conventional(&zones[i]) ) {
+            if ( ! conv_zone ) {
+                conv_zone = &zones[i];
+            }
+        } else if ( zbc_zone_sequential(&zones[i]) && zbc_zone_empty(&zones[i]) ) {
+            if ( ! seq_zone ) {
+                seq_zone = &zones[i];
+            }
+        }
+    }
+
+    if ( ! seq_zone ) {
+        fprintf(stderr, "[TEST][ERROR],No empty sequential zone of at least %u blocks\n",
+                lba_count);
+        printf("[TEST][ERROR][SENSE_KEY],no-target-zone\n");
+        printf("[TEST][ERROR][ASC_ASCQ],no-target-zone\n");
+        ret = 1;
+        goto out;
+    }
+
+    ret = posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE),
+                         (size_t)lba_count * info.zbd_logical_block_size);
+    if ( ret != 0 ) {
+        fprintf(stderr, "[TEST][ERROR],No memory for I/O buffer\n");
+        printf("[TEST][ERROR][SENSE_KEY],no-memory\n");
+        printf("[TEST][ERROR][ASC_ASCQ],no-memory\n");
+        buf = NULL;
+        ret = 1;
+        goto out;
+    }
+
+    /* Sequential zone: vectored write, which must advance the write pointer */
+    ret = 1;
+    if ( zbc_test_rw(seq_zone, buf, lba_count, 1, 1) != 0 ) {
+        goto reset;
+    }
+
+    zone = *seq_zone;
+    nz = 1;
+    if ( (zbc_report_zones(dev, zbc_zone_start_lba(seq_zone), ZBC_RO_ALL, &zone, &nz) != 0)
+         || (nz != 1)
+         || (zbc_zone_wp_lba(&zone) != zbc_zone_start_lba(seq_zone) + lba_count) ) {
+        fprintf(stderr, "[TEST][ERROR],Bad write pointer %llu (expected %llu)\n",
+                (unsigned long long) zbc_zone_wp_lba(&zone),
+                (unsigned long long) (zbc_zone_start_lba(seq_zone) + lba_count));
+        printf("[TEST][ERROR][SENSE_KEY],bad-write-pointer\n");
+        printf("[TEST][ERROR][ASC_ASCQ],bad-write-pointer\n");
+        goto reset;
+    }
+
+    /* Conventional zone: both ways */
+    if ( conv_zone ) {
+        if ( (zbc_test_rw(conv_zone, buf, lba_count, 0, 2) != 0)
+             || (zbc_test_rw(conv_zone, buf, lba_count, 1, 3) != 0) ) {
+            goto reset;
+        }
+    }
+
+    printf("%u blocks written and read back (%llu blocks per command)\n",
+           lba_count,
+           (unsigned long long) info.zbd_max_rw_logical_blocks);
+    ret = 0;
+
+reset:
+
+    zbc_reset_write_pointer(dev, zbc_zone_start_lba(seq_zone));
+
+out:
+
+    free(buf);
+    free(zones);
+    zbc_close(dev);
+
+    return( ret );
+
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libzbc/zbc.h>
+
+#include <zbc_private.h>
+
+/***** Main *****/
+
+int main(int argc,
+         char **argv)
+{
+    struct zbc_device *dev;
+    unsigned long long conv_sz = 0, zone_sz = 0;
+    int i, geom = 0, ret = 1;
+    char *path, *geom_path = NULL;
+
+    /* Check command line */
+    if ( argc < 3 ) {
+usage:
+        printf("Usage: %s [options] <dev> <conv size> <zone size>\n"
+               "  Set the zones of an emulated device: <conv size> logical blocks\n"
+               "  of conventional zones followed by sequential zones, all zones\n"
+               "  of <zone size> logical blocks\n"
+               "       %s [options] -g <dev> <geometry file>\n"
+               "  Set the zones of an emulated device from a zone geometry file\n"
+               "Options:\n"
+               "    -v   : Verbose mode\n",
+               argv[0],
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+
+            zbc_set_log_level("debug");
+
+        } else if ( strcmp(argv[i], "-g") == 0 ) {
+
+            geom = 1;
+
+        } else if ( argv[i][0] == '-' ) {
+
+            printf("Unknown option \"%s\"\n",
+                   argv[i]);
+            goto usage;
+
+        } else {
+
+            break;
+
+        }
+
+    }
+
+    if ( i != (argc - (geom ? 2 : 3)) ) {
+        goto usage;
+    }
+
+    /* Get parameters */
+    path = argv[i];
+    if ( geom ) {
+        geom_path = argv[i + 1];
+    } else {
+        conv_sz = strtoull(argv[i + 1], NULL, 10);
+        zone_sz = strtoull(argv[i + 2], NULL, 10);
+    }
+
+    /* Open device */
+    ret = zbc_open(path, O_RDWR, &dev);
+    if ( ret != 0 ) {
+	fprintf(stderr, "[TEST][ERROR],open device failed\n");
+	printf("[TEST][ERROR][SENSE_KEY],open-device-failed\n");
+	printf("[TEST][ERROR][ASC_ASCQ],open-device-failed\n");
+        return( 1 );
+    }
+
+    /* Set zones */
+    if ( geom ) {
+        ret = zbc_set_zone_geometry(dev, geom_path);
+    } else {
+        ret = zbc_set_zones(dev, conv_sz, zone_sz);
+    }
+    if ( ret != 0 ) {
+        fprintf(stderr,
+                "[TEST][ERROR],%s failed %d (%s)\n",
+                geom ? "zbc_set_zone_geometry" : "zbc_set_zones",
+                ret,
+                strerror(-ret));
+        printf("[TEST][ERROR][SENSE_KEY],set-zones-failed\n");
+        printf("[TEST][ERROR][ASC_ASCQ],set-zones-failed\n");
+        ret = 1;
+    }
+
+    /* Close device file */
+    zbc_close(dev);
+
+    return( ret );
+
+}
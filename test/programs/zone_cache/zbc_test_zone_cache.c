@@ -0,0 +1,519 @@
+/*
+ * This file is part of libzbc.
+ *
+ * Copyright (C) 2009-2014, HGST, Inc.  This software is distributed
+ * under the terms of the GNU Lesser General Public License version 3,
+ * or any later version, "as is," without technical support, and WITHOUT
+ * ANY WARRANTY, without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  You should have received a copy
+ * of the GNU Lesser General Public License along with libzbc.  If not,
+ * see <http://www.gnu.org/licenses/>.
+ *
+ * Authors: Damien Le Moal (damien.lemoal@hgst.com)
+ *          Christophe Louargant (christophe.louargant@hgst.com)
+ */
+
+/*
+ * Check the zone information interfaces of a device: the zones reported by
+ * a zone iterator, from the first zone and from a zone in the middle of the
+ * device, must match the zones listed in a single pass; the zone cache must
+ * find the zone containing any LBA and follow the write pointer and the
+ * condition of a sequential zone written, finished and reset, as reported
+ * by REPORT ZONES; the command policies must default to the policies of
+ * the library and read back as set.
+ */
+
+/***** Including files *****/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <libzbc/zbc.h>
+
+/***** Private data *****/
+
+#define ZBC_TEST_LBA_COUNT      8
+
+static struct zbc_device *dev;
+static struct zbc_zone *zones;
+static unsigned int nr_zones;
+
+/**
+ * Default command policies (see zbc_cmd_policy_default in lib/zbc.c).
+ */
+static struct zbc_cmd_policy zbc_test_policy_default[ZBC_CMD_CLASS_NUM] = {
+    { 20000, 3, 1000 },         /* ZBC_CMD_CLASS_IO */
+    { 20000, 3, 1000 },         /* ZBC_CMD_CLASS_ZONE */
+    { 20000, 3, 1000 },         /* ZBC_CMD_CLASS_REPORT */
+    { 60000, 3, 1000 },         /* ZBC_CMD_CLASS_FLUSH */
+    { 20000, 3, 1000 },         /* ZBC_CMD_CLASS_MGMT */
+};
+
+/***** Private functions *****/
+
+/**
+ * Print an error of the test: @sk is printed as both the sense key and
+ * the additional sense code, or the sense data of @dev if @sk is NULL.
+ */
+static void
+zbc_test_print_error(const char *msg,
+                     const char *sk)
+{
+    zbc_errno_t zbc_err;
+
+    printf("[TEST][ERROR],%s\n", msg);
+
+    if ( sk ) {
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", sk);
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", sk);
+    } else {
+        zbc_errno(dev, &zbc_err);
+        printf("[TEST][ERROR][SENSE_KEY],%s\n", zbc_sk_str(zbc_err.sk));
+        printf("[TEST][ERROR][ASC_ASCQ],%s\n", zbc_asc_ascq_str(zbc_err.asc_ascq));
+    }
+
+    return;
+
+}
+
+/**
+ * Test if two zone descriptors are identical and print them if not.
+ */
+static int
+zbc_test_zone_match(const char *what,
+                    struct zbc_zone *zone,
+                    struct zbc_zone *ref)
+{
+
+    if ( (zone->zbz_start == ref->zbz_start)
+         && (zone->zbz_length == ref->zbz_length)
+         && (zone->zbz_type == ref->zbz_type)
+         && (zone->zbz_condition == ref->zbz_condition)
+         && (zone->zbz_flags == ref->zbz_flags)
+         && (zbc_zone_not_wp(ref)
+             || (zone->zbz_write_pointer == ref->zbz_write_pointer)) ) {
+        return( 1 );
+    }
+
+    printf("%s: zone %llu+%llu, type 0x%x, cond 0x%x, flags 0x%x, wp %llu\n"
+           "    instead of zone %llu+%llu, type 0x%x, cond 0x%x, flags 0x%x, wp %llu\n",
+           what,
+           zbc_zone_start_lba(zone),
+           zbc_zone_length(zone),
+           zbc_zone_type(zone),
+           zbc_zone_condition(zone),
+           zone->zbz_flags,
+           zbc_zone_wp_lba(zone),
+           zbc_zone_start_lba(ref),
+           zbc_zone_length(ref),
+           zbc_zone_type(ref),
+           zbc_zone_condition(ref),
+           ref->zbz_flags,
+           zbc_zone_wp_lba(ref));
+
+    return( 0 );
+
+}
+
+/**
+ * Iterate over the zones from zone @first and compare with the zone list.
+ * Returns the number of batches, or -1 on error.
+ */
+static int
+zbc_test_iter(unsigned int first)
+{
+    struct zbc_zone_iter *iter;
+    struct zbc_zone *batch;
+    unsigned int n, i, z = first;
+    int nr_batches = 0, ret;
+
+    ret = zbc_zone_iter_open(dev, zbc_zone_start_lba(&zones[first]), ZBC_RO_ALL, &iter);
+    if ( ret != 0 ) {
+        zbc_test_print_error("zbc_zone_iter_open failed", NULL);
+        return( -1 );
+    }
+
+    while( 1 ) {
+
+        ret = zbc_zone_iter_next(iter, &batch, &n);
+        if ( ret != 0 ) {
+            zbc_test_print_error("zbc_zone_iter_next failed", NULL);
+            goto out;
+        }
+        if ( ! n ) {
+            break;
+        }
+
+        nr_batches++;
+        for(i = 0; i < n; i++, z++) {
+            if ( (z >= nr_zones) || (! zbc_test_zone_match("Iterator", &batch[i], &zones[z])) ) {
+                zbc_test_print_error("Iterator zone mismatch", "bad-zone-iter");
+                ret = -1;
+                goto out;
+            }
+        }
+
+    }
+
+    if ( z != nr_zones ) {
+        printf("Iterator reported %u zones instead of %u\n",
+               z - first,
+               nr_zones - first);
+        zbc_test_print_error("Iterator zone count mismatch", "bad-zone-iter");
+        ret = -1;
+    }
+
+out:
+
+    zbc_zone_iter_close(iter);
+
+    return( ret ? -1 : nr_batches );
+
+}
+
+/**
+ * Check that the cached information of all zones, looked up at the
+ * start, middle and end LBA of each zone, matches the zone list.
+ */
+static int
+zbc_test_lookup_all(void)
+{
+    struct zbc_zone zone;
+    uint64_t lba[3];
+    unsigned int i, j;
+
+    for(i = 0; i < nr_zones; i++) {
+
+        lba[0] = zbc_zone_start_lba(&zones[i]);
+        lba[1] = lba[0] + zbc_zone_length(&zones[i]) / 2;
+        lba[2] = zbc_zone_last_lba(&zones[i]);
+
+        for(j = 0; j < 3; j++) {
+            if ( zbc_zone_lookup(dev, lba[j], &zone) != 0 ) {
+                zbc_test_print_error("zbc_zone_lookup failed", "bad-zone-lookup");
+                return( -1 );
+            }
+            if ( ! zbc_test_zone_match("Lookup", &zone, &zones[i]) ) {
+                zbc_test_print_error("Cached zone mismatch", "bad-zone-lookup");
+                return( -1 );
+            }
+        }
+
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Check that the cached information of @zone matches REPORT ZONES
+ * and that its condition and write pointer are as expected.
+ */
+static int
+zbc_test_check_zone(const char *step,
+                    struct zbc_zone *zone,
+                    int cond,
+                    uint64_t wp)
+{
+    struct zbc_zone cached, reported;
+    unsigned int n = 1;
+
+    /* Look up first: REPORT ZONES updates the cache */
+    if ( zbc_zone_lookup(dev, zbc_zone_start_lba(zone), &cached) != 0 ) {
+        zbc_test_print_error("zbc_zone_lookup failed", "bad-zone-lookup");
+        return( -1 );
+    }
+
+    if ( zbc_report_zones(dev, zbc_zone_start_lba(zone), ZBC_RO_ALL, &reported, &n) != 0 ) {
+        zbc_test_print_error("zbc_report_zones failed", NULL);
+        return( -1 );
+    }
+
+    if ( ! zbc_test_zone_match(step, &cached, &reported) ) {
+        zbc_test_print_error("Cached zone differs from REPORT ZONES", "bad-zone-cache");
+        return( -1 );
+    }
+
+    if ( (zbc_zone_condition(&reported) != cond)
+         || ((cond != ZBC_ZC_FULL) && (zbc_zone_wp_lba(&reported) != wp)) ) {
+        printf("%s: zone %llu condition 0x%x, wp %llu (expected 0x%x, %llu)\n",
+               step,
+               zbc_zone_start_lba(zone),
+               zbc_zone_condition(&reported),
+               zbc_zone_wp_lba(&reported),
+               cond,
+               (unsigned long long) wp);
+        zbc_test_print_error("Bad zone state", "bad-zone-state");
+        return( -1 );
+    }
+
+    return( 0 );
+
+}
+
+/**
+ * Write, finish and reset the first empty sequential zone and check the
+ * cached information of the zone after each operation.
+ */
+static int
+zbc_test_wp(uint8_t *buf)
+{
+    struct zbc_zone *zone = NULL;
+    uint64_t start;
+    unsigned int i;
+
+    for(i = 0; i < nr_zones; i++) {
+        if ( zbc_zone_sequential(&zones[i]) && zbc_zone_empty(&zones[i]) ) {
+            zone = &zones[i];
+            break;
+        }
+    }
+
+    if ( ! zone ) {
+        zbc_test_print_error("No empty sequential zone", "no-target-zone");
+        return( -1 );
+    }
+
+    start = zbc_zone_start_lba(zone);
+
+    for(i = 0; i < 2; i++) {
+        if ( zbc_pwrite(dev, zone, buf, ZBC_TEST_LBA_COUNT, (uint64_t)i * ZBC_TEST_LBA_COUNT)
+             != ZBC_TEST_LBA_COUNT ) {
+            zbc_test_print_error("zbc_pwrite failed", NULL);
+            return( -1 );
+        }
+        if ( zbc_test_check_zone("Write", zone, ZBC_ZC_IMP_OPEN,
+                                 start + (uint64_t)(i + 1) * ZBC_TEST_LBA_COUNT) != 0 ) {
+            return( -1 );
+        }
+    }
+
+    if ( zbc_finish_zone(dev, start) != 0 ) {
+        zbc_test_print_error("zbc_finish_zone failed", NULL);
+        return( -1 );
+    }
+    if ( zbc_test_check_zone("Finish", zone, ZBC_ZC_FULL, 0) != 0 ) {
+        return( -1 );
+    }
+
+    if ( zbc_reset_write_pointer(dev, start) != 0 ) {
+        zbc_test_print_error("zbc_reset_write_pointer failed", NULL);
+        return( -1 );
+    }
+    if ( zbc_test_check_zone("Reset", zone, ZBC_ZC_EMPTY, start) != 0 ) {
+        return( -1 );
+    }
+
+    if ( zbc_pwrite(dev, zone, buf, ZBC_TEST_LBA_COUNT, 0) != ZBC_TEST_LBA_COUNT ) {
+        zbc_test_print_error("zbc_pwrite failed", NULL);
+        return( -1 );
+    }
+
+    /* Resynchronizing must keep the zone state */
+    if ( zbc_zone_cache_resync(dev) != 0 ) {
+        zbc_test_print_error("zbc_zone_cache_resync failed", NULL);
+        return( -1 );
+    }
+    if ( zbc_test_check_zone("Resync", zone, ZBC_ZC_IMP_OPEN, start + ZBC_TEST_LBA_COUNT) != 0 ) {
+        return( -1 );
+    }
+
+    if ( zbc_reset_write_pointer(dev, start) != 0 ) {
+        zbc_test_print_error("zbc_reset_write_pointer failed", NULL);
+        return( -1 );
+    }
+
+    return( zbc_test_check_zone("Reset", zone, ZBC_ZC_EMPTY, start) );
+
+}
+
+/**
+ * Check the default command policies, and that a policy set reads back
+ * without changing the policies of the other classes.
+ */
+static int
+zbc_test_policy(void)
+{
+    struct zbc_cmd_policy policy, set = { 5000, 1, 10 };
+    struct zbc_cmd_stats stats;
+    int cls;
+
+    for(cls = 0; cls < ZBC_CMD_CLASS_NUM; cls++) {
+        if ( (zbc_get_cmd_policy(dev, cls, &policy) != 0)
+             || memcmp(&policy, &zbc_test_policy_default[cls], sizeof(policy)) ) {
+            printf("Class %d policy: timeout %u ms, %u retries, backoff %u us\n",
+                   cls,
+                   policy.zcp_timeout,
+                   policy.zcp_max_retries,
+                   policy.zcp_backoff);
+            zbc_test_print_error("Bad default command policy", "bad-cmd-policy");
+            return( -1 );
+        }
+    }
+
+    if ( zbc_set_cmd_policy(dev, ZBC_CMD_CLASS_ZONE, &set) != 0 ) {
+        zbc_test_print_error("zbc_set_cmd_policy failed", "bad-cmd-policy");
+        return( -1 );
+    }
+
+    for(cls = 0; cls < ZBC_CMD_CLASS_NUM; cls++) {
+        zbc_get_cmd_policy(dev, cls, &policy);
+        if ( memcmp(&policy,
+                    (cls == ZBC_CMD_CLASS_ZONE) ? &set : &zbc_test_policy_default[cls],
+                    sizeof(policy)) ) {
+            printf("Class %d policy: timeout %u ms, %u retries, backoff %u us\n",
+                   cls,
+                   policy.zcp_timeout,
+                   policy.zcp_max_retries,
+                   policy.zcp_backoff);
+            zbc_test_print_error("Bad command policy", "bad-cmd-policy");
+            return( -1 );
+        }
+    }
+
+    /* Invalid policies and classes */
+    set.zcp_timeout = 0;
+    if ( (zbc_set_cmd_policy(dev, ZBC_CMD_CLASS_IO, &set) != -EINVAL)
+         || (zbc_set_cmd_policy(dev, ZBC_CMD_CLASS_NUM, &zbc_test_policy_default[0]) != -EINVAL)
+         || (zbc_get_cmd_policy(dev, ZBC_CMD_CLASS_NUM, &policy) != -EINVAL) ) {
+        zbc_test_print_error("Invalid command policy accepted", "bad-cmd-policy");
+        return( -1 );
+    }
+
+    /* No command can be retried or time out on an emulated device */
+    if ( (zbc_get_cmd_stats(dev, &stats) != 0)
+         || stats.zcs_retries
+         || stats.zcs_timeouts ) {
+        zbc_test_print_error("Bad command counters", "bad-cmd-stats");
+        return( -1 );
+    }
+
+    return( 0 );
+
+}
+
+/***** Main *****/
+
+int
+main(int argc,
+     char **argv)
+{
+    struct zbc_device_info info;
+    struct zbc_zone zone;
+    uint8_t *buf = NULL;
+    char *path;
+    int i, nr_batches, ret = 1;
+
+    /* Check command line */
+    if ( argc < 2 ) {
+usage:
+        printf("Usage: %s [options] <dev>\n"
+               "  Check the zone iterators, the zone cache and the command\n"
+               "  policies of a device\n"
+               "Options:\n"
+               "    -v   : Verbose mode\n",
+               argv[0]);
+        return( 1 );
+    }
+
+    /* Parse options */
+    for(i = 1; i < (argc - 1); i++) {
+
+        if ( strcmp(argv[i], "-v") == 0 ) {
+
+            zbc_set_log_level("debug");
+
+        } else if ( argv[i][0] == '-' ) {
+
+            printf("Unknown option \"%s\"\n",
+                   argv[i]);
+            goto usage;
+
+        } else {
+
+            break;
+
+        }
+
+    }
+
+    if ( i != (argc - 1) ) {
+        goto usage;
+    }
+
+    /* Open device */
+    path = argv[i];
+    ret = zbc_open(path, O_RDWR, &dev);
+    if ( ret != 0 ) {
+        dev = NULL;
+        zbc_test_print_error("open device failed", "open-device-failed");
+        return( 1 );
+    }
+
+    zbc_get_device_info(dev, &info);
+
+    ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
+    if ( ret != 0 ) {
+        zbc_test_print_error("zbc_list_zones failed", NULL);
+        ret = 1;
+        goto out;
+    }
+
+    ret = 1;
+
+    buf = calloc(ZBC_TEST_LBA_COUNT, info.zbd_logical_block_size);
+    if ( ! buf ) {
+        zbc_test_print_error("No memory", "no-memory");
+        goto out;
+    }
+
+    /* Zone iterators */
+    nr_batches = zbc_test_iter(0);
+    if ( (nr_batches < 0) || (zbc_test_iter(nr_zones / 2) < 0) ) {
+        goto out;
+    }
+
+    printf("%u zones reported in %d batches\n",
+           nr_zones,
+           nr_batches);
+
+    /* Zone cache */
+    if ( zbc_zone_lookup(dev, 0, &zone) != -ENXIO ) {
+        zbc_test_print_error("Lookup without zone cache", "bad-zone-lookup");
+        goto out;
+    }
+
+    if ( zbc_zone_cache_enable(dev) != 0 ) {
+        zbc_test_print_error("zbc_zone_cache_enable failed", NULL);
+        goto out;
+    }
+
+    if ( (zbc_test_lookup_all() != 0)
+         || (zbc_test_wp(buf) != 0) ) {
+        goto out;
+    }
+
+    if ( zbc_zone_lookup(dev, zbc_zone_next_lba(&zones[nr_zones - 1]), &zone) != -EINVAL ) {
+        zbc_test_print_error("Lookup beyond the device capacity", "bad-zone-lookup");
+        goto out;
+    }
+
+    /* Command policies */
+    if ( zbc_test_policy() != 0 ) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+
+    free(buf);
+    free(zones);
+    zbc_close(dev);
+
+    return( ret );
+
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "RESET_ZONES unsorted zone list with duplicates..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+expected_cond="0x1"
+
+# Get drive information
+zbc_test_get_drive_info
+
+if [ ${device_model} = "Host-aware" ]; then
+    zone_type="0x3"
+else
+    zone_type="0x2"
+fi
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Search target LBAs
+zbc_test_search_nr_zones_from_zone_type_and_cond 3 ${zone_type} "0x1"
+func_ret=$?
+
+if [ ${func_ret} -gt 0 ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+set -- ${target_slbas}
+target_lbas="${3} ${1} ${3} ${2} ${1}"
+
+# Start testing
+for lba in ${target_slbas}; do
+    zbc_test_run ${bin_path}/zbc_test_write_zone -v ${device} ${lba} 8
+done
+zbc_test_run ${bin_path}/zbc_test_reset_zones -v ${device} ${target_lbas}
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Get target zones condition
+zbc_test_search_vals_from_slbas ${target_slbas}
+
+# Check result
+zbc_test_check_zone_cond
+
+# Post process
+rm -f ${zone_info_file}
+
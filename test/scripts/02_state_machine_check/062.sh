@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "RESET_ZONES zone list with a conventional zone..."
+
+# Set expected error code
+expected_sk="Illegal-request"
+expected_asc="Invalid-field-in-cdb"
+expected_cond="0x1"
+
+# Get drive information
+zbc_test_get_drive_info
+
+if [ ${device_model} = "Host-aware" ]; then
+    zone_type="0x3"
+else
+    zone_type="0x2"
+fi
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Search target LBAs
+zbc_test_search_vals_from_zone_type "0x1"
+func_ret=$?
+
+if [ ${func_ret} -gt 0 ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+conv_lba=${target_slba}
+
+if [ ${device_model} = "Host-aware" ]; then
+    zone_type="0x3"
+else
+    zone_type="0x2"
+fi
+
+zbc_test_search_nr_zones_from_zone_type_and_cond 2 ${zone_type} "0x1"
+func_ret=$?
+
+if [ ${func_ret} -gt 0 ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+# Start testing
+for lba in ${target_slbas}; do
+    zbc_test_run ${bin_path}/zbc_test_write_zone -v ${device} ${lba} 8
+done
+zbc_test_run ${bin_path}/zbc_test_reset_zones -v ${device} ${target_slbas} ${conv_lba}
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Get target zones condition (all zones must be reset despite the error)
+zbc_test_search_vals_from_slbas ${target_slbas}
+
+# Check result
+zbc_test_check_zone_cond_sk_ascq
+
+# Post process
+zbc_test_run ${bin_path}/zbc_test_reset_zones ${device} ${target_slbas}
+rm -f ${zone_info_file}
+
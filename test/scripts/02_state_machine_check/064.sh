@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "RESET_ZONE_RANGE last zone of the range..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Get drive information
+zbc_test_get_drive_info
+
+if [ ${device_model} = "Host-aware" ]; then
+    zone_type="0x3"
+else
+    zone_type="0x2"
+fi
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Search target LBAs
+zbc_test_search_nr_zones_from_zone_type_and_cond 3 ${zone_type} "0x1"
+func_ret=$?
+
+if [ ${func_ret} -gt 0 ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+set -- ${target_slbas}
+first_lba=${1}
+last_lba=${3}
+
+# The zones must be contiguous
+zbc_test_search_vals_from_slba ${first_lba}
+if [ $(( ${first_lba} + ${target_size} * 2 )) != ${last_lba} ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+expected_ptr=$(( ${last_lba} + 8 ))
+
+# Start testing
+for lba in ${target_slbas}; do
+    zbc_test_run ${bin_path}/zbc_test_write_zone -v ${device} ${lba} 8
+done
+zbc_test_run ${bin_path}/zbc_test_reset_zones -v -r ${device} ${first_lba} 2
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Get zone information
+zbc_test_get_zone_info
+
+# The first two zones must be empty
+expected_cond="0x1"
+zbc_test_search_vals_from_slbas ${1} ${2}
+
+# Check result
+if [ ${target_cond} != ${expected_cond} ]; then
+    zbc_test_print_failed_zc
+else
+    # The zone after the range must not be reset
+    zbc_test_search_vals_from_slba ${last_lba}
+    zbc_test_check_zone_ptr
+fi
+
+# Post process
+zbc_test_run ${bin_path}/zbc_test_reset_write_ptr ${device} ${last_lba}
+rm -f ${zone_info_file}
+
@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "WRITE crossing the end of a sequential write preferred zone..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Get drive information
+zbc_test_get_drive_info
+
+if [ ${device_model} != "Host-aware" ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Search target LBA: an empty zone followed by an empty zone
+zbc_test_search_vals_from_zone_type_and_cond "0x3" "0x1"
+func_ret=$?
+
+if [ ${func_ret} -gt 0 ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+target_lba=$(( ${target_slba} ))
+next_lba=$(( ${target_slba} + ${target_size} ))
+
+zbc_test_search_vals_from_slba ${next_lba}
+if [ $? -gt 0 -o "${target_type}" != "0x3" -o "${target_cond}" != "0x1" ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+# Start testing: write sequentially the first zone up to its
+# last 8 blocks, then 16 blocks from there
+zbc_test_run ${bin_path}/zbc_test_write_zone -v -n $(( (${next_lba} - ${target_lba} - 8) / 8 )) ${device} ${target_lba} 8
+zbc_test_run ${bin_path}/zbc_test_write_zone -v ${device} $(( ${next_lba} - 8 )) 16
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Check result: the first zone is full and the next one
+# implicitly open with 8 blocks written
+zbc_test_search_vals_from_slba ${target_lba}
+if [ -n "${sk}" ]; then
+    zbc_test_print_failed_sk
+elif [ "${target_cond}" != "0xe" ]; then
+    expected_cond="0xe"
+    zbc_test_print_failed_zc
+else
+    zbc_test_search_vals_from_slba ${next_lba}
+    expected_cond="0x2"
+    expected_ptr=$(( ${next_lba} + 8 ))
+    if [ "${target_cond}" != "${expected_cond}" ]; then
+        zbc_test_print_failed_zc
+    else
+        zbc_test_check_zone_ptr
+    fi
+fi
+
+# Post process
+zbc_test_run ${bin_path}/zbc_test_reset_write_ptr ${device} ${target_lba}
+zbc_test_run ${bin_path}/zbc_test_reset_write_ptr ${device} ${next_lba}
+rm -f ${zone_info_file}
+
@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Memory device zone layout..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# 1 GiB, 64 MiB of conventional zones, 16 MiB zones
+device="mem:size=1G,zone=16M,conv=64M"
+
+# Get drive information
+zbc_test_get_drive_info
+
+# Get zone information
+zbc_test_get_zone_info
+
+nr_zones=`cat ${zone_info_file} | grep -c "\[ZONE_INFO\]"`
+nr_conv_zones=`cat ${zone_info_file} | grep -c "\[ZONE_INFO\],.*,0x1,.*,.*,.*,.*"`
+
+# Check result
+zbc_test_get_sk_ascq
+
+if [ "${device_model}" != "Host-managed" ]; then
+    zbc_test_print_failed_val "device model" "Host-managed" "${device_model}"
+elif [ "${max_lba}" != "2097151" ]; then
+    zbc_test_print_failed_val "max LBA" "2097151" "${max_lba}"
+elif [ "${nr_zones}" != "64" ]; then
+    zbc_test_print_failed_val "number of zones" "64" "${nr_zones}"
+elif [ "${nr_conv_zones}" != "4" ]; then
+    zbc_test_print_failed_val "number of conventional zones" "4" "${nr_conv_zones}"
+elif [ "${last_zone_size}" != "32768" ]; then
+    zbc_test_print_failed_val "zone size" "32768" "${last_zone_size}"
+else
+    zbc_test_check_no_sk_ascq
+fi
+
+# Post process
+rm -f ${zone_info_file}
+
+# Check failed
+zbc_test_check_failed
@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "FINISH_ZONE deallocates the blocks above the write pointer..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Hole punching applies to regular files only
+if [ ! -f ${device} ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+# Check that the file system supports hole punching
+punch_file=${device}.punch
+rm -f ${punch_file}
+dd if=/dev/zero of=${punch_file} bs=1M count=1 > /dev/null 2>&1
+fallocate -p -o 0 -l 1M ${punch_file} > /dev/null 2>&1
+func_ret=$?
+punch_blocks=`stat -c %b ${punch_file}`
+rm -f ${punch_file}
+
+if [ ${func_ret} -ne 0 -o "${punch_blocks}" != "0" ]; then
+    zbc_test_print_not_applicable
+    exit
+fi
+
+# 64 MiB of conventional zones, 16 MiB zones
+zbc_test_run ${bin_path}/zbc_test_set_zones ${device} 131072 32768
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Search target LBA
+zbc_test_search_vals_from_zone_type_and_cond "0x2" "0x1"
+target_lba=${target_slba}
+
+# Start testing: stale data above the write pointer (8 MiB from the
+# zone start, written to the file directly), then 8 blocks of data
+dd if=/dev/urandom of=${device} bs=1M seek=$(( ${target_lba} / 2048 )) count=8 conv=notrunc > /dev/null 2>&1
+zbc_test_run ${bin_path}/zbc_test_write_zone -v ${device} ${target_lba} 8
+blocks_before=`stat -c %b ${device}`
+zbc_test_run ${bin_path}/zbc_test_finish_zone -v ${device} ${target_lba}
+blocks_after=`stat -c %b ${device}`
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Check result
+freed_mib=$(( (${blocks_before} - ${blocks_after}) * `stat -c %B ${device}` / 1048576 ))
+if [ ${freed_mib} -lt 7 ]; then
+    zbc_test_print_failed_val "MiB deallocated" "7" "${freed_mib}"
+else
+    zbc_test_check_no_sk_ascq
+fi
+
+# Post process
+zbc_test_run ${bin_path}/zbc_test_reset_write_ptr ${device} ${target_lba}
+rm -f ${zone_info_file}
+
+# Check failed
+zbc_test_check_failed
@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Performance model: sequential reads seek once..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Drive performance profile
+perf_profile="/tmp/${test_name}_perf_profile"
+cat > ${perf_profile} << EOF
+rotation_us = 50000
+EOF
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_perf_model -v ${device} ${perf_profile} read 10 50000 300000
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Check result
+zbc_test_check_no_sk_ascq
+
+# Post process
+rm -f ${perf_profile}
+
+# Check failed
+zbc_test_check_failed
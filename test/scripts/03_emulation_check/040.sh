@@ -0,0 +1,72 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Zone geometry file with mixed zone sizes, types and conditions..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Zone geometry: 16, 32, 64 and 128 MiB zones
+geom_file="/tmp/${test_name}_geometry"
+cat > ${geom_file} << EOF
+2 conv 65536
+4 seq  131072
+1 seq  131072 rdonly
+1 seq  131072 offline
+2 conv 32768            # Conventional zones after sequential zones
+3 seq  262144
+EOF
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_set_zones -v -g ${device} ${geom_file}
+
+# Get drive information
+zbc_test_get_drive_info
+
+# Get zone information
+zbc_test_get_zone_info
+
+# Type, condition, start LBA and size of all zones
+zones=`cat ${zone_info_file} | grep "\[ZONE_INFO\]" | cut -d ',' -f 3-6 | tr '\n' ' '`
+expected_zones="0x1,0x0,0,65536 0x1,0x0,65536,65536 \
+0x2,0x1,131072,131072 0x2,0x1,262144,131072 0x2,0x1,393216,131072 0x2,0x1,524288,131072 \
+0x2,0xd,655360,131072 0x2,0xf,786432,131072 \
+0x1,0x0,917504,32768 0x1,0x0,950272,32768 \
+0x2,0x1,983040,262144 0x2,0x1,1245184,262144 0x2,0x1,1507328,262144 "
+
+# Check result
+zbc_test_get_sk_ascq
+
+if [ -n "${sk}" ]; then
+    zbc_test_print_failed_sk
+elif [ "${device_model}" != "Host-managed" ]; then
+    zbc_test_print_failed_val "device model" "Host-managed" "${device_model}"
+elif [ "${max_lba}" != "1769471" ]; then
+    zbc_test_print_failed_val "max LBA" "1769471" "${max_lba}"
+elif [ "${zones}" != "${expected_zones}" ]; then
+    zbc_test_print_failed_val "zones" "${expected_zones}" "${zones}"
+else
+    zbc_test_check_no_sk_ascq
+fi
+
+# Post process
+rm -f ${geom_file}
+rm -f ${zone_info_file}
+
+# Check failed
+zbc_test_check_failed
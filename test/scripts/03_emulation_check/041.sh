@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Zone geometry file with sequential write preferred zones..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# Zone geometry: host-aware device
+geom_file="/tmp/${test_name}_geometry"
+cat > ${geom_file} << EOF
+2 conv 65536
+8 pref 131072
+EOF
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_set_zones -v -g ${device} ${geom_file}
+
+# Get drive information
+zbc_test_get_drive_info
+
+# Get zone information
+zbc_test_get_zone_info
+
+nr_pref_zones=`cat ${zone_info_file} | grep -c "\[ZONE_INFO\],.*,0x3,0x1,.*,131072,.*"`
+
+# Check result
+zbc_test_get_sk_ascq
+
+if [ -n "${sk}" ]; then
+    zbc_test_print_failed_sk
+elif [ "${device_model}" != "Host-aware" ]; then
+    zbc_test_print_failed_val "device model" "Host-aware" "${device_model}"
+elif [ "${max_lba}" != "1179647" ]; then
+    zbc_test_print_failed_val "max LBA" "1179647" "${max_lba}"
+elif [ "${nr_pref_zones}" != "8" ]; then
+    zbc_test_print_failed_val "number of empty sequential write preferred zones" "8" "${nr_pref_zones}"
+else
+    zbc_test_check_no_sk_ascq
+fi
+
+# Post process
+rm -f ${geom_file}
+rm -f ${zone_info_file}
+
+# Check failed
+zbc_test_check_failed
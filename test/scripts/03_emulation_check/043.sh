@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Zone geometry file with an unknown zone type..."
+
+# Set expected error code
+expected_sk="set-zones-failed"
+expected_asc="set-zones-failed"
+
+# Zone geometry
+geom_file="/tmp/${test_name}_geometry"
+cat > ${geom_file} << EOF
+2 conv 65536
+4 swr 131072
+EOF
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_set_zones -v -g ${device} ${geom_file}
+
+# Check result
+zbc_test_get_sk_ascq
+zbc_test_check_sk_ascq
+
+# Post process
+rm -f ${geom_file}
+
+# Check failed
+zbc_test_check_failed
@@ -0,0 +1,47 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+
+. ../zbc_test_lib.sh
+
+zbc_test_init $0 $*
+
+zbc_test_info "Zone iterators, zone cache and command policies (host-aware)..."
+
+# Set expected error code
+expected_sk=""
+expected_asc=""
+
+# More zones than a zone iterator batch, of different sizes
+geom_file="/tmp/${test_name}_geometry"
+cat > ${geom_file} << EOF
+4 conv 65536
+10000 pref 128
+2 conv 32768
+3 pref 131072
+EOF
+zbc_test_run ${bin_path}/zbc_test_set_zones -g ${device} ${geom_file}
+
+# Start testing
+zbc_test_run ${bin_path}/zbc_test_zone_cache -v ${device}
+
+# Get SenseKey, ASC/ASCQ
+zbc_test_get_sk_ascq
+
+# Check result
+zbc_test_check_no_sk_ascq
+
+# Post process
+rm -f ${geom_file}
+
+# Check failed
+zbc_test_check_failed
@@ -279,6 +279,53 @@ function zbc_test_search_vals_from_zone_type_and_ignored_cond() {
 
 }
 
+function zbc_test_search_nr_zones_from_zone_type_and_cond() {
+
+    nr_zones=${1}
+    zone_type=${2}
+    zone_cond=${3}
+    target_slbas=""
+
+    declare -i count=0
+    for _line in `cat ${zone_info_file} | grep "\[ZONE_INFO\],.*,${zone_type},${zone_cond},.*,.*,.*"`; do
+
+        _IFS="${IFS}"
+        IFS=','
+        set -- ${_line}
+
+        target_slbas="${target_slbas} ${5}"
+
+        IFS="$_IFS"
+
+        count=${count}+1
+        if [ ${count} -eq $(( ${nr_zones} )) ]; then
+            return 0
+        fi
+
+    done
+
+    return 1
+
+}
+
+function zbc_test_search_vals_from_slbas() {
+
+    # Get the values of the first zone of the list not in
+    # the condition ${expected_cond}, or of the last zone
+    for _slba in $*; do
+
+        target_cond="N/A"
+        zbc_test_search_vals_from_slba ${_slba}
+        if [ "${target_cond}" != "${expected_cond}" ]; then
+            return 0
+        fi
+
+    done
+
+    return 0
+
+}
+
 function zbc_test_search_last_zone_vals_from_zone_type() {
 
     Found=False
@@ -441,6 +488,46 @@ function zbc_test_check_zone_cond_sk_ascq() {
 
 }
 
+function zbc_test_print_failed_zp() {
+
+    echo "" >> ${log_file} 2>&1
+    echo "Failed" >> ${log_file} 2>&1
+    echo "=> Expected write_pointer ${expected_ptr}, Got ${target_ptr}" >> ${log_file} 2>&1
+
+    echo -e "\r\e[120C[${red}Failed${end}]"
+    echo "        => Expected write_pointer ${expected_ptr}"
+    echo "           Got ${target_ptr}"
+
+    return 0
+
+}
+
+function zbc_test_check_zone_ptr() {
+
+    if [ ${target_ptr} == ${expected_ptr} ]; then
+        zbc_test_check_no_sk_ascq
+    else
+        zbc_test_print_failed_zp
+    fi
+
+    return 0
+
+}
+
+function zbc_test_print_failed_val() {
+
+    echo "" >> ${log_file} 2>&1
+    echo "Failed" >> ${log_file} 2>&1
+    echo "=> Expected ${1} ${2}, Got ${3}" >> ${log_file} 2>&1
+
+    echo -e "\r\e[120C[${red}Failed${end}]"
+    echo "        => Expected ${1} ${2}"
+    echo "           Got ${3}"
+
+    return 0
+
+}
+
 function zbc_test_dump_zone_info() {
 
     zbc_report_zones ${device} > ${dump_zone_info_file}
@@ -0,0 +1,79 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+#
+# Test the emulation backend features (memory devices, zone geometry
+# files, hole punching and performance model). The checks that need a
+# device use a 1 GiB regular file created in a directory (default /tmp)
+# and removed when done: these checks change the zone layout of the file.
+#
+
+if [ $# -gt 1 ]; then
+  echo "Usage: $0 [<directory>]"
+  echo "    Ex: $0 /tmp"
+  exit 1
+fi
+
+image_dir=${1:-/tmp}
+
+# Check credentials (emulated device metadata files are in /var/local)
+if [ $(id -u) -ne 0 ]; then
+    echo "Only root can do this."
+    exit 1
+fi
+
+# Set up path
+ZBC_TEST_DIR=$(cd $(dirname $0);pwd)
+ZBC_TEST_BIN_PATH=${ZBC_TEST_DIR}/programs
+ZBC_TEST_SUB_SCR_PATH=${ZBC_TEST_DIR}/scripts/03_emulation_check
+ZBC_TEST_SUB_LOG_PATH=${ZBC_TEST_DIR}/log/03_emulation_check
+
+if [ ! -d ${ZBC_TEST_BIN_PATH} ]; then
+    echo "Test program directory ${ZBC_TEST_BIN_PATH} does not exist"
+    exit 1
+fi
+
+# Create the emulated device file
+image_file=${image_dir}/zbc_test_emu.img
+rm -f ${image_file}
+truncate -s 1G ${image_file} || exit 1
+
+function image_remove()
+{
+    rm -f ${image_file}
+    rm -f /var/local/zbc-$(basename ${image_file}).meta
+}
+
+# Run tests
+declare -i zbc_test_ret=0
+
+mkdir -p ${ZBC_TEST_SUB_LOG_PATH}
+cd ${ZBC_TEST_SUB_SCR_PATH}
+
+echo "Executing emulation tests on ${image_file}..."
+for script in *.sh; do
+    ./${script} ${image_file} ${ZBC_TEST_BIN_PATH} ${ZBC_TEST_SUB_LOG_PATH}
+    if [ $? -ne 0 ]; then
+        zbc_test_ret=1
+    fi
+done
+
+cd ${ZBC_TEST_DIR}
+
+image_remove
+
+if [ ${zbc_test_ret} -ne 0 ]; then
+    echo "Failed"
+    exit 1
+fi
+
+echo "Passed"
@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# This file is part of libzbc.
+#
+# Copyright (C) 2009-2014, HGST, Inc.  All rights reserved.
+#
+# This software is distributed under the terms of the BSD 2-clause license,
+# "as is," without technical support, and WITHOUT ANY WARRANTY, without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+# PURPOSE. You should have received a copy of the BSD 2-clause license along
+# with libzbc. If not, see  <http://opensource.org/licenses/BSD-2-Clause>.
+#
+# Test the zoned block device backend (io_uring data path) using a zoned
+# null_blk device created with configfs and removed when done.
+#
+
+if [ $# -gt 1 ]; then
+  echo "Usage: $0 [<null_blk device name>]"
+  echo "    Ex: $0 zbc_test"
+  exit 1
+fi
+
+nullb_name=${1:-zbc_test}
+
+# Check credentials
+if [ $(id -u) -ne 0 ]; then
+    echo "Only root can do this."
+    exit 1
+fi
+
+# Set up path
+ZBC_TEST_DIR=$(cd $(dirname $0);pwd)
+ZBC_TEST_BIN_PATH=${ZBC_TEST_DIR}/programs
+NULLB_CFG_PATH=/sys/kernel/config/nullb
+
+bin_path=${ZBC_TEST_BIN_PATH}/zbc_test_aio
+if [ ! -e ${bin_path} ]; then
+    echo "Test program zbc_test_aio not found in directory ${ZBC_TEST_BIN_PATH}"
+    exit 1
+fi
+
+# Create the device: 1 GiB memory backed, 16 MiB zones, 4 conventional zones
+modprobe null_blk nr_devices=0 || exit 1
+if [ ! -d ${NULLB_CFG_PATH} ]; then
+    mount -t configfs none /sys/kernel/config 2>/dev/null
+fi
+if [ ! -d ${NULLB_CFG_PATH} ]; then
+    echo "null_blk configfs interface not available"
+    exit 1
+fi
+
+nullb_cfg=${NULLB_CFG_PATH}/${nullb_name}
+mkdir ${nullb_cfg} || exit 1
+echo 1024 > ${nullb_cfg}/size
+echo 4096 > ${nullb_cfg}/blocksize
+echo 1 > ${nullb_cfg}/memory_backed
+echo 1 > ${nullb_cfg}/zoned
+echo 16 > ${nullb_cfg}/zone_size
+echo 4 > ${nullb_cfg}/zone_nr_conv
+echo 2 > ${nullb_cfg}/irqmode
+echo 1 > ${nullb_cfg}/power
+device_file=/dev/nullb$(cat ${nullb_cfg}/index)
+
+function nullb_remove()
+{
+    echo 0 > ${nullb_cfg}/power
+    rmdir ${nullb_cfg}
+}
+
+if [ ! -b ${device_file} ]; then
+    echo "Create null_blk device ${nullb_name} failed"
+    nullb_remove
+    exit 1
+fi
+
+# Run tests
+declare -i zbc_test_ret=0
+
+echo "Executing asynchronous I/O tests on ${device_file}..."
+for args in "-z 1 -n 1 -c 8" "-z 4 -n 16 -c 64" "-z 16 -n 64 -c 256"; do
+    echo "    zbc_test_aio ${args}"
+    ${bin_path} ${args} ${device_file}
+    if [ $? -ne 0 ]; then
+        zbc_test_ret=1
+    fi
+done
+
+nullb_remove
+
+if [ ${zbc_test_ret} -ne 0 ]; then
+    echo "Failed"
+    exit 1
+fi
+
+echo "Passed"
@@ -25,11 +25,13 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
 
 #include <libzbc/zbc.h>
+#include <zbc_private.h>
 
 /***** Local functions *****/
 
@@ -52,6 +54,21 @@ zbc_read_zone_usec(void)
 
 }
 
+/**
+ * Process CPU time (user + system) in usecs.
+ */
+static __inline__ unsigned long long
+zbc_read_zone_cpu_usec(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return( (unsigned long long) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL
+            + (unsigned long long) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) );
+
+}
+
 /**
  * Signal handler.
  */
@@ -72,19 +89,21 @@ int main(int argc,
 {
     struct zbc_device_info info;
     struct zbc_device *dev = NULL;
-    unsigned long long elapsed;
+    unsigned long long elapsed, cpu;
     unsigned long long bcount = 0;
     unsigned long long brate;
     int zidx;
     int fd = -1, i, ret = 1;
     size_t iosize;
     void *iobuf = NULL;
+    const void *buf;
+    int borrow = 0;
     uint32_t lba_count;
     unsigned long long ionum = 0, iocount = 0;
     struct zbc_zone *zones = NULL;
     struct zbc_zone *iozone = NULL;
     unsigned int nr_zones;
-    char *path, *file = NULL;
+    char *path, *file = NULL, *perf = NULL;
     long long lba_ofst = 0;
     long long lba_max = 0;
     int flags = O_RDONLY;
@@ -98,11 +117,15 @@ usage:
                "Options:\n"
                "    -v         : Verbose mode\n"
                "    -dio       : Use direct I/Os for accessing the device\n"
+               "    -sgdio     : Use direct I/Os through the SG node of a device\n"
+               "    -borrow    : Read with zbc_pread_borrow (no copy of the data)\n"
                "    -nio <num> : Limit the number of I/O executed to <num>\n"
                "    -f <file>  : Write the content of the zone to <file>\n"
                "                 If <file> is \"-\", the zone content is\n"
                "                 written to the standard output\n"
-               "     -lba      : lba offset from the starting lba of the zone <zone no>.\n",
+               "     -lba      : lba offset from the starting lba of the zone <zone no>.\n"
+               "    -perf <file> : Time the commands of an emulated device\n"
+               "                   using the drive profile <file>\n",
                argv[0]);
         return( 1 );
     }
@@ -118,6 +141,14 @@ usage:
 
 	    flags |= O_DIRECT;
 
+	} else if ( strcmp(argv[i], "-sgdio") == 0 ) {
+
+	    flags |= ZBC_SG_DIRECT_IO;
+
+	} else if ( strcmp(argv[i], "-borrow") == 0 ) {
+
+	    borrow = 1;
+
         } else if ( strcmp(argv[i], "-nio") == 0 ) {
 
             if ( i >= (argc - 1) ) {
@@ -131,6 +162,15 @@ usage:
                 return( 1 );
             }
 
+        } else if ( strcmp(argv[i], "-perf") == 0 ) {
+
+            if ( i >= (argc - 1) ) {
+                goto usage;
+            }
+            i++;
+
+            perf = argv[i];
+
         } else if ( strcmp(argv[i], "-f") == 0 ) {
 
             if ( i >= (argc - 1) ) {
@@ -210,6 +250,18 @@ usage:
         goto out;
     }
 
+    if ( perf ) {
+        ret = zbc_set_perf_model(dev, perf);
+        if ( ret != 0 ) {
+            fprintf(stderr,
+                    "zbc_set_perf_model failed %d (%s)\n",
+                    ret,
+                    strerror(-ret));
+            ret = 1;
+            goto out;
+        }
+    }
+
     /* Get zone list */
     ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
     if ( ret != 0 ) {
@@ -264,7 +316,7 @@ usage:
         ret = 1;
         goto out;
     }
-    ret = posix_memalign((void **) &iobuf, info.zbd_logical_block_size, iosize);
+    ret = posix_memalign((void **) &iobuf, sysconf(_SC_PAGESIZE), iosize);
     if ( ret != 0 ) {
         fprintf(stderr,
                 "No memory for I/O buffer (%zu B)\n",
@@ -327,6 +379,7 @@ usage:
     lba_count = iosize / info.zbd_logical_block_size;
 
     elapsed = zbc_read_zone_usec();
+    cpu = zbc_read_zone_cpu_usec();
 
     while( (! zbc_read_zone_abort)
            && (lba_ofst < lba_max) ) {
@@ -336,9 +389,15 @@ usage:
             lba_count = lba_max - lba_ofst;
         }
 
-        ret = zbc_pread(dev, iozone, iobuf, lba_count, lba_ofst);
+        if ( borrow ) {
+            ret = zbc_pread_borrow(dev, iozone, &buf, lba_count, lba_ofst);
+        } else {
+            ret = zbc_pread(dev, iozone, iobuf, lba_count, lba_ofst);
+            buf = iobuf;
+        }
         if ( ret <= 0 ) {
-	    fprintf(stderr, "zbc_pread failed %d (%s)\n",
+	    fprintf(stderr, "%s failed %d (%s)\n",
+                    borrow ? "zbc_pread_borrow" : "zbc_pread",
 		    -ret,
 		    strerror(-ret));
             ret = 1;
@@ -348,7 +407,7 @@ usage:
 
         if ( file ) {
             /* Write file */
-            ret = write(fd, iobuf, lba_count * info.zbd_logical_block_size);
+            ret = write(fd, buf, lba_count * info.zbd_logical_block_size);
             if ( ret < 0 ) {
                 fprintf(stderr, "Write file \"%s\" failed %d (%s)\n",
                         file,
@@ -374,6 +433,7 @@ usage:
     }
 
     elapsed = zbc_read_zone_usec() - elapsed;
+    cpu = zbc_read_zone_cpu_usec() - cpu;
 
     if ( elapsed ) {
         printf("Read %llu B (%llu I/Os) in %llu.%03llu sec\n",
@@ -387,6 +447,10 @@ usage:
         printf("  BW %llu.%03llu MB/s\n",
                brate / 1000000,
                (brate % 1000000) / 1000);
+        printf("  CPU %llu.%03llu sec (%llu %%)\n",
+               cpu / 1000000,
+               (cpu % 1000000) / 1000,
+               cpu * 100 / elapsed);
     } else {
         printf("Read %llu B (%llu I/Os)\n",
                bcount,
@@ -38,7 +38,7 @@ main(int argc,
     char *path;
 
     /* Check command line */
-    if ( argc < 5 ) {
+    if ( argc < 4 ) {
 usage:
         printf("Usage: %s [options] <dev> <command> <command arguments>\n"
                "Options:\n"
@@ -47,7 +47,8 @@ usage:
                "    set_sz <conv zone size (MB)> <zone size (MiB)>  : Specify the total size in MiB of all conventional zones\n"
                "                                                      and the size in MiB of zones\n"
                "    set_ps <conv zone size (%%)> <zone size (MiB)>  : Specify the percentage of the capacity to use for\n"
-               "                                                      conventional zones and the size in MiB of zones\n",
+               "                                                      conventional zones and the size in MiB of zones\n"
+               "    geometry <file>                                 : Specify the zones with a zone geometry file\n",
                argv[0]);
         return( 1 );
     }
@@ -124,7 +125,28 @@ usage:
     printf("Setting zones:\n");
     i++;
 
-    if ( strcmp(argv[i], "set_sz") == 0 ) {
+    if ( strcmp(argv[i], "geometry") == 0 ) {
+
+        /* Zone geometry file */
+        if ( i != (argc - 2) ) {
+            goto usage;
+        }
+
+        printf("    Zone geometry file %s\n",
+               argv[i + 1]);
+
+        ret = zbc_set_zone_geometry(dev, argv[i + 1]);
+        if ( ret != 0 ) {
+            fprintf(stderr,
+                    "zbc_set_zone_geometry failed %d (%s)\n",
+                    ret,
+                    strerror(-ret));
+            ret = 1;
+        }
+
+        goto out;
+
+    } else if ( strcmp(argv[i], "set_sz") == 0 ) {
 
         /* Set size */
         if ( i != (argc - 3) ) {
@@ -30,6 +30,7 @@
 #include <linux/fs.h>
 
 #include <libzbc/zbc.h>
+#include <zbc_private.h>
 
 /***** Local functions *****/
 
@@ -86,7 +87,7 @@ main(int argc,
     struct zbc_zone *zones = NULL;
     struct zbc_zone *iozone = NULL;
     unsigned int nr_zones;
-    char *path, *file = NULL;
+    char *path, *file = NULL, *perf = NULL;
     long long lba_ofst = 0;
     int flush = 0;
     int flags = O_WRONLY;
@@ -105,7 +106,9 @@ usage:
                "    -f <file>  : Write the content of <file>\n"
                "    -loop      : If a file is specified, repeatedly write the\n"
                "                 file to the zone until the zone is full.\n"
-               "    -lba       : lba offset, from given zone <zone no> starting lba, where to write.\n",
+               "    -lba       : lba offset, from given zone <zone no> starting lba, where to write.\n"
+               "    -perf <file> : Time the commands of an emulated device\n"
+               "                   using the drive profile <file>\n",
                argv[0]);
         return( 1 );
     }
@@ -138,6 +141,15 @@ usage:
                 return( 1 );
             }
 
+        } else if ( strcmp(argv[i], "-perf") == 0 ) {
+
+            if ( i >= (argc - 1) ) {
+                goto usage;
+            }
+            i++;
+
+            perf = argv[i];
+
         } else if ( strcmp(argv[i], "-f") == 0 ) {
 
             if ( i >= (argc - 1) ) {
@@ -222,6 +234,18 @@ usage:
         goto out;
     }
 
+    if ( perf ) {
+        ret = zbc_set_perf_model(dev, perf);
+        if ( ret != 0 ) {
+            fprintf(stderr,
+                    "zbc_set_perf_model failed %d (%s)\n",
+                    ret,
+                    strerror(-ret));
+            ret = 1;
+            goto out;
+        }
+    }
+
     /* Get zone list */
     ret = zbc_list_zones(dev, 0, ZBC_RO_ALL, &zones, &nr_zones);
     if ( ret != 0 ) {